@@ -1,11 +1,25 @@
 #include "acpi.h"
 #include "aml_executive.h"
 #include "token.h"
+#include "madt.h"
+#include "pci_config.h"
+#include "hpet.h"
+#include "numa.h"
+#include "device_index.h"
+#include "facs.h"
+#include "timer_wheel.h"
+#include "power.h"
+#include "gas.h"
+#include "trace.h"
+#include "thermal.h"
+#include "processor.h"
+#include "memory.h"
+#include "profiler.h"
 
 #include <mkmi.h>
 #include <cdefs.h>
 
-ACPIManager::ACPIManager() : RSDP(NULL), MainSDT(NULL), MainSDTType(0), FADT(NULL), DSDT(NULL), DSDTExecutive(NULL) {
+ACPIManager::ACPIManager() : RSDP(NULL), MainSDT(NULL), MainSDTType(0), FADT(NULL), DSDT(NULL), DSDTExecutive(NULL), PCIRouting(NULL), Devices(NULL), Topology(NULL), PCIConfig(NULL), Clock(NULL), NUMA(NULL), GlobalLock(NULL), Power(NULL), Registers(NULL), Thermal(NULL), Processors(NULL) {
 	/* We find the RSDP through the KBST */
 	UserTCB *tcb = GetUserTCB();
 	TableListElement *systemTableList = GetSystemTableList(tcb);
@@ -27,7 +41,7 @@ ACPIManager::ACPIManager() : RSDP(NULL), MainSDT(NULL), MainSDTType(0), FADT(NUL
 		size_t size = ((SDTHeader*)addr)->Length;
 
 		if(ValidateTable((uint8_t*)addr, size)) {
-			MainSDT = Malloc(size);
+			MainSDT = (SDTHeader*)AllocateMemory(ACPI_MEMORY_TABLES, size);
 			Memcpy(MainSDT, addr, size);
 		} else {
 			Panic("Invalid ACPI XSDT checksum");
@@ -39,7 +53,7 @@ ACPIManager::ACPIManager() : RSDP(NULL), MainSDT(NULL), MainSDTType(0), FADT(NUL
 		size_t size = ((SDTHeader*)addr)->Length;
 
 		if(ValidateTable((uint8_t*)addr, size)) {
-			MainSDT = Malloc(size);
+			MainSDT = (SDTHeader*)AllocateMemory(ACPI_MEMORY_TABLES, size);
 			Memcpy(MainSDT, addr, size);
 		} else {
 			Panic("Invalid ACPI RSDT checksum");
@@ -48,6 +62,11 @@ ACPIManager::ACPIManager() : RSDP(NULL), MainSDT(NULL), MainSDTType(0), FADT(NUL
 
 	PrintTable(MainSDT);
 
+	/* SLIT distances are indexed by SRAT domains, so both are decoded after the loop */
+	SRATTable *srat = NULL;
+	FACSTable *facs = NULL;
+	SLITTable *slit = NULL;
+
 	int entries = (MainSDT->Length - sizeof(SDTHeader) ) / MainSDTType;
         for (int i = 0; i < entries; i++) {
 		/* Getting the table header */
@@ -58,20 +77,20 @@ ACPIManager::ACPIManager() : RSDP(NULL), MainSDT(NULL), MainSDTType(0), FADT(NUL
 			PrintTable(newSDTHeader);
 
 			if (Memcmp(newSDTHeader->Signature, "FACP", 4) == 0) {
-				FADT = new FADTTable;
+				FADT = (FADTTable*)AllocateMemory(ACPI_MEMORY_TABLES, sizeof(FADTTable));
 
 				Memcpy(FADT, newSDTHeader, sizeof(FADTTable));
 
 				if(FADT->X_Dsdt != 0) {
 					SDTHeader *dsdt = FADT->X_Dsdt + HIGHER_HALF;
-					DSDT = Malloc(dsdt->Length);
+					DSDT = (SDTHeader*)AllocateMemory(ACPI_MEMORY_TABLES, dsdt->Length);
 
 					Memcpy(DSDT, dsdt, dsdt->Length);
 
 					PrintTable(DSDT);
 				} else if(FADT->Dsdt != 0) {
 					SDTHeader *dsdt = FADT->X_Dsdt + HIGHER_HALF;
-					DSDT = Malloc(dsdt->Length);
+					DSDT = (SDTHeader*)AllocateMemory(ACPI_MEMORY_TABLES, dsdt->Length);
 
 					Memcpy(DSDT, dsdt, dsdt->Length);
 
@@ -80,86 +99,129 @@ ACPIManager::ACPIManager() : RSDP(NULL), MainSDT(NULL), MainSDTType(0), FADT(NUL
 					Panic("No DSDT found");
 				}
 
+				/* The FACS is used in place, the firmware shares the global lock word with us */
 				if(FADT->X_FirmwareControl != 0) {
+					facs = (FACSTable*)(FADT->X_FirmwareControl + HIGHER_HALF);
 				} else if(FADT->FirmwareControl != 0) {
-
-				} else {
-					Panic("No FACS found");
+					facs = (FACSTable*)(FADT->FirmwareControl + HIGHER_HALF);
 				}
+			} else if (Memcmp(newSDTHeader->Signature, "APIC", 4) == 0) {
+				Topology = CreateCPUTopology((MADTTable*)newSDTHeader);
+				ProbeIOAPICs(Topology);
+
+				Trace(ACPI_TRACE_INFO, TRACE_MADT, Topology->CPUCount, Topology->IOAPICCount, Topology->GSICount);
 			} else if (Memcmp(newSDTHeader->Signature, "MCFG", 4) == 0) {
-				/* Startup PCI driver */
+				PCIConfig = CreateConfigSpace((MCFGTable*)newSDTHeader);
+			} else if (Memcmp(newSDTHeader->Signature, "HPET", 4) == 0) {
+				Clock = CreateHPETClock((HPETTable*)newSDTHeader);
+
+				if (Clock != NULL) {
+					SetTraceClock(Clock);
+					Trace(ACPI_TRACE_INFO, TRACE_HPET, Clock->Frequency, Clock->ComparatorCount);
+				}
+			} else if (Memcmp(newSDTHeader->Signature, "SRAT", 4) == 0) {
+				srat = (SRATTable*)newSDTHeader;
+			} else if (Memcmp(newSDTHeader->Signature, "SLIT", 4) == 0) {
+				slit = (SLITTable*)newSDTHeader;
 			} else if (Memcmp(newSDTHeader->Signature, "SSDT", 4) == 0) {
 				/* Handle the accessory table */
 			} else {
 				/* Unknown table */
 			}
 		} else {
-			char sig[5];
-			sig[4] = '\0';
-
-			Memcpy(sig, newSDTHeader->Signature, 4);
-			MKMI_Printf("Invalid table: %s\r\n", sig);
+			Trace(ACPI_TRACE_WARNING, TRACE_TABLE_INVALID, TraceTag(newSDTHeader->Signature, 4));
 		}
         }
 
 	if (FADT == NULL)
 		Panic("No FADT found");
 
+	/* Every fixed register access afterwards goes through these */
+	Registers = CreateFixedRegisters(FADT);
+
+	/* HW-reduced platforms may have no FACS, the lock then only orders our own cores */
+	GlobalLock = CreateGlobalLock(facs, Registers);
+
+	if (srat != NULL) {
+		NUMA = CreateNUMATopology(srat, slit);
+
+		Trace(ACPI_TRACE_INFO, TRACE_NUMA, NUMA->NodeCount, NUMA->CPUCount, NUMA->MemoryRangeCount);
+	}
+
+	/* Without an MCFG, config space falls back to 0xCF8/0xCFC */
+	if (PCIConfig == NULL)
+		PCIConfig = CreateConfigSpace(NULL);
+
+	InstallConfigSpaceHandler(PCIConfig);
+
 	if(FADT->SMI_CommandPort == 0 &&
 	   FADT->AcpiEnable == 0 &&
 	   FADT->AcpiDisable == 0 &&
-	   (InPort(FADT->PM1aControlBlock, 8) & 1) == 1) {
-	   MKMI_Printf("ACPI already enabled.\r\n");
+	   (ReadGAS(&Registers->PM1aControl) & PM1_CONTROL_SCI_EN) != 0) {
+	   Trace(ACPI_TRACE_INFO, TRACE_ACPI_ALREADY_ENABLED);
 	} else {
-		MKMI_Printf("ACPI not yet enabled.\r\n");
+		Trace(ACPI_TRACE_INFO, TRACE_ACPI_ENABLING);
 
 		OutPort(FADT->SMI_CommandPort, FADT->AcpiEnable, 8);
 
-		MKMI_Printf("Waiting for ACPI to switch modes.\r\n");
-		while((InPort(FADT->PM1aControlBlock, 8) & 1) == 0);
+		while((ReadGAS(&Registers->PM1aControl) & PM1_CONTROL_SCI_EN) == 0);
 
-		if(FADT->PM1bControlBlock != 0)
-			while((InPort(FADT->PM1bControlBlock, 8) & 1) == 0);
+		if(Registers->PM1bControl.Valid)
+			while((ReadGAS(&Registers->PM1bControl) & PM1_CONTROL_SCI_EN) == 0);
 		
-		MKMI_Printf("ACPI is enabled.\r\n");
+		Trace(ACPI_TRACE_INFO, TRACE_ACPI_ENABLED);
 	}
 
-	/*
-	 * Code to have a reset:
-	 * OutPort(FADT->ResetReg.Address, FADT->ResetValue, 8);
-	 */
-
-
 	DSDTExecutive = new AMLExecutive();
+	DSDTExecutive->SetClock(Clock);
+	DSDTExecutive->SetGlobalLock(GlobalLock);
 	DSDTExecutive->Parse((uint8_t*)DSDT + sizeof(SDTHeader), DSDT->Length - sizeof(SDTHeader));
-	
-	/*
-	 * Code used to find S5 object
-	Token *s5 = DSDTExecutive->FindObject("_S5_");
-	if (s5 != NULL) {
-		MKMI_Printf("Found S5 object.\r\n");
-		Token *package = s5->Children->Head;
-		if(package != NULL && package->Type == PACKAGE) {
-			MKMI_Printf("Found package. %d elements\r\n", package->Package.NumElements);
-
-			Token *data = package->Children->Head;
-
-			for (int i = 0; i < package->Package.NumElements; i++) {
-				if(data->Type == ZERO) {
-					MKMI_Printf(" 0\r\n");
-				} else if(data->Type == INTEGER) {
-					MKMI_Printf(" %d\r\n", data->Int.Data);
-					shutdownBytes[i] = data->Int.Data;
-					MKMI_Printf("Invalid value type.\r\n");
-				}
-				
-				data = data->Next;
-			}
-		}
+	DSDTExecutive->SetTableFinder(FindLoadableTable, this);
+
+	/* Accessory tables extend the DSDT's namespace, each one can be unloaded on its own */
+	SDTHeader *table;
+	for (size_t i = 0; (table = GetTableEntry(i)) != NULL; ++i) {
+		if (Memcmp(table->Signature, "SSDT", 4) == 0) DSDTExecutive->LoadTable(table, table->Length, NULL);
 	}
-	*/
 
-	MKMI_Printf("ACPI initialized.\r\n");
+	ResolvePciRegions(DSDTExecutive, PCIConfig);
+
+	/* Slow firmware shows up here first, so debug builds profile the _INI runs */
+	bool profiling = TraceLevel >= ACPI_TRACE_DEBUG;
+	DSDTExecutive->EnableProfiling(profiling);
+
+	Trace(ACPI_TRACE_INFO, TRACE_DEVICES_INITIALIZED, DSDTExecutive->Execute());
+	if (profiling) PrintProfile(DSDTExecutive->GetProfiler(), 10);
+
+	/* Driver probes look up devices by ID instead of walking the namespace */
+	Devices = CreateDeviceIndex(DSDTExecutive);
+	Trace(ACPI_TRACE_INFO, TRACE_DEVICE_INDEX, Devices->Count);
+
+	/* Interrupt routing is resolved once here, device probes only look it up */
+	PCIRouting = CreateRoutingTable(DSDTExecutive, PCIConfig);
+	Trace(ACPI_TRACE_INFO, TRACE_PCI_ROUTING, PCIRouting->Stats.Bridges, PCIRouting->Map->Count, PCIRouting->Stats.Unresolved);
+	
+	/* Shutdown and reset only write registers worked out here */
+	Power = CreatePowerControl(DSDTExecutive, FADT, Registers);
+	Trace(ACPI_TRACE_INFO, TRACE_POWER,
+	      Power->States[ACPI_S5].Valid ? TraceTag("present", 7) : TraceTag("missing", 7),
+	      Power->ResetSupported ? TraceTag("present", 7) : TraceTag("missing", 7));
+
+	/* Zones are read once here, afterwards only when polled or notified */
+	Thermal = CreateThermalMonitor(DSDTExecutive);
+
+	/* Governors read these tables, only a Notify evaluates them again */
+	Processors = CreateProcessorTable(DSDTExecutive, Devices, Topology);
+
+	/* Tables loaded from here on update the PCI regions, devices, routes, zones and processors above, power control stays as the DSDT left it */
+	DSDTExecutive->SetTableHandler(TableChanged, this);
+
+	/* Everything parsed is still live, this is what the DSDT costs us to keep around */
+	ACPI_MemoryStats memory;
+	GetMemoryTotals(&memory);
+	Trace(ACPI_TRACE_INFO, TRACE_MEMORY, memory.Live, memory.Peak, memory.Live * 1024 / DSDT->Length);
+
+	Trace(ACPI_TRACE_INFO, TRACE_INITIALIZED);
 }
 
 bool ACPIManager::ValidateTable(uint8_t *ptr, size_t size) {
@@ -173,13 +235,7 @@ bool ACPIManager::ValidateTable(uint8_t *ptr, size_t size) {
 }
 
 void ACPIManager::PrintTable(SDTHeader *sdt) {
-	char sig[5] = { '\0' };
-	char oem[7] = { '\0' };
-
-	Memcpy(sig, sdt->Signature, 4);
-	Memcpy(oem, sdt->OEMID, 6);
-
-	MKMI_Printf("ACPI table found: %s (%s), %d bytes\r\n", sig, oem, sdt->Length);
+	Trace(ACPI_TRACE_INFO, TRACE_TABLE_FOUND, TraceTag(sdt->Signature, 4), TraceTag(sdt->OEMID, 6), sdt->Length);
 }
 
 SDTHeader *ACPIManager::FindTable(char *signature, size_t index) {
@@ -209,7 +265,175 @@ SDTHeader *ACPIManager::FindTable(char *signature, size_t index) {
         return NULL;
 }
 
+SDTHeader *ACPIManager::GetTableEntry(size_t index) {
+	if (index >= (MainSDT->Length - sizeof(SDTHeader)) / MainSDTType) return NULL;
+
+	uint8_t *entry = (uint8_t*)MainSDT + sizeof(SDTHeader) + index * MainSDTType;
+	uintptr_t addr = MainSDTType == 8 ? *(uint64_t*)entry : *(uint32_t*)entry;
+
+	return (SDTHeader*)(addr + HIGHER_HALF);
+}
+
+/* IDs shorter than their field match when the rest of it is padding */
+static bool MatchTableId(const uint8_t *field, size_t size, const char *id) {
+	size_t length = Strlen(id);
+	if (length > size) return false;
+	if (Memcmp(field, id, length) != 0) return false;
+
+	for (size_t i = length; i < size; ++i) {
+		if (field[i] != '\0' && field[i] != ' ') return false;
+	}
+
+	return true;
+}
+
+const void *ACPIManager::FindLoadableTable(const char *signature, const char *oemId, const char *oemTableId, void *context) {
+	ACPIManager *manager = (ACPIManager*)context;
+	SDTHeader *table;
+
+	for (size_t i = 0; (table = manager->GetTableEntry(i)) != NULL; ++i) {
+		if (!MatchTableId(table->Signature, 4, signature)) continue;
+		if (*oemId != '\0' && !MatchTableId(table->OEMID, 6, oemId)) continue;
+		if (*oemTableId != '\0' && !MatchTableId(table->OEMTableID, 8, oemTableId)) continue;
+
+		return table;
+	}
+
+	return NULL;
+}
+
+/* Removal runs before the subtree leaves the namespace, nothing keeps a node that is gone */
+void ACPIManager::TableChanged(AML_NamespaceNode *subtree, bool loaded, void *context) {
+	ACPIManager *manager = (ACPIManager*)context;
+
+	if (loaded) {
+		ResolvePciSubtree(manager->DSDTExecutive, manager->PCIConfig, subtree);
+		UpdateDeviceIndex(manager->Devices, subtree);
+		AddRoutingSubtree(manager->PCIRouting, subtree);
+		AddThermalSubtree(manager->Thermal, subtree);
+		AddProcessorSubtree(manager->Processors, subtree);
+		return;
+	}
+
+	RemoveProcessorSubtree(manager->Processors, subtree);
+	RemoveThermalSubtree(manager->Thermal, subtree);
+	RemoveRoutingSubtree(manager->PCIRouting, subtree);
+	RemoveDeviceSubtree(manager->Devices, subtree);
+}
+
+uint64_t ACPIManager::LoadTable(SDTHeader *table) {
+	return DSDTExecutive->LoadTable(table, table->Length, NULL);
+}
+
+bool ACPIManager::UnloadTable(uint64_t handle) {
+	return DSDTExecutive->UnloadTable(handle);
+}
+
+uint32_t ACPIManager::PinNamespace() {
+	return DSDTExecutive->PinNamespace();
+}
+
+void ACPIManager::UnpinNamespace(uint32_t pin) {
+	DSDTExecutive->UnpinNamespace(pin);
+}
+
+AML_NamespaceNode *ACPIManager::FindNode(const char *path) {
+	return DSDTExecutive->FindNode(path);
+}
+
+Token *ACPIManager::Evaluate(AML_NamespaceNode *node) {
+	return DSDTExecutive->Evaluate(node);
+}
+
+void ACPIManager::ReleaseResult(Token *result) {
+	DSDTExecutive->ReleaseResult(result);
+}
+
+AML_ResourceList *ACPIManager::GetResources(AML_NamespaceNode *device) {
+	return DSDTExecutive->GetResources(device);
+}
+
+size_t ACPIManager::FindDevices(const char *id, AML_NamespaceNode **devices, size_t max) {
+	return ::FindDevices(Devices, id, devices, max);
+}
+
+uint32_t ACPIManager::GetDeviceStatus(AML_NamespaceNode *device) {
+	return DSDTExecutive->GetStatus(device);
+}
+
+bool ACPIManager::RoutePciInterrupt(uint16_t segment, uint8_t bus, uint8_t device, uint8_t pin, uint32_t *gsi, uint8_t *flags) {
+	return LookupPciInterrupt(PCIRouting, segment, bus, device, pin, gsi, flags);
+}
+
+CPUTopology *ACPIManager::GetCPUTopology() {
+	return Topology;
+}
+
+PCI_ConfigSpace *ACPIManager::GetConfigSpace() {
+	return PCIConfig;
+}
+
+int ACPIManager::PowerOff() {
+	return ::PowerOff(Power);
+}
+
+int ACPIManager::Reboot() {
+	return ::Reboot(Power);
+}
+
+void ACPIManager::SetYieldHandler(void (*handler)(void *context), void *context) {
+	::SetYieldHandler(DSDTExecutive->GetTimerWheel(), handler, context);
+}
+
+void ACPIManager::DumpNamespace(const char *path) {
+	AML_NamespaceNode *scope = NULL;
+	uint32_t pin = DSDTExecutive->PinNamespace();
+
+	if (path != NULL) scope = DSDTExecutive->FindNode(path);
+	if (path == NULL || scope != NULL) DSDTExecutive->DumpNamespace(scope);
+
+	DSDTExecutive->UnpinNamespace(pin);
+}
+
+size_t ACPIManager::DrainTrace() {
+	return ::DrainTrace();
+}
+
+void ACPIManager::SetTraceCpuHandler(uint32_t (*handler)()) {
+	::SetTraceCpuHandler(handler);
+}
+
+void ACPIManager::DumpMemoryUsage() {
+	::DumpMemoryUsage();
+}
+
+uint64_t ACPIManager::PollThermalZones() {
+	return RunThermalMonitor(Thermal);
+}
+
+ACPI_ThermalMonitor *ACPIManager::GetThermalMonitor() {
+	return Thermal;
+}
+
+ACPI_ProcessorTable *ACPIManager::GetProcessorTable() {
+	return Processors;
+}
+
+AML_GlobalLock *ACPIManager::GetGlobalLock() {
+	return GlobalLock;
+}
+
+HPET_Clock *ACPIManager::GetClock() {
+	return Clock;
+}
+
+NUMA_Topology *ACPIManager::GetNUMATopology() {
+	return NUMA;
+}
+
 void ACPIManager::Panic(const char *message) {
+	/* Whatever led up to this has not been printed yet */
+	::DrainTrace();
 	MKMI_Printf("ACPI PANIC: %s\r\n", message);
 	_exit(128);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "aml_executive.h"
+#include "pci_routing.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -102,6 +103,17 @@ struct FADTTable {
 	GenericAddressStructure X_GPE1Block;
 }__attribute__((packed));
 
+struct CPUTopology;
+struct PCI_ConfigSpace;
+struct HPET_Clock;
+struct NUMA_Topology;
+struct AML_DeviceIndex;
+struct AML_GlobalLock;
+struct ACPI_PowerControl;
+struct ACPI_FixedRegisters;
+struct ACPI_ThermalMonitor;
+struct ACPI_ProcessorTable;
+
 class ACPIManager {
 public:
 	ACPIManager();
@@ -110,8 +122,54 @@ public:
 
 	SDTHeader *FindTable(char *signature, size_t index);
 	bool ValidateTable(uint8_t *ptr, size_t size);
+
+	/* Hold a pin from FindNode until done with the node, an unload may free it otherwise */
+	uint32_t PinNamespace();
+	void UnpinNamespace(uint32_t pin);
+	AML_NamespaceNode *FindNode(const char *path);
+	Token *Evaluate(AML_NamespaceNode *node);
+	void ReleaseResult(Token *result);
+	AML_ResourceList *GetResources(AML_NamespaceNode *device);
+	size_t FindDevices(const char *id, AML_NamespaceNode **devices, size_t max);
+	uint32_t GetDeviceStatus(AML_NamespaceNode *device);
+	bool RoutePciInterrupt(uint16_t segment, uint8_t bus, uint8_t device, uint8_t pin, uint32_t *gsi, uint8_t *flags);
+
+	CPUTopology *GetCPUTopology();
+	PCI_ConfigSpace *GetConfigSpace();
+	HPET_Clock *GetClock();
+	AML_GlobalLock *GetGlobalLock();
+
+	int PowerOff();
+	int Reboot();
+
+	/* Lets the scheduler run other work while an evaluation is parked, without one the core polls */
+	void SetYieldHandler(void (*handler)(void *context), void *context);
+
+	/* Definition blocks loaded at runtime, UnloadTable takes the returned handle */
+	uint64_t LoadTable(SDTHeader *table);
+	bool UnloadTable(uint64_t handle);
+
+	/* Prints the subtree under path, the whole namespace when it is NULL */
+	void DumpNamespace(const char *path);
+	/* Log records are only formatted here */
+	size_t DrainTrace();
+	void SetTraceCpuHandler(uint32_t (*handler)());
+	/* Live and peak bytes for each kind of allocation */
+	void DumpMemoryUsage();
+
+	/* Call when the returned deadline passes, one timer covers every thermal zone */
+	uint64_t PollThermalZones();
+	ACPI_ThermalMonitor *GetThermalMonitor();
+	/* C-states and P-states per CPU, read them with ReadProcessorPower */
+	ACPI_ProcessorTable *GetProcessorTable();
+	NUMA_Topology *GetNUMATopology();
 private:
 	void PrintTable(SDTHeader *sdt);
+	/* The entry at index in the XSDT or RSDT, NULL past the end */
+	SDTHeader *GetTableEntry(size_t index);
+
+	static void TableChanged(AML_NamespaceNode *subtree, bool loaded, void *context);
+	static const void *FindLoadableTable(const char *signature, const char *oemId, const char *oemTableId, void *context);
 
 	RSDP2 *RSDP;
 
@@ -123,4 +181,17 @@ private:
 	SDTHeader *DSDT;
 	AMLExecutive *DSDTExecutive;
 
+	PCI_RoutingTable *PCIRouting;
+	AML_DeviceIndex *Devices;
+
+	CPUTopology *Topology;
+	PCI_ConfigSpace *PCIConfig;
+	HPET_Clock *Clock;
+	NUMA_Topology *NUMA;
+	AML_GlobalLock *GlobalLock;
+	ACPI_PowerControl *Power;
+	ACPI_FixedRegisters *Registers;
+	ACPI_ThermalMonitor *Thermal;
+	ACPI_ProcessorTable *Processors;
+
 };
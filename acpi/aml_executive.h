@@ -4,8 +4,37 @@
 
 #include "instruction_hashmap.h"
 #include "token.h"
+#include "namespace.h"
+#include "notify.h"
+#include "resource.h"
+#include "sync.h"
 
-void ParseByte(TokenList *tokens, AML_Hashmap *hashmap, uint8_t *data, size_t *idx);
+struct HPET_Clock;
+struct AML_GlobalLock;
+struct AML_TimerWheel;
+struct AML_Profiler;
+
+/* A definition block loaded at runtime, everything parsed from it goes away together */
+struct AML_Table {
+	uint64_t Handle;
+
+	/* Private copy of the table, method bodies point into it */
+	uint8_t *Data;
+	size_t Length;
+
+	TokenList *Tokens;
+	AML_NamespaceOwner Owner;
+
+	AML_Table *Next;
+};
+
+/* Called for every subtree a table spliced in, after it was loaded and before it is unloaded */
+typedef void (*AML_TableHandler)(AML_NamespaceNode *subtree, bool loaded, void *context);
+/* Finds the table LoadTable names, NULL when there is none */
+typedef const void *(*AML_TableFinder)(const char *signature, const char *oemId, const char *oemTableId, void *context);
+
+void ParseByte(TokenList *tokens, AML_Hashmap *hashmap, AmlCursor *cursor);
+TokenList *ParseTermList(AML_Hashmap *hashmap, AmlCursor *cursor, uint8_t *end);
 
 class AMLExecutive {
 public:
@@ -14,8 +43,79 @@ public:
 
 	int Parse(uint8_t *data, size_t size);
 	Token *FindObject(const char *name);
+	/* Nodes from FindNode and Resolve are only valid while a pin is held, pins nest */
+	uint32_t PinNamespace();
+	void UnpinNamespace(uint32_t pin);
+	AML_NamespaceNode *FindNode(const char *path);
+	void DumpNamespace(AML_NamespaceNode *scope);
+	AML_NamespaceNode *Resolve(AML_NamespaceNode *scope, NameType *name);
+	Token *Evaluate(AML_NamespaceNode *node);
+	Token *Evaluate(AML_NamespaceNode *node, const uint64_t *args, size_t argCount);
+	void ReleaseResult(Token *result);
+	bool EvaluateInteger(AML_NamespaceNode *node, uint64_t *value);
+	AML_ResourceList *GetResources(AML_NamespaceNode *device);
+	uint32_t GetStatus(AML_NamespaceNode *device);
+	/* Runs \_SB._INI and _INI of every device present, returns how many ran */
 	int Execute();
+
+	/* Returns the handle Unload takes, 0 if the table is not valid */
+	uint64_t LoadTable(const void *table, size_t length, AML_NamespaceNode *scope);
+	uint64_t LoadTable(const char *signature, const char *oemId, const char *oemTableId, AML_NamespaceNode *scope);
+	bool UnloadTable(uint64_t handle);
+	void SetTableHandler(AML_TableHandler handler, void *context);
+	void SetTableFinder(AML_TableFinder finder, void *context);
+
+	bool Notify(AML_NamespaceNode *node, uint32_t value);
+	AML_NotifyQueue *GetNotifyQueue();
+	AML_Namespace *GetNamespace();
+	AML_Hashmap *GetHashmap();
+
+	/* Evaluations started afterwards are profiled or not, what was recorded stays around */
+	void EnableProfiling(bool enable);
+	AML_Profiler *GetProfiler();
+	/* NULL while profiling is off */
+	AML_Profiler *GetActiveProfiler();
+
+	/* Method code folded against Names is parsed again once this moves on */
+	uint64_t GetFoldGeneration();
+	void InvalidateFolding();
+
+	void SetClock(HPET_Clock *clock);
+	HPET_Clock *GetClock();
+	AML_TimerWheel *GetTimerWheel();
+	void SetGlobalLock(AML_GlobalLock *lock);
+	AML_GlobalLock *GetGlobalLock();
 private:
+	/* Owns its tables and namespace, never copied */
+	AMLExecutive(const AMLExecutive&);
+	AMLExecutive &operator=(const AMLExecutive&);
+
+	/* Evaluate inside a read section the caller already holds */
+	Token *EvaluateNode(AML_NamespaceNode *node, const uint64_t *args, size_t argCount);
+	void NotifyTable(AML_Table *table, bool loaded);
+	int InitializeDevices(AML_NamespaceNode *scope);
+
 	AML_Hashmap *Hashmap;
 	TokenList *RootTokenList;
+
+	AML_Namespace *Namespace;
+	AML_NotifyQueue *Notifications;
+
+	AML_SpinLock TablesLock;
+	AML_Table *Tables;
+	uint64_t NextTableHandle;
+
+	AML_TableHandler TableHandler;
+	void *TableHandlerContext;
+	AML_TableFinder TableFinder;
+	void *TableFinderContext;
+
+	uint64_t FoldGeneration;
+
+	AML_Profiler *Profiler;
+	bool Profiling;
+
+	HPET_Clock *Clock;
+	AML_TimerWheel *Timers;
+	AML_GlobalLock *GlobalLock;
 };
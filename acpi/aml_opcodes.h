@@ -95,6 +95,8 @@
 #define AML_EVENT 0x02
 #define AML_CONDREF_OP 0x12
 #define AML_ARBFIELD_OP 0x13
+#define AML_LOAD_TABLE_OP 0x1F
+#define AML_LOAD_OP 0x20
 #define AML_STALL_OP 0x21
 #define AML_SLEEP_OP 0x22
 #define AML_ACQUIRE_OP 0x23
@@ -104,6 +106,7 @@
 #define AML_RESET_OP 0x26
 #define AML_FROM_BCD_OP 0x28
 #define AML_TO_BCD_OP 0x29
+#define AML_UNLOAD_OP 0x2A
 #define AML_REVISION_OP 0x30
 #define AML_DEBUG_OP 0x31
 #define AML_FATAL_OP 0x32
@@ -117,20 +120,55 @@
 #define AML_INDEXFIELD 0x86 /* ACPI spec v5.0 section 19.5.60 */
 #define AML_BANKFIELD 0x87
 
+/* Extended opcodes as stored in operation tokens */
+#define AML_EXTENDED(op) ((AML_EXTOP_PREFIX << 8) | (op))
+
 /* Field Access Type */
 #define AML_FIELD_ANY_ACCESS 0x00
 #define AML_FIELD_BYTE_ACCESS 0x01
 #define AML_FIELD_WORD_ACCESS 0x02
 #define AML_FIELD_DWORD_ACCESS 0x03
 #define AML_FIELD_QWORD_ACCESS 0x04
+#define AML_FIELD_BUFFER_ACCESS 0x05
+#define AML_FIELD_ACCESS_MASK 0x0F
 #define AML_FIELD_LOCK 0x10
 #define AML_FIELD_PRESERVE 0x00
 #define AML_FIELD_WRITE_ONES 0x01
 #define AML_FIELD_WRITE_ZEROES 0x02
+#define AML_FIELD_UPDATE_SHIFT 5
+#define AML_FIELD_UPDATE_MASK 0x03
+
+/* Field List Elements */
+#define AML_FIELD_RESERVED 0x00
+#define AML_FIELD_ACCESS 0x01
+#define AML_FIELD_CONNECT 0x02
+#define AML_FIELD_EXTENDED_ACCESS 0x03
+
+/* Region Spaces */
+#define AML_REGION_SYSTEM_MEMORY 0x00
+#define AML_REGION_SYSTEM_IO 0x01
+#define AML_REGION_PCI_CONFIG 0x02
+#define AML_REGION_EMBEDDED_CONTROL 0x03
+#define AML_REGION_SMBUS 0x04
+#define AML_REGION_SYSTEM_CMOS 0x05
+#define AML_REGION_PCI_BAR_TARGET 0x06
+#define AML_REGION_IPMI 0x07
+#define AML_REGION_GPIO 0x08
+#define AML_REGION_GENERIC_SERIAL_BUS 0x09
+#define AML_REGION_PCC 0x0A
+#define AML_REGION_SPACE_COUNT 0x0B
 
 /* Methods */
 #define AML_METHOD_ARGC_MASK 0x07
 #define AML_METHOD_SERIALIZED 0x08
+#define AML_METHOD_SYNC_SHIFT 4
+#define AML_MUTEX_SYNC_MASK 0x0F
+/* Acquire timeout that never expires */
+#define AML_WAIT_FOREVER 0xFFFF
+
+/* Interpreter limits */
+#define AML_MAX_ARGS 7
+#define AML_MAX_LOCALS 8
 
 /* Match Comparison Type */
 #define AML_MATCH_MTR 0x0
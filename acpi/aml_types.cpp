@@ -3,126 +3,115 @@
 
 #include <mkmi.h>
 
-void HandleNameTypeSegments(NameType *name, uint8_t *data, size_t *idx) {
-	if (data[*idx] == AML_DUAL_PREFIX) {
-		/* Dual name */
-		*idx += 1;
-
-		name->SegmentNumber = 2;
-		name->NameSegments = Malloc(name->SegmentNumber * 4);
-		Memcpy(name->NameSegments + 0, &data[*idx], 4);
-		Memcpy(name->NameSegments + 4, &data[*idx + 4], 4);
-
-		*idx += 8;
-	} else if (data[*idx] == AML_MULTI_PREFIX) {
-		/* Multiple name segments */
-		*idx += 1;
-
-		name->SegmentNumber = data[*idx];
-
-		*idx += 1;
-
-		name->NameSegments = Malloc(name->SegmentNumber * 4);
-
-		for (size_t i = 0; i < name->SegmentNumber ; ++i) {
-			Memcpy(&name->NameSegments[i * 4], &data[*idx], 4);
-			*idx += 4;
-		}
-	} else if (data[*idx] == 0x00) {
-		/* The name is NULL */
-		*idx += 1;
-
-		name->SegmentNumber = 0;
-		name->NameSegments = NULL;
+/* Indexed by the top two bits of the lead byte, see ACPI spec section 20.2.4 */
+static const struct {
+	uint8_t LeadMask;
+	uint32_t FollowMask;
+} PkgLeadBytes[4] = {
+	{0x3F, 0x000000},
+	{0x0F, 0x0000FF},
+	{0x0F, 0x00FFFF},
+	{0x0F, 0xFFFFFF},
+};
+
+void HandleNameType(NameType *name, AmlCursor *cursor) {
+	name->IsRoot = false;
+	name->ParentPrefixes = 0;
+
+	uint8_t lead = ReadByte(cursor);
+
+	if (lead == AML_ROOT_CHAR) {
+		name->IsRoot = true;
+		lead = ReadByte(cursor);
 	} else {
-		/* Simple name segment */
-		name->SegmentNumber = 1;
-		name->NameSegments = Malloc(name->SegmentNumber * 4);
-		Memcpy(name->NameSegments + 0, &data[*idx], 4);
+		while (lead == AML_PARENT_CHAR) {
+			name->ParentPrefixes++;
+			lead = ReadByte(cursor);
+		}
+	}
 
-		*idx += 4;
+	size_t count;
+	switch (lead) {
+		case AML_DUAL_PREFIX:
+			count = 2;
+			break;
+		case AML_MULTI_PREFIX:
+			count = ReadByte(cursor);
+			break;
+		case 0x00:
+			/* The name is NULL, this is also where an overrun ends up */
+			count = 0;
+			break;
+		default:
+			/* Simple name segment, the lead byte is its first character */
+			count = 1;
+			cursor->Position--;
+			break;
 	}
-}
 
-void HandleNameType(NameType *name, uint8_t *data, size_t *idx) {
-	if(data[*idx] == AML_ROOT_CHAR) {
-		name->IsRoot = true;
-		*idx += 1;
-	} else if (data[*idx] == AML_PARENT_CHAR) {
-		name->IsRoot = false;
-		*idx += 1;
-	} else {
-		name->IsRoot = false;
+	/* Segments are not copied, the table outlives every token parsed from it */
+	if (count == 0 || !CursorReserve(cursor, count * 4)) {
+		name->SegmentNumber = 0;
+		name->NameSegments = NULL;
+		return;
 	}
 
-	HandleNameTypeSegments(name, data, idx);
+	name->SegmentNumber = count;
+	name->NameSegments = (char*)cursor->Position;
+	cursor->Position += count * 4;
 }
 
-void HandleIntegerType(IntegerType *integer, uint8_t *data, size_t *idx) {
-	size_t moveAmount = 0;
-
-	integer->Data = 0;
-
-	switch(data[*idx - 1]) {
-		case AML_QWORDPREFIX:
-			moveAmount += 4;
-			integer->Data |= (data[*idx + 7] << 56);
-			integer->Data |= (data[*idx + 6] << 48);
-			integer->Data |= (data[*idx + 5] << 40);
-			integer->Data |= (data[*idx + 4] << 32);
-		case AML_DWORDPREFIX:
-			moveAmount += 2;
-			integer->Data |= (data[*idx + 3] << 24);
-			integer->Data |= (data[*idx + 2] << 16);
-		case AML_WORDPREFIX:
-			moveAmount += 1;
-			integer->Data |= (data[*idx + 1] << 8);
+void HandleIntegerType(IntegerType *integer, uint8_t prefix, AmlCursor *cursor) {
+	switch(prefix) {
 		case AML_BYTEPREFIX:
-			moveAmount += 1;
-			integer->Data |= data[*idx];
-
-			*idx += moveAmount;
+			integer->Data = ReadByte(cursor);
+			integer->Size = 1;
+			break;
+		case AML_WORDPREFIX:
+			integer->Data = ReadWord(cursor);
+			integer->Size = 2;
+			break;
+		case AML_DWORDPREFIX:
+			integer->Data = ReadDWord(cursor);
+			integer->Size = 4;
+			break;
+		case AML_QWORDPREFIX:
+			integer->Data = ReadQWord(cursor);
+			integer->Size = 8;
+			break;
+		case AML_ONES_OP:
+			integer->Data = ~0ull;
+			integer->Size = 8;
 			break;
 		default:
-			moveAmount = 1;
-			integer->Data |= data[*idx - 1];
+			/* Zero and One are their own value */
+			integer->Data = prefix;
+			integer->Size = 1;
 			break;
 	}
-
-	integer->Size = moveAmount;
 }
 
-int HandlePkgLengthType(uint8_t *pkgLength, uint8_t *data, size_t *idx) {
-	uint8_t leadByte = data[*idx];
+int HandlePkgLengthType(uint32_t *pkgLength, AmlCursor *cursor) {
 	*pkgLength = 0;
-	uint8_t byteCount = leadByte & 0b11000000;
-	
-	byteCount >>= 6;
+	if (!CursorReserve(cursor, 1)) return 0;
 
-	switch(byteCount) {
-		case 0:
-			*pkgLength |= leadByte & 0b00111111;
-			*idx += 1;
-			break;
-		case 1:
-			*pkgLength |= leadByte & 0b00001111;
-			*pkgLength |= (data[*idx + 1] << 4);
-			*idx += 2;
-			break;
-		case 2:
-			*pkgLength |= leadByte & 0b00001111;
-			*pkgLength |= (data[*idx + 1] << 4);
-			*pkgLength |= (data[*idx + 2] << 12);
-			*idx += 3;
-			break;
-		case 3:
-			*pkgLength |= leadByte & 0b00001111;
-			*pkgLength |= (data[*idx + 1] << 4);
-			*pkgLength |= (data[*idx + 2] << 12);
-			*pkgLength |= (data[*idx + 3] << 20);
-			*idx += 4;
-			break;
+	uint8_t leadByte = *cursor->Position;
+	uint8_t byteCount = leadByte >> 6;
+
+	if (!CursorReserve(cursor, byteCount + 1)) return 0;
+
+	/* Away from the end of the table all the follow bytes come in with one load */
+	uint32_t follow;
+	if (CursorRemaining(cursor) >= 4) {
+		__builtin_memcpy(&follow, cursor->Position, 4);
+		follow = AML_LE32(follow) >> 8;
+	} else {
+		follow = 0;
+		for (uint8_t i = 0; i < byteCount; ++i) follow |= (uint32_t)cursor->Position[i + 1] << (i * 8);
 	}
 
+	*pkgLength = (leadByte & PkgLeadBytes[byteCount].LeadMask) | ((follow & PkgLeadBytes[byteCount].FollowMask) << 4);
+	cursor->Position += byteCount + 1;
+
 	return byteCount;
 }
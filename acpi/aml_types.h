@@ -5,8 +5,10 @@
 
 struct NameType {
 	bool IsRoot;
+	uint8_t ParentPrefixes;
 
 	uint8_t SegmentNumber;
+	/* Points into the table the name was parsed from */
 	char *NameSegments;
 };
 
@@ -15,8 +17,105 @@ struct IntegerType {
 	uint8_t Size;
 };
 
-void HandleNameTypeSegments(NameType *name, uint8_t *data, size_t *idx);
-void HandleNameType(NameType *name, uint8_t *data, size_t *idx);
-void HandleIntegerType(IntegerType *integer, uint8_t *data, size_t *idx);
+/*
+ * Reads never go past End. One that would leaves the cursor at End,
+ * returns zeroes and sets Overrun, so decoders need no checks of their own.
+ */
+struct AmlCursor {
+	uint8_t *Start;
+	uint8_t *Position;
+	uint8_t *End;
 
-int HandlePkgLengthType(uint8_t *pkgLength, uint8_t *data, size_t *idx);
+	bool Overrun;
+};
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define AML_LE16(x) __builtin_bswap16(x)
+#define AML_LE32(x) __builtin_bswap32(x)
+#define AML_LE64(x) __builtin_bswap64(x)
+#else
+#define AML_LE16(x) (x)
+#define AML_LE32(x) (x)
+#define AML_LE64(x) (x)
+#endif
+
+static inline void InitCursor(AmlCursor *cursor, uint8_t *data, size_t size) {
+	cursor->Start = data;
+	cursor->Position = data;
+	cursor->End = data + size;
+	cursor->Overrun = false;
+}
+
+static inline size_t CursorRemaining(const AmlCursor *cursor) {
+	return cursor->End - cursor->Position;
+}
+
+static inline size_t CursorOffset(const AmlCursor *cursor) {
+	return cursor->Position - cursor->Start;
+}
+
+static inline bool CursorReserve(AmlCursor *cursor, size_t size) {
+	if (__builtin_expect(CursorRemaining(cursor) >= size, 1)) return true;
+
+	cursor->Position = cursor->End;
+	cursor->Overrun = true;
+	return false;
+}
+
+static inline void CursorSkip(AmlCursor *cursor, size_t size) {
+	if (CursorReserve(cursor, size)) cursor->Position += size;
+}
+
+/* The byte ParseByte dispatched on, handlers use it to tell opcodes sharing one apart */
+static inline uint8_t CursorOpcode(const AmlCursor *cursor) {
+	return cursor->Position[-1];
+}
+
+static inline uint8_t PeekByte(const AmlCursor *cursor) {
+	return cursor->Position < cursor->End ? *cursor->Position : 0;
+}
+
+static inline uint8_t ReadByte(AmlCursor *cursor) {
+	if (!CursorReserve(cursor, 1)) return 0;
+	return *cursor->Position++;
+}
+
+static inline uint16_t ReadWord(AmlCursor *cursor) {
+	uint16_t value;
+	if (!CursorReserve(cursor, 2)) return 0;
+
+	__builtin_memcpy(&value, cursor->Position, 2);
+	cursor->Position += 2;
+	return AML_LE16(value);
+}
+
+static inline uint32_t ReadDWord(AmlCursor *cursor) {
+	uint32_t value;
+	if (!CursorReserve(cursor, 4)) return 0;
+
+	__builtin_memcpy(&value, cursor->Position, 4);
+	cursor->Position += 4;
+	return AML_LE32(value);
+}
+
+static inline uint64_t ReadQWord(AmlCursor *cursor) {
+	uint64_t value;
+	if (!CursorReserve(cursor, 8)) return 0;
+
+	__builtin_memcpy(&value, cursor->Position, 8);
+	cursor->Position += 8;
+	return AML_LE64(value);
+}
+
+/* Where a package starting at pkgStart ends, never past the enclosing one */
+static inline uint8_t *PackageEnd(AmlCursor *cursor, uint8_t *pkgStart, uint32_t pkgLength) {
+	if (pkgLength <= (size_t)(cursor->End - pkgStart)) return pkgStart + pkgLength;
+
+	cursor->Overrun = true;
+	return cursor->End;
+}
+
+void HandleNameType(NameType *name, AmlCursor *cursor);
+void HandleIntegerType(IntegerType *integer, uint8_t prefix, AmlCursor *cursor);
+
+int HandlePkgLengthType(uint32_t *pkgLength, AmlCursor *cursor);
@@ -0,0 +1,219 @@
+#include "device_index.h"
+#include "aml_executive.h"
+#include "namespace.h"
+#include "notify.h"
+#include "token.h"
+
+#include <mkmi.h>
+
+static inline size_t BucketFor(uint64_t key) {
+	return (key * 0x9E3779B97F4A7C15ull) >> 56 & (DEVICE_INDEX_BUCKETS - 1);
+}
+
+static inline bool IsHexDigit(char c) {
+	return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F');
+}
+
+static inline uint8_t HexValue(char c) {
+	return c <= '9' ? c - '0' : c - 'A' + 10;
+}
+
+/* "PNP0A08" and EisaId("PNP0A08") end up with the same key */
+uint64_t DeviceIdKey(const char *id) {
+	size_t length = Strlen(id);
+
+	bool isEisa = length == 7;
+	for (size_t i = 0; isEisa && i < 3; ++i) isEisa = id[i] >= 'A' && id[i] <= 'Z';
+	for (size_t i = 3; isEisa && i < 7; ++i) isEisa = IsHexDigit(id[i]);
+
+	if (isEisa) {
+		uint16_t vendor = ((id[0] & 0x1F) << 10) | ((id[1] & 0x1F) << 5) | (id[2] & 0x1F);
+
+		return (vendor >> 8) | ((vendor & 0xFF) << 8) |
+		       (((HexValue(id[3]) << 4) | HexValue(id[4])) << 16) |
+		       ((uint32_t)((HexValue(id[5]) << 4) | HexValue(id[6])) << 24);
+	}
+
+	/* FNV-1a */
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= (uint8_t)id[i];
+		hash *= 0x100000001B3ull;
+	}
+
+	return hash | DEVICE_KEY_STRING;
+}
+
+static bool TokenKey(Token *id, uint64_t *key) {
+	if (GetTokenInteger(id, key)) return true;
+
+	if (id != NULL && id->Type == STRING) {
+		*key = DeviceIdKey(id->String);
+		return true;
+	}
+
+	return false;
+}
+
+static void Insert(AML_DeviceIndex *index, uint64_t key, AML_NamespaceNode *node) {
+	AcquireSpinLock(&index->WriteLock);
+
+	AML_DeviceEntry **last = &index->Buckets[BucketFor(key)];
+
+	for (; *last != NULL; last = &(*last)->Next) {
+		/* A _CID repeating the _HID */
+		if ((*last)->Key == key && (*last)->Node == node) {
+			ReleaseSpinLock(&index->WriteLock);
+			return;
+		}
+	}
+
+	AML_DeviceEntry *entry = new AML_DeviceEntry;
+	entry->Key = key;
+	entry->Node = node;
+	entry->Next = NULL;
+
+	__atomic_store_n(last, entry, __ATOMIC_RELEASE);
+	index->Count++;
+
+	ReleaseSpinLock(&index->WriteLock);
+}
+
+static void AddDevice(AML_DeviceIndex *index, AML_NamespaceNode *device) {
+	AMLExecutive *executive = index->Executive;
+	uint64_t key;
+
+	Token *hid = executive->Evaluate(FindChild(device, "_HID"));
+	if (TokenKey(hid, &key)) Insert(index, key, device);
+	executive->ReleaseResult(hid);
+
+	Token *cid = executive->Evaluate(FindChild(device, "_CID"));
+	if (cid == NULL) return;
+
+	if (cid->Type != PACKAGE) {
+		if (TokenKey(cid, &key)) Insert(index, key, device);
+		executive->ReleaseResult(cid);
+		return;
+	}
+
+	for (Token *id = cid->Children->Head; id != NULL; id = id->Next) {
+		if (TokenKey(id, &key)) Insert(index, key, device);
+	}
+
+	executive->ReleaseResult(cid);
+}
+
+static void Scan(AML_DeviceIndex *index, AML_NamespaceNode *node) {
+	if (node->Type == NODE_DEVICE) {
+		/* _STA is evaluated again on next use */
+		node->Status = AML_STA_UNKNOWN;
+		AddDevice(index, node);
+	}
+
+	for (AML_NamespaceNode *child = FirstChild(node); child != NULL; child = NextSibling(child)) {
+		Scan(index, child);
+	}
+}
+
+static void FreeRetiredEntry(void *object) {
+	delete (AML_DeviceEntry*)object;
+}
+
+static void Remove(AML_DeviceIndex *index, AML_NamespaceNode *subtree) {
+	AML_Namespace *ns = index->Executive->GetNamespace();
+
+	AcquireSpinLock(&index->WriteLock);
+
+	for (size_t i = 0; i < DEVICE_INDEX_BUCKETS; ++i) {
+		AML_DeviceEntry **current = &index->Buckets[i];
+
+		while (*current != NULL) {
+			AML_DeviceEntry *entry = *current;
+
+			if (IsNodeInSubtree(entry->Node, subtree)) {
+				/* Entry keeps its Next, a lookup standing on it still reaches the rest of the chain */
+				__atomic_store_n(current, entry->Next, __ATOMIC_RELEASE);
+				RetireObject(ns, entry, FreeRetiredEntry);
+				index->Count--;
+			} else {
+				current = &entry->Next;
+			}
+		}
+	}
+
+	ReleaseSpinLock(&index->WriteLock);
+}
+
+void UpdateDeviceIndex(AML_DeviceIndex *index, AML_NamespaceNode *subtree) {
+	AML_Namespace *ns = index->Executive->GetNamespace();
+
+	uint32_t section = EnterNamespace(ns);
+	Remove(index, subtree);
+	Scan(index, subtree);
+	LeaveNamespace(ns, section);
+}
+
+void RemoveDeviceSubtree(AML_DeviceIndex *index, AML_NamespaceNode *subtree) {
+	Remove(index, subtree);
+}
+
+static void DeviceNotifyHandler(AML_NamespaceNode *node, uint32_t value, void *context) {
+	switch (value) {
+		case AML_NOTIFY_BUS_CHECK:
+		case AML_NOTIFY_DEVICE_CHECK:
+		case AML_NOTIFY_EJECT_REQUEST:
+		case AML_NOTIFY_DEVICE_CHECK_LIGHT:
+			UpdateDeviceIndex((AML_DeviceIndex*)context, node);
+			break;
+		default:
+			break;
+	}
+}
+
+AML_DeviceIndex *CreateDeviceIndex(AMLExecutive *executive) {
+	AML_DeviceIndex *index = new AML_DeviceIndex;
+	AML_NamespaceNode *root = executive->GetNamespace()->Root;
+
+	index->Executive = executive;
+	InitSpinLock(&index->WriteLock);
+	index->Count = 0;
+	for (size_t i = 0; i < DEVICE_INDEX_BUCKETS; ++i) index->Buckets[i] = NULL;
+
+	uint32_t section = EnterNamespace(executive->GetNamespace());
+	Scan(index, root);
+	LeaveNamespace(executive->GetNamespace(), section);
+
+	index->Subscription = SubscribeNotify(executive->GetNotifyQueue(), root, true, DeviceNotifyHandler, index);
+
+	return index;
+}
+
+void DeleteDeviceIndex(AML_DeviceIndex *index) {
+	UnsubscribeNotify(index->Executive->GetNotifyQueue(), index->Subscription);
+	Remove(index, index->Executive->GetNamespace()->Root);
+	delete index;
+}
+
+size_t FindDevicesByKey(AML_DeviceIndex *index, uint64_t key, AML_NamespaceNode **devices, size_t max) {
+	AML_Namespace *ns = index->Executive->GetNamespace();
+	size_t count = 0;
+
+	/* Entries removed meanwhile stay readable until the section is over */
+	uint32_t section = EnterNamespace(ns);
+
+	AML_DeviceEntry *entry = __atomic_load_n(&index->Buckets[BucketFor(key)], __ATOMIC_ACQUIRE);
+	for (; entry != NULL; entry = __atomic_load_n(&entry->Next, __ATOMIC_ACQUIRE)) {
+		if (entry->Key != key) continue;
+
+		if (count < max) devices[count] = entry->Node;
+		count++;
+	}
+
+	LeaveNamespace(ns, section);
+
+	return count;
+}
+
+size_t FindDevices(AML_DeviceIndex *index, const char *id, AML_NamespaceNode **devices, size_t max) {
+	return FindDevicesByKey(index, DeviceIdKey(id), devices, max);
+}
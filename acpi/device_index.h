@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sync.h"
+
+class AMLExecutive;
+struct AML_NamespaceNode;
+struct AML_NotifySubscription;
+
+/* Must be a power of two */
+#define DEVICE_INDEX_BUCKETS 256
+
+/* Keys of IDs that are not in EISA form, so they never collide with compressed IDs */
+#define DEVICE_KEY_STRING (1ull << 63)
+
+struct AML_DeviceEntry {
+	uint64_t Key;
+	AML_NamespaceNode *Node;
+
+	AML_DeviceEntry *Next;
+};
+
+struct AML_DeviceIndex {
+	AMLExecutive *Executive;
+
+	/* Serializes inserts and removals, lookups walk the chains in a namespace read section */
+	AML_SpinLock WriteLock;
+	/* Chained, every chain is kept in namespace order */
+	AML_DeviceEntry *Buckets[DEVICE_INDEX_BUCKETS];
+	size_t Count;
+
+	AML_NotifySubscription *Subscription;
+};
+
+uint64_t DeviceIdKey(const char *id);
+
+AML_DeviceIndex *CreateDeviceIndex(AMLExecutive *executive);
+void DeleteDeviceIndex(AML_DeviceIndex *index);
+
+/* Drops every entry under the subtree and indexes it again */
+void UpdateDeviceIndex(AML_DeviceIndex *index, AML_NamespaceNode *subtree);
+/* Drops every entry under the subtree, call it before the subtree leaves the namespace */
+void RemoveDeviceSubtree(AML_DeviceIndex *index, AML_NamespaceNode *subtree);
+
+/* Fills up to max devices and returns how many match in total */
+size_t FindDevicesByKey(AML_DeviceIndex *index, uint64_t key, AML_NamespaceNode **devices, size_t max);
+size_t FindDevices(AML_DeviceIndex *index, const char *id, AML_NamespaceNode **devices, size_t max);
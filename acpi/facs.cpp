@@ -0,0 +1,83 @@
+#include "facs.h"
+#include "gas.h"
+
+#include <mkmi.h>
+
+/* Sets owned, or pending if the firmware has it. Returns whether we own it now */
+static bool AcquireFirmwareLock(volatile uint32_t *lock) {
+	uint32_t old = __atomic_load_n(lock, __ATOMIC_RELAXED);
+	uint32_t next;
+
+	do {
+		next = (old & ~FACS_GLOBAL_LOCK_PENDING) | FACS_GLOBAL_LOCK_OWNED;
+		if (old & FACS_GLOBAL_LOCK_OWNED) next |= FACS_GLOBAL_LOCK_PENDING;
+	} while (!__atomic_compare_exchange_n(lock, &old, next, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+	return !(next & FACS_GLOBAL_LOCK_PENDING);
+}
+
+/* Clears both bits. Returns whether the firmware was waiting for it */
+static bool ReleaseFirmwareLock(volatile uint32_t *lock) {
+	uint32_t old = __atomic_load_n(lock, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(lock, &old, old & ~(FACS_GLOBAL_LOCK_PENDING | FACS_GLOBAL_LOCK_OWNED),
+					    false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	return old & FACS_GLOBAL_LOCK_PENDING;
+}
+
+AML_GlobalLock *CreateGlobalLock(FACSTable *facs, ACPI_FixedRegisters *registers) {
+	AML_GlobalLock *lock = new AML_GlobalLock;
+
+	/* The FACS is 64 byte aligned, so the lock word is naturally aligned too */
+	lock->Lock = NULL;
+	if (facs != NULL && Memcmp(facs->Signature, "FACS", 4) == 0) {
+		lock->Lock = (volatile uint32_t*)((uintptr_t)facs + __builtin_offsetof(FACSTable, GlobalLock));
+	}
+
+	lock->Registers = registers;
+
+	InitMutex(&lock->Mutex, 0);
+
+	lock->Stats.Acquisitions = 0;
+	lock->Stats.FirmwareContended = 0;
+	lock->Stats.ReleasesSignalled = 0;
+
+	return lock;
+}
+
+void DeleteGlobalLock(AML_GlobalLock *lock) {
+	delete lock;
+}
+
+bool TryAcquireGlobalLock(AML_GlobalLock *lock, void *owner) {
+	if (!TryAcquireMutex(&lock->Mutex, owner)) return false;
+
+	/* Nested acquisitions already hold the firmware bit */
+	if (lock->Mutex.Depth > 1 || lock->Lock == NULL || AcquireFirmwareLock(lock->Lock)) {
+		__atomic_fetch_add(&lock->Stats.Acquisitions, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	/* The firmware will clear pending when it lets go, another core may retry meanwhile */
+	__atomic_fetch_add(&lock->Stats.FirmwareContended, 1, __ATOMIC_RELAXED);
+	ReleaseMutex(&lock->Mutex);
+
+	return false;
+}
+
+void ReleaseGlobalLock(AML_GlobalLock *lock) {
+	if (lock->Mutex.Depth == 1 && lock->Lock != NULL && ReleaseFirmwareLock(lock->Lock)) {
+		GAS_Register *controls[2] = { &lock->Registers->PM1aControl, &lock->Registers->PM1bControl };
+
+		for (size_t i = 0; i < 2; ++i) {
+			if (!controls[i]->Valid) continue;
+
+			WriteGAS(controls[i], ReadGAS(controls[i]) | PM1_CONTROL_GBL_RLS);
+		}
+
+		__atomic_fetch_add(&lock->Stats.ReleasesSignalled, 1, __ATOMIC_RELAXED);
+	}
+
+	ReleaseMutex(&lock->Mutex);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sync.h"
+
+struct ACPI_FixedRegisters;
+
+/* Global lock bits, see ACPI spec section 5.2.10.1 */
+#define FACS_GLOBAL_LOCK_PENDING (1 << 0)
+#define FACS_GLOBAL_LOCK_OWNED (1 << 1)
+
+/* GBL_RLS in the PM1 control registers, tells the firmware the lock is free */
+#define PM1_CONTROL_GBL_RLS (1 << 2)
+
+struct FACSTable {
+	char Signature[4];
+	uint32_t Length;
+	uint32_t HardwareSignature;
+	uint32_t FirmwareWakingVector;
+	uint32_t GlobalLock;
+	uint32_t Flags;
+	uint64_t X_FirmwareWakingVector;
+	uint8_t Version;
+	uint8_t Reserved[3];
+	uint32_t OSPMFlags;
+	uint8_t Reserved2[24];
+}__attribute__((packed));
+
+struct AML_GlobalLockStats {
+	uint64_t Acquisitions;
+	/* Attempts that found the firmware holding the lock and left the pending bit */
+	uint64_t FirmwareContended;
+	/* Releases that had to raise GBL_RLS */
+	uint64_t ReleasesSignalled;
+};
+
+struct AML_GlobalLock {
+	/* The lock word inside the FACS, NULL when there is none */
+	volatile uint32_t *Lock;
+	/* GBL_RLS goes to the PM1 control registers in here */
+	ACPI_FixedRegisters *Registers;
+
+	/* Orders the cores of the OS among themselves before touching the firmware bits */
+	AML_Mutex Mutex;
+
+	AML_GlobalLockStats Stats;
+};
+
+AML_GlobalLock *CreateGlobalLock(FACSTable *facs, ACPI_FixedRegisters *registers);
+void DeleteGlobalLock(AML_GlobalLock *lock);
+
+/* Never blocks, recursive for the owner like any other AML mutex */
+bool TryAcquireGlobalLock(AML_GlobalLock *lock, void *owner);
+void ReleaseGlobalLock(AML_GlobalLock *lock);
@@ -0,0 +1,448 @@
+#include "field_access.h"
+#include "region.h"
+#include "token.h"
+#include "aml_types.h"
+#include "aml_opcodes.h"
+#include "memory.h"
+
+#include <mkmi.h>
+
+/* Number of containers a single read keeps around before going back to the hardware */
+#define FIELD_BATCH_SLOTS 8
+
+struct FieldContainer {
+	uint64_t Address;
+	uint8_t Width;
+	bool Valid;
+
+	uint64_t Value;
+};
+
+/* Lives for one ReadFieldUnits call, reads are never cached across AML statements */
+struct FieldBatch {
+	uint8_t Space;
+
+	size_t Used;
+	size_t Next;
+	FieldContainer Containers[FIELD_BATCH_SLOTS];
+};
+
+/*
+ * The last container written, held back so the next unit of the same call
+ * going into it is written along with it. Anything else flushes it first,
+ * so the hardware still sees every container in order.
+ */
+struct FieldWriteBatch {
+	bool Pending;
+	uint8_t Space;
+	uint8_t UpdateRule;
+
+	uint64_t Address;
+	uint8_t Width;
+	uint64_t Value;
+	uint64_t Mask;
+	size_t NaiveAccesses;
+};
+
+static AML_FieldAccessStats FieldStats;
+
+static inline uint64_t BitMask(uint32_t bits) {
+	return bits >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1;
+}
+
+static inline void CountAccess(uint64_t *counter, uint64_t count) {
+	__atomic_fetch_add(counter, count, __ATOMIC_RELAXED);
+}
+
+/* Up to 64 bits at any bit offset of a little endian byte string, missing bytes read as zero */
+static uint64_t GetBits(const uint8_t *bytes, size_t size, uint32_t offset, uint32_t count) {
+	uint64_t value = 0;
+
+	for (uint32_t done = 0; done < count;) {
+		uint32_t byte = (offset + done) / 8, shift = (offset + done) % 8;
+		uint32_t chunk = 8 - shift < count - done ? 8 - shift : count - done;
+
+		uint64_t bits = byte < size ? (bytes[byte] >> shift) & BitMask(chunk) : 0;
+		value |= bits << done;
+		done += chunk;
+	}
+
+	return value;
+}
+
+static void PutBits(uint8_t *bytes, uint32_t offset, uint32_t count, uint64_t value) {
+	for (uint32_t done = 0; done < count;) {
+		uint32_t byte = (offset + done) / 8, shift = (offset + done) % 8;
+		uint32_t chunk = 8 - shift < count - done ? 8 - shift : count - done;
+
+		uint8_t mask = BitMask(chunk) << shift;
+		bytes[byte] = (bytes[byte] & ~mask) | (((value >> done) << shift) & mask);
+		done += chunk;
+	}
+}
+
+static uint8_t AccessTypeToWidth(uint8_t accessType) {
+	switch(accessType & AML_FIELD_ACCESS_MASK) {
+		case AML_FIELD_WORD_ACCESS:
+			return 16;
+		case AML_FIELD_DWORD_ACCESS:
+			return 32;
+		case AML_FIELD_QWORD_ACCESS:
+			return 64;
+		case AML_FIELD_ANY_ACCESS:
+		case AML_FIELD_BYTE_ACCESS:
+		case AML_FIELD_BUFFER_ACCESS:
+		default:
+			return 8;
+	}
+}
+
+/* Walks the field list, filling units if given, and returns the number of named fields */
+static size_t WalkFieldList(AML_FieldUnit *units, uint8_t accessWidth, AmlCursor cursor) {
+	size_t count = 0;
+	uint32_t bitOffset = 0;
+
+	while(cursor.Position < cursor.End) {
+		uint32_t length = 0;
+
+		switch(PeekByte(&cursor)) {
+			case AML_FIELD_RESERVED:
+				CursorSkip(&cursor, 1);
+				HandlePkgLengthType(&length, &cursor);
+				bitOffset += length;
+				break;
+			case AML_FIELD_ACCESS:
+				CursorSkip(&cursor, 1);
+				accessWidth = AccessTypeToWidth(ReadByte(&cursor));
+				CursorSkip(&cursor, 1);
+				break;
+			case AML_FIELD_EXTENDED_ACCESS:
+				CursorSkip(&cursor, 1);
+				accessWidth = AccessTypeToWidth(ReadByte(&cursor));
+				CursorSkip(&cursor, 2);
+				break;
+			case AML_FIELD_CONNECT:
+				/* Connections only matter to serial bus and GPIO regions */
+				CursorSkip(&cursor, 1);
+				if (PeekByte(&cursor) == AML_BUFFER_OP) {
+					CursorSkip(&cursor, 1);
+
+					uint8_t *pkgStart = cursor.Position;
+					HandlePkgLengthType(&length, &cursor);
+					cursor.Position = PackageEnd(&cursor, pkgStart, length);
+				} else {
+					NameType connection;
+					HandleNameType(&connection, &cursor);
+				}
+				break;
+			default:
+				if (!CursorReserve(&cursor, 4)) break;
+
+				if (units != NULL) {
+					Memcpy(units[count].Name, cursor.Position, 4);
+				}
+
+				cursor.Position += 4;
+				HandlePkgLengthType(&length, &cursor);
+
+				if (units != NULL) {
+					units[count].BitOffset = bitOffset;
+					units[count].BitWidth = length;
+					units[count].AccessWidth = accessWidth;
+				}
+
+				bitOffset += length;
+				count++;
+				break;
+		}
+	}
+
+	return count;
+}
+
+size_t HandleFieldList(AML_FieldUnit **units, uint8_t fieldFlags, AmlCursor *cursor, uint8_t *end) {
+	uint8_t accessWidth = AccessTypeToWidth(fieldFlags);
+
+	/* Both walks stop at the end of the field's own package */
+	AmlCursor list = *cursor;
+	list.End = end;
+
+	/* Counting first lets us allocate all the units at once */
+	size_t count = WalkFieldList(NULL, accessWidth, list);
+
+	*units = NULL;
+	if (count != 0) {
+		*units = (AML_FieldUnit*)AllocateMemory(ACPI_MEMORY_TOKENS, count * sizeof(AML_FieldUnit));
+		WalkFieldList(*units, accessWidth, list);
+	}
+
+	if (cursor->Position < end) cursor->Position = end;
+
+	return count;
+}
+
+AML_FieldUnit *FindFieldUnit(Token *field, const char *name, uint32_t *index) {
+	for (uint32_t i = 0; i < field->Field.UnitCount; ++i) {
+		if (Memcmp(field->Field.Units[i].Name, name, 4) != 0) continue;
+
+		if (index != NULL) *index = i;
+		return &field->Field.Units[i];
+	}
+
+	return NULL;
+}
+
+static void InitBatch(FieldBatch *batch, Token *field) {
+	batch->Space = field->Field.Region->Region.RegionSpace;
+	batch->Used = 0;
+	batch->Next = 0;
+
+	for (size_t i = 0; i < FIELD_BATCH_SLOTS; ++i) batch->Containers[i].Valid = false;
+}
+
+static FieldContainer *FindContainer(FieldBatch *batch, uint64_t address, uint8_t width) {
+	for (size_t i = 0; i < batch->Used; ++i) {
+		FieldContainer *container = &batch->Containers[i];
+
+		if (container->Valid && container->Address == address && container->Width == width) {
+			return container;
+		}
+	}
+
+	return NULL;
+}
+
+static FieldContainer *NextContainer(FieldBatch *batch) {
+	FieldContainer *container;
+
+	if (batch->Used < FIELD_BATCH_SLOTS) {
+		container = &batch->Containers[batch->Used++];
+	} else {
+		container = &batch->Containers[batch->Next];
+		batch->Next = (batch->Next + 1) % FIELD_BATCH_SLOTS;
+	}
+
+	return container;
+}
+
+static uint64_t BatchRead(FieldBatch *batch, uint64_t address, uint8_t width) {
+	FieldContainer *container = FindContainer(batch, address, width);
+	if (container != NULL) {
+		CountAccess(&FieldStats.AccessesSaved, 1);
+		return container->Value;
+	}
+
+	/* Not in the batch, this one costs a real access */
+	CountAccess(&FieldStats.HardwareReads, 1);
+
+	container = NextContainer(batch);
+	container->Address = address;
+	container->Width = width;
+	container->Valid = true;
+	container->Value = RegionRead(batch->Space, address, width);
+
+	return container->Value;
+}
+
+/* Fills (BitWidth + 7) / 8 bytes */
+static int ReadUnit(FieldBatch *batch, Token *field, uint32_t index, uint8_t *bytes) {
+	if (index >= field->Field.UnitCount) return -1;
+
+	AML_FieldUnit *unit = &field->Field.Units[index];
+	uint8_t width = unit->AccessWidth;
+	uint64_t regionBase = field->Field.Region->Region.Base;
+	uint32_t bit = unit->BitOffset;
+	uint32_t done = 0;
+
+	for (size_t i = 0; i < (unit->BitWidth + 7) / 8; ++i) bytes[i] = 0;
+
+	while (done < unit->BitWidth) {
+		uint64_t address = regionBase + (bit / width) * (width / 8);
+		uint32_t shift = bit % width;
+		uint32_t chunk = width - shift;
+		if (chunk > unit->BitWidth - done) chunk = unit->BitWidth - done;
+
+		uint64_t raw = BatchRead(batch, address, width);
+		PutBits(bytes, done, chunk, (raw >> shift) & BitMask(chunk));
+
+		done += chunk;
+		bit += chunk;
+	}
+
+	CountAccess(&FieldStats.UnitReads, 1);
+
+	return 0;
+}
+
+static void InitWriteBatch(FieldWriteBatch *batch) {
+	batch->Pending = false;
+}
+
+static void FlushWrites(FieldWriteBatch *batch) {
+	if (!batch->Pending) return;
+
+	uint64_t full = BitMask(batch->Width);
+	uint64_t base;
+	size_t accesses = 1;
+
+	switch(batch->UpdateRule) {
+		case AML_FIELD_WRITE_ONES:
+			base = full;
+			break;
+		case AML_FIELD_WRITE_ZEROES:
+			base = 0;
+			break;
+		case AML_FIELD_PRESERVE:
+		default:
+			if (batch->Mask == full) {
+				base = 0;
+			} else {
+				base = RegionRead(batch->Space, batch->Address, batch->Width);
+				CountAccess(&FieldStats.HardwareReads, 1);
+				accesses++;
+			}
+			break;
+	}
+
+	uint64_t value = (base & ~batch->Mask) | (batch->Value & batch->Mask);
+	RegionWrite(batch->Space, batch->Address, value & full, batch->Width);
+	CountAccess(&FieldStats.HardwareWrites, 1);
+
+	CountAccess(&FieldStats.AccessesSaved, batch->NaiveAccesses - accesses);
+	batch->Pending = false;
+}
+
+static void BatchWrite(FieldWriteBatch *batch, uint8_t space, uint8_t updateRule, uint64_t address, uint8_t width, uint64_t mask, uint64_t bits) {
+	bool partial = mask != BitMask(width);
+	size_t naive = (partial && updateRule == AML_FIELD_PRESERVE) ? 2 : 1;
+
+	/* Bits written twice go out twice, firmware may pulse them */
+	bool same = batch->Pending && batch->Space == space && batch->UpdateRule == updateRule &&
+		    batch->Address == address && batch->Width == width && !(batch->Mask & mask);
+
+	if (!same) {
+		FlushWrites(batch);
+
+		batch->Pending = true;
+		batch->Space = space;
+		batch->UpdateRule = updateRule;
+		batch->Address = address;
+		batch->Width = width;
+		batch->Value = 0;
+		batch->Mask = 0;
+		batch->NaiveAccesses = 0;
+	}
+
+	batch->Value = (batch->Value & ~mask) | (bits & mask);
+	batch->Mask |= mask;
+	batch->NaiveAccesses += naive;
+}
+
+static int QueueWrite(FieldWriteBatch *batch, Token *field, uint32_t index, const uint8_t *bytes, size_t size) {
+	if (index >= field->Field.UnitCount) return -1;
+
+	AML_FieldUnit *unit = &field->Field.Units[index];
+	uint8_t space = field->Field.Region->Region.RegionSpace;
+	uint8_t updateRule = (field->Field.FieldFlags >> AML_FIELD_UPDATE_SHIFT) & AML_FIELD_UPDATE_MASK;
+	uint8_t width = unit->AccessWidth;
+	uint64_t regionBase = field->Field.Region->Region.Base;
+	uint32_t bit = unit->BitOffset;
+	uint32_t done = 0;
+
+	while (done < unit->BitWidth) {
+		uint64_t address = regionBase + (bit / width) * (width / 8);
+		uint32_t shift = bit % width;
+		uint32_t chunk = width - shift;
+		if (chunk > unit->BitWidth - done) chunk = unit->BitWidth - done;
+
+		uint64_t bits = GetBits(bytes, size, done, chunk);
+		BatchWrite(batch, space, updateRule, address, width, BitMask(chunk) << shift, bits << shift);
+
+		done += chunk;
+		bit += chunk;
+	}
+
+	CountAccess(&FieldStats.UnitWrites, 1);
+
+	return 0;
+}
+
+static inline bool IsIntegerUnit(Token *field, uint32_t unit) {
+	return unit < field->Field.UnitCount && field->Field.Units[unit].BitWidth <= 64;
+}
+
+int ReadFieldUnits(Token *field, const uint32_t *units, uint64_t *values, size_t count) {
+	if (field->Field.Region == NULL) return -1;
+
+	FieldBatch batch;
+	InitBatch(&batch, field);
+
+	for (size_t i = 0; i < count; ++i) {
+		if (!IsIntegerUnit(field, units[i])) return -1;
+
+		uint8_t bytes[8];
+		ReadUnit(&batch, field, units[i], bytes);
+		values[i] = GetBits(bytes, (field->Field.Units[units[i]].BitWidth + 7) / 8, 0, 64);
+	}
+
+	return 0;
+}
+
+int WriteFieldUnits(Token *field, const uint32_t *units, const uint64_t *values, size_t count) {
+	if (field->Field.Region == NULL) return -1;
+
+	/* Checked up front, nothing is written when one of them is bad */
+	for (size_t i = 0; i < count; ++i) {
+		if (!IsIntegerUnit(field, units[i])) return -1;
+	}
+
+	FieldWriteBatch batch;
+	InitWriteBatch(&batch);
+
+	for (size_t i = 0; i < count; ++i) {
+		uint8_t bytes[8] = { 0 };
+		PutBits(bytes, 0, 64, values[i]);
+		QueueWrite(&batch, field, units[i], bytes, 8);
+	}
+
+	FlushWrites(&batch);
+
+	return 0;
+}
+
+int ReadFieldUnit(Token *field, uint32_t unit, uint64_t *value) {
+	return ReadFieldUnits(field, &unit, value, 1);
+}
+
+int WriteFieldUnit(Token *field, uint32_t unit, uint64_t value) {
+	return WriteFieldUnits(field, &unit, &value, 1);
+}
+
+int ReadFieldUnitBytes(Token *field, uint32_t unit, uint8_t *bytes) {
+	if (field->Field.Region == NULL) return -1;
+
+	FieldBatch batch;
+	InitBatch(&batch, field);
+
+	return ReadUnit(&batch, field, unit, bytes);
+}
+
+int WriteFieldUnitBytes(Token *field, uint32_t unit, const uint8_t *bytes, size_t size) {
+	if (field->Field.Region == NULL) return -1;
+
+	FieldWriteBatch batch;
+	InitWriteBatch(&batch);
+
+	int error = QueueWrite(&batch, field, unit, bytes, size);
+	FlushWrites(&batch);
+
+	return error;
+}
+
+void GetFieldAccessStats(AML_FieldAccessStats *stats) {
+	stats->UnitReads = __atomic_load_n(&FieldStats.UnitReads, __ATOMIC_RELAXED);
+	stats->UnitWrites = __atomic_load_n(&FieldStats.UnitWrites, __ATOMIC_RELAXED);
+	stats->HardwareReads = __atomic_load_n(&FieldStats.HardwareReads, __ATOMIC_RELAXED);
+	stats->HardwareWrites = __atomic_load_n(&FieldStats.HardwareWrites, __ATOMIC_RELAXED);
+	stats->AccessesSaved = __atomic_load_n(&FieldStats.AccessesSaved, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+struct Token;
+struct AmlCursor;
+
+struct AML_FieldUnit {
+	char Name[4];
+
+	/* Resolved once when the field list is parsed */
+	uint32_t BitOffset;
+	uint32_t BitWidth;
+	uint8_t AccessWidth;
+};
+
+struct AML_FieldAccessStats {
+	uint64_t UnitReads;
+	uint64_t UnitWrites;
+
+	uint64_t HardwareReads;
+	uint64_t HardwareWrites;
+
+	/*
+	 * Accesses a unit-by-unit engine would have done, minus the ones we did.
+	 * Containers are only shared within one ReadFieldUnits or WriteFieldUnits
+	 * call, AML reads and stores cover a single unit and save nothing. In
+	 * practice this counts the writes WriteFieldUnits merges.
+	 */
+	uint64_t AccessesSaved;
+};
+
+size_t HandleFieldList(AML_FieldUnit **units, uint8_t fieldFlags, AmlCursor *cursor, uint8_t *end);
+
+AML_FieldUnit *FindFieldUnit(Token *field, const char *name, uint32_t *index);
+
+/* Integer forms, units wider than 64 bits are refused */
+int ReadFieldUnits(Token *field, const uint32_t *units, uint64_t *values, size_t count);
+int WriteFieldUnits(Token *field, const uint32_t *units, const uint64_t *values, size_t count);
+int ReadFieldUnit(Token *field, uint32_t unit, uint64_t *value);
+int WriteFieldUnit(Token *field, uint32_t unit, uint64_t value);
+
+/* Any width, bytes holds (BitWidth + 7) / 8 of them, least significant first */
+int ReadFieldUnitBytes(Token *field, uint32_t unit, uint8_t *bytes);
+/* Bytes past size write zeroes */
+int WriteFieldUnitBytes(Token *field, uint32_t unit, const uint8_t *bytes, size_t size);
+
+void GetFieldAccessStats(AML_FieldAccessStats *stats);
@@ -0,0 +1,251 @@
+#include "gas.h"
+#include "region.h"
+
+struct GAS_Accessors {
+	GAS_ReadFunction DirectRead;
+	GAS_WriteFunction DirectWrite;
+	GAS_ReadFunction ShiftedRead;
+	GAS_WriteFunction ShiftedWrite;
+	GAS_WriteFunction ClearWrite;
+};
+
+#define GAS_ACCESSORS(space, width) \
+	{ GASDirectRead<space, width>, GASDirectWrite<space, width>, GASShiftedRead<space, width>, GASShiftedWrite<space, width>, \
+	  GASClearWrite<space, width> }
+
+/* Indexed by log2(width / 8) */
+static const GAS_Accessors MemoryAccessors[4] = {
+	GAS_ACCESSORS(AML_REGION_SYSTEM_MEMORY, 8),
+	GAS_ACCESSORS(AML_REGION_SYSTEM_MEMORY, 16),
+	GAS_ACCESSORS(AML_REGION_SYSTEM_MEMORY, 32),
+	GAS_ACCESSORS(AML_REGION_SYSTEM_MEMORY, 64),
+};
+
+static const GAS_Accessors IOAccessors[3] = {
+	GAS_ACCESSORS(AML_REGION_SYSTEM_IO, 8),
+	GAS_ACCESSORS(AML_REGION_SYSTEM_IO, 16),
+	GAS_ACCESSORS(AML_REGION_SYSTEM_IO, 32),
+};
+
+/* FADT fields */
+#define FADT_PM_TIMER_LENGTH 4
+
+static inline uint64_t BitMask(uint32_t bits) {
+	return bits >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1;
+}
+
+static uint64_t InvalidRead(const GAS_Register*) {
+	return 0;
+}
+
+static void InvalidWrite(const GAS_Register*, uint64_t) {
+}
+
+/*
+ * Other spaces, or registers spanning several access units, one unit at a time.
+ * Registers are at most 64 bits, blocks like GPE are split into bytes first.
+ */
+static uint64_t GenericRead(const GAS_Register *reg) {
+	uint32_t bits = reg->BitOffset + reg->BitWidth;
+	uint64_t value = 0;
+
+	for (uint32_t done = 0; done < bits && done < 64; done += reg->AccessWidth) {
+		value |= RegionRead(reg->Space, reg->Address + done / 8, reg->AccessWidth) << done;
+	}
+
+	return (value >> reg->BitOffset) & reg->Mask;
+}
+
+static void GenericWrite(const GAS_Register *reg, uint64_t value) {
+	uint32_t bits = reg->BitOffset + reg->BitWidth;
+	value = (value & reg->Mask) << reg->BitOffset;
+
+	for (uint32_t done = 0; done < bits && done < 64; done += reg->AccessWidth) {
+		uint64_t unitMask = BitMask(reg->AccessWidth) << done;
+		uint64_t registerMask = (reg->Mask << reg->BitOffset) & unitMask;
+		uint64_t unit = (value & unitMask) >> done;
+
+		/* Units only partly covered by the register keep their other bits, status bits are left at zero */
+		if (registerMask != unitMask && !reg->WriteClear) {
+			uint64_t old = RegionRead(reg->Space, reg->Address + done / 8, reg->AccessWidth);
+			unit |= old & ~(registerMask >> done);
+		}
+
+		RegionWrite(reg->Space, reg->Address + done / 8, unit, reg->AccessWidth);
+	}
+}
+
+static uint8_t WidthIndex(uint8_t width) {
+	switch (width) {
+		case 8:
+			return 0;
+		case 16:
+			return 1;
+		case 32:
+			return 2;
+		default:
+			return 3;
+	}
+}
+
+static void SelectAccessors(GAS_Register *reg) {
+	reg->Read = GenericRead;
+	reg->Write = GenericWrite;
+	reg->Mask = BitMask(reg->BitWidth);
+	reg->Mapped = reg->Address;
+
+	if (!reg->Valid) {
+		reg->Read = InvalidRead;
+		reg->Write = InvalidWrite;
+		return;
+	}
+
+	/* Anything that doesn't fit one unit keeps the generic path */
+	if (reg->BitOffset + reg->BitWidth > reg->AccessWidth) return;
+
+	const GAS_Accessors *accessors = NULL;
+	uint8_t index = WidthIndex(reg->AccessWidth);
+
+	if (reg->Space == AML_REGION_SYSTEM_MEMORY) {
+		accessors = &MemoryAccessors[index];
+		reg->Mapped = reg->Address + HIGHER_HALF;
+	} else if (reg->Space == AML_REGION_SYSTEM_IO && index < 3) {
+		accessors = &IOAccessors[index];
+	}
+
+	if (accessors == NULL) return;
+
+	bool whole = reg->BitOffset == 0 && reg->BitWidth == reg->AccessWidth;
+	reg->Read = whole ? accessors->DirectRead : accessors->ShiftedRead;
+	reg->Write = whole ? accessors->DirectWrite : reg->WriteClear ? accessors->ClearWrite : accessors->ShiftedWrite;
+}
+
+/* Rounds up to the next width an access can have */
+static uint8_t AccessWidthFor(uint32_t bits) {
+	if (bits <= 8) return 8;
+	if (bits <= 16) return 16;
+	if (bits <= 32) return 32;
+	return 64;
+}
+
+void ResolveGAS(GAS_Register *reg, volatile GenericAddressStructure *gas) {
+	reg->Valid = gas->Address != 0 && gas->BitWidth != 0;
+	reg->WriteClear = false;
+	reg->Space = gas->AddressSpace;
+	reg->Address = gas->Address;
+	reg->BitOffset = gas->BitOffset;
+	reg->BitWidth = gas->BitWidth;
+
+	/* AccessSize 1 to 4 is byte to qword, 0 leaves it to the register's size */
+	if (gas->AccessSize >= 1 && gas->AccessSize <= 4) reg->AccessWidth = 8 << (gas->AccessSize - 1);
+	else reg->AccessWidth = AccessWidthFor(gas->BitOffset + gas->BitWidth);
+
+	SelectAccessors(reg);
+}
+
+void ResolveLegacyGAS(GAS_Register *reg, uint32_t port, uint8_t length) {
+	reg->Valid = port != 0 && length != 0;
+	reg->WriteClear = false;
+	reg->Space = AML_REGION_SYSTEM_IO;
+	reg->Address = port;
+	reg->BitOffset = 0;
+	reg->BitWidth = length * 8;
+	reg->AccessWidth = AccessWidthFor(reg->BitWidth);
+
+	/* Blocks wider than a port go byte by byte */
+	if (reg->AccessWidth > 32) reg->AccessWidth = 8;
+
+	SelectAccessors(reg);
+}
+
+void ResolveGASSlice(GAS_Register *slice, const GAS_Register *block, uint32_t byteOffset, uint8_t bitWidth) {
+	slice->Valid = block->Valid;
+	slice->WriteClear = false;
+	slice->Space = block->Space;
+	slice->Address = block->Address + byteOffset;
+	slice->BitOffset = 0;
+	slice->BitWidth = bitWidth;
+	slice->AccessWidth = block->AccessWidth < bitWidth ? block->AccessWidth : AccessWidthFor(bitWidth);
+
+	SelectAccessors(slice);
+}
+
+void MarkWriteClear(GAS_Register *reg) {
+	reg->WriteClear = true;
+	SelectAccessors(reg);
+}
+
+static void ResolveFixed(GAS_Register *reg, volatile GenericAddressStructure *extended, bool hasExtended, uint32_t port, uint8_t length) {
+	if (hasExtended && extended->Address != 0) ResolveGAS(reg, extended);
+	else ResolveLegacyGAS(reg, port, length);
+}
+
+/* Byte by byte as the spec requires, the status bytes first and the enable bytes after them */
+static void ResolveGPEBlock(ACPI_GPEBlock *gpe, volatile GenericAddressStructure *extended, bool hasExtended, uint32_t port, uint8_t length) {
+	GAS_Register block;
+	ResolveFixed(&block, extended, hasExtended, port, length);
+
+	/* A GAS bit width cannot describe blocks past 31 bytes, the FADT length is what counts */
+	block.Valid = block.Address != 0 && length != 0;
+
+	gpe->Count = block.Valid ? length / 2 : 0;
+	gpe->Status = NULL;
+	gpe->Enable = NULL;
+	if (gpe->Count == 0) return;
+
+	gpe->Status = new GAS_Register[gpe->Count];
+	gpe->Enable = new GAS_Register[gpe->Count];
+
+	for (uint8_t i = 0; i < gpe->Count; ++i) {
+		ResolveGASSlice(&gpe->Status[i], &block, i, 8);
+		MarkWriteClear(&gpe->Status[i]);
+		ResolveGASSlice(&gpe->Enable[i], &block, gpe->Count + i, 8);
+	}
+}
+
+ACPI_FixedRegisters *CreateFixedRegisters(volatile FADTTable *fadt) {
+	ACPI_FixedRegisters *registers = new ACPI_FixedRegisters;
+
+	/* ACPI 1.0 tables end before the extended blocks */
+	bool hasExtended = fadt->Header.Length >= __builtin_offsetof(FADTTable, X_GPE1Block) + sizeof(GenericAddressStructure);
+
+	GAS_Register pm1a, pm1b;
+	ResolveFixed(&pm1a, &fadt->X_PM1aEventBlock, hasExtended, fadt->PM1aEventBlock, fadt->PM1EventLength);
+	ResolveFixed(&pm1b, &fadt->X_PM1bEventBlock, hasExtended, fadt->PM1bEventBlock, fadt->PM1EventLength);
+
+	/* Event blocks are the status register followed by the enable register */
+	uint8_t half = fadt->PM1EventLength / 2;
+	ResolveGASSlice(&registers->PM1aStatus, &pm1a, 0, half * 8);
+	ResolveGASSlice(&registers->PM1aEnable, &pm1a, half, half * 8);
+	ResolveGASSlice(&registers->PM1bStatus, &pm1b, 0, half * 8);
+	ResolveGASSlice(&registers->PM1bEnable, &pm1b, half, half * 8);
+	MarkWriteClear(&registers->PM1aStatus);
+	MarkWriteClear(&registers->PM1bStatus);
+
+	ResolveFixed(&registers->PM1aControl, &fadt->X_PM1aControlBlock, hasExtended, fadt->PM1aControlBlock, fadt->PM1ControlLength);
+	ResolveFixed(&registers->PM1bControl, &fadt->X_PM1bControlBlock, hasExtended, fadt->PM1bControlBlock, fadt->PM1ControlLength);
+	ResolveFixed(&registers->PMTimer, &fadt->X_PMTimerBlock, hasExtended, fadt->PMTimerBlock, FADT_PM_TIMER_LENGTH);
+	ResolveGPEBlock(&registers->GPE0, &fadt->X_GPE0Block, hasExtended, fadt->GPE0Block, fadt->GPE0Length);
+	ResolveGPEBlock(&registers->GPE1, &fadt->X_GPE1Block, hasExtended, fadt->GPE1Block, fadt->GPE1Length);
+
+	/* The reset register only exists from ACPI 2.0 on */
+	bool hasReset = fadt->Header.Length >= __builtin_offsetof(FADTTable, ResetValue) + 1;
+	if (hasReset) {
+		ResolveGAS(&registers->Reset, &fadt->ResetReg);
+	} else {
+		registers->Reset.Valid = false;
+		registers->Reset.WriteClear = false;
+		SelectAccessors(&registers->Reset);
+	}
+
+	return registers;
+}
+
+void DeleteFixedRegisters(ACPI_FixedRegisters *registers) {
+	delete[] registers->GPE0.Status;
+	delete[] registers->GPE0.Enable;
+	delete[] registers->GPE1.Status;
+	delete[] registers->GPE1.Enable;
+
+	delete registers;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include <mkmi.h>
+
+#include "acpi.h"
+#include "aml_opcodes.h"
+
+struct GAS_Register;
+
+typedef uint64_t (*GAS_ReadFunction)(const GAS_Register *reg);
+typedef void (*GAS_WriteFunction)(const GAS_Register *reg, uint64_t value);
+
+/*
+ * A GenericAddressStructure resolved once. Read and Write point at an
+ * instantiation specialized on space and access width, so an access is a
+ * single port or MMIO operation without looking at the fields again.
+ */
+struct GAS_Register {
+	bool Valid;
+
+	uint8_t Space;
+	/* In bits, like the region handlers */
+	uint8_t AccessWidth;
+	uint8_t BitOffset;
+	uint8_t BitWidth;
+	uint64_t Mask;
+	/* Status bits clear when written as one, writes must not carry the others back */
+	bool WriteClear;
+
+	uint64_t Address;
+	/* What the specialized accessors use, physical memory is already mapped */
+	uintptr_t Mapped;
+
+	GAS_ReadFunction Read;
+	GAS_WriteFunction Write;
+};
+
+/* One register per byte of each half, GPE n is bit n % 8 of byte n / 8. See ACPI spec section 4.8.4.1 */
+struct ACPI_GPEBlock {
+	uint8_t Count;
+	GAS_Register *Status;
+	GAS_Register *Enable;
+};
+
+/* The fixed hardware registers from the FADT */
+struct ACPI_FixedRegisters {
+	GAS_Register PM1aStatus;
+	GAS_Register PM1bStatus;
+	GAS_Register PM1aEnable;
+	GAS_Register PM1bEnable;
+	GAS_Register PM1aControl;
+	GAS_Register PM1bControl;
+	GAS_Register PMTimer;
+	ACPI_GPEBlock GPE0;
+	ACPI_GPEBlock GPE1;
+	GAS_Register Reset;
+};
+
+template<uint8_t Width> struct GAS_Word;
+template<> struct GAS_Word<8> { typedef uint8_t Type; };
+template<> struct GAS_Word<16> { typedef uint16_t Type; };
+template<> struct GAS_Word<32> { typedef uint32_t Type; };
+template<> struct GAS_Word<64> { typedef uint64_t Type; };
+
+template<uint8_t Space, uint8_t Width> struct GAS_Space;
+
+template<uint8_t Width> struct GAS_Space<AML_REGION_SYSTEM_MEMORY, Width> {
+	static inline uint64_t Read(uintptr_t address) {
+		return *(volatile typename GAS_Word<Width>::Type*)address;
+	}
+
+	static inline void Write(uintptr_t address, uint64_t value) {
+		*(volatile typename GAS_Word<Width>::Type*)address = value;
+	}
+};
+
+/* Ports go up to 32 bits, wider registers take the generic path */
+template<uint8_t Width> struct GAS_Space<AML_REGION_SYSTEM_IO, Width> {
+	static inline uint64_t Read(uintptr_t address) {
+		return InPort(address, Width);
+	}
+
+	static inline void Write(uintptr_t address, uint64_t value) {
+		OutPort(address, value, Width);
+	}
+};
+
+/* The register is exactly one access unit */
+template<uint8_t Space, uint8_t Width> uint64_t GASDirectRead(const GAS_Register *reg) {
+	return GAS_Space<Space, Width>::Read(reg->Mapped);
+}
+
+template<uint8_t Space, uint8_t Width> void GASDirectWrite(const GAS_Register *reg, uint64_t value) {
+	GAS_Space<Space, Width>::Write(reg->Mapped, value);
+}
+
+/* The register sits inside one access unit at an odd bit offset, writes keep the bits around it */
+template<uint8_t Space, uint8_t Width> uint64_t GASShiftedRead(const GAS_Register *reg) {
+	return (GAS_Space<Space, Width>::Read(reg->Mapped) >> reg->BitOffset) & reg->Mask;
+}
+
+template<uint8_t Space, uint8_t Width> void GASShiftedWrite(const GAS_Register *reg, uint64_t value) {
+	uint64_t unit = GAS_Space<Space, Width>::Read(reg->Mapped);
+	unit &= ~(reg->Mask << reg->BitOffset);
+	unit |= (value & reg->Mask) << reg->BitOffset;
+	GAS_Space<Space, Width>::Write(reg->Mapped, unit);
+}
+
+/* The same for status registers, zeroes leave the bits around it alone */
+template<uint8_t Space, uint8_t Width> void GASClearWrite(const GAS_Register *reg, uint64_t value) {
+	GAS_Space<Space, Width>::Write(reg->Mapped, (value & reg->Mask) << reg->BitOffset);
+}
+
+/* Invalid registers read as zero and ignore writes, callers need not check */
+static inline uint64_t ReadGAS(const GAS_Register *reg) {
+	return reg->Read(reg);
+}
+
+static inline void WriteGAS(const GAS_Register *reg, uint64_t value) {
+	reg->Write(reg, value);
+}
+
+void ResolveGAS(GAS_Register *reg, volatile GenericAddressStructure *gas);
+/* Pre-ACPI 2.0 blocks, a port and a length in bytes */
+void ResolveLegacyGAS(GAS_Register *reg, uint32_t port, uint8_t length);
+/* Part of a register block, e.g. the enable half of PM1 or one GPE byte */
+void ResolveGASSlice(GAS_Register *slice, const GAS_Register *block, uint32_t byteOffset, uint8_t bitWidth);
+/* Makes writes to a status register touch only the bits being cleared */
+void MarkWriteClear(GAS_Register *reg);
+
+ACPI_FixedRegisters *CreateFixedRegisters(volatile FADTTable *fadt);
+void DeleteFixedRegisters(ACPI_FixedRegisters *registers);
@@ -0,0 +1,205 @@
+#include "hpet.h"
+#include "aml_opcodes.h"
+
+#include <mkmi.h>
+
+#define FEMTOSECONDS_PER_NS 1000000ull
+#define FEMTOSECONDS_PER_SECOND 1000000000000000ull
+
+HPET_Clock *CreateHPETClock(HPETTable *hpet) {
+	if (hpet->Address.AddressSpace != AML_REGION_SYSTEM_MEMORY || hpet->Address.Address == 0) return NULL;
+
+	HPET_Clock *clock = new HPET_Clock;
+	clock->Registers = hpet->Address.Address + HIGHER_HALF;
+
+	uint64_t capabilities = ReadHPETRegister(clock, HPET_CAPABILITIES);
+
+	clock->Period = capabilities >> 32;
+	if (clock->Period == 0) {
+		delete clock;
+		return NULL;
+	}
+
+	clock->Frequency = FEMTOSECONDS_PER_SECOND / clock->Period;
+
+	/*
+	 * Both directions are worked out once, conversions are then a multiply and a shift.
+	 * Period is 32 bits and a nanosecond 2^20 femtoseconds at most, so both dividends
+	 * fit in 64 bits and no 128 bit division helper gets pulled in.
+	 */
+	clock->Multiplier = ((uint64_t)clock->Period << HPET_SHIFT) / FEMTOSECONDS_PER_NS;
+	clock->InverseMultiplier = (FEMTOSECONDS_PER_NS << HPET_SHIFT) / clock->Period;
+
+	clock->Is64Bit = capabilities & HPET_CAP_COUNTER_64;
+	clock->Last = 0;
+	clock->MinimumTick = hpet->MinimumTick;
+	clock->ComparatorCount = ((capabilities >> 8) & 0x1F) + 1;
+	clock->PeriodicMask = 0;
+	clock->Allocated = 0;
+
+	for (uint8_t i = 0; i < clock->ComparatorCount; ++i) {
+		uint64_t config = ReadHPETRegister(clock, HPET_TIMER_CONFIGURATION(i));
+		if (config & HPET_TIMER_PERIODIC_CAPABLE) clock->PeriodicMask |= 1u << i;
+
+		/* Start with every comparator quiet */
+		WriteHPETRegister(clock, HPET_TIMER_CONFIGURATION(i), config & ~(HPET_TIMER_ENABLE | HPET_TIMER_PERIODIC));
+	}
+
+	uint64_t config = ReadHPETRegister(clock, HPET_CONFIGURATION);
+	WriteHPETRegister(clock, HPET_CONFIGURATION, config | HPET_CONFIG_ENABLE);
+
+	/* A 32 bit counter may be well past zero by now, the first reads extend from here */
+	if (!clock->Is64Bit) clock->Last = (uint32_t)ReadHPETRegister(clock, HPET_MAIN_COUNTER);
+
+	return clock;
+}
+
+void DeleteHPETClock(HPET_Clock *clock) {
+	delete clock;
+}
+
+/*
+ * Lock-free, the counter is assumed to be read at least every 2^31 ticks.
+ * A reader whose sample is older than Last returns Last instead of taking
+ * the difference for a wrap.
+ */
+uint64_t ExtendHPETCounter(HPET_Clock *clock, uint32_t counter) {
+	uint64_t last = __atomic_load_n(&clock->Last, __ATOMIC_ACQUIRE);
+
+	while (true) {
+		if ((uint32_t)((uint32_t)last - counter) < 0x80000000u) return last;
+
+		uint64_t now = (last & ~0xFFFFFFFFull) | counter;
+		if (now < last) now += 1ull << 32;
+
+		if (__atomic_compare_exchange_n(&clock->Last, &last, now, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return now;
+	}
+}
+
+int AllocateHPETComparator(HPET_Clock *clock, bool periodic) {
+	uint32_t allocated = __atomic_load_n(&clock->Allocated, __ATOMIC_RELAXED);
+
+	while (true) {
+		uint32_t candidates = ~allocated;
+		if (clock->ComparatorCount < 32) candidates &= (1u << clock->ComparatorCount) - 1;
+		if (periodic) candidates &= clock->PeriodicMask;
+
+		if (candidates == 0) return -1;
+
+		/* Non periodic requests take comparators periodic ones cannot use first */
+		uint32_t preferred = periodic ? candidates : candidates & ~clock->PeriodicMask;
+		uint8_t comparator = __builtin_ctz(preferred != 0 ? preferred : candidates);
+
+		if (__atomic_compare_exchange_n(&clock->Allocated, &allocated, allocated | (1u << comparator),
+						false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			return comparator;
+		}
+	}
+}
+
+/* Left quiet for the next owner: disarmed, edge triggered and nothing pending */
+void ReleaseHPETComparator(HPET_Clock *clock, uint8_t comparator) {
+	DisarmHPETComparator(clock, comparator);
+
+	if (comparator < clock->ComparatorCount) {
+		uint64_t config = ReadHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator));
+		WriteHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator), config & ~HPET_TIMER_LEVEL);
+		TestHPETStatus(clock, comparator);
+	}
+
+	__atomic_and_fetch(&clock->Allocated, ~(1u << comparator), __ATOMIC_RELEASE);
+}
+
+uint32_t GetHPETComparatorRoutes(HPET_Clock *clock, uint8_t comparator) {
+	if (comparator >= clock->ComparatorCount) return 0;
+
+	return ReadHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator)) >> 32;
+}
+
+bool RouteHPETComparator(HPET_Clock *clock, uint8_t comparator, uint8_t irq, bool level) {
+	if (irq >= 32 || !(GetHPETComparatorRoutes(clock, comparator) & (1u << irq))) return false;
+
+	uint64_t config = ReadHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator));
+	config &= ~(HPET_TIMER_ROUTE_MASK | HPET_TIMER_LEVEL);
+	config |= (uint64_t)irq << HPET_TIMER_ROUTE_SHIFT;
+	if (level) config |= HPET_TIMER_LEVEL;
+
+	WriteHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator), config);
+
+	return true;
+}
+
+void ArmHPETOneShot(HPET_Clock *clock, uint8_t comparator, uint64_t ns) {
+	if (comparator >= clock->ComparatorCount) return;
+
+	uint64_t ticks = HPETNsToTicks(clock, ns);
+	if (ticks < clock->MinimumTick) ticks = clock->MinimumTick;
+
+	uint64_t config = ReadHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator));
+	config &= ~HPET_TIMER_PERIODIC;
+	config |= HPET_TIMER_ENABLE;
+
+	WriteHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator), config);
+	WriteHPETRegister(clock, HPET_TIMER_COMPARATOR(comparator), ReadHPETRegister(clock, HPET_MAIN_COUNTER) + ticks);
+}
+
+void ArmHPETStatus(HPET_Clock *clock, uint8_t comparator, uint64_t ns) {
+	if (comparator >= clock->ComparatorCount) return;
+
+	uint64_t ticks = HPETNsToTicks(clock, ns);
+	if (ticks < clock->MinimumTick) ticks = clock->MinimumTick;
+
+	/* The new value goes in first, a match against the old one would set the bit early */
+	WriteHPETRegister(clock, HPET_TIMER_COMPARATOR(comparator), ReadHPETRegister(clock, HPET_MAIN_COUNTER) + ticks);
+
+	uint64_t config = ReadHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator));
+	config &= ~(HPET_TIMER_ENABLE | HPET_TIMER_PERIODIC);
+	config |= HPET_TIMER_LEVEL;
+
+	WriteHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator), config);
+	TestHPETStatus(clock, comparator);
+}
+
+/* The status register is write one to clear, the other comparators' bits are written as zero */
+bool TestHPETStatus(HPET_Clock *clock, uint8_t comparator) {
+	uint64_t bit = 1ull << comparator;
+	if (!(ReadHPETRegister(clock, HPET_INTERRUPT_STATUS) & bit)) return false;
+
+	WriteHPETRegister(clock, HPET_INTERRUPT_STATUS, bit);
+
+	return true;
+}
+
+bool HPETComparatorPassed(HPET_Clock *clock, uint8_t comparator) {
+	uint64_t config = ReadHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator));
+	uint64_t value = ReadHPETRegister(clock, HPET_TIMER_COMPARATOR(comparator));
+	uint64_t counter = ReadHPETRegister(clock, HPET_MAIN_COUNTER);
+
+	if (!clock->Is64Bit || !(config & HPET_TIMER_64_CAPABLE)) return (int32_t)((uint32_t)counter - (uint32_t)value) >= 0;
+
+	return (int64_t)(counter - value) >= 0;
+}
+
+bool ArmHPETPeriodic(HPET_Clock *clock, uint8_t comparator, uint64_t ns) {
+	if (comparator >= clock->ComparatorCount || !(clock->PeriodicMask & (1u << comparator))) return false;
+
+	uint64_t ticks = HPETNsToTicks(clock, ns);
+	if (ticks < clock->MinimumTick) ticks = clock->MinimumTick;
+
+	uint64_t config = ReadHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator));
+	config |= HPET_TIMER_ENABLE | HPET_TIMER_PERIODIC | HPET_TIMER_VALUE_SET;
+
+	/* With VALUE_SET, the first write sets the comparator and the second the period */
+	WriteHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator), config);
+	WriteHPETRegister(clock, HPET_TIMER_COMPARATOR(comparator), ReadHPETRegister(clock, HPET_MAIN_COUNTER) + ticks);
+	WriteHPETRegister(clock, HPET_TIMER_COMPARATOR(comparator), ticks);
+
+	return true;
+}
+
+void DisarmHPETComparator(HPET_Clock *clock, uint8_t comparator) {
+	if (comparator >= clock->ComparatorCount) return;
+
+	uint64_t config = ReadHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator));
+	WriteHPETRegister(clock, HPET_TIMER_CONFIGURATION(comparator), config & ~(HPET_TIMER_ENABLE | HPET_TIMER_PERIODIC));
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "acpi.h"
+
+#define HPET_MAX_COMPARATORS 32
+
+/* General registers, see the IA-PC HPET specification section 2.3 */
+#define HPET_CAPABILITIES 0x00
+#define HPET_CONFIGURATION 0x10
+#define HPET_INTERRUPT_STATUS 0x20
+#define HPET_MAIN_COUNTER 0xF0
+
+#define HPET_CAP_COUNTER_64 (1 << 13)
+#define HPET_CAP_LEGACY_ROUTE (1 << 15)
+#define HPET_CONFIG_ENABLE (1 << 0)
+
+/* Per comparator registers */
+#define HPET_TIMER_CONFIGURATION(n) (0x100 + 0x20 * (n))
+#define HPET_TIMER_COMPARATOR(n) (0x108 + 0x20 * (n))
+
+#define HPET_TIMER_LEVEL (1 << 1)
+#define HPET_TIMER_ENABLE (1 << 2)
+#define HPET_TIMER_PERIODIC (1 << 3)
+#define HPET_TIMER_PERIODIC_CAPABLE (1 << 4)
+#define HPET_TIMER_64_CAPABLE (1 << 5)
+#define HPET_TIMER_VALUE_SET (1 << 6)
+#define HPET_TIMER_ROUTE_SHIFT 9
+#define HPET_TIMER_ROUTE_MASK (0x1F << HPET_TIMER_ROUTE_SHIFT)
+
+/* The fixed point scale of the tick to nanosecond multiplier */
+#define HPET_SHIFT 32
+
+struct HPETTable {
+	SDTHeader Header;
+
+	uint32_t EventTimerBlockID;
+	GenericAddressStructure Address;
+	uint8_t HPETNumber;
+	uint16_t MinimumTick;
+	uint8_t PageProtection;
+}__attribute__((packed));
+
+struct HPET_Clock {
+	uintptr_t Registers;
+
+	/* Femtoseconds per tick, as reported by the capabilities register */
+	uint32_t Period;
+	uint64_t Frequency;
+
+	/* ns = (ticks * Multiplier) >> HPET_SHIFT, ticks = (ns * InverseMultiplier) >> HPET_SHIFT */
+	uint64_t Multiplier;
+	uint64_t InverseMultiplier;
+
+	bool Is64Bit;
+	/* Last value seen from a 32 bit counter, extended to 64 bits */
+	uint64_t Last;
+
+	uint16_t MinimumTick;
+	uint8_t ComparatorCount;
+	uint32_t PeriodicMask;
+	uint32_t Allocated;
+};
+
+HPET_Clock *CreateHPETClock(HPETTable *hpet);
+void DeleteHPETClock(HPET_Clock *clock);
+
+static inline uint64_t ReadHPETRegister(HPET_Clock *clock, uint32_t offset) {
+	return *(volatile uint64_t*)(clock->Registers + offset);
+}
+
+static inline void WriteHPETRegister(HPET_Clock *clock, uint32_t offset, uint64_t value) {
+	*(volatile uint64_t*)(clock->Registers + offset) = value;
+}
+
+uint64_t ExtendHPETCounter(HPET_Clock *clock, uint32_t counter);
+
+/* Monotonic, a single MMIO load on 64 bit counters */
+static inline uint64_t ReadHPETCounter(HPET_Clock *clock) {
+	uint64_t counter = ReadHPETRegister(clock, HPET_MAIN_COUNTER);
+	if (__builtin_expect(clock->Is64Bit, 1)) return counter;
+
+	return ExtendHPETCounter(clock, counter);
+}
+
+static inline uint64_t HPETTicksToNs(HPET_Clock *clock, uint64_t ticks) {
+	return ((unsigned __int128)ticks * clock->Multiplier) >> HPET_SHIFT;
+}
+
+static inline uint64_t HPETNsToTicks(HPET_Clock *clock, uint64_t ns) {
+	return ((unsigned __int128)ns * clock->InverseMultiplier) >> HPET_SHIFT;
+}
+
+static inline uint64_t ReadHPETNanoseconds(HPET_Clock *clock) {
+	return HPETTicksToNs(clock, ReadHPETCounter(clock));
+}
+
+int AllocateHPETComparator(HPET_Clock *clock, bool periodic);
+void ReleaseHPETComparator(HPET_Clock *clock, uint8_t comparator);
+
+uint32_t GetHPETComparatorRoutes(HPET_Clock *clock, uint8_t comparator);
+bool RouteHPETComparator(HPET_Clock *clock, uint8_t comparator, uint8_t irq, bool level);
+
+void ArmHPETOneShot(HPET_Clock *clock, uint8_t comparator, uint64_t ns);
+/* Level triggered with the interrupt left off, going off only sets the comparator's status bit */
+void ArmHPETStatus(HPET_Clock *clock, uint8_t comparator, uint64_t ns);
+/* Clears the status bit when it was set */
+bool TestHPETStatus(HPET_Clock *clock, uint8_t comparator);
+/* Whether the main counter is at or past the comparator, across a wrap of 32 bit ones too */
+bool HPETComparatorPassed(HPET_Clock *clock, uint8_t comparator);
+bool ArmHPETPeriodic(HPET_Clock *clock, uint8_t comparator, uint64_t ns);
+void DisarmHPETComparator(HPET_Clock *clock, uint8_t comparator);
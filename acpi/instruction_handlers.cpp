@@ -4,186 +4,380 @@
 #include "instruction_hashmap.h"
 #include "token.h"
 #include "aml_opcodes.h"
+#include "field_access.h"
+#include "memory.h"
 
 #include <mkmi.h>
 
-inline PrintOpcodes(uint8_t *data, size_t idx) {
-	for (int i = -2; i < 40; i++) MKMI_Printf("0x%x ", data[idx + i]);
+static inline void PrintOpcodes(AmlCursor *cursor) {
+	for (uint8_t *byte = cursor->Position - 2; byte < cursor->Position + 40 && byte < cursor->End; byte++) MKMI_Printf("0x%x ", *byte);
 	MKMI_Printf("\r\n");
 }
 
-void HandleZeroOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandleZeroOp(AML_Hashmap*, TokenList *list, AmlCursor*) {
 	AddToken(list, ZERO);
 }
 
-void HandleOneOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandleOneOp(AML_Hashmap*, TokenList *list, AmlCursor*) {
 	AddToken(list, ONE);
 }
 
-void HandleAliasOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandleAliasOp(AML_Hashmap*, TokenList *list, AmlCursor *cursor) {
 	NameType nameOne, nameTwo;
 
-	HandleNameType(&nameOne, data, idx);
-	HandleNameType(&nameTwo, data, idx);
+	HandleNameType(&nameOne, cursor);
+	HandleNameType(&nameTwo, cursor);
 
 	AddToken(list, ALIAS, &nameOne, &nameTwo);
 }
 
-void HandleNameOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandleNameOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor) {
 	NameType name;
-	HandleNameType(&name, data, idx);
+	HandleNameType(&name, cursor);
 
 	TokenList *children = CreateTokenList();
-	ParseByte(children, hashmap, data, idx);
+	ParseByte(children, hashmap, cursor);
 
 	AddToken(list, NAME, &name, children);
 }
 
-void HandleIntegerOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandleIntegerOp(AML_Hashmap*, TokenList *list, AmlCursor *cursor) {
 	IntegerType integer;
-	HandleIntegerType(&integer, data, idx);
+	HandleIntegerType(&integer, CursorOpcode(cursor), cursor);
 	AddToken(list, INTEGER, &integer);
 }
 
-void HandleStringPrefix(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
-	const char *str = &data[*idx];
-	size_t len = 2; /* First char + '\0' */
+void HandleStringPrefix(AML_Hashmap*, TokenList *list, AmlCursor *cursor) {
+	const char *str = (char*)cursor->Position;
+
+	while(PeekByte(cursor) != '\0') cursor->Position++;
+	size_t len = (char*)cursor->Position - str + 1; /* Characters + '\0' */
+	CursorSkip(cursor, 1);
 
-	while(data[*idx] != '\0') { ++len; *idx += 1; }
-	
 	AddToken(list, STRING, str, len);
 }
 
-void HandleScopeOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandleScopeOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor) {
+	uint8_t *pkgStart = cursor->Position;
 	uint32_t pkgLength = 0;
-
-	int headerSize = HandlePkgLengthType((uint8_t*)&pkgLength, data, idx);
+	HandlePkgLengthType(&pkgLength, cursor);
+	uint8_t *end = PackageEnd(cursor, pkgStart, pkgLength);
 
 	NameType name;
-	HandleNameType(&name, data, idx);
-	headerSize += 4;
-/*
-	uintptr_t fieldsEnd = (pkgLength - headerSize) + *idx;
-	TokenList *children = CreateTokenList();
+	HandleNameType(&name, cursor);
 
-	while(*idx < fieldsEnd) {
-		ParseByte(children, hashmap, data, idx);
-	}*/
+	TokenList *children = ParseTermList(hashmap, cursor, end);
 
-	AddToken(list, SCOPE, &name, pkgLength);
+	AddToken(list, SCOPE, &name, pkgLength, children);
 }
 
-void HandleBufferOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandleBufferOp(AML_Hashmap*, TokenList *list, AmlCursor *cursor) {
+	uint8_t *pkgStart = cursor->Position;
 	uint32_t pkgLength = 0;
-	HandlePkgLengthType((uint8_t*)&pkgLength, data, idx);
+	HandlePkgLengthType(&pkgLength, cursor);
+	uint8_t *end = PackageEnd(cursor, pkgStart, pkgLength);
 
 	IntegerType bufferSize;
-	*idx+=1;
-	HandleIntegerType(&bufferSize, data, idx);
+	HandleIntegerType(&bufferSize, ReadByte(cursor), cursor);
+
+	/* The initializer may be shorter than the buffer, the rest reads as zero */
+	size_t initializer = cursor->Position < end ? end - cursor->Position : 0;
+	if (initializer > bufferSize.Data) initializer = bufferSize.Data;
 
-	uint8_t *byteList = Malloc(bufferSize.Data);
-	Memcpy(byteList, &data[*idx], bufferSize.Data);
-	*idx += bufferSize.Data;
+	uint8_t *byteList = (uint8_t*)AllocateMemory(ACPI_MEMORY_BUFFERS, bufferSize.Data);
+	Memcpy(byteList, cursor->Position, initializer);
+	for (size_t i = initializer; i < bufferSize.Data; ++i) byteList[i] = 0;
+	if (cursor->Position < end) cursor->Position = end;
 
 	AddToken(list, BUFFER, pkgLength, &bufferSize, byteList);
 }
 
-void HandlePackageOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandlePackageOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor) {
+	uint8_t *pkgStart = cursor->Position;
 	uint32_t pkgLength = 0;
-	HandlePkgLengthType((uint8_t*)&pkgLength, data, idx);
+	HandlePkgLengthType(&pkgLength, cursor);
+	uint8_t *end = PackageEnd(cursor, pkgStart, pkgLength);
 	
-	uint32_t numElements = 0;
-	numElements |= data[*idx];
-	*idx += 1;
+	uint32_t numElements = ReadByte(cursor);
 
 	TokenList *children = CreateTokenList();
 
-	for(int elementsParsed = 0; elementsParsed < numElements; elementsParsed++) {
-		ParseByte(children, hashmap, data, idx);
+	/* Elements past the initializers are left uninitialized */
+	for(uint32_t elementsParsed = 0; elementsParsed < numElements && cursor->Position < end; elementsParsed++) {
+		ParseByte(children, hashmap, cursor);
 	}
 
+	if (cursor->Position < end) cursor->Position = end;
+
 	AddToken(list, PACKAGE, pkgLength, numElements, children);
 
 }
 
-void HandleMethodOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandleMethodOp(AML_Hashmap*, TokenList *list, AmlCursor *cursor) {
+	uint8_t *pkgStart = cursor->Position;
 	uint32_t pkgLength = 0;
-	HandlePkgLengthType((uint8_t*)&pkgLength, data, idx);
+	HandlePkgLengthType(&pkgLength, cursor);
+	uint8_t *end = PackageEnd(cursor, pkgStart, pkgLength);
 
 	NameType name;
-	HandleNameType(&name, data, idx);
+	HandleNameType(&name, cursor);
+
+	uint32_t methodFlags = ReadByte(cursor);
+
+	/* The body is only parsed when the method gets executed */
+	uint8_t *body = cursor->Position;
+	uint32_t bodyLength = body < end ? end - body : 0;
+	if (cursor->Position < end) cursor->Position = end;
+
+	AddToken(list, METHOD, pkgLength, &name, methodFlags, body, bodyLength);
+}
 
-	uint32_t methodFlags = data[*idx];
-	*idx += 1;
+void HandleNotifyOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor) {
+	NameType object;
+	HandleNameType(&object, cursor);
+
+	TokenList *children = CreateTokenList();
+	ParseByte(children, hashmap, cursor);
+
+	AddToken(list, NOTIFY, &object, children);
+}
+
+void HandleOnesOp(AML_Hashmap*, TokenList *list, AmlCursor*) {
+	IntegerType integer;
+	integer.Data = ~0ull;
+	integer.Size = 8;
+	AddToken(list, INTEGER, &integer);
+}
+
+void HandleLocalOp(AML_Hashmap*, TokenList *list, AmlCursor *cursor) {
+	AddToken(list, LOCAL, CursorOpcode(cursor) - AML_LOCAL0_OP);
+}
 
-	AddToken(list, METHOD, pkgLength, &name, methodFlags);
+void HandleArgOp(AML_Hashmap*, TokenList *list, AmlCursor *cursor) {
+	AddToken(list, ARG, CursorOpcode(cursor) - AML_ARG0_OP);
 }
 
-void HandleExtendedOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
-	*idx += 1;
-	switch(data[*idx - 1]) {
+/* Operands of every opcode HandleOperationOp parses, targets included */
+static const struct {
+	uint8_t Opcode;
+	uint8_t Operands;
+} OperandCounts[] = {
+	{AML_STORE_OP, 2}, {AML_REFOF_OP, 1}, {AML_ADD_OP, 3}, {AML_CONCAT_OP, 3},
+	{AML_SUBTRACT_OP, 3}, {AML_INCREMENT_OP, 1}, {AML_DECREMENT_OP, 1}, {AML_MULTIPLY_OP, 3},
+	{AML_DIVIDE_OP, 4}, {AML_SHL_OP, 3}, {AML_SHR_OP, 3}, {AML_AND_OP, 3},
+	{AML_NAND_OP, 3}, {AML_OR_OP, 3}, {AML_NOR_OP, 3}, {AML_XOR_OP, 3},
+	{AML_NOT_OP, 2}, {AML_FINDSETLEFTBIT_OP, 2}, {AML_FINDSETRIGHTBIT_OP, 2}, {AML_DEREF_OP, 1},
+	{AML_CONCATRES_OP, 3}, {AML_MOD_OP, 3}, {AML_SIZEOF_OP, 1}, {AML_INDEX_OP, 3},
+	{AML_DWORDFIELD_OP, 3}, {AML_WORDFIELD_OP, 3}, {AML_BYTEFIELD_OP, 3}, {AML_BITFIELD_OP, 3},
+	{AML_OBJECTTYPE_OP, 1}, {AML_QWORDFIELD_OP, 3}, {AML_LAND_OP, 2}, {AML_LOR_OP, 2},
+	{AML_LNOT_OP, 1}, {AML_LEQUAL_OP, 2}, {AML_LGREATER_OP, 2}, {AML_LLESS_OP, 2},
+	{AML_TOBUFFER_OP, 2}, {AML_TODECIMALSTRING_OP, 2}, {AML_TOHEXSTRING_OP, 2}, {AML_TOINTEGER_OP, 2},
+	{AML_TOSTRING_OP, 3}, {AML_COPYOBJECT_OP, 2}, {AML_MID_OP, 4}, {AML_CONTINUE_OP, 0},
+	{AML_NOP_OP, 0}, {AML_RETURN_OP, 1}, {AML_BREAK_OP, 0}, {AML_BREAKPOINT_OP, 0},
+};
+
+static void ParseOperation(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor, uint16_t opcode, uint8_t operands) {
+	TokenList *children = CreateTokenList();
+
+	for (uint8_t i = 0; i < operands; ++i) {
+		ParseByte(children, hashmap, cursor);
+	}
+
+	AddToken(list, OPERATION, opcode, children);
+}
+
+void HandleOperationOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor) {
+	uint8_t opcode = CursorOpcode(cursor);
+
+	for (size_t i = 0; i < sizeof(OperandCounts) / sizeof(OperandCounts[0]); ++i) {
+		if (OperandCounts[i].Opcode == opcode) return ParseOperation(hashmap, list, cursor, opcode, OperandCounts[i].Operands);
+	}
+
+	AddToken(list, UNKNOWN, opcode);
+}
+
+void HandleControlOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor) {
+	uint8_t opcode = CursorOpcode(cursor);
+
+	uint8_t *pkgStart = cursor->Position;
+	uint32_t pkgLength = 0;
+	HandlePkgLengthType(&pkgLength, cursor);
+	uint8_t *end = PackageEnd(cursor, pkgStart, pkgLength);
+
+	/* Else has no predicate, it runs when the If right before it did not */
+	TokenList *predicate = CreateTokenList();
+	if (opcode != AML_ELSE_OP) ParseByte(predicate, hashmap, cursor);
+
+	TokenList *body = ParseTermList(hashmap, cursor, end);
+
+	AddToken(list, CONTROL, opcode, predicate, body);
+}
+
+void HandleExtendedOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor) {
+	switch(ReadByte(cursor)) {
+		case AML_CONDREF_OP:
+			ParseOperation(hashmap, list, cursor, AML_EXTENDED(AML_CONDREF_OP), 2);
+			break;
+		case AML_DEBUG_OP:
+			ParseOperation(hashmap, list, cursor, AML_EXTENDED(AML_DEBUG_OP), 0);
+			break;
+		case AML_REVISION_OP:
+			ParseOperation(hashmap, list, cursor, AML_EXTENDED(AML_REVISION_OP), 0);
+			break;
+		case AML_MUTEX:
+			HandleExtOpMutex(hashmap, list, cursor);
+			break;
+		case AML_ACQUIRE_OP:
+			HandleExtOpAcquire(hashmap, list, cursor);
+			break;
+		case AML_RELEASE_OP:
+		case AML_SLEEP_OP:
+		case AML_STALL_OP:
+		case AML_SIGNAL_OP:
+		case AML_RESET_OP:
+			ParseOperation(hashmap, list, cursor, AML_EXTENDED(CursorOpcode(cursor)), 1);
+			break;
+		case AML_WAIT_OP:
+			ParseOperation(hashmap, list, cursor, AML_EXTENDED(AML_WAIT_OP), 2);
+			break;
+		case AML_TIMER_OP:
+			ParseOperation(hashmap, list, cursor, AML_EXTENDED(AML_TIMER_OP), 0);
+			break;
+		case AML_LOAD_OP:
+			ParseOperation(hashmap, list, cursor, AML_EXTENDED(AML_LOAD_OP), 2);
+			break;
+		case AML_LOAD_TABLE_OP:
+			ParseOperation(hashmap, list, cursor, AML_EXTENDED(AML_LOAD_TABLE_OP), 6);
+			break;
+		case AML_UNLOAD_OP:
+			ParseOperation(hashmap, list, cursor, AML_EXTENDED(AML_UNLOAD_OP), 1);
+			break;
+		case AML_EVENT: {
+			NameType name;
+			HandleNameType(&name, cursor);
+			AddToken(list, EVENT, &name);
+			}
+			break;
 		case AML_OPREGION:
-			HandleExtOpRegion(hashmap, list, data, idx);
+			HandleExtOpRegion(hashmap, list, cursor);
 			break;
 		case AML_FIELD:
-			HandleExtOpField(hashmap, list, data, idx);
+			HandleExtOpField(hashmap, list, cursor);
+			break;
+		case AML_PROCESSOR:
+			HandleExtOpProcessor(hashmap, list, cursor);
 			break;
 		case AML_DEVICE:
-			HandleExtOpDevice(hashmap, list, data, idx);
+		case AML_THERMALZONE:
+			HandleExtOpDevice(hashmap, list, cursor);
 			break;
 		default:
-			uint32_t code = data[*idx - 1];
+			uint32_t code = CursorOpcode(cursor);
 			AddToken(list, UNKNOWN, code);
 			break;
 	}
 }
 
-void HandleExtOpRegion(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+static Token *FindRegion(TokenList *list, NameType *name) {
+	if (name->SegmentNumber == 0) return NULL;
+
+	const char *segment = &name->NameSegments[(name->SegmentNumber - 1) * 4];
+
+	for (Token *current = list->Head; current != NULL; current = current->Next) {
+		if (current->Type != REGION || current->Region.Name.SegmentNumber == 0) continue;
+
+		const char *regionSegment = &current->Region.Name.NameSegments[(current->Region.Name.SegmentNumber - 1) * 4];
+		if (Memcmp(regionSegment, segment, 4) == 0) return current;
+	}
+
+	return NULL;
+}
+
+void HandleExtOpMutex(AML_Hashmap*, TokenList *list, AmlCursor *cursor) {
 	NameType name;
-	HandleNameType(&name, data, idx);
-	uint32_t regionSpace = data[*idx];
-	*idx+=1;
+	HandleNameType(&name, cursor);
+	uint32_t syncFlags = ReadByte(cursor);
+
+	AddToken(list, MUTEX, &name, syncFlags);
+}
+
+void HandleExtOpAcquire(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor) {
+	TokenList *children = CreateTokenList();
+	ParseByte(children, hashmap, cursor);
+
+	/* The timeout is a raw WordData, not a term */
+	IntegerType timeout;
+	timeout.Data = ReadWord(cursor);
+	timeout.Size = 2;
+
+	AddToken(children, INTEGER, &timeout);
+	AddToken(list, OPERATION, AML_EXTENDED(AML_ACQUIRE_OP), children);
+}
+
+void HandleExtOpRegion(AML_Hashmap*, TokenList *list, AmlCursor *cursor) {
+	NameType name;
+	HandleNameType(&name, cursor);
+	uint32_t regionSpace = ReadByte(cursor);
 
 	IntegerType regionOffset, regionLen;
 	
-	*idx+=1;
-	HandleIntegerType(&regionOffset, data, idx);
-	*idx+=1;
-	HandleIntegerType(&regionLen, data, idx);
+	HandleIntegerType(&regionOffset, ReadByte(cursor), cursor);
+	HandleIntegerType(&regionLen, ReadByte(cursor), cursor);
 
 
 	AddToken(list, REGION, &name, regionSpace, &regionOffset, &regionLen);
 }
 
-void HandleExtOpField(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandleExtOpField(AML_Hashmap*, TokenList *list, AmlCursor *cursor) {
+	uint8_t *pkgStart = cursor->Position;
 	uint32_t pkgLength = 0;
-	int headerSize = HandlePkgLengthType((uint8_t*)&pkgLength, data, idx);
+	HandlePkgLengthType(&pkgLength, cursor);
+	uint8_t *end = PackageEnd(cursor, pkgStart, pkgLength);
 
 	NameType name;
-	HandleNameType(&name, data, idx);
-	headerSize += 4;
+	HandleNameType(&name, cursor);
 
-	uint32_t fieldFlags = data[*idx];
-	*idx+=1;
+	uint32_t fieldFlags = ReadByte(cursor);
 
-	headerSize += 1;
+	/* Bit offsets and widths are resolved here, once, instead of on every access */
+	AML_FieldUnit *units;
+	size_t unitCount = HandleFieldList(&units, fieldFlags, cursor, end);
 
-	uintptr_t fieldsEnd = (pkgLength - headerSize) + *idx;
-	TokenList *children = CreateTokenList();
+	AddToken(list, FIELD, pkgLength, &name, fieldFlags, units, unitCount);
+	list->Tail->Field.Region = FindRegion(list, &name);
+}
 
-	while(*idx < fieldsEnd) {
-		ParseByte(children, hashmap, data, idx);
-	}
+void HandleExtOpProcessor(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor) {
+	uint8_t *pkgStart = cursor->Position;
+	uint32_t pkgLength = 0;
+	HandlePkgLengthType(&pkgLength, cursor);
+	uint8_t *end = PackageEnd(cursor, pkgStart, pkgLength);
+
+	NameType name;
+	HandleNameType(&name, cursor);
 
-	AddToken(list, FIELD, pkgLength, &name, fieldFlags, children);
+	uint32_t processorId = ReadByte(cursor);
+	uint32_t blockAddress = ReadDWord(cursor);
+	uint32_t blockLength = ReadByte(cursor);
+
+	TokenList *children = ParseTermList(hashmap, cursor, end);
+
+	AddToken(list, PROCESSOR, pkgLength, &name, processorId, blockAddress, blockLength, children);
 }
 
-void HandleExtOpDevice(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx) {
+void HandleExtOpDevice(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor) {
+	uint8_t opcode = CursorOpcode(cursor);
+
+	uint8_t *pkgStart = cursor->Position;
 	uint32_t pkgLength = 0;
-	HandlePkgLengthType((uint8_t*)&pkgLength, data, idx);
+	HandlePkgLengthType(&pkgLength, cursor);
+	uint8_t *end = PackageEnd(cursor, pkgStart, pkgLength);
 
 	NameType name;
-	HandleNameType(&name, data, idx);
+	HandleNameType(&name, cursor);
+
+	TokenList *children = ParseTermList(hashmap, cursor, end);
 
-	AddToken(list, DEVICE, pkgLength, &name);
+	/* A thermal zone is laid out like a device, only the namespace tells them apart */
+	AddToken(list, opcode == AML_THERMALZONE ? THERMALZONE : DEVICE, pkgLength, &name, children);
 }
@@ -4,22 +4,32 @@
 
 struct AML_Hashmap;
 struct TokenList;
+struct AmlCursor;
 
-void HandleUnknowOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleZeroOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleOneOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleAliasOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleNameOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleIntegerOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleStringPrefix(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleScopeOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleBufferOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandlePackageOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleMethodOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
+void HandleUnknowOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleZeroOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleOneOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleAliasOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleNameOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleIntegerOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleStringPrefix(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleScopeOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleBufferOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandlePackageOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleMethodOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleNotifyOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleOnesOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleLocalOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleArgOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleOperationOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleControlOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
 
-void HandleExtendedOp(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
+void HandleExtendedOp(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
 
 
-void HandleExtOpRegion(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleExtOpField(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
-void HandleExtOpDevice(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
+void HandleExtOpMutex(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleExtOpAcquire(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleExtOpRegion(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleExtOpField(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleExtOpProcessor(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
+void HandleExtOpDevice(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
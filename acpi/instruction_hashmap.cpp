@@ -8,6 +8,8 @@ AML_Hashmap *CreateHashmap() {
 	AML_Hashmap *hashmap = new AML_Hashmap;
 	hashmap->Size = 89;
 	hashmap->Entries = new AML_HashmapEntry[hashmap->Size];
+	hashmap->Namespace = NULL;
+	hashmap->Scope = NULL;
 	
 	hashmap->Entries[0] = (AML_HashmapEntry){AML_ZERO_OP, HandleZeroOp};
 	hashmap->Entries[1] = (AML_HashmapEntry){AML_ONE_OP, HandleOneOp};
@@ -29,75 +31,75 @@ AML_Hashmap *CreateHashmap() {
 	hashmap->Entries[17] = (AML_HashmapEntry){AML_EXTOP_PREFIX, HandleExtendedOp};
 	hashmap->Entries[18] = (AML_HashmapEntry){AML_ROOT_CHAR, NULL};
 	hashmap->Entries[19] = (AML_HashmapEntry){AML_PARENT_CHAR, NULL};
-	hashmap->Entries[20] = (AML_HashmapEntry){AML_LOCAL0_OP, NULL};
-	hashmap->Entries[21] = (AML_HashmapEntry){AML_LOCAL1_OP, NULL};
-	hashmap->Entries[22] = (AML_HashmapEntry){AML_LOCAL2_OP, NULL};
-	hashmap->Entries[23] = (AML_HashmapEntry){AML_LOCAL3_OP, NULL};
-	hashmap->Entries[24] = (AML_HashmapEntry){AML_LOCAL4_OP, NULL};
-	hashmap->Entries[25] = (AML_HashmapEntry){AML_LOCAL5_OP, NULL};
-	hashmap->Entries[26] = (AML_HashmapEntry){AML_LOCAL6_OP, NULL};
-	hashmap->Entries[27] = (AML_HashmapEntry){AML_LOCAL7_OP, NULL};
-	hashmap->Entries[28] = (AML_HashmapEntry){AML_ARG0_OP, NULL};
-	hashmap->Entries[29] = (AML_HashmapEntry){AML_ARG1_OP, NULL};
-	hashmap->Entries[30] = (AML_HashmapEntry){AML_ARG2_OP, NULL};
-	hashmap->Entries[31] = (AML_HashmapEntry){AML_ARG3_OP, NULL};
-	hashmap->Entries[32] = (AML_HashmapEntry){AML_ARG4_OP, NULL};
-	hashmap->Entries[33] = (AML_HashmapEntry){AML_ARG5_OP, NULL};
-	hashmap->Entries[34] = (AML_HashmapEntry){AML_ARG6_OP, NULL};
-	hashmap->Entries[35] = (AML_HashmapEntry){AML_STORE_OP, NULL};
-	hashmap->Entries[36] = (AML_HashmapEntry){AML_REFOF_OP, NULL};
-	hashmap->Entries[37] = (AML_HashmapEntry){AML_ADD_OP, NULL};
-	hashmap->Entries[38] = (AML_HashmapEntry){AML_CONCAT_OP, NULL};
-	hashmap->Entries[39] = (AML_HashmapEntry){AML_SUBTRACT_OP, NULL};
-	hashmap->Entries[40] = (AML_HashmapEntry){AML_INCREMENT_OP, NULL};
-	hashmap->Entries[41] = (AML_HashmapEntry){AML_DECREMENT_OP, NULL};
-	hashmap->Entries[42] = (AML_HashmapEntry){AML_MULTIPLY_OP, NULL};
-	hashmap->Entries[43] = (AML_HashmapEntry){AML_DIVIDE_OP, NULL};
-	hashmap->Entries[44] = (AML_HashmapEntry){AML_SHL_OP, NULL};
-	hashmap->Entries[45] = (AML_HashmapEntry){AML_SHR_OP, NULL};
-	hashmap->Entries[46] = (AML_HashmapEntry){AML_AND_OP, NULL};
-	hashmap->Entries[47] = (AML_HashmapEntry){AML_OR_OP, NULL};
-	hashmap->Entries[48] = (AML_HashmapEntry){AML_XOR_OP, NULL};
-	hashmap->Entries[49] = (AML_HashmapEntry){AML_NAND_OP, NULL};
-	hashmap->Entries[50] = (AML_HashmapEntry){AML_NOR_OP, NULL};
-	hashmap->Entries[51] = (AML_HashmapEntry){AML_NOT_OP, NULL};
-	hashmap->Entries[52] = (AML_HashmapEntry){AML_FINDSETLEFTBIT_OP, NULL};
-	hashmap->Entries[53] = (AML_HashmapEntry){AML_FINDSETRIGHTBIT_OP, NULL};
-	hashmap->Entries[54] = (AML_HashmapEntry){AML_DEREF_OP, NULL};
-	hashmap->Entries[55] = (AML_HashmapEntry){AML_CONCATRES_OP, NULL};
-	hashmap->Entries[56] = (AML_HashmapEntry){AML_MOD_OP, NULL};
-	hashmap->Entries[57] = (AML_HashmapEntry){AML_NOTIFY_OP, NULL};
-	hashmap->Entries[58] = (AML_HashmapEntry){AML_SIZEOF_OP, NULL};
-	hashmap->Entries[59] = (AML_HashmapEntry){AML_INDEX_OP, NULL};
+	hashmap->Entries[20] = (AML_HashmapEntry){AML_LOCAL0_OP, HandleLocalOp};
+	hashmap->Entries[21] = (AML_HashmapEntry){AML_LOCAL1_OP, HandleLocalOp};
+	hashmap->Entries[22] = (AML_HashmapEntry){AML_LOCAL2_OP, HandleLocalOp};
+	hashmap->Entries[23] = (AML_HashmapEntry){AML_LOCAL3_OP, HandleLocalOp};
+	hashmap->Entries[24] = (AML_HashmapEntry){AML_LOCAL4_OP, HandleLocalOp};
+	hashmap->Entries[25] = (AML_HashmapEntry){AML_LOCAL5_OP, HandleLocalOp};
+	hashmap->Entries[26] = (AML_HashmapEntry){AML_LOCAL6_OP, HandleLocalOp};
+	hashmap->Entries[27] = (AML_HashmapEntry){AML_LOCAL7_OP, HandleLocalOp};
+	hashmap->Entries[28] = (AML_HashmapEntry){AML_ARG0_OP, HandleArgOp};
+	hashmap->Entries[29] = (AML_HashmapEntry){AML_ARG1_OP, HandleArgOp};
+	hashmap->Entries[30] = (AML_HashmapEntry){AML_ARG2_OP, HandleArgOp};
+	hashmap->Entries[31] = (AML_HashmapEntry){AML_ARG3_OP, HandleArgOp};
+	hashmap->Entries[32] = (AML_HashmapEntry){AML_ARG4_OP, HandleArgOp};
+	hashmap->Entries[33] = (AML_HashmapEntry){AML_ARG5_OP, HandleArgOp};
+	hashmap->Entries[34] = (AML_HashmapEntry){AML_ARG6_OP, HandleArgOp};
+	hashmap->Entries[35] = (AML_HashmapEntry){AML_STORE_OP, HandleOperationOp};
+	hashmap->Entries[36] = (AML_HashmapEntry){AML_REFOF_OP, HandleOperationOp};
+	hashmap->Entries[37] = (AML_HashmapEntry){AML_ADD_OP, HandleOperationOp};
+	hashmap->Entries[38] = (AML_HashmapEntry){AML_CONCAT_OP, HandleOperationOp};
+	hashmap->Entries[39] = (AML_HashmapEntry){AML_SUBTRACT_OP, HandleOperationOp};
+	hashmap->Entries[40] = (AML_HashmapEntry){AML_INCREMENT_OP, HandleOperationOp};
+	hashmap->Entries[41] = (AML_HashmapEntry){AML_DECREMENT_OP, HandleOperationOp};
+	hashmap->Entries[42] = (AML_HashmapEntry){AML_MULTIPLY_OP, HandleOperationOp};
+	hashmap->Entries[43] = (AML_HashmapEntry){AML_DIVIDE_OP, HandleOperationOp};
+	hashmap->Entries[44] = (AML_HashmapEntry){AML_SHL_OP, HandleOperationOp};
+	hashmap->Entries[45] = (AML_HashmapEntry){AML_SHR_OP, HandleOperationOp};
+	hashmap->Entries[46] = (AML_HashmapEntry){AML_AND_OP, HandleOperationOp};
+	hashmap->Entries[47] = (AML_HashmapEntry){AML_OR_OP, HandleOperationOp};
+	hashmap->Entries[48] = (AML_HashmapEntry){AML_XOR_OP, HandleOperationOp};
+	hashmap->Entries[49] = (AML_HashmapEntry){AML_NAND_OP, HandleOperationOp};
+	hashmap->Entries[50] = (AML_HashmapEntry){AML_NOR_OP, HandleOperationOp};
+	hashmap->Entries[51] = (AML_HashmapEntry){AML_NOT_OP, HandleOperationOp};
+	hashmap->Entries[52] = (AML_HashmapEntry){AML_FINDSETLEFTBIT_OP, HandleOperationOp};
+	hashmap->Entries[53] = (AML_HashmapEntry){AML_FINDSETRIGHTBIT_OP, HandleOperationOp};
+	hashmap->Entries[54] = (AML_HashmapEntry){AML_DEREF_OP, HandleOperationOp};
+	hashmap->Entries[55] = (AML_HashmapEntry){AML_CONCATRES_OP, HandleOperationOp};
+	hashmap->Entries[56] = (AML_HashmapEntry){AML_MOD_OP, HandleOperationOp};
+	hashmap->Entries[57] = (AML_HashmapEntry){AML_NOTIFY_OP, HandleNotifyOp};
+	hashmap->Entries[58] = (AML_HashmapEntry){AML_SIZEOF_OP, HandleOperationOp};
+	hashmap->Entries[59] = (AML_HashmapEntry){AML_INDEX_OP, HandleOperationOp};
 	hashmap->Entries[60] = (AML_HashmapEntry){AML_MATCH_OP, NULL};
-	hashmap->Entries[61] = (AML_HashmapEntry){AML_DWORDFIELD_OP, NULL};
-	hashmap->Entries[62] = (AML_HashmapEntry){AML_WORDFIELD_OP, NULL};
-	hashmap->Entries[63] = (AML_HashmapEntry){AML_BYTEFIELD_OP, NULL};
-	hashmap->Entries[64] = (AML_HashmapEntry){AML_BITFIELD_OP, NULL};
-	hashmap->Entries[65] = (AML_HashmapEntry){AML_OBJECTTYPE_OP, NULL};
-	hashmap->Entries[66] = (AML_HashmapEntry){AML_QWORDFIELD_OP, NULL};
-	hashmap->Entries[67] = (AML_HashmapEntry){AML_LAND_OP, NULL};
-	hashmap->Entries[68] = (AML_HashmapEntry){AML_LOR_OP, NULL};
-	hashmap->Entries[69] = (AML_HashmapEntry){AML_LNOT_OP, NULL};
-	hashmap->Entries[70] = (AML_HashmapEntry){AML_LEQUAL_OP, NULL};
-	hashmap->Entries[71] = (AML_HashmapEntry){AML_LGREATER_OP, NULL};
-	hashmap->Entries[72] = (AML_HashmapEntry){AML_LLESS_OP, NULL};
-	hashmap->Entries[73] = (AML_HashmapEntry){AML_TOBUFFER_OP, NULL};
-	hashmap->Entries[74] = (AML_HashmapEntry){AML_TODECIMALSTRING_OP, NULL};
-	hashmap->Entries[75] = (AML_HashmapEntry){AML_TOHEXSTRING_OP, NULL};
-	hashmap->Entries[76] = (AML_HashmapEntry){AML_TOINTEGER_OP, NULL};
-	hashmap->Entries[77] = (AML_HashmapEntry){AML_TOSTRING_OP, NULL};
-	hashmap->Entries[78] = (AML_HashmapEntry){AML_MID_OP, NULL};
-	hashmap->Entries[79] = (AML_HashmapEntry){AML_COPYOBJECT_OP, NULL};
-	hashmap->Entries[80] = (AML_HashmapEntry){AML_CONTINUE_OP, NULL};
-	hashmap->Entries[81] = (AML_HashmapEntry){AML_IF_OP, NULL};
-	hashmap->Entries[82] = (AML_HashmapEntry){AML_ELSE_OP, NULL};
-	hashmap->Entries[83] = (AML_HashmapEntry){AML_WHILE_OP, NULL};
-	hashmap->Entries[84] = (AML_HashmapEntry){AML_NOP_OP, NULL};
-	hashmap->Entries[85] = (AML_HashmapEntry){AML_RETURN_OP, NULL};
-	hashmap->Entries[86] = (AML_HashmapEntry){AML_BREAK_OP, NULL};
-	hashmap->Entries[87] = (AML_HashmapEntry){AML_BREAKPOINT_OP, NULL};
-	hashmap->Entries[88] = (AML_HashmapEntry){AML_ONES_OP, NULL};
+	hashmap->Entries[61] = (AML_HashmapEntry){AML_DWORDFIELD_OP, HandleOperationOp};
+	hashmap->Entries[62] = (AML_HashmapEntry){AML_WORDFIELD_OP, HandleOperationOp};
+	hashmap->Entries[63] = (AML_HashmapEntry){AML_BYTEFIELD_OP, HandleOperationOp};
+	hashmap->Entries[64] = (AML_HashmapEntry){AML_BITFIELD_OP, HandleOperationOp};
+	hashmap->Entries[65] = (AML_HashmapEntry){AML_OBJECTTYPE_OP, HandleOperationOp};
+	hashmap->Entries[66] = (AML_HashmapEntry){AML_QWORDFIELD_OP, HandleOperationOp};
+	hashmap->Entries[67] = (AML_HashmapEntry){AML_LAND_OP, HandleOperationOp};
+	hashmap->Entries[68] = (AML_HashmapEntry){AML_LOR_OP, HandleOperationOp};
+	hashmap->Entries[69] = (AML_HashmapEntry){AML_LNOT_OP, HandleOperationOp};
+	hashmap->Entries[70] = (AML_HashmapEntry){AML_LEQUAL_OP, HandleOperationOp};
+	hashmap->Entries[71] = (AML_HashmapEntry){AML_LGREATER_OP, HandleOperationOp};
+	hashmap->Entries[72] = (AML_HashmapEntry){AML_LLESS_OP, HandleOperationOp};
+	hashmap->Entries[73] = (AML_HashmapEntry){AML_TOBUFFER_OP, HandleOperationOp};
+	hashmap->Entries[74] = (AML_HashmapEntry){AML_TODECIMALSTRING_OP, HandleOperationOp};
+	hashmap->Entries[75] = (AML_HashmapEntry){AML_TOHEXSTRING_OP, HandleOperationOp};
+	hashmap->Entries[76] = (AML_HashmapEntry){AML_TOINTEGER_OP, HandleOperationOp};
+	hashmap->Entries[77] = (AML_HashmapEntry){AML_TOSTRING_OP, HandleOperationOp};
+	hashmap->Entries[78] = (AML_HashmapEntry){AML_MID_OP, HandleOperationOp};
+	hashmap->Entries[79] = (AML_HashmapEntry){AML_COPYOBJECT_OP, HandleOperationOp};
+	hashmap->Entries[80] = (AML_HashmapEntry){AML_CONTINUE_OP, HandleOperationOp};
+	hashmap->Entries[81] = (AML_HashmapEntry){AML_IF_OP, HandleControlOp};
+	hashmap->Entries[82] = (AML_HashmapEntry){AML_ELSE_OP, HandleControlOp};
+	hashmap->Entries[83] = (AML_HashmapEntry){AML_WHILE_OP, HandleControlOp};
+	hashmap->Entries[84] = (AML_HashmapEntry){AML_NOP_OP, HandleOperationOp};
+	hashmap->Entries[85] = (AML_HashmapEntry){AML_RETURN_OP, HandleOperationOp};
+	hashmap->Entries[86] = (AML_HashmapEntry){AML_BREAK_OP, HandleOperationOp};
+	hashmap->Entries[87] = (AML_HashmapEntry){AML_BREAKPOINT_OP, HandleOperationOp};
+	hashmap->Entries[88] = (AML_HashmapEntry){AML_ONES_OP, HandleOnesOp};
 
 	return hashmap;
 }
@@ -4,8 +4,11 @@
 
 struct AML_Hashmap;
 struct TokenList;
+struct AmlCursor;
+struct AML_Namespace;
+struct AML_NamespaceNode;
 
-typedef void (*AML_OpcodeHandler)(AML_Hashmap *hashmap, TokenList *list, uint8_t *data, size_t *idx);
+typedef void (*AML_OpcodeHandler)(AML_Hashmap *hashmap, TokenList *list, AmlCursor *cursor);
 
 struct AML_HashmapEntry {
 	uint8_t OPCode;
@@ -15,6 +18,13 @@ struct AML_HashmapEntry {
 struct AML_Hashmap {
 	size_t Size;
 	AML_HashmapEntry* Entries;
+
+	/*
+	 * Set while parsing a method body, so calls can be told apart from
+	 * plain name references by the argument count of their target.
+	 */
+	AML_Namespace *Namespace;
+	AML_NamespaceNode *Scope;
 };
 
 AML_Hashmap *CreateHashmap();
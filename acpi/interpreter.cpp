@@ -0,0 +1,2186 @@
+#include "interpreter.h"
+#include "aml_executive.h"
+#include "aml_opcodes.h"
+#include "field_access.h"
+#include "facs.h"
+#include "timer_wheel.h"
+#include "sync.h"
+#include "trace.h"
+#include "memory.h"
+
+#include <mkmi.h>
+
+/* Flow control, only ever seen between the statement runners */
+#define AML_RETURN 1
+#define AML_BREAK 2
+#define AML_CONTINUE 3
+
+#define AML_TRUE (~0ull)
+
+/* ObjectType results, see ACPI spec section 19.6.97 */
+#define AML_TYPE_UNINITIALIZED 0
+#define AML_TYPE_INTEGER 1
+#define AML_TYPE_STRING 2
+#define AML_TYPE_BUFFER 3
+#define AML_TYPE_PACKAGE 4
+#define AML_TYPE_FIELD_UNIT 5
+#define AML_TYPE_DEVICE 6
+#define AML_TYPE_EVENT 7
+#define AML_TYPE_METHOD 8
+#define AML_TYPE_MUTEX 9
+#define AML_TYPE_REGION 10
+#define AML_TYPE_PROCESSOR 12
+#define AML_TYPE_THERMAL_ZONE 13
+#define AML_TYPE_BUFFER_FIELD 14
+
+static AML_MutexStats MutexStats;
+static AML_FoldStats FoldStats;
+
+static int EvalTerm(AML_Frame *frame, Token *token, AML_Value *value);
+static int ExecuteList(AML_Frame *frame, TokenList *list);
+static int StoreValue(AML_Frame *frame, Token *target, AML_Value *value);
+static Token *ToBufferObject(AML_Frame *frame, AML_Value *value);
+
+void InitContext(AML_Context *context, AMLExecutive *executive) {
+	context->Executive = executive;
+	context->SyncLevel = 0;
+	context->Depth = 0;
+	context->Held = NULL;
+	context->Profiler = executive->GetActiveProfiler();
+	context->Profile = NULL;
+}
+
+void GetMutexStats(AML_MutexStats *stats) {
+	Memcpy(stats, &MutexStats, sizeof(AML_MutexStats));
+}
+
+void GetFoldStats(AML_FoldStats *stats) {
+	Memcpy(stats, &FoldStats, sizeof(AML_FoldStats));
+}
+
+static AML_Value NoneValue() {
+	AML_Value value;
+	value.Type = VALUE_NONE;
+	value.Integer = 0;
+	value.Object = NULL;
+	value.Node = NULL;
+	return value;
+}
+
+static AML_Value ObjectValue(AML_ValueType type, Token *object) {
+	AML_Value value = NoneValue();
+	value.Type = type;
+	value.Object = object;
+	return value;
+}
+
+static AML_Value NodeValue(AML_NamespaceNode *node) {
+	AML_Value value = NoneValue();
+	value.Type = VALUE_NODE;
+	value.Node = node;
+	return value;
+}
+
+/* Temporaries */
+
+static Token *NewToken(TokenType type, uint8_t flags) {
+	Token *token = (Token*)AllocateMemory(ACPI_MEMORY_TOKENS, sizeof(Token));
+	token->Type = type;
+	token->Flags = flags;
+	token->Children = NULL;
+	token->Next = NULL;
+	return token;
+}
+
+static Token *Keep(AML_Frame *frame, Token *token) {
+	if (frame != NULL) {
+		token->Next = frame->Temporaries;
+		frame->Temporaries = token;
+	}
+
+	return token;
+}
+
+static Token *NewString(AML_Frame *frame, const char *data, size_t length) {
+	Token *token = NewToken(STRING, TOKEN_TEMPORARY);
+	token->String = (char*)AllocateMemory(ACPI_MEMORY_STRINGS, length + 1);
+	Memcpy(token->String, data, length);
+	token->String[length] = '\0';
+	return Keep(frame, token);
+}
+
+static Token *NewBuffer(AML_Frame *frame, size_t size) {
+	Token *token = NewToken(BUFFER, TOKEN_TEMPORARY);
+	token->Buffer.PkgLength = 0;
+	token->Buffer.BufferSize.Data = size;
+	token->Buffer.BufferSize.Size = 0;
+	token->Buffer.ByteList = (uint8_t*)AllocateMemory(ACPI_MEMORY_BUFFERS, size);
+	for (size_t i = 0; i < size; ++i) token->Buffer.ByteList[i] = 0;
+	return Keep(frame, token);
+}
+
+static void AppendElement(Token *package, Token *element) {
+	TokenList *list = package->Children;
+
+	element->Next = NULL;
+	if (list->Head == NULL) list->Head = element;
+	else list->Tail->Next = element;
+	list->Tail = element;
+}
+
+/* Elements are always copies, a token can only sit in one list */
+static Token *CopyToken(Token *object, uint8_t flags) {
+	Token *copy = NewToken(object->Type, flags);
+	*copy = *object;
+	copy->Flags = flags;
+	copy->Children = NULL;
+	copy->Next = NULL;
+
+	switch (object->Type) {
+		case STRING: {
+			size_t length = Strlen(object->String) + 1;
+			copy->String = (char*)AllocateMemory(ACPI_MEMORY_STRINGS, length);
+			Memcpy(copy->String, object->String, length);
+			}
+			break;
+		case BUFFER: {
+			size_t size = object->Buffer.BufferSize.Data;
+			copy->Buffer.ByteList = (uint8_t*)AllocateMemory(ACPI_MEMORY_BUFFERS, size);
+			Memcpy(copy->Buffer.ByteList, object->Buffer.ByteList, size);
+			}
+			break;
+		case PACKAGE:
+			copy->Children = CreateTokenList();
+			if (object->Children == NULL) break;
+
+			for (Token *element = object->Children->Head; element != NULL; element = element->Next) {
+				AppendElement(copy, CopyToken(element, flags));
+			}
+			break;
+		default:
+			break;
+	}
+
+	return copy;
+}
+
+void ReleaseTemporary(Token *token) {
+	if (token == NULL || !(token->Flags & TOKEN_TEMPORARY)) return;
+
+	if (token->Type == STRING) FreeMemory(token->String);
+	if (token->Type == BUFFER) FreeMemory(token->Buffer.ByteList);
+
+	if (token->Children != NULL) {
+		Token *element = token->Children->Head;
+		while (element != NULL) {
+			Token *next = element->Next;
+			ReleaseTemporary(element);
+			element = next;
+		}
+
+		FreeMemory(token->Children);
+	}
+
+	FreeMemory(token);
+}
+
+/* Mutexes */
+
+static bool TryAcquireObject(AML_Context *context, AML_Mutex *mutex) {
+	AML_GlobalLock *global = context->Executive->GetGlobalLock();
+	if (global != NULL && mutex == &global->Mutex) return TryAcquireGlobalLock(global, context);
+
+	return TryAcquireMutex(mutex, context);
+}
+
+static void ReleaseObject(AML_Context *context, AML_Mutex *mutex) {
+	AML_GlobalLock *global = context->Executive->GetGlobalLock();
+	if (global != NULL && mutex == &global->Mutex) return ReleaseGlobalLock(global);
+
+	ReleaseMutex(mutex);
+}
+
+/* Timeout in milliseconds, returns false once it expires */
+static bool WaitForMutex(AML_Context *context, AML_Mutex *mutex, uint16_t timeout) {
+	if (TryAcquireObject(context, mutex)) return true;
+
+	__atomic_fetch_add(&MutexStats.Contended, 1, __ATOMIC_RELAXED);
+
+	AML_TimerWheel *wheel = context->Executive->GetTimerWheel();
+	bool forever = timeout == AML_WAIT_FOREVER;
+
+	AML_Timer timer;
+	if (!forever) AddTimer(wheel, &timer, ReadTimerWheelNanoseconds(wheel) + timeout * 1000000ull);
+
+	bool acquired;
+	while (!(acquired = TryAcquireObject(context, mutex))) {
+		if (!forever && __atomic_load_n(&timer.Fired, __ATOMIC_ACQUIRE)) break;
+
+		YieldTimerWheel(wheel);
+	}
+
+	if (!forever) CancelTimer(wheel, &timer);
+	if (!acquired) __atomic_fetch_add(&MutexStats.Timeouts, 1, __ATOMIC_RELAXED);
+
+	return acquired;
+}
+
+static int AcquireHeld(AML_Context *context, AML_Mutex *mutex, uint16_t timeout, bool *acquired) {
+	bool owned = __atomic_load_n(&mutex->Owner, __ATOMIC_RELAXED) == context;
+
+	/* Mutexes are taken in increasing sync level order, so no two cores can wait on each other */
+	if (!owned && mutex->SyncLevel < context->SyncLevel) {
+		__atomic_fetch_add(&MutexStats.SyncLevelErrors, 1, __ATOMIC_RELAXED);
+		return AML_ERROR_SYNC_LEVEL;
+	}
+
+	*acquired = WaitForMutex(context, mutex, timeout);
+	if (!*acquired) return AML_OK;
+
+	__atomic_fetch_add(&MutexStats.Acquisitions, 1, __ATOMIC_RELAXED);
+	if (owned) return AML_OK;
+
+	mutex->PreviousSyncLevel = context->SyncLevel;
+	mutex->NextHeld = context->Held;
+	context->Held = mutex;
+	context->SyncLevel = mutex->SyncLevel;
+
+	return AML_OK;
+}
+
+static int ReleaseHeld(AML_Context *context, AML_Mutex *mutex) {
+	if (__atomic_load_n(&mutex->Owner, __ATOMIC_RELAXED) != context) return AML_ERROR;
+
+	if (mutex->Depth == 1) {
+		/* And released in the opposite order */
+		if (mutex->SyncLevel < context->SyncLevel) {
+			__atomic_fetch_add(&MutexStats.SyncLevelErrors, 1, __ATOMIC_RELAXED);
+			return AML_ERROR_SYNC_LEVEL;
+		}
+
+		AML_Mutex **link = &context->Held;
+		while (*link != NULL && *link != mutex) link = &(*link)->NextHeld;
+		if (*link != NULL) *link = mutex->NextHeld;
+
+		context->SyncLevel = mutex->PreviousSyncLevel;
+	}
+
+	ReleaseObject(context, mutex);
+
+	return AML_OK;
+}
+
+/* Anything a method acquired and did not release goes when the method ends */
+static void ReleaseAbandoned(AML_Context *context, AML_Mutex *held) {
+	while (context->Held != NULL && context->Held != held) {
+		AML_Mutex *mutex = context->Held;
+		context->Held = mutex->NextHeld;
+		context->SyncLevel = mutex->PreviousSyncLevel;
+
+		mutex->Depth = 1;
+		ReleaseObject(context, mutex);
+	}
+}
+
+static AML_Mutex *FindMutex(AML_Frame *frame, Token *operand) {
+	if (operand == NULL || operand->Type != NAMEREF) return NULL;
+
+	AML_NamespaceNode *node = ResolveName(frame->Context->Executive->GetNamespace(), frame->Scope, &operand->Name);
+	if (node == NULL || node->Type != NODE_MUTEX) return NULL;
+	if (node->Object != NULL) return &node->Object->Mutex.Lock;
+
+	AML_GlobalLock *global = frame->Context->Executive->GetGlobalLock();
+	return global != NULL ? &global->Mutex : NULL;
+}
+
+/* Events */
+
+static Token *FindEvent(AML_Frame *frame, Token *operand) {
+	if (operand == NULL || operand->Type != NAMEREF) return NULL;
+
+	AML_NamespaceNode *node = ResolveName(frame->Context->Executive->GetNamespace(), frame->Scope, &operand->Name);
+	if (node == NULL || node->Type != NODE_EVENT) return NULL;
+
+	return node->Object;
+}
+
+static bool ConsumeSignal(Token *event) {
+	uint32_t count = __atomic_load_n(&event->Event.Count, __ATOMIC_RELAXED);
+
+	while (count != 0) {
+		if (__atomic_compare_exchange_n(&event->Event.Count, &count, count - 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return true;
+	}
+
+	return false;
+}
+
+static bool WaitForEvent(AML_Frame *frame, Token *event, uint64_t timeout) {
+	if (ConsumeSignal(event)) return true;
+	if (timeout == 0) return false;
+
+	AML_TimerWheel *wheel = frame->Context->Executive->GetTimerWheel();
+	bool forever = timeout >= AML_WAIT_FOREVER;
+	uint64_t start = ReadTimerWheelNanoseconds(wheel);
+
+	AML_Timer timer;
+	if (!forever) AddTimer(wheel, &timer, start + timeout * 1000000ull);
+
+	bool signalled;
+	while (!(signalled = ConsumeSignal(event))) {
+		if (!forever && __atomic_load_n(&timer.Fired, __ATOMIC_ACQUIRE)) break;
+
+		YieldTimerWheel(wheel);
+	}
+
+	if (!forever) CancelTimer(wheel, &timer);
+	frame->SleepNs += ReadTimerWheelNanoseconds(wheel) - start;
+
+	return signalled;
+}
+
+static void Sleep(AML_Frame *frame, uint64_t ns) {
+	AML_TimerWheel *wheel = frame->Context->Executive->GetTimerWheel();
+	uint64_t start = ReadTimerWheelNanoseconds(wheel);
+
+	SleepFor(wheel, ns);
+
+	frame->SleepNs += ReadTimerWheelNanoseconds(wheel) - start;
+}
+
+/* Stalls only count against a method while profiling, they are too short to be worth a timestamp otherwise */
+static void Stall(AML_Frame *frame, uint64_t us) {
+	AML_TimerWheel *wheel = frame->Context->Executive->GetTimerWheel();
+	AML_ProfileFrame *profile = frame->Context->Profile;
+
+	if (profile == NULL) {
+		StallFor(wheel, us);
+		return;
+	}
+
+	uint64_t start = ReadTimerWheelNanoseconds(wheel);
+	StallFor(wheel, us);
+	profile->StallNs += ReadTimerWheelNanoseconds(wheel) - start;
+}
+
+static inline void ProfileFieldAccess(AML_Frame *frame, Token *field) {
+	AML_ProfileFrame *profile = frame->Context->Profile;
+	if (profile == NULL || field->Field.Region == NULL) return;
+
+	uint8_t space = field->Field.Region->Region.RegionSpace;
+	if (space < AML_REGION_SPACE_COUNT) profile->RegionAccesses[space]++;
+}
+
+/* Fields declared with Lock take the global lock around every access, outside of sync level ordering */
+static AML_GlobalLock *LockField(AML_Frame *frame, Token *field) {
+	if (!(field->Field.FieldFlags & AML_FIELD_LOCK)) return NULL;
+
+	AML_GlobalLock *global = frame->Context->Executive->GetGlobalLock();
+	if (global != NULL) WaitForMutex(frame->Context, &global->Mutex, AML_WAIT_FOREVER);
+
+	return global;
+}
+
+/* Values */
+
+static void ValueFromToken(Token *token, AML_Value *value) {
+	uint64_t integer;
+
+	if (GetTokenInteger(token, &integer)) *value = IntegerValue(integer);
+	else if (token != NULL) *value = ObjectValue(VALUE_OBJECT, token);
+	else *value = NoneValue();
+}
+
+static uint8_t *ObjectBytes(Token *object, size_t *size) {
+	if (object->Type == BUFFER) {
+		*size = object->Buffer.BufferSize.Data;
+		return object->Buffer.ByteList;
+	}
+
+	if (object->Type == STRING) {
+		*size = Strlen(object->String);
+		return (uint8_t*)object->String;
+	}
+
+	*size = 0;
+	return NULL;
+}
+
+static uint64_t ReadBits(const uint8_t *bytes, size_t size, uint32_t bitOffset, uint32_t bitWidth) {
+	uint64_t value = 0;
+
+	if (bitOffset % 8 == 0 && bitWidth % 8 == 0) {
+		for (uint32_t i = 0; i < bitWidth / 8 && bitOffset / 8 + i < size; ++i) {
+			value |= (uint64_t)bytes[bitOffset / 8 + i] << (i * 8);
+		}
+
+		return value;
+	}
+
+	for (uint32_t i = 0; i < bitWidth; ++i) {
+		uint32_t bit = bitOffset + i;
+		if (bit / 8 >= size) break;
+
+		if ((bytes[bit / 8] >> (bit % 8)) & 1) value |= 1ull << i;
+	}
+
+	return value;
+}
+
+static void WriteBits(uint8_t *bytes, size_t size, uint32_t bitOffset, uint32_t bitWidth, uint64_t value) {
+	if (bitOffset % 8 == 0 && bitWidth % 8 == 0) {
+		for (uint32_t i = 0; i < bitWidth / 8 && bitOffset / 8 + i < size; ++i) {
+			bytes[bitOffset / 8 + i] = value >> (i * 8);
+		}
+
+		return;
+	}
+
+	for (uint32_t i = 0; i < bitWidth; ++i) {
+		uint32_t bit = bitOffset + i;
+		if (bit / 8 >= size) break;
+
+		if ((value >> i) & 1) bytes[bit / 8] |= 1 << (bit % 8);
+		else bytes[bit / 8] &= ~(1 << (bit % 8));
+	}
+}
+
+static AML_Namespace *GetNamespace(AML_Frame *frame) {
+	return frame->Context->Executive->GetNamespace();
+}
+
+static AML_FrameObject *FindFrameObject(AML_Frame *frame, NameType *name) {
+	if (name->IsRoot || name->ParentPrefixes != 0 || name->SegmentNumber != 1) return NULL;
+
+	for (AML_FrameObject *object = frame->Objects; object != NULL; object = object->Next) {
+		if (Memcmp(object->Name, name->NameSegments, 4) == 0) return object;
+	}
+
+	return NULL;
+}
+
+static AML_FrameObject *CreateFrameObject(AML_Frame *frame, NameType *name) {
+	if (name->SegmentNumber == 0) return NULL;
+
+	AML_FrameObject *object = (AML_FrameObject*)AllocateMemory(ACPI_MEMORY_FRAMES, sizeof(AML_FrameObject));
+	Memcpy(object->Name, &name->NameSegments[(name->SegmentNumber - 1) * 4], 4);
+	object->Value = NoneValue();
+	object->IsBufferField = false;
+	object->BitOffset = 0;
+	object->BitWidth = 0;
+	object->Next = frame->Objects;
+	frame->Objects = object;
+
+	return object;
+}
+
+static int ReadNode(AML_Frame *frame, AML_NamespaceNode *node, AML_Value *value) {
+	switch (node->Type) {
+		case NODE_NAME: {
+			if (node->Object->Children == NULL) return AML_ERROR;
+
+			/* Stores from other cores swap the head, the old one outlives our read section */
+			Token *object = __atomic_load_n(&node->Object->Children->Head, __ATOMIC_ACQUIRE);
+			ValueFromToken(object, value);
+			}
+			return AML_OK;
+		case NODE_FIELD_UNIT: {
+			Token *field = node->Object;
+			if (node->FieldUnit >= field->Field.UnitCount) return AML_ERROR;
+
+			/* Units wider than an integer read as a buffer */
+			uint32_t bits = field->Field.Units[node->FieldUnit].BitWidth;
+			Token *buffer = bits > 64 ? NewBuffer(frame, (bits + 7) / 8) : NULL;
+			uint8_t bytes[8];
+
+			ProfileFieldAccess(frame, field);
+
+			AML_GlobalLock *global = LockField(frame, field);
+			int error = ReadFieldUnitBytes(field, node->FieldUnit, buffer != NULL ? buffer->Buffer.ByteList : bytes);
+			if (global != NULL) ReleaseGlobalLock(global);
+
+			if (error != 0) return AML_ERROR;
+
+			if (buffer != NULL) {
+				*value = ObjectValue(VALUE_OBJECT, buffer);
+			} else {
+				*value = IntegerValue(ReadBits(bytes, (bits + 7) / 8, 0, bits));
+			}
+			}
+			return AML_OK;
+		case NODE_ALIAS: {
+			AML_NamespaceNode *target = ResolveName(GetNamespace(frame), node->Parent, &node->Object->Alias.NameOne);
+			if (target == NULL) return AML_ERROR;
+
+			return ReadNode(frame, target, value);
+			}
+		case NODE_METHOD:
+			return ExecuteMethod(frame->Context, node, NULL, 0, frame, value);
+		default:
+			*value = NodeValue(node);
+			return AML_OK;
+	}
+}
+
+static int ReadFrameObject(AML_FrameObject *object, AML_Value *value) {
+	if (!object->IsBufferField) {
+		*value = object->Value;
+		return AML_OK;
+	}
+
+	size_t size;
+	uint8_t *bytes = ObjectBytes(object->Value.Object, &size);
+	*value = IntegerValue(ReadBits(bytes, size, object->BitOffset, object->BitWidth));
+
+	return AML_OK;
+}
+
+/* Turns references into the data they point at */
+static int Deref(AML_Frame *frame, AML_Value *value) {
+	switch (value->Type) {
+		case VALUE_ELEMENT:
+			ValueFromToken(value->Object, value);
+			return AML_OK;
+		case VALUE_BYTE: {
+			size_t size;
+			uint8_t *bytes = ObjectBytes(value->Object, &size);
+			if (value->Integer >= size) return AML_ERROR;
+
+			*value = IntegerValue(bytes[value->Integer]);
+			}
+			return AML_OK;
+		case VALUE_NODE:
+			return ReadNode(frame, value->Node, value);
+		default:
+			return AML_OK;
+	}
+}
+
+static uint64_t ParseIntegerString(const char *string) {
+	uint64_t value = 0;
+	bool hex = string[0] == '0' && (string[1] == 'x' || string[1] == 'X');
+	if (hex) string += 2;
+
+	for (; *string != '\0'; ++string) {
+		char c = *string;
+		uint8_t digit;
+
+		if (c >= '0' && c <= '9') digit = c - '0';
+		else if (hex && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+		else if (hex && c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+		else break;
+
+		value = value * (hex ? 16 : 10) + digit;
+	}
+
+	return value;
+}
+
+static int ToInteger(AML_Frame *frame, AML_Value *value, uint64_t *integer) {
+	AML_Value data = *value;
+
+	int status = Deref(frame, &data);
+	if (status != AML_OK) return status;
+
+	if (data.Type == VALUE_INTEGER) {
+		*integer = data.Integer;
+		return AML_OK;
+	}
+
+	if (data.Type != VALUE_OBJECT) return AML_ERROR;
+
+	if (data.Object->Type == STRING) {
+		*integer = ParseIntegerString(data.Object->String);
+		return AML_OK;
+	}
+
+	if (data.Object->Type == BUFFER) {
+		size_t size = data.Object->Buffer.BufferSize.Data;
+		*integer = ReadBits(data.Object->Buffer.ByteList, size, 0, 64);
+		return AML_OK;
+	}
+
+	return AML_ERROR;
+}
+
+static int EvalInteger(AML_Frame *frame, Token *token, uint64_t *integer) {
+	AML_Value value;
+
+	int status = EvalTerm(frame, token, &value);
+	if (status != AML_OK) return status;
+
+	return ToInteger(frame, &value, integer);
+}
+
+/* Evaluates to plain data, references are followed */
+static int EvalData(AML_Frame *frame, Token *token, AML_Value *value) {
+	int status = EvalTerm(frame, token, value);
+	if (status != AML_OK) return status;
+
+	return Deref(frame, value);
+}
+
+/* Stores */
+
+static void FreeRetiredToken(void *token) {
+	FreeToken((Token*)token);
+}
+
+/* The value is out before the flag is read, a method folding it right now sees one of the two */
+static void StoredName(AML_Frame *frame, Token *name) {
+	if (__atomic_load_n(&name->Flags, __ATOMIC_SEQ_CST) & TOKEN_FOLDED) frame->Context->Executive->InvalidateFolding();
+}
+
+static int StoreName(AML_Frame *frame, Token *name, AML_Value *value) {
+	TokenList *children = name->Children;
+	if (children == NULL || children->Head == NULL) return AML_ERROR;
+
+	Token *current = __atomic_load_n(&children->Head, __ATOMIC_ACQUIRE);
+	Token *replacement;
+
+	uint64_t integer;
+	if (value->Type == VALUE_INTEGER || GetTokenInteger(current, &integer)) {
+		int status = ToInteger(frame, value, &integer);
+		if (status != AML_OK) return status;
+
+		if (current->Type == INTEGER) {
+			__atomic_store_n(&current->Int.Data, integer, __ATOMIC_SEQ_CST);
+			StoredName(frame, name);
+			return AML_OK;
+		}
+
+		replacement = NewToken(INTEGER, 0);
+		replacement->Int.Data = integer;
+		replacement->Int.Size = 8;
+	} else if (value->Type == VALUE_OBJECT) {
+		replacement = CopyToken(value->Object, 0);
+	} else {
+		return AML_ERROR_UNSUPPORTED;
+	}
+
+	/* Evaluations on other cores may still be reading the old object, it goes after a grace period */
+	children->Tail = replacement;
+	Token *previous = __atomic_exchange_n(&children->Head, replacement, __ATOMIC_SEQ_CST);
+	RetireObject(GetNamespace(frame), previous, FreeRetiredToken);
+	StoredName(frame, name);
+
+	return AML_OK;
+}
+
+static int StoreNode(AML_Frame *frame, AML_NamespaceNode *node, AML_Value *value) {
+	switch (node->Type) {
+		case NODE_FIELD_UNIT: {
+			Token *field = node->Object;
+			if (node->FieldUnit >= field->Field.UnitCount) return AML_ERROR;
+
+			uint8_t integer[8];
+			const uint8_t *bytes = integer;
+			size_t size = sizeof(integer);
+
+			/* Wide units take buffers as they are, anything else goes through an integer */
+			if (field->Field.Units[node->FieldUnit].BitWidth > 64) {
+				Token *buffer = ToBufferObject(frame, value);
+				if (buffer == NULL) return AML_ERROR;
+
+				bytes = buffer->Buffer.ByteList;
+				size = buffer->Buffer.BufferSize.Data;
+			} else {
+				uint64_t number;
+				int status = ToInteger(frame, value, &number);
+				if (status != AML_OK) return status;
+
+				WriteBits(integer, sizeof(integer), 0, 64, number);
+			}
+
+			ProfileFieldAccess(frame, field);
+
+			AML_GlobalLock *global = LockField(frame, field);
+			int error = WriteFieldUnitBytes(field, node->FieldUnit, bytes, size);
+			if (global != NULL) ReleaseGlobalLock(global);
+
+			return error == 0 ? AML_OK : AML_ERROR;
+			}
+		case NODE_NAME:
+			return StoreName(frame, node->Object, value);
+		case NODE_ALIAS: {
+			AML_NamespaceNode *target = ResolveName(GetNamespace(frame), node->Parent, &node->Object->Alias.NameOne);
+			if (target == NULL) return AML_ERROR;
+
+			return StoreNode(frame, target, value);
+			}
+		default:
+			return AML_ERROR_UNSUPPORTED;
+	}
+}
+
+static int StoreReference(AML_Frame *frame, AML_Value *reference, AML_Value *value) {
+	uint64_t integer;
+
+	switch (reference->Type) {
+		case VALUE_NODE:
+			return StoreNode(frame, reference->Node, value);
+		case VALUE_BYTE: {
+			size_t size;
+			uint8_t *bytes = ObjectBytes(reference->Object, &size);
+			if (reference->Integer >= size) return AML_ERROR;
+
+			int status = ToInteger(frame, value, &integer);
+			if (status != AML_OK) return status;
+
+			bytes[reference->Integer] = integer;
+			}
+			return AML_OK;
+		case VALUE_ELEMENT: {
+			/* Only integer elements can be overwritten in place */
+			Token *element = reference->Object;
+			if (!GetTokenInteger(element, &integer)) return AML_ERROR_UNSUPPORTED;
+
+			int status = ToInteger(frame, value, &integer);
+			if (status != AML_OK) return status;
+
+			element->Type = INTEGER;
+			element->Int.Data = integer;
+			element->Int.Size = 8;
+			}
+			return AML_OK;
+		default:
+			return AML_ERROR;
+	}
+}
+
+/* Stores to Debug are recorded, the string is cut to what fits in one record */
+static void TraceValue(AML_Value *value) {
+	switch (value->Type) {
+		case VALUE_INTEGER:
+			Trace(ACPI_TRACE_DEBUG, TRACE_AML_DEBUG_INTEGER, value->Integer);
+			break;
+		case VALUE_OBJECT:
+			if (value->Object->Type == STRING) {
+				const char *string = value->Object->String;
+				size_t length = Strlen(string);
+				uint64_t tags[ACPI_TRACE_ARGS];
+
+				for (size_t i = 0; i < ACPI_TRACE_ARGS; ++i) {
+					size_t offset = i * 8;
+					tags[i] = offset < length ? TraceTag(&string[offset], length - offset) : 0;
+				}
+
+				Trace(ACPI_TRACE_DEBUG, TRACE_AML_DEBUG_STRING, tags[0], tags[1], tags[2], tags[3]);
+			} else {
+				Trace(ACPI_TRACE_DEBUG, TRACE_AML_DEBUG_OBJECT, value->Object->Type);
+			}
+			break;
+		default:
+			Trace(ACPI_TRACE_DEBUG, TRACE_AML_DEBUG_REFERENCE);
+			break;
+	}
+}
+
+static int StoreValue(AML_Frame *frame, Token *target, AML_Value *value) {
+	switch (target->Type) {
+		case ZERO:
+			/* No target */
+			return AML_OK;
+		case LOCAL:
+			if (target->Slot.Index >= AML_MAX_LOCALS) return AML_ERROR;
+
+			frame->Locals[target->Slot.Index] = *value;
+			return AML_OK;
+		case ARG: {
+			if (target->Slot.Index >= AML_MAX_ARGS) return AML_ERROR;
+
+			/* Args passed as RefOf are written through */
+			AML_Value *arg = &frame->Args[target->Slot.Index];
+			if (arg->Type == VALUE_NODE) return StoreNode(frame, arg->Node, value);
+
+			*arg = *value;
+			}
+			return AML_OK;
+		case NAMEREF: {
+			AML_FrameObject *object = FindFrameObject(frame, &target->Name);
+			if (object != NULL && object->IsBufferField) {
+				uint64_t integer;
+				int status = ToInteger(frame, value, &integer);
+				if (status != AML_OK) return status;
+
+				size_t size;
+				uint8_t *bytes = ObjectBytes(object->Value.Object, &size);
+				WriteBits(bytes, size, object->BitOffset, object->BitWidth, integer);
+				return AML_OK;
+			}
+
+			if (object != NULL) {
+				object->Value = *value;
+				return AML_OK;
+			}
+
+			AML_NamespaceNode *node = ResolveName(GetNamespace(frame), frame->Scope, &target->Name);
+			if (node == NULL) return AML_ERROR;
+
+			return StoreNode(frame, node, value);
+			}
+		case OPERATION: {
+			if (target->Operation.Opcode == AML_EXTENDED(AML_DEBUG_OP)) {
+				TraceValue(value);
+				return AML_OK;
+			}
+
+			/* Index(), DerefOf() and friends evaluate to the reference to write through */
+			AML_Value reference;
+			int status = EvalTerm(frame, target, &reference);
+			if (status != AML_OK) return status;
+
+			return StoreReference(frame, &reference, value);
+			}
+		default:
+			return AML_ERROR_UNSUPPORTED;
+	}
+}
+
+/* Operations */
+
+static int Compare(AML_Frame *frame, AML_Value *left, AML_Value *right, int *result) {
+	if (left->Type == VALUE_OBJECT && (left->Object->Type == STRING || left->Object->Type == BUFFER) &&
+	    right->Type == VALUE_OBJECT && (right->Object->Type == STRING || right->Object->Type == BUFFER)) {
+		size_t leftSize, rightSize;
+		uint8_t *leftBytes = ObjectBytes(left->Object, &leftSize);
+		uint8_t *rightBytes = ObjectBytes(right->Object, &rightSize);
+
+		*result = Memcmp(leftBytes, rightBytes, leftSize < rightSize ? leftSize : rightSize);
+		if (*result == 0) *result = leftSize < rightSize ? -1 : leftSize > rightSize ? 1 : 0;
+
+		return AML_OK;
+	}
+
+	uint64_t a, b;
+	int status = ToInteger(frame, left, &a);
+	if (status == AML_OK) status = ToInteger(frame, right, &b);
+	if (status != AML_OK) return status;
+
+	*result = a < b ? -1 : a > b ? 1 : 0;
+
+	return AML_OK;
+}
+
+static size_t FormatInteger(char *buffer, uint64_t integer, uint8_t base) {
+	char digits[20];
+	size_t count = 0;
+
+	do {
+		uint8_t digit = integer % base;
+		digits[count++] = digit < 10 ? '0' + digit : 'A' + digit - 10;
+		integer /= base;
+	} while (integer != 0);
+
+	for (size_t i = 0; i < count; ++i) buffer[i] = digits[count - 1 - i];
+
+	return count;
+}
+
+static Token *ToBufferObject(AML_Frame *frame, AML_Value *value) {
+	if (value->Type == VALUE_INTEGER) {
+		Token *buffer = NewBuffer(frame, 8);
+		WriteBits(buffer->Buffer.ByteList, 8, 0, 64, value->Integer);
+		return buffer;
+	}
+
+	if (value->Type != VALUE_OBJECT) return NULL;
+	if (value->Object->Type == BUFFER) return value->Object;
+
+	if (value->Object->Type == STRING) {
+		size_t size = Strlen(value->Object->String) + 1;
+		Token *buffer = NewBuffer(frame, size);
+		Memcpy(buffer->Buffer.ByteList, value->Object->String, size);
+		return buffer;
+	}
+
+	return NULL;
+}
+
+static Token *ToStringObject(AML_Frame *frame, AML_Value *value, uint8_t base) {
+	if (value->Type == VALUE_INTEGER) {
+		char digits[24];
+		return NewString(frame, digits, FormatInteger(digits, value->Integer, base));
+	}
+
+	if (value->Type == VALUE_OBJECT && value->Object->Type == STRING) return value->Object;
+
+	return NULL;
+}
+
+static int Concatenate(AML_Frame *frame, AML_Value *left, AML_Value *right, AML_Value *result) {
+	if (left->Type == VALUE_OBJECT && left->Object->Type == STRING) {
+		Token *tail = ToStringObject(frame, right, 16);
+		if (tail == NULL) return AML_ERROR_UNSUPPORTED;
+
+		size_t leftLength = Strlen(left->Object->String);
+		size_t rightLength = Strlen(tail->String);
+
+		Token *string = NewString(frame, left->Object->String, leftLength + rightLength);
+		Memcpy(string->String + leftLength, tail->String, rightLength);
+		*result = ObjectValue(VALUE_OBJECT, string);
+		return AML_OK;
+	}
+
+	Token *head = ToBufferObject(frame, left);
+	Token *tail = ToBufferObject(frame, right);
+	if (head == NULL || tail == NULL) return AML_ERROR_UNSUPPORTED;
+
+	size_t headSize = head->Buffer.BufferSize.Data;
+	size_t tailSize = tail->Buffer.BufferSize.Data;
+
+	Token *buffer = NewBuffer(frame, headSize + tailSize);
+	Memcpy(buffer->Buffer.ByteList, head->Buffer.ByteList, headSize);
+	Memcpy(buffer->Buffer.ByteList + headSize, tail->Buffer.ByteList, tailSize);
+	*result = ObjectValue(VALUE_OBJECT, buffer);
+
+	return AML_OK;
+}
+
+static int ObjectType(AML_Frame *frame, Token *operand, uint64_t *type) {
+	AML_Value value;
+
+	if (operand->Type == NAMEREF) {
+		AML_FrameObject *object = FindFrameObject(frame, &operand->Name);
+		AML_NamespaceNode *node = object == NULL ? ResolveName(GetNamespace(frame), frame->Scope, &operand->Name) : NULL;
+
+		if (object != NULL && object->IsBufferField) {
+			*type = AML_TYPE_BUFFER_FIELD;
+			return AML_OK;
+		}
+
+		if (node != NULL) {
+			switch (node->Type) {
+				case NODE_FIELD_UNIT:
+					*type = AML_TYPE_FIELD_UNIT;
+					return AML_OK;
+				case NODE_DEVICE:
+					*type = AML_TYPE_DEVICE;
+					return AML_OK;
+				case NODE_METHOD:
+					*type = AML_TYPE_METHOD;
+					return AML_OK;
+				case NODE_REGION:
+					*type = AML_TYPE_REGION;
+					return AML_OK;
+				case NODE_MUTEX:
+					*type = AML_TYPE_MUTEX;
+					return AML_OK;
+				case NODE_EVENT:
+					*type = AML_TYPE_EVENT;
+					return AML_OK;
+				case NODE_THERMAL_ZONE:
+					*type = AML_TYPE_THERMAL_ZONE;
+					return AML_OK;
+				case NODE_PROCESSOR:
+					*type = AML_TYPE_PROCESSOR;
+					return AML_OK;
+				default:
+					break;
+			}
+		}
+	}
+
+	int status = EvalData(frame, operand, &value);
+	if (status != AML_OK) return status;
+
+	if (value.Type == VALUE_INTEGER) *type = AML_TYPE_INTEGER;
+	else if (value.Type != VALUE_OBJECT) *type = AML_TYPE_UNINITIALIZED;
+	else if (value.Object->Type == STRING) *type = AML_TYPE_STRING;
+	else if (value.Object->Type == BUFFER) *type = AML_TYPE_BUFFER;
+	else if (value.Object->Type == PACKAGE) *type = AML_TYPE_PACKAGE;
+	else *type = AML_TYPE_UNINITIALIZED;
+
+	return AML_OK;
+}
+
+static int CreateBufferField(AML_Frame *frame, uint8_t opcode, Token **operands) {
+	AML_Value source;
+	uint64_t index;
+
+	int status = EvalData(frame, operands[0], &source);
+	if (status == AML_OK) status = EvalInteger(frame, operands[1], &index);
+	if (status != AML_OK) return status;
+
+	if (source.Type != VALUE_OBJECT || source.Object->Type != BUFFER || operands[2]->Type != NAMEREF) return AML_ERROR;
+
+	AML_FrameObject *field = CreateFrameObject(frame, &operands[2]->Name);
+	if (field == NULL) return AML_ERROR;
+
+	field->Value = source;
+	field->IsBufferField = true;
+
+	switch (opcode) {
+		case AML_BITFIELD_OP:
+			field->BitOffset = index;
+			field->BitWidth = 1;
+			break;
+		case AML_BYTEFIELD_OP:
+			field->BitOffset = index * 8;
+			field->BitWidth = 8;
+			break;
+		case AML_WORDFIELD_OP:
+			field->BitOffset = index * 8;
+			field->BitWidth = 16;
+			break;
+		case AML_DWORDFIELD_OP:
+			field->BitOffset = index * 8;
+			field->BitWidth = 32;
+			break;
+		default:
+			field->BitOffset = index * 8;
+			field->BitWidth = 64;
+			break;
+	}
+
+	return AML_OK;
+}
+
+static int Index(AML_Frame *frame, Token **operands, AML_Value *result) {
+	AML_Value source;
+	uint64_t index;
+
+	int status = EvalData(frame, operands[0], &source);
+	if (status == AML_OK) status = EvalInteger(frame, operands[1], &index);
+	if (status != AML_OK) return status;
+
+	if (source.Type != VALUE_OBJECT) return AML_ERROR;
+
+	if (source.Object->Type == PACKAGE) {
+		Token *element = source.Object->Children != NULL ? source.Object->Children->Head : NULL;
+		for (uint64_t i = 0; i < index && element != NULL; ++i) element = element->Next;
+		if (element == NULL) return AML_ERROR;
+
+		*result = ObjectValue(VALUE_ELEMENT, element);
+	} else {
+		size_t size;
+		if (ObjectBytes(source.Object, &size) == NULL || index >= size) return AML_ERROR;
+
+		*result = ObjectValue(VALUE_BYTE, source.Object);
+		result->Integer = index;
+	}
+
+	return StoreValue(frame, operands[2], result);
+}
+
+static int Mid(AML_Frame *frame, Token **operands, AML_Value *result) {
+	AML_Value source;
+	uint64_t index, length;
+
+	int status = EvalData(frame, operands[0], &source);
+	if (status == AML_OK) status = EvalInteger(frame, operands[1], &index);
+	if (status == AML_OK) status = EvalInteger(frame, operands[2], &length);
+	if (status != AML_OK) return status;
+
+	if (source.Type != VALUE_OBJECT) return AML_ERROR;
+
+	size_t size;
+	uint8_t *bytes = ObjectBytes(source.Object, &size);
+	if (bytes == NULL) return AML_ERROR;
+
+	if (index > size) index = size;
+	if (length > size - index) length = size - index;
+
+	Token *object;
+	if (source.Object->Type == STRING) {
+		object = NewString(frame, (char*)bytes + index, length);
+	} else {
+		object = NewBuffer(frame, length);
+		Memcpy(object->Buffer.ByteList, bytes + index, length);
+	}
+
+	*result = ObjectValue(VALUE_OBJECT, object);
+
+	return StoreValue(frame, operands[3], result);
+}
+
+static int Arithmetic(AML_Frame *frame, uint8_t opcode, Token **operands, AML_Value *result) {
+	uint64_t a, b, r;
+
+	int status = EvalInteger(frame, operands[0], &a);
+	if (status == AML_OK) status = EvalInteger(frame, operands[1], &b);
+	if (status != AML_OK) return status;
+
+	switch (opcode) {
+		case AML_ADD_OP: r = a + b; break;
+		case AML_SUBTRACT_OP: r = a - b; break;
+		case AML_MULTIPLY_OP: r = a * b; break;
+		case AML_SHL_OP: r = b >= 64 ? 0 : a << b; break;
+		case AML_SHR_OP: r = b >= 64 ? 0 : a >> b; break;
+		case AML_AND_OP: r = a & b; break;
+		case AML_NAND_OP: r = ~(a & b); break;
+		case AML_OR_OP: r = a | b; break;
+		case AML_NOR_OP: r = ~(a | b); break;
+		case AML_XOR_OP: r = a ^ b; break;
+		case AML_MOD_OP:
+			if (b == 0) return AML_ERROR;
+			r = a % b;
+			break;
+		case AML_DIVIDE_OP: {
+			if (b == 0) return AML_ERROR;
+
+			AML_Value remainder = IntegerValue(a % b);
+			status = StoreValue(frame, operands[2], &remainder);
+			if (status != AML_OK) return status;
+
+			*result = IntegerValue(a / b);
+			return StoreValue(frame, operands[3], result);
+			}
+		default:
+			return AML_ERROR_UNSUPPORTED;
+	}
+
+	*result = IntegerValue(r);
+
+	return StoreValue(frame, operands[2], result);
+}
+
+/* The table comes from a SystemMemory region or from a buffer, the target gets its handle */
+static int LoadDefinitionBlock(AML_Frame *frame, Token **operands, AML_Value *result) {
+	AMLExecutive *executive = frame->Context->Executive;
+	uint64_t handle = 0;
+
+	if (operands[0] == NULL || operands[1] == NULL) return AML_ERROR;
+
+	AML_NamespaceNode *node = NULL;
+	if (operands[0]->Type == NAMEREF) node = ResolveName(GetNamespace(frame), frame->Scope, &operands[0]->Name);
+
+	if (node != NULL && node->Type == NODE_REGION) {
+		Token *region = node->Object;
+		if (region->Region.RegionSpace != AML_REGION_SYSTEM_MEMORY) return AML_ERROR_UNSUPPORTED;
+
+		handle = executive->LoadTable((void*)(region->Region.Base + HIGHER_HALF), region->Region.RegionLen.Data, NULL);
+	} else {
+		AML_Value source;
+		int status = EvalData(frame, operands[0], &source);
+		if (status != AML_OK) return status;
+		if (source.Type != VALUE_OBJECT || source.Object->Type != BUFFER) return AML_ERROR;
+
+		handle = executive->LoadTable(source.Object->Buffer.ByteList, source.Object->Buffer.BufferSize.Data, NULL);
+	}
+
+	*result = IntegerValue(handle != 0 ? AML_TRUE : 0);
+
+	AML_Value target = IntegerValue(handle);
+	return StoreValue(frame, operands[1], &target);
+}
+
+static int EvalString(AML_Frame *frame, Token *token, const char **string) {
+	AML_Value value;
+	int status = EvalData(frame, token, &value);
+	if (status != AML_OK) return status;
+	if (value.Type != VALUE_OBJECT || value.Object->Type != STRING) return AML_ERROR;
+
+	*string = value.Object->String;
+
+	return AML_OK;
+}
+
+/* Signature and OEM IDs pick a table from the XSDT, RootPath and ParameterPath are optional */
+static int LoadSystemTable(AML_Frame *frame, Token **operands, AML_Value *result) {
+	const char *signature, *oemId, *oemTableId, *rootPath, *parameterPath;
+
+	int status = EvalString(frame, operands[0], &signature);
+	if (status == AML_OK) status = EvalString(frame, operands[1], &oemId);
+	if (status == AML_OK) status = EvalString(frame, operands[2], &oemTableId);
+	if (status == AML_OK) status = EvalString(frame, operands[3], &rootPath);
+	if (status == AML_OK) status = EvalString(frame, operands[4], &parameterPath);
+	if (status != AML_OK) return status;
+
+	AML_Namespace *ns = GetNamespace(frame);
+	AML_NamespaceNode *scope = ns->Root;
+
+	if (*rootPath != '\0') {
+		scope = FindNode(ns, frame->Scope, rootPath);
+		if (scope == NULL) return AML_ERROR;
+	}
+
+	uint64_t handle = frame->Context->Executive->LoadTable(signature, oemId, oemTableId, scope);
+	*result = IntegerValue(handle);
+	if (handle == 0 || *parameterPath == '\0') return AML_OK;
+
+	AML_NamespaceNode *parameter = FindNode(ns, scope, parameterPath);
+	if (parameter == NULL) return AML_OK;
+
+	AML_Value data;
+	status = EvalData(frame, operands[5], &data);
+	if (status != AML_OK) return status;
+
+	return StoreNode(frame, parameter, &data);
+}
+
+static int ExecuteOperation(AML_Frame *frame, Token *token, AML_Value *result) {
+	/* LoadTable has the most operands */
+	Token *operands[6] = { NULL, NULL, NULL, NULL, NULL, NULL };
+	size_t count = 0;
+
+	if (token->Children != NULL) {
+		for (Token *operand = token->Children->Head; operand != NULL && count < 6; operand = operand->Next) {
+			operands[count++] = operand;
+		}
+	}
+
+	*result = NoneValue();
+
+	uint16_t opcode = token->Operation.Opcode;
+	uint64_t a, b;
+	int status;
+
+	switch (opcode) {
+		case AML_STORE_OP:
+		case AML_COPYOBJECT_OP:
+			status = EvalData(frame, operands[0], result);
+			if (status != AML_OK) return status;
+
+			return StoreValue(frame, operands[1], result);
+		case AML_ADD_OP:
+		case AML_SUBTRACT_OP:
+		case AML_MULTIPLY_OP:
+		case AML_DIVIDE_OP:
+		case AML_MOD_OP:
+		case AML_SHL_OP:
+		case AML_SHR_OP:
+		case AML_AND_OP:
+		case AML_NAND_OP:
+		case AML_OR_OP:
+		case AML_NOR_OP:
+		case AML_XOR_OP:
+			return Arithmetic(frame, opcode, operands, result);
+		case AML_NOT_OP:
+		case AML_FINDSETLEFTBIT_OP:
+		case AML_FINDSETRIGHTBIT_OP:
+			status = EvalInteger(frame, operands[0], &a);
+			if (status != AML_OK) return status;
+
+			if (opcode == AML_NOT_OP) *result = IntegerValue(~a);
+			else if (a == 0) *result = IntegerValue(0);
+			else if (opcode == AML_FINDSETLEFTBIT_OP) *result = IntegerValue(64 - __builtin_clzll(a));
+			else *result = IntegerValue(__builtin_ctzll(a) + 1);
+
+			return StoreValue(frame, operands[1], result);
+		case AML_INCREMENT_OP:
+		case AML_DECREMENT_OP:
+			status = EvalInteger(frame, operands[0], &a);
+			if (status != AML_OK) return status;
+
+			*result = IntegerValue(opcode == AML_INCREMENT_OP ? a + 1 : a - 1);
+			return StoreValue(frame, operands[0], result);
+		case AML_LAND_OP:
+		case AML_LOR_OP:
+			status = EvalInteger(frame, operands[0], &a);
+			if (status == AML_OK) status = EvalInteger(frame, operands[1], &b);
+			if (status != AML_OK) return status;
+
+			if (opcode == AML_LAND_OP) *result = IntegerValue(a && b ? AML_TRUE : 0);
+			else *result = IntegerValue(a || b ? AML_TRUE : 0);
+			return AML_OK;
+		case AML_LNOT_OP:
+			status = EvalInteger(frame, operands[0], &a);
+			if (status != AML_OK) return status;
+
+			*result = IntegerValue(a == 0 ? AML_TRUE : 0);
+			return AML_OK;
+		case AML_LEQUAL_OP:
+		case AML_LGREATER_OP:
+		case AML_LLESS_OP: {
+			AML_Value left, right;
+			int comparison;
+
+			status = EvalData(frame, operands[0], &left);
+			if (status == AML_OK) status = EvalData(frame, operands[1], &right);
+			if (status == AML_OK) status = Compare(frame, &left, &right, &comparison);
+			if (status != AML_OK) return status;
+
+			bool truth = opcode == AML_LEQUAL_OP ? comparison == 0 :
+				     opcode == AML_LGREATER_OP ? comparison > 0 : comparison < 0;
+			*result = IntegerValue(truth ? AML_TRUE : 0);
+			}
+			return AML_OK;
+		case AML_CONCAT_OP: {
+			AML_Value left, right;
+
+			status = EvalData(frame, operands[0], &left);
+			if (status == AML_OK) status = EvalData(frame, operands[1], &right);
+			if (status == AML_OK) status = Concatenate(frame, &left, &right, result);
+			if (status != AML_OK) return status;
+
+			return StoreValue(frame, operands[2], result);
+			}
+		case AML_TOINTEGER_OP:
+			status = EvalInteger(frame, operands[0], &a);
+			if (status != AML_OK) return status;
+
+			*result = IntegerValue(a);
+			return StoreValue(frame, operands[1], result);
+		case AML_TOBUFFER_OP:
+		case AML_TOHEXSTRING_OP:
+		case AML_TODECIMALSTRING_OP: {
+			AML_Value source;
+			status = EvalData(frame, operands[0], &source);
+			if (status != AML_OK) return status;
+
+			Token *object = opcode == AML_TOBUFFER_OP ? ToBufferObject(frame, &source) :
+					ToStringObject(frame, &source, opcode == AML_TOHEXSTRING_OP ? 16 : 10);
+			if (object == NULL) return AML_ERROR_UNSUPPORTED;
+
+			*result = ObjectValue(VALUE_OBJECT, object);
+			return StoreValue(frame, operands[1], result);
+			}
+		case AML_TOSTRING_OP: {
+			AML_Value source;
+			status = EvalData(frame, operands[0], &source);
+			if (status == AML_OK) status = EvalInteger(frame, operands[1], &a);
+			if (status != AML_OK) return status;
+
+			if (source.Type != VALUE_OBJECT || source.Object->Type != BUFFER) return AML_ERROR;
+
+			size_t length = 0;
+			size_t size = source.Object->Buffer.BufferSize.Data;
+			while (length < size && length < a && source.Object->Buffer.ByteList[length] != 0) length++;
+
+			*result = ObjectValue(VALUE_OBJECT, NewString(frame, (char*)source.Object->Buffer.ByteList, length));
+			return StoreValue(frame, operands[2], result);
+			}
+		case AML_MID_OP:
+			return Mid(frame, operands, result);
+		case AML_SIZEOF_OP: {
+			AML_Value source;
+			status = EvalData(frame, operands[0], &source);
+			if (status != AML_OK) return status;
+
+			if (source.Type != VALUE_OBJECT) return AML_ERROR;
+
+			size_t size;
+			if (source.Object->Type == PACKAGE) size = source.Object->Package.NumElements;
+			else if (ObjectBytes(source.Object, &size) == NULL) return AML_ERROR;
+
+			*result = IntegerValue(size);
+			}
+			return AML_OK;
+		case AML_OBJECTTYPE_OP:
+			status = ObjectType(frame, operands[0], &a);
+			if (status != AML_OK) return status;
+
+			*result = IntegerValue(a);
+			return AML_OK;
+		case AML_INDEX_OP:
+			return Index(frame, operands, result);
+		case AML_DEREF_OP:
+			status = EvalTerm(frame, operands[0], result);
+			if (status != AML_OK) return status;
+
+			/* A string holds the path of the object */
+			if (result->Type == VALUE_OBJECT && result->Object->Type == STRING) {
+				AML_NamespaceNode *node = FindNode(GetNamespace(frame), frame->Scope, result->Object->String);
+				if (node == NULL) return AML_ERROR;
+
+				*result = NodeValue(node);
+			}
+
+			return Deref(frame, result);
+		case AML_REFOF_OP:
+		case AML_EXTENDED(AML_CONDREF_OP): {
+			AML_NamespaceNode *node = NULL;
+			if (operands[0]->Type == NAMEREF) node = ResolveName(GetNamespace(frame), frame->Scope, &operands[0]->Name);
+
+			if (opcode == AML_REFOF_OP) {
+				if (node == NULL) return EvalTerm(frame, operands[0], result);
+
+				*result = NodeValue(node);
+				return AML_OK;
+			}
+
+			if (node == NULL) {
+				*result = IntegerValue(0);
+				return AML_OK;
+			}
+
+			AML_Value reference = NodeValue(node);
+			*result = IntegerValue(AML_TRUE);
+			return StoreValue(frame, operands[1], &reference);
+			}
+		case AML_EXTENDED(AML_ACQUIRE_OP): {
+			AML_Mutex *mutex = FindMutex(frame, operands[0]);
+			if (mutex == NULL || operands[1] == NULL) return AML_ERROR;
+
+			bool acquired;
+			status = AcquireHeld(frame->Context, mutex, operands[1]->Int.Data, &acquired);
+			if (status != AML_OK) return status;
+
+			/* True means the timeout expired */
+			*result = IntegerValue(acquired ? 0 : AML_TRUE);
+			}
+			return AML_OK;
+		case AML_EXTENDED(AML_RELEASE_OP): {
+			AML_Mutex *mutex = FindMutex(frame, operands[0]);
+			if (mutex == NULL) return AML_ERROR;
+
+			return ReleaseHeld(frame->Context, mutex);
+			}
+		case AML_EXTENDED(AML_SLEEP_OP):
+			status = EvalInteger(frame, operands[0], &a);
+			if (status != AML_OK) return status;
+
+			Sleep(frame, a * 1000000ull);
+			return AML_OK;
+		case AML_EXTENDED(AML_STALL_OP):
+			status = EvalInteger(frame, operands[0], &a);
+			if (status != AML_OK) return status;
+
+			Stall(frame, a);
+			return AML_OK;
+		case AML_EXTENDED(AML_WAIT_OP):
+		case AML_EXTENDED(AML_SIGNAL_OP):
+		case AML_EXTENDED(AML_RESET_OP): {
+			Token *event = FindEvent(frame, operands[0]);
+			if (event == NULL) return AML_ERROR;
+
+			if (opcode == AML_EXTENDED(AML_SIGNAL_OP)) {
+				__atomic_fetch_add(&event->Event.Count, 1, __ATOMIC_RELEASE);
+				return AML_OK;
+			}
+
+			if (opcode == AML_EXTENDED(AML_RESET_OP)) {
+				__atomic_store_n(&event->Event.Count, 0, __ATOMIC_RELAXED);
+				return AML_OK;
+			}
+
+			status = EvalInteger(frame, operands[1], &a);
+			if (status != AML_OK) return status;
+
+			/* True means the timeout expired */
+			*result = IntegerValue(WaitForEvent(frame, event, a) ? 0 : AML_TRUE);
+			}
+			return AML_OK;
+		case AML_EXTENDED(AML_TIMER_OP):
+			/* In 100ns units */
+			*result = IntegerValue(ReadTimerWheelNanoseconds(frame->Context->Executive->GetTimerWheel()) / 100);
+			return AML_OK;
+		case AML_EXTENDED(AML_LOAD_OP):
+			return LoadDefinitionBlock(frame, operands, result);
+		case AML_EXTENDED(AML_LOAD_TABLE_OP):
+			return LoadSystemTable(frame, operands, result);
+		case AML_EXTENDED(AML_UNLOAD_OP):
+			status = EvalInteger(frame, operands[0], &a);
+			if (status != AML_OK) return status;
+
+			return frame->Context->Executive->UnloadTable(a) ? AML_OK : AML_ERROR;
+		case AML_BITFIELD_OP:
+		case AML_BYTEFIELD_OP:
+		case AML_WORDFIELD_OP:
+		case AML_DWORDFIELD_OP:
+		case AML_QWORDFIELD_OP:
+			return CreateBufferField(frame, opcode, operands);
+		case AML_RETURN_OP:
+			status = EvalData(frame, operands[0], &frame->Return);
+			if (status != AML_OK) return status;
+
+			return AML_RETURN;
+		case AML_BREAK_OP:
+			return AML_BREAK;
+		case AML_CONTINUE_OP:
+			return AML_CONTINUE;
+		case AML_NOP_OP:
+		case AML_BREAKPOINT_OP:
+		case AML_EXTENDED(AML_DEBUG_OP):
+			return AML_OK;
+		case AML_EXTENDED(AML_REVISION_OP):
+			*result = IntegerValue(AML_INTERPRETER_REVISION);
+			return AML_OK;
+		default:
+			return AML_ERROR_UNSUPPORTED;
+	}
+}
+
+/* Statements */
+
+static bool IsStaticData(Token *token) {
+	switch (token->Type) {
+		case LOCAL:
+		case ARG:
+		case OPERATION:
+		case CALL:
+			return false;
+		default:
+			return true;
+	}
+}
+
+static int EvalPackage(AML_Frame *frame, Token *token, AML_Value *value) {
+	bool isStatic = true;
+
+	if (token->Children != NULL) {
+		for (Token *element = token->Children->Head; element != NULL && isStatic; element = element->Next) {
+			isStatic = IsStaticData(element);
+		}
+	}
+
+	/* Packages without expressions are used straight from the table */
+	if (isStatic) {
+		*value = ObjectValue(VALUE_OBJECT, token);
+		return AML_OK;
+	}
+
+	Token *package = Keep(frame, NewToken(PACKAGE, TOKEN_TEMPORARY));
+	package->Package = token->Package;
+	package->Children = CreateTokenList();
+
+	for (Token *element = token->Children->Head; element != NULL; element = element->Next) {
+		if (IsStaticData(element)) {
+			AppendElement(package, CopyToken(element, TOKEN_TEMPORARY));
+			continue;
+		}
+
+		AML_Value elementValue;
+		int status = EvalData(frame, element, &elementValue);
+		if (status != AML_OK) return status;
+
+		if (elementValue.Type == VALUE_INTEGER) {
+			Token *integer = NewToken(INTEGER, TOKEN_TEMPORARY);
+			integer->Int.Data = elementValue.Integer;
+			integer->Int.Size = 8;
+			AppendElement(package, integer);
+		} else if (elementValue.Type == VALUE_OBJECT) {
+			AppendElement(package, CopyToken(elementValue.Object, TOKEN_TEMPORARY));
+		} else {
+			return AML_ERROR_UNSUPPORTED;
+		}
+	}
+
+	*value = ObjectValue(VALUE_OBJECT, package);
+
+	return AML_OK;
+}
+
+static int DeclareName(AML_Frame *frame, Token *token) {
+	AML_Value value = NoneValue();
+
+	if (token->Children != NULL && token->Children->Head != NULL) {
+		int status = EvalData(frame, token->Children->Head, &value);
+		if (status != AML_OK) return status;
+	}
+
+	/* Every invocation works on its own copy, e.g. a resource template it patches */
+	if (value.Type == VALUE_OBJECT && !(value.Object->Flags & TOKEN_TEMPORARY)) {
+		value.Object = Keep(frame, CopyToken(value.Object, TOKEN_TEMPORARY));
+	}
+
+	AML_FrameObject *object = CreateFrameObject(frame, &token->Name);
+	if (object == NULL) return AML_ERROR;
+
+	object->Value = value;
+
+	return AML_OK;
+}
+
+static int EvalCall(AML_Frame *frame, Token *token, AML_Value *value) {
+	AML_Value args[AML_MAX_ARGS];
+	size_t argCount = 0;
+
+	if (token->Children != NULL) {
+		for (Token *arg = token->Children->Head; arg != NULL && argCount < AML_MAX_ARGS; arg = arg->Next) {
+			int status = EvalTerm(frame, arg, &args[argCount]);
+			if (status != AML_OK) return status;
+
+			/* References made with RefOf are passed as is, everything else by value */
+			if (args[argCount].Type != VALUE_NODE) {
+				status = Deref(frame, &args[argCount]);
+				if (status != AML_OK) return status;
+			}
+
+			argCount++;
+		}
+	}
+
+	return ExecuteMethod(frame->Context, token->Call.Method, args, argCount, frame, value);
+}
+
+static int ExecuteWhile(AML_Frame *frame, Token *token) {
+	for (size_t iterations = 0; ; ++iterations) {
+		if (iterations >= AML_MAX_LOOP_ITERATIONS) return AML_ERROR;
+
+		uint64_t predicate;
+		int status = EvalInteger(frame, token->Children->Head, &predicate);
+		if (status != AML_OK) return status;
+		if (predicate == 0) return AML_OK;
+
+		status = ExecuteList(frame, token->Control.Body);
+		if (status == AML_BREAK) return AML_OK;
+		if (status != AML_OK && status != AML_CONTINUE) return status;
+	}
+}
+
+static int EvalTerm(AML_Frame *frame, Token *token, AML_Value *value) {
+	*value = NoneValue();
+
+	if (token == NULL) return AML_ERROR;
+
+	switch (token->Type) {
+		case ZERO:
+		case ONE:
+		case INTEGER:
+		case STRING:
+		case BUFFER:
+			ValueFromToken(token, value);
+			return AML_OK;
+		case PACKAGE:
+			return EvalPackage(frame, token, value);
+		case LOCAL:
+			if (token->Slot.Index >= AML_MAX_LOCALS) return AML_ERROR;
+
+			*value = frame->Locals[token->Slot.Index];
+			return AML_OK;
+		case ARG:
+			if (token->Slot.Index >= AML_MAX_ARGS) return AML_ERROR;
+
+			*value = frame->Args[token->Slot.Index];
+			return AML_OK;
+		case NAMEREF: {
+			AML_FrameObject *object = FindFrameObject(frame, &token->Name);
+			if (object != NULL) return ReadFrameObject(object, value);
+
+			AML_NamespaceNode *node = ResolveName(GetNamespace(frame), frame->Scope, &token->Name);
+			if (node == NULL) return AML_ERROR;
+
+			return ReadNode(frame, node, value);
+			}
+		case CALL:
+			return EvalCall(frame, token, value);
+		case OPERATION:
+			return ExecuteOperation(frame, token, value);
+		case NAME:
+			return DeclareName(frame, token);
+		case NOTIFY: {
+			uint64_t notifyValue;
+			int status = EvalInteger(frame, token->Children->Head, &notifyValue);
+			if (status != AML_OK) return status;
+
+			AML_NamespaceNode *node = ResolveName(GetNamespace(frame), frame->Scope, &token->Notify.Object);
+			if (node == NULL) return AML_ERROR;
+
+			frame->Context->Executive->Notify(node, notifyValue);
+			}
+			return AML_OK;
+		default:
+			return AML_ERROR_UNSUPPORTED;
+	}
+}
+
+static int ExecuteList(AML_Frame *frame, TokenList *list) {
+	for (Token *token = list->Head; token != NULL; token = token->Next) {
+		int status;
+
+		if (token->Type == CONTROL) {
+			switch (token->Control.Opcode) {
+				case AML_IF_OP: {
+					uint64_t predicate;
+					status = EvalInteger(frame, token->Children->Head, &predicate);
+					if (status != AML_OK) return status;
+
+					Token *next = token->Next;
+					bool hasElse = next != NULL && next->Type == CONTROL && next->Control.Opcode == AML_ELSE_OP;
+
+					if (predicate != 0) status = ExecuteList(frame, token->Control.Body);
+					else if (hasElse) status = ExecuteList(frame, next->Control.Body);
+
+					if (hasElse) token = next;
+					}
+					break;
+				case AML_WHILE_OP:
+					status = ExecuteWhile(frame, token);
+					break;
+				default:
+					/* An Else whose If was not right before it */
+					status = AML_OK;
+					break;
+			}
+		} else {
+			AML_Value value;
+			status = EvalTerm(frame, token, &value);
+		}
+
+		if (status != AML_OK) return status;
+	}
+
+	return AML_OK;
+}
+
+/* Folding */
+
+struct AML_Fold {
+	AML_Frame *Frame;
+	/* The whole method body, names it declares live in the frame and are never folded */
+	TokenList *Code;
+	bool UseNames;
+	/* Some Name's value was folded in, the code is only good until one of them is written */
+	bool Dependent;
+};
+
+/* Number of leading operands that must be constant, the rest are targets. Zero when the opcode is never folded */
+static size_t FoldedOperands(uint16_t opcode) {
+	switch (opcode) {
+		case AML_ADD_OP:
+		case AML_SUBTRACT_OP:
+		case AML_MULTIPLY_OP:
+		case AML_DIVIDE_OP:
+		case AML_MOD_OP:
+		case AML_SHL_OP:
+		case AML_SHR_OP:
+		case AML_AND_OP:
+		case AML_NAND_OP:
+		case AML_OR_OP:
+		case AML_NOR_OP:
+		case AML_XOR_OP:
+		case AML_LAND_OP:
+		case AML_LOR_OP:
+		case AML_LEQUAL_OP:
+		case AML_LGREATER_OP:
+		case AML_LLESS_OP:
+			return 2;
+		case AML_NOT_OP:
+		case AML_FINDSETLEFTBIT_OP:
+		case AML_FINDSETRIGHTBIT_OP:
+		case AML_LNOT_OP:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static bool IsBufferFieldOpcode(uint16_t opcode) {
+	return opcode == AML_BITFIELD_OP || opcode == AML_BYTEFIELD_OP || opcode == AML_WORDFIELD_OP ||
+	       opcode == AML_DWORDFIELD_OP || opcode == AML_QWORDFIELD_OP;
+}
+
+/* Names the body creates live in the frame and shadow the namespace */
+static bool DeclaresName(TokenList *list, NameType *name) {
+	if (list == NULL) return false;
+
+	for (Token *token = list->Head; token != NULL; token = token->Next) {
+		NameType *declared = NULL;
+
+		if (token->Type == NAME) declared = &token->Name;
+		else if (token->Type == OPERATION && IsBufferFieldOpcode(token->Operation.Opcode) &&
+			 token->Children->Head != NULL && token->Children->Head->Next != NULL) {
+			Token *target = token->Children->Head->Next->Next;
+			if (target != NULL && target->Type == NAMEREF) declared = &target->Name;
+		}
+
+		if (declared != NULL && declared->SegmentNumber == 1 && Memcmp(declared->NameSegments, name->NameSegments, 4) == 0) return true;
+
+		if (token->Type == CONTROL && DeclaresName(token->Control.Body, name)) return true;
+	}
+
+	return false;
+}
+
+static bool FoldConstant(AML_Fold *fold, Token *token, uint64_t *value) {
+	if (GetTokenInteger(token, value)) return true;
+	if (!fold->UseNames || token->Type != NAMEREF) return false;
+
+	if (token->Name.SegmentNumber == 1 && !token->Name.IsRoot && token->Name.ParentPrefixes == 0 && DeclaresName(fold->Code, &token->Name)) return false;
+
+	AML_NamespaceNode *node = ResolveName(GetNamespace(fold->Frame), fold->Frame->Scope, &token->Name);
+	if (node == NULL || node->Type != NODE_NAME || node->Object->Children == NULL) return false;
+
+	/* Flagged before the value is read, a store racing with us sees the flag or we see its value */
+	Token *name = node->Object;
+	__atomic_fetch_or(&name->Flags, TOKEN_FOLDED, __ATOMIC_SEQ_CST);
+
+	Token *object = __atomic_load_n(&name->Children->Head, __ATOMIC_SEQ_CST);
+	if (object == NULL || object->Type != INTEGER) return false;
+
+	*value = __atomic_load_n(&object->Int.Data, __ATOMIC_SEQ_CST);
+	fold->Dependent = true;
+
+	return true;
+}
+
+static size_t CountTokens(TokenList *list) {
+	size_t count = 0;
+	if (list == NULL) return 0;
+
+	for (Token *token = list->Head; token != NULL; token = token->Next) {
+		count += 1 + CountTokens(token->Children);
+		if (token->Type == CONTROL) count += CountTokens(token->Control.Body);
+	}
+
+	return count;
+}
+
+/* The interpreter computes the folded value itself, so it is exactly what running the code gives */
+static size_t FoldOperation(AML_Fold *fold, Token *token) {
+	size_t removed = 0;
+	if (token->Children == NULL) return 0;
+
+	for (Token *operand = token->Children->Head; operand != NULL; operand = operand->Next) {
+		if (operand->Type == OPERATION) removed += FoldOperation(fold, operand);
+	}
+
+	size_t constants = FoldedOperands(token->Operation.Opcode);
+	if (constants == 0) return removed;
+
+	uint64_t values[2];
+	size_t count = 0;
+
+	for (Token *operand = token->Children->Head; operand != NULL; operand = operand->Next, ++count) {
+		if (count < constants && !FoldConstant(fold, operand, &values[count])) return removed;
+		if (count >= constants && operand->Type != ZERO) return removed;
+	}
+
+	if (count < constants) return removed;
+
+	/* Names become literals first, the result is the same as long as they are not written */
+	Token *operand = token->Children->Head;
+	for (size_t i = 0; i < constants; ++i, operand = operand->Next) {
+		if (operand->Type != NAMEREF) continue;
+
+		operand->Type = INTEGER;
+		operand->Int.Data = values[i];
+		operand->Int.Size = 8;
+	}
+
+	AML_Value result;
+	if (ExecuteOperation(fold->Frame, token, &result) != AML_OK || result.Type != VALUE_INTEGER) return removed;
+
+	removed += CountTokens(token->Children);
+	FreeTokenList(token->Children);
+	FreeMemory(token->Children);
+
+	token->Type = INTEGER;
+	token->Children = NULL;
+	token->Int.Data = result.Integer;
+	token->Int.Size = 8;
+
+	__atomic_fetch_add(&FoldStats.Folded, 1, __ATOMIC_RELAXED);
+
+	return removed;
+}
+
+static size_t FoldList(AML_Fold *fold, TokenList *list);
+
+/* Folds the predicate of a control token, true when it turned out constant */
+static bool FoldPredicate(AML_Fold *fold, Token *token, size_t *removed, uint64_t *value) {
+	Token *predicate = token->Children != NULL ? token->Children->Head : NULL;
+	if (predicate == NULL) return false;
+
+	if (predicate->Type == OPERATION) *removed += FoldOperation(fold, predicate);
+
+	return FoldConstant(fold, predicate, value);
+}
+
+/*
+ * An If whose predicate is known is replaced by the body that would run,
+ * along with its Else. A While that never runs goes entirely.
+ */
+static size_t FoldList(AML_Fold *fold, TokenList *list) {
+	size_t removed = 0;
+	if (list == NULL) return 0;
+
+	Token *previous = NULL;
+	Token **link = &list->Head;
+
+	while (*link != NULL) {
+		Token *token = *link;
+		uint64_t value;
+
+		if (token->Type == OPERATION) {
+			removed += FoldOperation(fold, token);
+		} else if (token->Type == CALL && token->Children != NULL) {
+			for (Token *argument = token->Children->Head; argument != NULL; argument = argument->Next) {
+				if (argument->Type == OPERATION) removed += FoldOperation(fold, argument);
+			}
+		} else if (token->Type == CONTROL && token->Control.Opcode != AML_ELSE_OP && FoldPredicate(fold, token, &removed, &value)) {
+			Token *next = token->Next;
+			Token *otherwise = NULL;
+
+			if (token->Control.Opcode == AML_IF_OP && next != NULL && next->Type == CONTROL && next->Control.Opcode == AML_ELSE_OP) {
+				otherwise = next;
+				next = next->Next;
+			}
+
+			TokenList *taken = NULL;
+			if (token->Control.Opcode == AML_IF_OP) taken = value != 0 ? token->Control.Body : (otherwise != NULL ? otherwise->Control.Body : NULL);
+
+			/* While (One) and friends stay as they are */
+			if (token->Control.Opcode == AML_WHILE_OP && value != 0) {
+				removed += FoldList(fold, token->Control.Body);
+				previous = token;
+				link = &token->Next;
+				continue;
+			}
+
+			Token *first = next;
+			if (taken != NULL && taken->Head != NULL) {
+				first = taken->Head;
+				taken->Tail->Next = next;
+				if (next == NULL) list->Tail = taken->Tail;
+
+				taken->Head = NULL;
+				taken->Tail = NULL;
+			} else if (next == NULL) {
+				list->Tail = previous;
+			}
+
+			*link = first;
+
+			removed += 1 + CountTokens(token->Children) + CountTokens(token->Control.Body);
+			FreeToken(token);
+
+			if (otherwise != NULL) {
+				removed += 1 + CountTokens(otherwise->Control.Body);
+				FreeToken(otherwise);
+			}
+
+			__atomic_fetch_add(&FoldStats.Pruned, 1, __ATOMIC_RELAXED);
+
+			/* The spliced body is folded as part of this list */
+			continue;
+		} else if (token->Type == CONTROL) {
+			removed += FoldList(fold, token->Control.Body);
+		}
+
+		previous = token;
+		link = &token->Next;
+	}
+
+	return removed;
+}
+
+static void FreeRetiredCode(void *code) {
+	FreeTokenList((TokenList*)code);
+	FreeMemory(code);
+}
+
+/* Methods */
+
+static TokenList *ParseMethodCode(AML_Context *context, AML_NamespaceNode *method, bool useNames) {
+	Token *token = method->Object;
+	AMLExecutive *executive = context->Executive;
+
+	/* A private copy of the hashmap carries the scope calls are resolved in */
+	AML_Hashmap hashmap = *executive->GetHashmap();
+	hashmap.Namespace = executive->GetNamespace();
+	hashmap.Scope = method;
+
+	AmlCursor cursor;
+	InitCursor(&cursor, token->Method.Body, token->Method.BodyLength);
+	TokenList *code = ParseTermList(&hashmap, &cursor, cursor.End);
+
+	/* Read before any value is, a store in between makes the code stale right away */
+	uint64_t generation = executive->GetFoldGeneration();
+
+	/* Folded operations only ever see integers, nothing here is filled in */
+	AML_Frame frame;
+	frame.Context = context;
+	frame.Scope = method;
+	frame.Objects = NULL;
+	frame.SleepNs = 0;
+	frame.Temporaries = NULL;
+	frame.Return = NoneValue();
+
+	for (size_t i = 0; i < AML_MAX_ARGS; ++i) frame.Args[i] = NoneValue();
+	for (size_t i = 0; i < AML_MAX_LOCALS; ++i) frame.Locals[i] = NoneValue();
+
+	AML_Fold fold;
+	fold.Frame = &frame;
+	fold.Code = code;
+	fold.UseNames = useNames;
+	fold.Dependent = false;
+
+	size_t before = CountTokens(code);
+	size_t removed = FoldList(&fold, code);
+
+	__atomic_fetch_add(&FoldStats.Methods, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&FoldStats.Tokens, before, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&FoldStats.Removed, removed, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&token->Method.FoldGeneration, fold.Dependent ? generation : 0, __ATOMIC_RELAXED);
+
+	return code;
+}
+
+/*
+ * Bodies are parsed and folded on their first call, not when Parse or
+ * LoadTable runs. Most methods of a DSDT never run, and any later load or
+ * unload moves the fold generation on, so code folded against Names at
+ * load time would be parsed again on its first call anyway.
+ */
+static TokenList *GetMethodCode(AML_Context *context, AML_NamespaceNode *method) {
+	Token *token = method->Object;
+	uint8_t state = __atomic_load_n(&token->Method.CodeState, __ATOMIC_ACQUIRE);
+
+	if (state == METHOD_CODE_PARSED) {
+		uint64_t folded = __atomic_load_n(&token->Method.FoldGeneration, __ATOMIC_RELAXED);
+		if (folded == 0 || folded == context->Executive->GetFoldGeneration()) return token->Method.Code;
+
+		/* A Name the code was folded against was written, parse again without any of them */
+		if (__atomic_compare_exchange_n(&token->Method.CodeState, &state, METHOD_CODE_PARSING,
+						false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+			TokenList *stale = token->Method.Code;
+			token->Method.Code = ParseMethodCode(context, method, false);
+			__atomic_store_n(&token->Method.CodeState, METHOD_CODE_PARSED, __ATOMIC_RELEASE);
+
+			/* Invocations on other cores may still be running the old code */
+			RetireObject(context->Executive->GetNamespace(), stale, FreeRetiredCode);
+			__atomic_fetch_add(&FoldStats.Invalidations, 1, __ATOMIC_RELAXED);
+
+			return token->Method.Code;
+		}
+	}
+
+	uint8_t expected = METHOD_CODE_UNPARSED;
+	if (__atomic_compare_exchange_n(&token->Method.CodeState, &expected, METHOD_CODE_PARSING,
+					false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+		token->Method.Code = ParseMethodCode(context, method, true);
+
+		__atomic_store_n(&token->Method.CodeState, METHOD_CODE_PARSED, __ATOMIC_RELEASE);
+		return token->Method.Code;
+	}
+
+	/* Another core is parsing it, once per method and once more if a folded Name is written */
+	while (__atomic_load_n(&token->Method.CodeState, __ATOMIC_ACQUIRE) != METHOD_CODE_PARSED) CpuRelax();
+
+	return token->Method.Code;
+}
+
+/* Moves a result out of the frame that is about to be torn down */
+static int Adopt(AML_Frame *frame, AML_Frame *caller, AML_Value *value) {
+	if (value->Type == VALUE_ELEMENT || value->Type == VALUE_BYTE) {
+		int status = Deref(frame, value);
+		if (status != AML_OK) return status;
+	}
+
+	if (value->Type == VALUE_OBJECT && (value->Object->Flags & TOKEN_TEMPORARY)) {
+		value->Object = Keep(caller, CopyToken(value->Object, TOKEN_TEMPORARY));
+	}
+
+	return AML_OK;
+}
+
+static void FreeFrame(AML_Frame *frame) {
+	Token *temporary = frame->Temporaries;
+	while (temporary != NULL) {
+		Token *next = temporary->Next;
+		ReleaseTemporary(temporary);
+		temporary = next;
+	}
+
+	AML_FrameObject *object = frame->Objects;
+	while (object != NULL) {
+		AML_FrameObject *next = object->Next;
+		FreeMemory(object);
+		object = next;
+	}
+}
+
+int ExecuteMethod(AML_Context *context, AML_NamespaceNode *method, const AML_Value *args, size_t argCount, AML_Frame *caller, AML_Value *result) {
+	*result = NoneValue();
+
+	if (method == NULL || method->Type != NODE_METHOD || method->Object == NULL) return AML_ERROR;
+	if (context->Depth >= AML_MAX_CALL_DEPTH) return AML_ERROR_DEPTH;
+
+	Token *token = method->Object;
+	TokenList *code = GetMethodCode(context, method);
+	if (code == NULL) return AML_ERROR;
+
+	/* Serialized methods take their own mutex, everything else runs on as many cores as call it */
+	bool serialized = token->Method.MethodFlags & AML_METHOD_SERIALIZED;
+	uint8_t syncLevel = context->SyncLevel;
+
+	if (serialized) {
+		AML_Mutex *mutex = &token->Method.Mutex;
+
+		/* Taking a lower level mutex while holding a higher one is how deadlocks start */
+		if (__atomic_load_n(&mutex->Owner, __ATOMIC_RELAXED) != context && mutex->SyncLevel < context->SyncLevel) {
+			return AML_ERROR_SYNC_LEVEL;
+		}
+
+		/* Waiters park on the timer wheel like Acquire does */
+		WaitForMutex(context, mutex, AML_WAIT_FOREVER);
+		context->SyncLevel = mutex->SyncLevel > syncLevel ? mutex->SyncLevel : syncLevel;
+	}
+
+	AML_Frame frame;
+	frame.Context = context;
+	frame.Scope = method;
+	frame.Objects = NULL;
+	frame.SleepNs = 0;
+	frame.Temporaries = NULL;
+	frame.Return = NoneValue();
+
+	for (size_t i = 0; i < AML_MAX_ARGS; ++i) frame.Args[i] = i < argCount && args != NULL ? args[i] : NoneValue();
+	for (size_t i = 0; i < AML_MAX_LOCALS; ++i) frame.Locals[i] = NoneValue();
+
+	AML_Mutex *held = context->Held;
+	AML_TimerWheel *wheel = context->Executive->GetTimerWheel();
+	uint64_t start = ReadTimerWheelNanoseconds(wheel);
+
+	/* Disabled, profiling costs this branch and the one below */
+	AML_ProfileFrame profile;
+	if (context->Profiler != NULL) {
+		EnterProfileFrame(&profile, context->Profile, method, start);
+		context->Profile = &profile;
+	}
+
+	context->Depth++;
+	int status = ExecuteList(&frame, code);
+	context->Depth--;
+
+	ReleaseAbandoned(context, held);
+
+	uint64_t end = ReadTimerWheelNanoseconds(wheel);
+	if (context->Profiler != NULL) {
+		LeaveProfileFrame(context->Profiler, &profile, end, frame.SleepNs);
+		context->Profile = profile.Caller;
+	}
+
+	__atomic_fetch_add(&token->Method.Stats.Calls, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&token->Method.Stats.ElapsedNs, end - start, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&token->Method.Stats.SleepNs, frame.SleepNs, __ATOMIC_RELAXED);
+	if (caller != NULL) caller->SleepNs += frame.SleepNs;
+
+	/* Break and Continue outside of a loop just end the method */
+	if (status > AML_OK) status = AML_OK;
+
+	if (status == AML_OK) {
+		status = Adopt(&frame, caller, &frame.Return);
+		*result = frame.Return;
+	}
+
+	FreeFrame(&frame);
+
+	if (serialized) {
+		context->SyncLevel = syncLevel;
+		ReleaseMutex(&token->Method.Mutex);
+	}
+
+	return status;
+}
+
+bool GetMethodStats(AML_NamespaceNode *method, AML_MethodStats *stats) {
+	if (method == NULL || method->Type != NODE_METHOD || method->Object == NULL) return false;
+
+	AML_MethodStats *source = &method->Object->Method.Stats;
+	stats->Calls = __atomic_load_n(&source->Calls, __ATOMIC_RELAXED);
+	stats->ElapsedNs = __atomic_load_n(&source->ElapsedNs, __ATOMIC_RELAXED);
+	stats->SleepNs = __atomic_load_n(&source->SleepNs, __ATOMIC_RELAXED);
+
+	return true;
+}
+
+Token *ValueToToken(AML_Value *value) {
+	switch (value->Type) {
+		case VALUE_INTEGER: {
+			Token *integer = NewToken(INTEGER, TOKEN_TEMPORARY);
+			integer->Int.Data = value->Integer;
+			integer->Int.Size = 8;
+			return integer;
+			}
+		case VALUE_OBJECT:
+			/* A Store may retire a named object once the caller has left the namespace */
+			if (value->Object->Flags & TOKEN_TEMPORARY) return value->Object;
+			return CopyToken(value->Object, TOKEN_TEMPORARY);
+		default:
+			return NULL;
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "aml_opcodes.h"
+#include "token.h"
+#include "namespace.h"
+#include "profiler.h"
+
+class AMLExecutive;
+
+#define AML_OK 0
+#define AML_ERROR -1
+#define AML_ERROR_UNSUPPORTED -2
+#define AML_ERROR_SYNC_LEVEL -3
+#define AML_ERROR_DEPTH -4
+
+#define AML_MAX_CALL_DEPTH 32
+/* Bounds While loops polling hardware that never answers */
+#define AML_MAX_LOOP_ITERATIONS 0x100000
+
+#define AML_INTERPRETER_REVISION 1
+
+enum AML_ValueType {
+	VALUE_NONE,
+	VALUE_INTEGER,
+	/* A string, buffer or package token, or a name inside a package */
+	VALUE_OBJECT,
+	/* RefOf, or a named object that holds no data */
+	VALUE_NODE,
+	/* Index into a package, Object is the element */
+	VALUE_ELEMENT,
+	/* Index into a buffer or a string, Integer is the byte */
+	VALUE_BYTE,
+};
+
+struct AML_Value {
+	AML_ValueType Type;
+	uint64_t Integer;
+	Token *Object;
+	AML_NamespaceNode *Node;
+};
+
+/*
+ * One per thread of execution. Its address owns every mutex taken on its
+ * behalf, so a Serialized method can call back into itself.
+ */
+struct AML_Context {
+	AMLExecutive *Executive;
+	uint8_t SyncLevel;
+	uint32_t Depth;
+
+	/* Mutexes taken with Acquire, most recent first */
+	AML_Mutex *Held;
+
+	/* NULL unless profiling, then the innermost running method */
+	AML_Profiler *Profiler;
+	AML_ProfileFrame *Profile;
+};
+
+struct AML_MutexStats {
+	uint64_t Acquisitions;
+	/* Acquisitions that missed the compare-and-swap fast path */
+	uint64_t Contended;
+	uint64_t Timeouts;
+	uint64_t SyncLevelErrors;
+};
+
+struct AML_FoldStats {
+	/* Methods called at least once, bodies are folded on the first call */
+	uint64_t Methods;
+	/* Tokens parsed and how many of them folding took out */
+	uint64_t Tokens;
+	uint64_t Removed;
+	uint64_t Folded;
+	/* Control tokens whose predicate turned out constant */
+	uint64_t Pruned;
+	/* Methods parsed again because a Name folded into them was written */
+	uint64_t Invalidations;
+};
+
+/* Objects created by Name and CreateXField inside a method live in its frame */
+struct AML_FrameObject {
+	char Name[4];
+	AML_Value Value;
+
+	bool IsBufferField;
+	uint32_t BitOffset;
+	uint32_t BitWidth;
+
+	AML_FrameObject *Next;
+};
+
+/* Per invocation, nothing in here is shared with other cores */
+struct AML_Frame {
+	AML_Context *Context;
+	AML_NamespaceNode *Scope;
+
+	AML_Value Args[AML_MAX_ARGS];
+	AML_Value Locals[AML_MAX_LOCALS];
+
+	AML_FrameObject *Objects;
+	/* Time parked in Sleep and Wait, callees included */
+	uint64_t SleepNs;
+	/* Strings, buffers and packages built while running, chained through Next */
+	Token *Temporaries;
+
+	AML_Value Return;
+};
+
+static inline AML_Value IntegerValue(uint64_t integer) {
+	AML_Value value;
+	value.Type = VALUE_INTEGER;
+	value.Integer = integer;
+	value.Object = NULL;
+	value.Node = NULL;
+	return value;
+}
+
+void InitContext(AML_Context *context, AMLExecutive *executive);
+
+/* When caller is NULL, temporaries in the result are not owned by any frame */
+int ExecuteMethod(AML_Context *context, AML_NamespaceNode *method, const AML_Value *args, size_t argCount, AML_Frame *caller, AML_Value *result);
+
+Token *ValueToToken(AML_Value *value);
+void ReleaseTemporary(Token *token);
+
+void GetMutexStats(AML_MutexStats *stats);
+void GetFoldStats(AML_FoldStats *stats);
+bool GetMethodStats(AML_NamespaceNode *method, AML_MethodStats *stats);
@@ -1,152 +1,338 @@
 #include "aml_executive.h"
+#include "acpi.h"
 #include "token.h"
+#include "aml_opcodes.h"
+#include "interpreter.h"
+#include "timer_wheel.h"
+#include "field_access.h"
+#include "trace.h"
+#include "memory.h"
+#include "profiler.h"
 
 #include <mkmi.h>
 
-void ParseByte(TokenList *tokens, AML_Hashmap *hashmap, uint8_t *data, size_t *idx) {
-	uint8_t byte = data[*idx];
-	*idx += 1;
+static inline bool IsLeadNameChar(uint8_t byte) {
+	return (byte >= 'A' && byte <= 'Z') || byte == '_' ||
+	       byte == AML_ROOT_CHAR || byte == AML_PARENT_CHAR ||
+	       byte == AML_DUAL_PREFIX || byte == AML_MULTI_PREFIX;
+}
+
+void ParseByte(TokenList *tokens, AML_Hashmap *hashmap, AmlCursor *cursor) {
+	if (cursor->Position >= cursor->End) return;
+	uint8_t byte = ReadByte(cursor);
 
 	AML_OpcodeHandler handler = FindHandler(hashmap, byte);
 
-	if (handler) return handler(hashmap, tokens, data, idx);
+	if (handler) return handler(hashmap, tokens, cursor);
+
+	if (IsLeadNameChar(byte)) {
+		/* A reference to a named object, e.g. a link device inside a package */
+		NameType name;
+		cursor->Position--;
+		HandleNameType(&name, cursor);
+
+		/* Inside a method body, names of methods are calls followed by their arguments */
+		AML_NamespaceNode *node = hashmap->Namespace != NULL ? ResolveName(hashmap->Namespace, hashmap->Scope, &name) : NULL;
+		if (node != NULL && node->Type == NODE_METHOD) {
+			TokenList *args = CreateTokenList();
+			uint8_t argCount = node->Object->Method.MethodFlags & AML_METHOD_ARGC_MASK;
+
+			for (uint8_t i = 0; i < argCount; ++i) {
+				ParseByte(args, hashmap, cursor);
+			}
+
+			return AddToken(tokens, CALL, &name, node, args);
+		}
+
+		return AddToken(tokens, NAMEREF, &name);
+	}
+
 	AddToken(tokens, UNKNOWN, byte);	
 }
 
-AMLExecutive::AMLExecutive() {
-	/* Initialize the hashmap and the root token list */
-	Hashmap = CreateHashmap();
-	RootTokenList = CreateTokenList(); 
+TokenList *ParseTermList(AML_Hashmap *hashmap, AmlCursor *cursor, uint8_t *end) {
+	TokenList *children = CreateTokenList();
+
+	/* Never let a malformed object run past its own package */
+	uint8_t *outer = cursor->End;
+	cursor->End = end;
+
+	while (cursor->Position < end) {
+		ParseByte(children, hashmap, cursor);
+	}
+
+	cursor->End = outer;
+	cursor->Position = end;
+
+	return children;
+}
+
+/* Initialize the hashmap and the root token list, in declaration order since Notifications needs the namespace */
+AMLExecutive::AMLExecutive() :
+	Hashmap(CreateHashmap()),
+	RootTokenList(CreateTokenList()),
+	Namespace(CreateNamespace()),
+	Notifications(CreateNotifyQueue(Namespace)),
+	TablesLock(),
+	Tables(NULL),
+	NextTableHandle(1),
+	TableHandler(NULL),
+	TableHandlerContext(NULL),
+	TableFinder(NULL),
+	TableFinderContext(NULL),
+	FoldGeneration(1),
+	Profiler(NULL),
+	Profiling(false),
+	Clock(NULL),
+	Timers(CreateTimerWheel(NULL)),
+	GlobalLock(NULL) {
+	InitSpinLock(&TablesLock);
+}
+
+static void FreeTable(void *object) {
+	AML_Table *table = (AML_Table*)object;
+
+	FreeTokenList(table->Tokens);
+	FreeMemory(table->Tokens);
+	FreeMemory(table->Data);
+	if (table->Owner.Nodes != NULL) FreeMemory(table->Owner.Nodes);
+
+	delete table;
 }
 
 AMLExecutive::~AMLExecutive() {
 	/* Free the memory occupied by the token list and the hashmap */
 	DeleteHashmap(Hashmap);
 	FreeTokenList(RootTokenList);
-}
+	FreeMemory(RootTokenList);
 
-inline void PrintName(char *nameSegments, size_t count, bool isRoot) {
-	char segs[count * 4 + 1];
-	if (nameSegments != NULL || nameSegments != -1) {
-		Memcpy(segs, nameSegments, count * 4);
+	while (Tables != NULL) {
+		AML_Table *next = Tables->Next;
+		FreeTable(Tables);
+		Tables = next;
 	}
-	segs[count * 4] = '\0';
-	MKMI_Printf(" - Name segments: %d\r\n"
-		    " - Is root: %s\r\n"
-		    " - Segments: %s\r\n",
-		    count, isRoot ? "Yes" : "No", segs);
+
+	DeleteNotifyQueue(Notifications);
+	if (Profiler != NULL) DeleteProfiler(Profiler);
+	DeleteNamespace(Namespace);
+	DeleteTimerWheel(Timers);
 }
 
 int AMLExecutive::Parse(uint8_t *data, size_t size) {
-	size_t idx = 0;
-	while (idx < size) {
-		ParseByte(RootTokenList, Hashmap, data, &idx);
+	AmlCursor cursor;
+	InitCursor(&cursor, data, size);
+
+	while (cursor.Position < cursor.End) {
+		ParseByte(RootTokenList, Hashmap, &cursor);
 	}
 
-	MKMI_Printf("Done parsing %d bytes of AML code.\r\n", size);
+	Trace(ACPI_TRACE_INFO, TRACE_PARSE_DONE, size);
+	if (cursor.Overrun) Trace(ACPI_TRACE_WARNING, TRACE_PARSE_OVERRUN);
 
-	Token *current = RootTokenList->Head;
+	LoadNamespace(Namespace, Namespace->Root, RootTokenList, NULL);
+	Trace(ACPI_TRACE_INFO, TRACE_NAMESPACE_LOADED, Namespace->NodeCount);
 
-	bool error = false;
-	while (current && !error) {
-		MKMI_Printf("Token Type: ");
-		switch (current->Type) {
-			case ZERO:
-				MKMI_Printf("ZERO\r\n");
-				break;
-			case ONE:
-				MKMI_Printf("ONE\r\n");
-				break;
-			case ALIAS:
-				MKMI_Printf("ALIAS\r\n");
-				break;
-			case NAME:
-				MKMI_Printf("NAME:\r\n");
-				PrintName(current->Name.NameSegments, current->Name.SegmentNumber, current->Name.IsRoot);
-				break;
-			case INTEGER:
-				MKMI_Printf("INTEGER:\r\n"
-					    " - Size: %d\r\n"
-					    " - Data: %d\r\n", current->Int.Size, current->Int.Data);
-				break;
-			case STRING:
-				MKMI_Printf("STRING\r\n");
-				break;
-			case SCOPE:
-				MKMI_Printf("SCOPE:\r\n"
-				            " - PkgLength: %d\r\n", current->Scope.PkgLength);
-				PrintName(current->Scope.Name.NameSegments, current->Scope.Name.SegmentNumber, current->Scope.Name.IsRoot);
-				break;
-			case BUFFER: {
-				MKMI_Printf("BUFFER:\r\n"
-					    " - PkgLength: %d\r\n"
-					    " - Buffer size: %d\r\n"
-					    " - Byte list:", current->Buffer.PkgLength, current->Buffer.BufferSize.Data);
-				for (int i = 0; i < current->Buffer.BufferSize.Data; ++i) {
-					MKMI_Printf(" 0x%x ", current->Buffer.ByteList[i]);
-				}
-				MKMI_Printf("\r\n");
+	return 0;
+}
+
+/*
+ * Parses into the table's own token list and splices its objects in under
+ * scope, nothing already in the namespace is touched. Costs as much as the
+ * table is long.
+ */
+uint64_t AMLExecutive::LoadTable(const void *table, size_t length, AML_NamespaceNode *scope) {
+	SDTHeader *header = (SDTHeader*)table;
+	if (table == NULL || length < sizeof(SDTHeader) || header->Length < sizeof(SDTHeader) || header->Length > length) return 0;
+
+	uint8_t checksum = 0;
+	for (size_t i = 0; i < header->Length; ++i) checksum += ((const uint8_t*)table)[i];
+
+	if (checksum != 0) {
+		Trace(ACPI_TRACE_WARNING, TRACE_TABLE_INVALID, TraceTag(header->Signature, 4));
+		return 0;
+	}
+
+	AML_Table *loaded = new AML_Table;
+	loaded->Length = header->Length;
+	loaded->Data = (uint8_t*)AllocateMemory(ACPI_MEMORY_TABLES, loaded->Length);
+	Memcpy(loaded->Data, table, loaded->Length);
+	loaded->Tokens = CreateTokenList();
+	loaded->Owner.Nodes = NULL;
+	loaded->Owner.Count = 0;
+	loaded->Owner.Capacity = 0;
+
+	AmlCursor cursor;
+	InitCursor(&cursor, loaded->Data + sizeof(SDTHeader), loaded->Length - sizeof(SDTHeader));
+
+	while (cursor.Position < cursor.End) {
+		ParseByte(loaded->Tokens, Hashmap, &cursor);
+	}
+
+	if (cursor.Overrun) Trace(ACPI_TRACE_WARNING, TRACE_PARSE_OVERRUN);
+
+	LoadNamespace(Namespace, scope != NULL ? scope : Namespace->Root, loaded->Tokens, &loaded->Owner);
+	/* A new Name may now shadow one some method was folded against */
+	InvalidateFolding();
+
+	/* Before anyone has the handle, so an unload never overtakes it */
+	NotifyTable(loaded, true);
+	size_t count = loaded->Owner.Count;
+
+	AcquireSpinLock(&TablesLock);
+	uint64_t handle = NextTableHandle++;
+	loaded->Handle = handle;
+	loaded->Next = Tables;
+	Tables = loaded;
+	ReleaseSpinLock(&TablesLock);
+
+	Trace(ACPI_TRACE_INFO, TRACE_TABLE_LOADED, TraceTag(header->Signature, 4), handle, count);
+
+	return handle;
+}
+
+uint64_t AMLExecutive::LoadTable(const char *signature, const char *oemId, const char *oemTableId, AML_NamespaceNode *scope) {
+	if (TableFinder == NULL) return 0;
+
+	SDTHeader *header = (SDTHeader*)TableFinder(signature, oemId, oemTableId, TableFinderContext);
+	if (header == NULL) return 0;
+
+	return LoadTable(header, header->Length, scope);
+}
+
+/*
+ * Only what the table created leaves the namespace, along with whatever was
+ * added under it later. Its tokens are freed once no method of it can still
+ * be running.
+ */
+bool AMLExecutive::UnloadTable(uint64_t handle) {
+	AcquireSpinLock(&TablesLock);
+
+	AML_Table **current = &Tables;
+	while (*current != NULL && (*current)->Handle != handle) current = &(*current)->Next;
+
+	AML_Table *table = *current;
+	if (table != NULL) *current = table->Next;
+
+	ReleaseSpinLock(&TablesLock);
+
+	if (table == NULL) return false;
+
+	/* Nodes removed below stay valid until we leave */
+	uint32_t section = EnterNamespace(Namespace);
+
+	NotifyTable(table, false);
+
+	size_t count = table->Owner.Count;
+	UnloadNamespace(Namespace, &table->Owner);
+	InvalidateFolding();
+	DropRemovedNodes(Notifications);
+	if (Profiler != NULL) DropRemovedMethods(Profiler);
+
+	LeaveNamespace(Namespace, section);
+
+	RetireObject(Namespace, table, FreeTable);
+
+	Trace(ACPI_TRACE_INFO, TRACE_TABLE_UNLOADED, handle, count);
+
+	return true;
+}
+
+void AMLExecutive::NotifyTable(AML_Table *table, bool loaded) {
+	if (TableHandler == NULL) return;
+
+	uint32_t section = EnterNamespace(Namespace);
+
+	size_t count = GetOwnerRoots(Namespace, &table->Owner, NULL, 0);
+	if (count != 0) {
+		AML_NamespaceNode **roots = new AML_NamespaceNode*[count];
+		count = GetOwnerRoots(Namespace, &table->Owner, roots, count);
+
+		for (size_t i = 0; i < count; ++i) TableHandler(roots[i], loaded, TableHandlerContext);
+
+		delete[] roots;
+	}
+
+	LeaveNamespace(Namespace, section);
+}
+
+void AMLExecutive::SetTableHandler(AML_TableHandler handler, void *context) {
+	TableHandler = handler;
+	TableHandlerContext = context;
+}
+
+void AMLExecutive::SetTableFinder(AML_TableFinder finder, void *context) {
+	TableFinder = finder;
+	TableFinderContext = context;
+}
+
+static const char *NodeTypeNames[] = {
+	"Scope", "Device", "Name", "Method", "Region", "Field", "Alias", "Mutex", "Event", "ThermalZone", "Processor",
+};
+
+static void DumpNode(AML_NamespaceNode *node, size_t depth) {
+	char name[5];
+	Memcpy(name, node->Name, 4);
+	name[4] = '\0';
+
+	for (size_t i = 0; i < depth; ++i) MKMI_Printf("  ");
+	MKMI_Printf("%s %s", name, NodeTypeNames[node->Type]);
+
+	Token *object = node->Object;
+	if (object != NULL) {
+		switch (node->Type) {
+			case NODE_NAME: {
+				Token *value = object->Children != NULL ? object->Children->Head : NULL;
+				if (value == NULL) break;
+
+				if (value->Type == INTEGER) MKMI_Printf(" = 0x%x", value->Int.Data);
+				else if (value->Type == ZERO || value->Type == ONE) MKMI_Printf(" = %d", value->Type == ONE);
+				else if (value->Type == STRING) MKMI_Printf(" = \"%s\"", value->String);
+				else if (value->Type == BUFFER) MKMI_Printf(", buffer of %d bytes", value->Buffer.BufferSize.Data);
+				else if (value->Type == PACKAGE) MKMI_Printf(", package of %d elements", value->Package.NumElements);
 				}
 				break;
-			case PACKAGE:
-				MKMI_Printf("PACKAGE:\r\n"
-					    " - PkgLength: %d\r\n"
-					    " - Num elements: %d\r\n", current->Package.PkgLength, current->Package.NumElements);
-				break;
-			case METHOD:
-				MKMI_Printf("METHOD:\r\n"
-					    " - PkgLength: %d\r\n"
-					    " - Method flags: %d\r\n", current->Method.PkgLength, current->Method.MethodFlags);
-				PrintName(current->Method.Name.NameSegments, current->Method.Name.SegmentNumber, current->Method.Name.IsRoot);
-				break;
-			case REGION:
-				MKMI_Printf("REGION:\r\n"
-					    " - Region space: %d\r\n"
-					    " - Region offset: %d\r\n"
-					    " - Region length: %d\r\n", current->Region.RegionSpace, current->Region.RegionOffset.Data, current->Region.RegionLen.Data);
-				PrintName(current->Region.Name.NameSegments, current->Region.Name.SegmentNumber, current->Region.Name.IsRoot);
-				break;
-			case FIELD:
-				MKMI_Printf("FIELD:\r\n"
-					    " - PkgLength: %d\r\n"
-					    " - Field flags: %d\r\n", current->Field.PkgLength, current->Field.FieldFlags);
-				PrintName(current->Field.Name.NameSegments, current->Field.Name.SegmentNumber, current->Field.Name.IsRoot);
+			case NODE_METHOD:
+				MKMI_Printf(", %d args, flags 0x%x", object->Method.MethodFlags & AML_METHOD_ARGC_MASK, object->Method.MethodFlags);
 				break;
-			case DEVICE:
-				MKMI_Printf("DEVICE:\r\n"
-					    " - PkgLength: %d\r\n", current->Device.PkgLength);
-				PrintName(current->Device.Name.NameSegments, current->Device.Name.SegmentNumber, current->Device.Name.IsRoot);
+			case NODE_REGION:
+				MKMI_Printf(", space %d at 0x%x, %d bytes", object->Region.RegionSpace,
+					    object->Region.RegionOffset.Data, object->Region.RegionLen.Data);
 				break;
-			case UNKNOWN:
-				MKMI_Printf("UNKNOWN, Opcode: 0x%x\r\n", current->UnknownOpcode);
+			case NODE_FIELD_UNIT: {
+				AML_FieldUnit *unit = &object->Field.Units[node->FieldUnit];
+				MKMI_Printf(", bits %d+%d", unit->BitOffset, unit->BitWidth);
+				}
 				break;
 			default:
-				MKMI_Printf("UNKNOWN\r\n");
-				error = true;
 				break;
 		}
+	}
+
+	MKMI_Printf("\r\n");
 
-		current = current->Next;
+	for (AML_NamespaceNode *child = FirstChild(node); child != NULL; child = NextSibling(child)) {
+		DumpNode(child, depth + 1);
 	}
+}
 
-	return 0;
+/* Only on demand, a full DSDT takes far longer to print than to parse */
+void AMLExecutive::DumpNamespace(AML_NamespaceNode *scope) {
+	uint32_t section = EnterNamespace(Namespace);
+	DumpNode(scope != NULL ? scope : Namespace->Root, 0);
+	LeaveNamespace(Namespace, section);
 }
 
 Token *AMLExecutive::FindObject(const char *name) {
 	Token *current = NULL;
 	size_t nameLength = Strlen(name);
 
-	for (int i = 0; i < RootTokenList->TotalNames; i++) {
+	for (unsigned int i = 0; i < RootTokenList->TotalNames; i++) {
 		current = RootTokenList->Names[i].Token;
 
 		if(current->Name.SegmentNumber <= 0) continue;
 		if(nameLength > current->Name.SegmentNumber * 4) continue;
 
-		if(Memcmp(current->Name.NameSegments, name, nameLength) == 0) {
-			MKMI_Printf("Found:\r\n");
-			PrintName(current->Name.NameSegments, current->Name.SegmentNumber, current->Name.IsRoot);
-			return current;
-		}
+		if(Memcmp(current->Name.NameSegments, name, nameLength) == 0) return current;
 
 	}
 
@@ -154,6 +340,242 @@ Token *AMLExecutive::FindObject(const char *name) {
 
 }
 
+uint32_t AMLExecutive::PinNamespace() {
+	return EnterNamespace(Namespace);
+}
+
+void AMLExecutive::UnpinNamespace(uint32_t pin) {
+	LeaveNamespace(Namespace, pin);
+}
+
+AML_NamespaceNode *AMLExecutive::FindNode(const char *path) {
+	uint32_t section = EnterNamespace(Namespace);
+	AML_NamespaceNode *node = ::FindNode(Namespace, Namespace->Root, path);
+	LeaveNamespace(Namespace, section);
+
+	return node;
+}
+
+AML_NamespaceNode *AMLExecutive::Resolve(AML_NamespaceNode *scope, NameType *name) {
+	uint32_t section = EnterNamespace(Namespace);
+	AML_NamespaceNode *node = ResolveName(Namespace, scope, name);
+	LeaveNamespace(Namespace, section);
+
+	return node;
+}
+
+Token *AMLExecutive::Evaluate(AML_NamespaceNode *node) {
+	return Evaluate(node, NULL, 0);
+}
+
+/*
+ * Results are copies, hand them back with ReleaseResult. Nothing in them is
+ * reclaimed along with the namespace when a Store or an unload replaces it.
+ */
+Token *AMLExecutive::Evaluate(AML_NamespaceNode *node, const uint64_t *args, size_t argCount) {
+	uint32_t section = EnterNamespace(Namespace);
+	Token *result = EvaluateNode(node, args, argCount);
+	LeaveNamespace(Namespace, section);
+
+	return result;
+}
+
+Token *AMLExecutive::EvaluateNode(AML_NamespaceNode *node, const uint64_t *args, size_t argCount) {
+	if (node == NULL || node->Object == NULL) return NULL;
+
+	switch (node->Type) {
+		case NODE_NAME: {
+			if (node->Object->Children == NULL) return NULL;
+
+			AML_Value value;
+			value.Type = VALUE_OBJECT;
+			value.Object = __atomic_load_n(&node->Object->Children->Head, __ATOMIC_ACQUIRE);
+			if (value.Object == NULL) return NULL;
+
+			return ValueToToken(&value);
+			}
+		case NODE_ALIAS:
+			return EvaluateNode(ResolveName(Namespace, node->Parent, &node->Object->Alias.NameOne), args, argCount);
+		case NODE_METHOD: {
+			/* Every evaluation gets its own context, callers on other cores never wait on each other */
+			AML_Context context;
+			InitContext(&context, this);
+
+			AML_Value values[AML_MAX_ARGS];
+			if (argCount > AML_MAX_ARGS) argCount = AML_MAX_ARGS;
+			for (size_t i = 0; i < argCount; ++i) values[i] = IntegerValue(args[i]);
+
+			AML_Value result;
+			if (ExecuteMethod(&context, node, values, argCount, NULL, &result) != AML_OK) return NULL;
+
+			return ValueToToken(&result);
+			}
+		default:
+			return NULL;
+	}
+}
+
+void AMLExecutive::ReleaseResult(Token *result) {
+	ReleaseTemporary(result);
+}
+
+bool AMLExecutive::EvaluateInteger(AML_NamespaceNode *node, uint64_t *value) {
+	Token *result = Evaluate(node);
+	bool found = GetTokenInteger(result, value);
+
+	ReleaseResult(result);
+
+	return found;
+}
+
+AML_ResourceList *AMLExecutive::GetResources(AML_NamespaceNode *device) {
+	if (device == NULL) return NULL;
+
+	AML_ResourceList *resources = __atomic_load_n(&device->Resources, __ATOMIC_ACQUIRE);
+	if (resources != NULL) return resources;
+
+	uint32_t section = EnterNamespace(Namespace);
+	Token *crs = EvaluateNode(FindChild(device, "_CRS"), NULL, 0);
+	LeaveNamespace(Namespace, section);
+
+	if (crs == NULL || crs->Type != BUFFER) {
+		ReleaseResult(crs);
+		return NULL;
+	}
+
+	resources = CreateResourceList(crs->Buffer.ByteList, crs->Buffer.BufferSize.Data);
+	ReleaseResult(crs);
+
+	/* Decoded once, drivers share the cached array afterwards. A racing core's copy is dropped */
+	AML_ResourceList *expected = NULL;
+	if (!__atomic_compare_exchange_n(&device->Resources, &expected, resources, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		DeleteResourceList(resources);
+		return expected;
+	}
+
+	return resources;
+}
+
+uint32_t AMLExecutive::GetStatus(AML_NamespaceNode *device) {
+	if (device == NULL) return 0;
+	if (device->Status != AML_STA_UNKNOWN) return device->Status;
+
+	uint64_t status = AML_STA_DEFAULT;
+
+	uint32_t section = EnterNamespace(Namespace);
+	AML_NamespaceNode *sta = FindChild(device, "_STA");
+	bool failed = sta != NULL && !EvaluateInteger(sta, &status);
+	LeaveNamespace(Namespace, section);
+
+	if (failed) return AML_STA_DEFAULT;
+
+	/* Only a known result is cached, a method _STA is tried again next time */
+	device->Status = status;
+
+	return device->Status;
+}
+
+/*
+ * Depth first, see ACPI spec section 6.5.1. Children of a device that is
+ * not present are only looked at when _STA says it is functioning.
+ */
+int AMLExecutive::InitializeDevices(AML_NamespaceNode *scope) {
+	int count = 0;
+
+	for (AML_NamespaceNode *child = FirstChild(scope); child != NULL; child = NextSibling(child)) {
+		if (child->Type == NODE_DEVICE || child->Type == NODE_PROCESSOR || child->Type == NODE_THERMAL_ZONE) {
+			uint32_t status = GetStatus(child);
+			if (!(status & (AML_STA_PRESENT | AML_STA_FUNCTIONING))) continue;
+
+			AML_NamespaceNode *ini = FindChild(child, "_INI");
+			if ((status & AML_STA_PRESENT) && ini != NULL) {
+				ReleaseResult(EvaluateNode(ini, NULL, 0));
+				count++;
+			}
+		} else if (child->Type != NODE_SCOPE) {
+			continue;
+		}
+
+		count += InitializeDevices(child);
+	}
+
+	return count;
+}
+
 int AMLExecutive::Execute() {
-	return 0;
+	uint32_t section = EnterNamespace(Namespace);
+	int count = 0;
+
+	/* \_SB._INI goes before any device, firmware sets up the operating system interface in it */
+	AML_NamespaceNode *sb = FindChild(Namespace->Root, "_SB_");
+	AML_NamespaceNode *ini = sb != NULL ? FindChild(sb, "_INI") : NULL;
+	if (ini != NULL) {
+		ReleaseResult(EvaluateNode(ini, NULL, 0));
+		count++;
+	}
+
+	count += InitializeDevices(Namespace->Root);
+
+	LeaveNamespace(Namespace, section);
+
+	return count;
+}
+
+bool AMLExecutive::Notify(AML_NamespaceNode *node, uint32_t value) {
+	return QueueNotify(Notifications, node, value);
+}
+
+AML_NotifyQueue *AMLExecutive::GetNotifyQueue() {
+	return Notifications;
+}
+
+AML_Namespace *AMLExecutive::GetNamespace() {
+	return Namespace;
+}
+
+AML_Hashmap *AMLExecutive::GetHashmap() {
+	return Hashmap;
+}
+
+void AMLExecutive::EnableProfiling(bool enable) {
+	if (enable && Profiler == NULL) Profiler = CreateProfiler();
+
+	__atomic_store_n(&Profiling, enable, __ATOMIC_RELEASE);
+}
+
+AML_Profiler *AMLExecutive::GetProfiler() {
+	return Profiler;
+}
+
+AML_Profiler *AMLExecutive::GetActiveProfiler() {
+	return __atomic_load_n(&Profiling, __ATOMIC_ACQUIRE) ? Profiler : NULL;
+}
+
+uint64_t AMLExecutive::GetFoldGeneration() {
+	return __atomic_load_n(&FoldGeneration, __ATOMIC_SEQ_CST);
+}
+
+void AMLExecutive::InvalidateFolding() {
+	__atomic_fetch_add(&FoldGeneration, 1, __ATOMIC_SEQ_CST);
+}
+
+void AMLExecutive::SetClock(HPET_Clock *clock) {
+	Clock = clock;
+	SetTimerWheelClock(Timers, clock);
+}
+
+HPET_Clock *AMLExecutive::GetClock() {
+	return Clock;
+}
+
+AML_TimerWheel *AMLExecutive::GetTimerWheel() {
+	return Timers;
+}
+
+void AMLExecutive::SetGlobalLock(AML_GlobalLock *lock) {
+	GlobalLock = lock;
+}
+
+AML_GlobalLock *AMLExecutive::GetGlobalLock() {
+	return GlobalLock;
 }
@@ -0,0 +1,276 @@
+#include "madt.h"
+
+#include <mkmi.h>
+
+#define NO_IOAPIC 0xFF
+
+/* Firmware may append fields in later revisions, never drop them, so only a minimum is checked */
+static size_t EntrySize(uint8_t type) {
+	switch (type) {
+		case MADT_LOCAL_APIC: return sizeof(MADTLocalAPIC);
+		case MADT_IO_APIC: return sizeof(MADTIOAPIC);
+		case MADT_INTERRUPT_OVERRIDE: return sizeof(MADTInterruptOverride);
+		case MADT_NMI_SOURCE: return sizeof(MADTNMISource);
+		case MADT_LOCAL_APIC_NMI: return sizeof(MADTLocalAPICNMI);
+		case MADT_LOCAL_APIC_OVERRIDE: return sizeof(MADTLocalAPICOverride);
+		case MADT_LOCAL_X2APIC: return sizeof(MADTLocalX2APIC);
+		case MADT_LOCAL_X2APIC_NMI: return sizeof(MADTLocalX2APICNMI);
+		case MADT_GICC: return sizeof(MADTGICC);
+		case MADT_GICD: return sizeof(MADTGICD);
+		default: return sizeof(MADTEntryHeader);
+	}
+}
+
+/* The entry at *idx, NULL at the end of the table. Entries too short for their type are stepped over */
+static MADTEntryHeader *NextEntry(uint8_t *entries, size_t length, size_t *idx) {
+	while (*idx + sizeof(MADTEntryHeader) <= length) {
+		MADTEntryHeader *entry = (MADTEntryHeader*)&entries[*idx];
+		if (entry->Length < sizeof(MADTEntryHeader) || *idx + entry->Length > length) return NULL;
+
+		*idx += entry->Length;
+		if (entry->Length >= EntrySize(entry->Type)) return entry;
+	}
+
+	return NULL;
+}
+
+static void ApplyNMI(CPUTopology *topology, uint32_t uid, uint8_t lint, uint16_t flags) {
+	for (size_t i = 0; i < topology->CPUCount; ++i) {
+		if (uid != MADT_ALL_PROCESSORS && topology->ProcessorUID[i] != uid) continue;
+
+		topology->NMILINT[i] = lint;
+		topology->NMIFlags[i] = flags;
+	}
+}
+
+static void AddCPU(CPUTopology *topology, uint64_t hardwareId, uint32_t uid, uint32_t flags) {
+	if (!(flags & (MADT_CPU_ENABLED | MADT_CPU_ONLINE_CAPABLE))) return;
+
+	size_t idx = topology->CPUCount++;
+	topology->HardwareID[idx] = hardwareId;
+	topology->ProcessorUID[idx] = uid;
+	topology->Flags[idx] = flags;
+	topology->NMILINT[idx] = MADT_NO_LINT;
+	topology->NMIFlags[idx] = 0;
+	topology->GICRBase[idx] = 0;
+}
+
+/* Only decodes the table, I/O APIC ranges are filled in by ProbeIOAPICs */
+CPUTopology *CreateCPUTopology(MADTTable *madt) {
+	CPUTopology *topology = new CPUTopology;
+	uint8_t *entries = (uint8_t*)madt + sizeof(MADTTable);
+	size_t entriesLength = madt->Header.Length > sizeof(MADTTable) ? madt->Header.Length - sizeof(MADTTable) : 0;
+
+	/* Counted first, so every array is exactly as long as it needs to be */
+	size_t cpus = 0, ioapics = 0, sources = 0, nmiCount = 0;
+	size_t idx = 0;
+	MADTEntryHeader *entry;
+
+	while ((entry = NextEntry(entries, entriesLength, &idx)) != NULL) {
+		switch (entry->Type) {
+			case MADT_LOCAL_APIC:
+			case MADT_LOCAL_X2APIC:
+			case MADT_GICC:
+				cpus++;
+				break;
+			case MADT_IO_APIC:
+				ioapics++;
+				break;
+			case MADT_NMI_SOURCE:
+				sources++;
+				break;
+			case MADT_LOCAL_APIC_NMI:
+			case MADT_LOCAL_X2APIC_NMI:
+				nmiCount++;
+				break;
+			default:
+				break;
+		}
+	}
+
+	topology->CPUCount = 0;
+	topology->HardwareID = new uint64_t[cpus];
+	topology->ProcessorUID = new uint32_t[cpus];
+	topology->Flags = new uint32_t[cpus];
+	topology->NMILINT = new uint8_t[cpus];
+	topology->NMIFlags = new uint16_t[cpus];
+	topology->GICRBase = new uint64_t[cpus];
+
+	topology->LocalAPICAddress = madt->LocalAPICAddress;
+
+	topology->IOAPICCount = 0;
+	topology->IOAPICs = new IOAPICInfo[ioapics];
+
+	topology->GSICount = 0;
+	topology->GSIToIOAPIC = NULL;
+
+	topology->NMISourceCount = 0;
+	topology->NMISources = new NMISourceInfo[sources];
+
+	topology->GICDBase = 0;
+	topology->GICVersion = 0;
+
+	for (uint8_t i = 0; i < MADT_ISA_IRQS; ++i) {
+		topology->ISAToGSI[i] = i;
+		topology->ISAFlags[i] = 0;
+	}
+
+	/* NMI entries may name processors that come later in the table */
+	MADTEntryHeader **nmis = new MADTEntryHeader*[nmiCount];
+	nmiCount = 0;
+	idx = 0;
+
+	while ((entry = NextEntry(entries, entriesLength, &idx)) != NULL) {
+		switch (entry->Type) {
+			case MADT_LOCAL_APIC: {
+				MADTLocalAPIC *lapic = (MADTLocalAPIC*)entry;
+				AddCPU(topology, lapic->APICID, lapic->ProcessorUID, lapic->Flags);
+				}
+				break;
+			case MADT_LOCAL_X2APIC: {
+				MADTLocalX2APIC *x2apic = (MADTLocalX2APIC*)entry;
+				AddCPU(topology, x2apic->X2APICID, x2apic->ProcessorUID, x2apic->Flags);
+				}
+				break;
+			case MADT_GICC: {
+				MADTGICC *gicc = (MADTGICC*)entry;
+				AddCPU(topology, gicc->MPIDR, gicc->ProcessorUID, gicc->Flags);
+
+				if (topology->CPUCount != 0 && topology->ProcessorUID[topology->CPUCount - 1] == gicc->ProcessorUID) {
+					topology->GICRBase[topology->CPUCount - 1] = gicc->GICRBase;
+				}
+				}
+				break;
+			case MADT_IO_APIC: {
+				MADTIOAPIC *ioapic = (MADTIOAPIC*)entry;
+				IOAPICInfo *info = &topology->IOAPICs[topology->IOAPICCount++];
+				info->ID = ioapic->IOAPICID;
+				info->Address = ioapic->Address;
+				info->GSIBase = ioapic->GSIBase;
+				info->GSICount = 0;
+				}
+				break;
+			case MADT_INTERRUPT_OVERRIDE: {
+				MADTInterruptOverride *override = (MADTInterruptOverride*)entry;
+				if (override->Source < MADT_ISA_IRQS) {
+					topology->ISAToGSI[override->Source] = override->GSI;
+					topology->ISAFlags[override->Source] = override->Flags;
+				}
+				}
+				break;
+			case MADT_NMI_SOURCE: {
+				MADTNMISource *source = (MADTNMISource*)entry;
+				topology->NMISources[topology->NMISourceCount].GSI = source->GSI;
+				topology->NMISources[topology->NMISourceCount].Flags = source->Flags;
+				topology->NMISourceCount++;
+				}
+				break;
+			case MADT_LOCAL_APIC_NMI:
+			case MADT_LOCAL_X2APIC_NMI:
+				nmis[nmiCount++] = entry;
+				break;
+			case MADT_LOCAL_APIC_OVERRIDE:
+				topology->LocalAPICAddress = ((MADTLocalAPICOverride*)entry)->Address;
+				break;
+			case MADT_GICD: {
+				MADTGICD *gicd = (MADTGICD*)entry;
+				topology->GICDBase = gicd->PhysicalBase;
+				topology->GICVersion = gicd->Version;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	for (size_t i = 0; i < nmiCount; ++i) {
+		if (nmis[i]->Type == MADT_LOCAL_APIC_NMI) {
+			MADTLocalAPICNMI *nmi = (MADTLocalAPICNMI*)nmis[i];
+			ApplyNMI(topology, nmi->ProcessorUID == 0xFF ? MADT_ALL_PROCESSORS : nmi->ProcessorUID, nmi->LINT, nmi->Flags);
+		} else {
+			MADTLocalX2APICNMI *nmi = (MADTLocalX2APICNMI*)nmis[i];
+			ApplyNMI(topology, nmi->ProcessorUID, nmi->LINT, nmi->Flags);
+		}
+	}
+
+	delete[] nmis;
+
+	return topology;
+}
+
+static uint32_t ReadIOAPICEntries(uint64_t address) {
+	volatile uint32_t *registers = (volatile uint32_t*)(address + HIGHER_HALF);
+
+	/* IOAPICVER, bits 16-23 hold the index of the last redirection entry */
+	registers[0] = 0x01;
+	return ((registers[4] >> 16) & 0xFF) + 1;
+}
+
+void ProbeIOAPICs(CPUTopology *topology) {
+	for (size_t i = 0; i < topology->IOAPICCount; ++i) {
+		topology->IOAPICs[i].GSICount = ReadIOAPICEntries(topology->IOAPICs[i].Address);
+	}
+
+	MapIOAPICRanges(topology);
+}
+
+void MapIOAPICRanges(CPUTopology *topology) {
+	delete[] topology->GSIToIOAPIC;
+	topology->GSIToIOAPIC = NULL;
+
+	/* Flatten the I/O APIC ranges into a direct lookup table */
+	topology->GSICount = 0;
+	for (size_t i = 0; i < topology->IOAPICCount; ++i) {
+		uint32_t end = topology->IOAPICs[i].GSIBase + topology->IOAPICs[i].GSICount;
+		if (end > topology->GSICount) topology->GSICount = end;
+	}
+
+	if (topology->GSICount == 0) return;
+
+	topology->GSIToIOAPIC = new uint8_t[topology->GSICount];
+	for (uint32_t gsi = 0; gsi < topology->GSICount; ++gsi) topology->GSIToIOAPIC[gsi] = NO_IOAPIC;
+
+	for (size_t i = 0; i < topology->IOAPICCount; ++i) {
+		IOAPICInfo *info = &topology->IOAPICs[i];
+		for (uint32_t gsi = info->GSIBase; gsi < info->GSIBase + info->GSICount; ++gsi) {
+			topology->GSIToIOAPIC[gsi] = i;
+		}
+	}
+}
+
+void DeleteCPUTopology(CPUTopology *topology) {
+	delete[] topology->HardwareID;
+	delete[] topology->ProcessorUID;
+	delete[] topology->Flags;
+	delete[] topology->NMILINT;
+	delete[] topology->NMIFlags;
+	delete[] topology->GICRBase;
+	delete[] topology->IOAPICs;
+	delete[] topology->NMISources;
+	delete[] topology->GSIToIOAPIC;
+	delete topology;
+}
+
+int FindCPUByUID(CPUTopology *topology, uint32_t uid) {
+	for (size_t i = 0; i < topology->CPUCount; ++i) {
+		if (topology->ProcessorUID[i] == uid) return i;
+	}
+
+	return -1;
+}
+
+int FindIOAPICForGSI(CPUTopology *topology, uint32_t gsi) {
+	if (gsi >= topology->GSICount || topology->GSIToIOAPIC[gsi] == NO_IOAPIC) return -1;
+
+	return topology->GSIToIOAPIC[gsi];
+}
+
+uint32_t ISAIrqToGSI(CPUTopology *topology, uint8_t irq, uint16_t *flags) {
+	if (irq >= MADT_ISA_IRQS) {
+		if (flags != NULL) *flags = 0;
+		return irq;
+	}
+
+	if (flags != NULL) *flags = topology->ISAFlags[irq];
+	return topology->ISAToGSI[irq];
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "acpi.h"
+
+#define MADT_LOCAL_APIC 0x00
+#define MADT_IO_APIC 0x01
+#define MADT_INTERRUPT_OVERRIDE 0x02
+#define MADT_NMI_SOURCE 0x03
+#define MADT_LOCAL_APIC_NMI 0x04
+#define MADT_LOCAL_APIC_OVERRIDE 0x05
+#define MADT_LOCAL_X2APIC 0x09
+#define MADT_LOCAL_X2APIC_NMI 0x0A
+#define MADT_GICC 0x0B
+#define MADT_GICD 0x0C
+
+#define MADT_CPU_ENABLED 0x01
+#define MADT_CPU_ONLINE_CAPABLE 0x02
+
+/* Applies to every processor in NMI entries */
+#define MADT_ALL_PROCESSORS 0xFFFFFFFF
+
+#define MADT_ISA_IRQS 16
+#define MADT_NO_LINT 0xFF
+
+struct MADTTable {
+	SDTHeader Header;
+
+	uint32_t LocalAPICAddress;
+	uint32_t Flags;
+}__attribute__((packed));
+
+struct MADTEntryHeader {
+	uint8_t Type;
+	uint8_t Length;
+}__attribute__((packed));
+
+struct MADTLocalAPIC {
+	MADTEntryHeader Header;
+	uint8_t ProcessorUID;
+	uint8_t APICID;
+	uint32_t Flags;
+}__attribute__((packed));
+
+struct MADTIOAPIC {
+	MADTEntryHeader Header;
+	uint8_t IOAPICID;
+	uint8_t Reserved;
+	uint32_t Address;
+	uint32_t GSIBase;
+}__attribute__((packed));
+
+struct MADTInterruptOverride {
+	MADTEntryHeader Header;
+	uint8_t Bus;
+	uint8_t Source;
+	uint32_t GSI;
+	uint16_t Flags;
+}__attribute__((packed));
+
+struct MADTNMISource {
+	MADTEntryHeader Header;
+	uint16_t Flags;
+	uint32_t GSI;
+}__attribute__((packed));
+
+struct MADTLocalAPICNMI {
+	MADTEntryHeader Header;
+	uint8_t ProcessorUID;
+	uint16_t Flags;
+	uint8_t LINT;
+}__attribute__((packed));
+
+struct MADTLocalAPICOverride {
+	MADTEntryHeader Header;
+	uint16_t Reserved;
+	uint64_t Address;
+}__attribute__((packed));
+
+struct MADTLocalX2APIC {
+	MADTEntryHeader Header;
+	uint16_t Reserved;
+	uint32_t X2APICID;
+	uint32_t Flags;
+	uint32_t ProcessorUID;
+}__attribute__((packed));
+
+struct MADTLocalX2APICNMI {
+	MADTEntryHeader Header;
+	uint16_t Flags;
+	uint32_t ProcessorUID;
+	uint8_t LINT;
+	uint8_t Reserved[3];
+}__attribute__((packed));
+
+struct MADTGICC {
+	MADTEntryHeader Header;
+	uint16_t Reserved;
+	uint32_t CPUInterfaceNumber;
+	uint32_t ProcessorUID;
+	uint32_t Flags;
+	uint32_t ParkingVersion;
+	uint32_t PerformanceGSIV;
+	uint64_t ParkedAddress;
+	uint64_t PhysicalBase;
+	uint64_t GICV;
+	uint64_t GICH;
+	uint32_t VGICMaintenanceInterrupt;
+	uint64_t GICRBase;
+	uint64_t MPIDR;
+}__attribute__((packed));
+
+struct MADTGICD {
+	MADTEntryHeader Header;
+	uint16_t Reserved;
+	uint32_t GICID;
+	uint64_t PhysicalBase;
+	uint32_t SystemVectorBase;
+	uint8_t Version;
+	uint8_t Reserved2[3];
+}__attribute__((packed));
+
+struct IOAPICInfo {
+	uint8_t ID;
+	uint64_t Address;
+	uint32_t GSIBase;
+	uint32_t GSICount;
+};
+
+struct NMISourceInfo {
+	uint32_t GSI;
+	uint16_t Flags;
+};
+
+/*
+ * Everything is stored as parallel arrays indexed by CPU or I/O APIC index,
+ * so the interrupt routing paths touch only the array they need.
+ */
+struct CPUTopology {
+	size_t CPUCount;
+	/* APIC ID, x2APIC ID or MPIDR */
+	uint64_t *HardwareID;
+	uint32_t *ProcessorUID;
+	uint32_t *Flags;
+	uint8_t *NMILINT;
+	uint16_t *NMIFlags;
+	/* Per-CPU redistributor, GICv3 and later */
+	uint64_t *GICRBase;
+
+	uint64_t LocalAPICAddress;
+
+	size_t IOAPICCount;
+	IOAPICInfo *IOAPICs;
+
+	/* Dense GSI -> I/O APIC index, 0xFF when no I/O APIC serves the GSI */
+	uint32_t GSICount;
+	uint8_t *GSIToIOAPIC;
+
+	/* ISA IRQs with the identity mapping unless overridden */
+	uint32_t ISAToGSI[MADT_ISA_IRQS];
+	uint16_t ISAFlags[MADT_ISA_IRQS];
+
+	size_t NMISourceCount;
+	NMISourceInfo *NMISources;
+
+	uint64_t GICDBase;
+	uint8_t GICVersion;
+};
+
+CPUTopology *CreateCPUTopology(MADTTable *madt);
+/* Reads how many inputs every I/O APIC has, then maps GSIs to them */
+void ProbeIOAPICs(CPUTopology *topology);
+/* Builds the GSI lookup from the I/O APIC ranges as they are */
+void MapIOAPICRanges(CPUTopology *topology);
+void DeleteCPUTopology(CPUTopology *topology);
+
+int FindCPUByUID(CPUTopology *topology, uint32_t uid);
+int FindIOAPICForGSI(CPUTopology *topology, uint32_t gsi);
+uint32_t ISAIrqToGSI(CPUTopology *topology, uint8_t irq, uint16_t *flags);
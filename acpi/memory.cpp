@@ -0,0 +1,104 @@
+#include "memory.h"
+
+#include <mkmi.h>
+
+/* Keeps the block behind it 16 bytes aligned, like Malloc does */
+struct ACPI_MemoryHeader {
+	uint64_t Size;
+	uint32_t Tag;
+	uint32_t Magic;
+} __attribute__((aligned(16)));
+
+#define ACPI_MEMORY_MAGIC 0x41434D4D
+
+static const char *TagNames[ACPI_MEMORY_TAG_COUNT] = {
+	[ACPI_MEMORY_TABLES] = "Tables",
+	[ACPI_MEMORY_TOKENS] = "Tokens",
+	[ACPI_MEMORY_NAMES] = "Names",
+	[ACPI_MEMORY_BUFFERS] = "Buffers",
+	[ACPI_MEMORY_STRINGS] = "Strings",
+	[ACPI_MEMORY_FRAMES] = "Frames",
+	[ACPI_MEMORY_PROFILE] = "Profile",
+	[ACPI_MEMORY_RECORDING] = "Recording",
+};
+
+/* The last one sums up all the tags */
+static ACPI_MemoryStats Stats[ACPI_MEMORY_TAG_COUNT + 1];
+
+static void RaisePeak(ACPI_MemoryStats *stats, uint64_t live) {
+	uint64_t peak = __atomic_load_n(&stats->Peak, __ATOMIC_RELAXED);
+
+	while (live > peak) {
+		if (__atomic_compare_exchange_n(&stats->Peak, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+	}
+}
+
+static void Account(ACPI_MemoryStats *stats, uint64_t size) {
+	uint64_t live = __atomic_add_fetch(&stats->Live, size, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->Allocations, 1, __ATOMIC_RELAXED);
+
+	RaisePeak(stats, live);
+}
+
+static void Unaccount(ACPI_MemoryStats *stats, uint64_t size) {
+	__atomic_fetch_sub(&stats->Live, size, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->Frees, 1, __ATOMIC_RELAXED);
+}
+
+void *AllocateMemory(ACPI_MemoryTag tag, size_t size) {
+	ACPI_MemoryHeader *header = (ACPI_MemoryHeader*)Malloc(sizeof(ACPI_MemoryHeader) + size);
+	if (header == NULL) return NULL;
+
+	header->Size = size;
+	header->Tag = tag;
+	header->Magic = ACPI_MEMORY_MAGIC;
+
+	Account(&Stats[tag], size);
+	Account(&Stats[ACPI_MEMORY_TAG_COUNT], size);
+
+	return header + 1;
+}
+
+void FreeMemory(void *pointer) {
+	if (pointer == NULL) return;
+
+	ACPI_MemoryHeader *header = (ACPI_MemoryHeader*)pointer - 1;
+
+	/* Not ours, or freed twice. Leaking it beats corrupting the heap */
+	if (header->Magic != ACPI_MEMORY_MAGIC || header->Tag >= ACPI_MEMORY_TAG_COUNT) return;
+	header->Magic = 0;
+
+	Unaccount(&Stats[header->Tag], header->Size);
+	Unaccount(&Stats[ACPI_MEMORY_TAG_COUNT], header->Size);
+
+	Free(header);
+}
+
+static void CopyStats(ACPI_MemoryStats *from, ACPI_MemoryStats *to) {
+	to->Live = __atomic_load_n(&from->Live, __ATOMIC_RELAXED);
+	to->Peak = __atomic_load_n(&from->Peak, __ATOMIC_RELAXED);
+	to->Allocations = __atomic_load_n(&from->Allocations, __ATOMIC_RELAXED);
+	to->Frees = __atomic_load_n(&from->Frees, __ATOMIC_RELAXED);
+}
+
+void GetMemoryStats(ACPI_MemoryTag tag, ACPI_MemoryStats *stats) {
+	if (tag >= ACPI_MEMORY_TAG_COUNT) return;
+
+	CopyStats(&Stats[tag], stats);
+}
+
+void GetMemoryTotals(ACPI_MemoryStats *stats) {
+	CopyStats(&Stats[ACPI_MEMORY_TAG_COUNT], stats);
+}
+
+void DumpMemoryUsage() {
+	ACPI_MemoryStats stats;
+
+	for (size_t i = 0; i <= ACPI_MEMORY_TAG_COUNT; ++i) {
+		CopyStats(&Stats[i], &stats);
+
+		MKMI_Printf("%s: %d bytes live, %d peak, %d allocations, %d frees\r\n",
+		            i < ACPI_MEMORY_TAG_COUNT ? TagNames[i] : "Total",
+		            stats.Live, stats.Peak, stats.Allocations, stats.Frees);
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/* Who owns an allocation, so we know where the footprint comes from */
+enum ACPI_MemoryTag {
+	/* Copies of the RSDT/XSDT, FADT and DSDT */
+	ACPI_MEMORY_TABLES,
+	/* Tokens, token lists and the field units hanging off them */
+	ACPI_MEMORY_TOKENS,
+	/* Namespace nodes, the name segments themselves point into the tables */
+	ACPI_MEMORY_NAMES,
+	ACPI_MEMORY_BUFFERS,
+	ACPI_MEMORY_STRINGS,
+	/* Locals and temporaries of running methods */
+	ACPI_MEMORY_FRAMES,
+	/* Method entries and call stacks, only while profiling */
+	ACPI_MEMORY_PROFILE,
+	/* Region traffic recorded or being replayed */
+	ACPI_MEMORY_RECORDING,
+	ACPI_MEMORY_TAG_COUNT,
+};
+
+struct ACPI_MemoryStats {
+	/* Bytes handed out, headers not included */
+	uint64_t Live;
+	uint64_t Peak;
+
+	uint64_t Allocations;
+	uint64_t Frees;
+};
+
+/* Malloc with the tag and size kept in front of the block */
+void *AllocateMemory(ACPI_MemoryTag tag, size_t size);
+/* Takes anything AllocateMemory returned, NULL included */
+void FreeMemory(void *pointer);
+
+void GetMemoryStats(ACPI_MemoryTag tag, ACPI_MemoryStats *stats);
+/* All tags together, Peak is the highest the sum ever got */
+void GetMemoryTotals(ACPI_MemoryStats *stats);
+
+void DumpMemoryUsage();
@@ -0,0 +1,475 @@
+#include "namespace.h"
+#include "token.h"
+#include "resource.h"
+#include "memory.h"
+
+#include <mkmi.h>
+
+#define NAMESPACE_MAX_SEGMENTS 32
+
+static AML_NamespaceNode *CreateNode(AML_Namespace *ns, AML_NamespaceNode *parent, const char *segment, NodeType type, Token *object) {
+	AML_NamespaceNode *node = (AML_NamespaceNode*)AllocateMemory(ACPI_MEMORY_NAMES, sizeof(AML_NamespaceNode));
+
+	Memcpy(node->Name, segment, 4);
+	node->Type = type;
+	node->Object = object;
+	node->FieldUnit = 0;
+	node->Resources = NULL;
+	node->Status = AML_STA_UNKNOWN;
+	node->Owner = NULL;
+	node->OwnerIndex = 0;
+	node->Removed = false;
+	node->Parent = parent;
+	node->Children = NULL;
+	node->Next = NULL;
+
+	/* Everything above is visible to a reader that finds the node */
+	if (parent != NULL) {
+		AML_NamespaceNode **last = &parent->Children;
+		while (*last != NULL) last = &(*last)->Next;
+		__atomic_store_n(last, node, __ATOMIC_RELEASE);
+	}
+
+	ns->NodeCount++;
+
+	AML_NamespaceOwner *owner = ns->Loading;
+	if (owner == NULL) return node;
+
+	if (owner->Count == owner->Capacity) {
+		size_t capacity = owner->Capacity != 0 ? owner->Capacity * 2 : 16;
+		AML_NamespaceNode **nodes = (AML_NamespaceNode**)AllocateMemory(ACPI_MEMORY_NAMES, capacity * sizeof(AML_NamespaceNode*));
+
+		if (owner->Nodes != NULL) {
+			Memcpy(nodes, owner->Nodes, owner->Count * sizeof(AML_NamespaceNode*));
+			FreeMemory(owner->Nodes);
+		}
+
+		owner->Nodes = nodes;
+		owner->Capacity = capacity;
+	}
+
+	node->Owner = owner;
+	node->OwnerIndex = owner->Count;
+	owner->Nodes[owner->Count++] = node;
+
+	return node;
+}
+
+AML_Namespace *CreateNamespace() {
+	AML_Namespace *ns = new AML_Namespace;
+	ns->NodeCount = 0;
+	InitSpinLock(&ns->WriteLock);
+	ns->Loading = NULL;
+	ns->Epoch = 0;
+	ns->Readers[0] = 0;
+	ns->Readers[1] = 0;
+	ns->Retired = NULL;
+	ns->RetiredCount = 0;
+	ns->Root = CreateNode(ns, NULL, "\\___", NODE_SCOPE, NULL);
+
+	/* Predefined root scopes, see ACPI spec section 5.3.1 */
+	CreateNode(ns, ns->Root, "_GPE", NODE_SCOPE, NULL);
+	CreateNode(ns, ns->Root, "_PR_", NODE_SCOPE, NULL);
+	CreateNode(ns, ns->Root, "_SB_", NODE_SCOPE, NULL);
+	CreateNode(ns, ns->Root, "_SI_", NODE_SCOPE, NULL);
+	CreateNode(ns, ns->Root, "_TZ_", NODE_SCOPE, NULL);
+	CreateNode(ns, ns->Root, "_GL_", NODE_MUTEX, NULL);
+
+	return ns;
+}
+
+static void DeleteNode(AML_NamespaceNode *node) {
+	AML_NamespaceNode *child = node->Children;
+	while (child != NULL) {
+		AML_NamespaceNode *next = child->Next;
+		DeleteNode(child);
+		child = next;
+	}
+
+	if (node->Resources != NULL) DeleteResourceList(node->Resources);
+	FreeMemory(node);
+}
+
+static size_t CountNodes(AML_NamespaceNode *node) {
+	size_t count = 1;
+	for (AML_NamespaceNode *child = node->Children; child != NULL; child = child->Next) count += CountNodes(child);
+
+	return count;
+}
+
+static void FreeSubtree(void *node) {
+	DeleteNode((AML_NamespaceNode*)node);
+}
+
+/*
+ * An object retired in epoch N may still be seen by readers that entered in
+ * N or N-1. The epoch only moves on once the older of the two parities has
+ * no readers left, so at N+2 both of those are gone.
+ */
+static size_t Reclaim(AML_Namespace *ns) {
+	for (int i = 0; i < 2; ++i) {
+		uint64_t epoch = __atomic_load_n(&ns->Epoch, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ns->Readers[(epoch + 1) & 1], __ATOMIC_SEQ_CST) != 0) break;
+
+		__atomic_store_n(&ns->Epoch, epoch + 1, __ATOMIC_SEQ_CST);
+	}
+
+	uint64_t epoch = __atomic_load_n(&ns->Epoch, __ATOMIC_RELAXED);
+	AML_RetiredObject **current = &ns->Retired;
+	size_t count = 0;
+
+	while (*current != NULL) {
+		AML_RetiredObject *retired = *current;
+
+		if (retired->Epoch + 2 > epoch) {
+			current = &retired->Next;
+			continue;
+		}
+
+		*current = retired->Next;
+		retired->Free(retired->Object);
+		delete retired;
+
+		ns->RetiredCount--;
+		count++;
+	}
+
+	return count;
+}
+
+/* Both of these expect WriteLock held */
+static void Retire(AML_Namespace *ns, void *object, void (*free)(void *object)) {
+	AML_RetiredObject *retired = new AML_RetiredObject;
+	retired->Object = object;
+	retired->Free = free;
+
+	/* Taken after the object was unlinked, later readers cannot reach it */
+	retired->Epoch = __atomic_load_n(&ns->Epoch, __ATOMIC_SEQ_CST);
+	retired->Next = ns->Retired;
+	ns->Retired = retired;
+	ns->RetiredCount++;
+}
+
+static bool Unlink(AML_Namespace *ns, AML_NamespaceNode *node) {
+	AML_NamespaceNode *parent = node->Parent;
+	if (parent == NULL) return false;
+
+	AML_NamespaceNode **current = &parent->Children;
+	while (*current != NULL && *current != node) current = &(*current)->Next;
+	if (*current != node) return false;
+
+	/* Node keeps its own Next, a reader standing on it still reaches the siblings */
+	__atomic_store_n(current, node->Next, __ATOMIC_RELEASE);
+	ns->NodeCount -= CountNodes(node);
+
+	return true;
+}
+
+void RetireObject(AML_Namespace *ns, void *object, void (*free)(void *object)) {
+	AcquireSpinLock(&ns->WriteLock);
+
+	Retire(ns, object, free);
+	Reclaim(ns);
+
+	ReleaseSpinLock(&ns->WriteLock);
+}
+
+size_t ReclaimNamespace(AML_Namespace *ns) {
+	AcquireSpinLock(&ns->WriteLock);
+	size_t count = Reclaim(ns);
+	ReleaseSpinLock(&ns->WriteLock);
+
+	return count;
+}
+
+/* A subtree leaving drops out of every owner's list, nobody unloads it twice */
+static void MarkRemoved(AML_NamespaceNode *node) {
+	if (node->Owner != NULL) node->Owner->Nodes[node->OwnerIndex] = NULL;
+	node->Owner = NULL;
+	__atomic_store_n(&node->Removed, true, __ATOMIC_SEQ_CST);
+
+	for (AML_NamespaceNode *child = node->Children; child != NULL; child = child->Next) MarkRemoved(child);
+}
+
+void RemoveNode(AML_Namespace *ns, AML_NamespaceNode *node) {
+	AcquireSpinLock(&ns->WriteLock);
+
+	if (Unlink(ns, node)) {
+		MarkRemoved(node);
+		Retire(ns, node, FreeSubtree);
+		Reclaim(ns);
+	}
+
+	ReleaseSpinLock(&ns->WriteLock);
+}
+
+/*
+ * Only nodes whose parent the owner did not create are unlinked, the rest
+ * go along with them. Cost is linear in what the owner created plus what
+ * other tables later added under it.
+ */
+void UnloadNamespace(AML_Namespace *ns, AML_NamespaceOwner *owner) {
+	AcquireSpinLock(&ns->WriteLock);
+
+	for (size_t i = owner->Count; i-- > 0;) {
+		AML_NamespaceNode *node = owner->Nodes[i];
+		if (node == NULL || node->Parent->Owner == owner) continue;
+
+		if (Unlink(ns, node)) {
+			MarkRemoved(node);
+			Retire(ns, node, FreeSubtree);
+		}
+	}
+
+	Reclaim(ns);
+
+	if (owner->Nodes != NULL) FreeMemory(owner->Nodes);
+	owner->Nodes = NULL;
+	owner->Count = 0;
+	owner->Capacity = 0;
+
+	ReleaseSpinLock(&ns->WriteLock);
+}
+
+size_t GetOwnerRoots(AML_Namespace *ns, AML_NamespaceOwner *owner, AML_NamespaceNode **roots, size_t max) {
+	size_t count = 0;
+
+	AcquireSpinLock(&ns->WriteLock);
+
+	for (size_t i = 0; i < owner->Count; ++i) {
+		AML_NamespaceNode *node = owner->Nodes[i];
+		if (node == NULL || node->Parent->Owner == owner) continue;
+
+		if (roots != NULL) {
+			if (count == max) break;
+			roots[count] = node;
+		}
+
+		count++;
+	}
+
+	ReleaseSpinLock(&ns->WriteLock);
+
+	return count;
+}
+
+void DeleteNamespace(AML_Namespace *ns) {
+	/* Nobody reads any more, everything retired goes now */
+	while (ns->Retired != NULL) {
+		AML_RetiredObject *retired = ns->Retired;
+		ns->Retired = retired->Next;
+
+		retired->Free(retired->Object);
+		delete retired;
+	}
+
+	DeleteNode(ns->Root);
+	delete ns;
+}
+
+AML_NamespaceNode *FindChild(AML_NamespaceNode *parent, const char *segment) {
+	for (AML_NamespaceNode *child = FirstChild(parent); child != NULL; child = NextSibling(child)) {
+		if (Memcmp(child->Name, segment, 4) == 0) return child;
+	}
+
+	return NULL;
+}
+
+/* Finds the scope a name's prefix points to, optionally creating missing scopes */
+static AML_NamespaceNode *WalkPrefix(AML_Namespace *ns, AML_NamespaceNode *scope, bool isRoot, uint8_t parents, const char *segments, size_t count, bool create) {
+	AML_NamespaceNode *current = isRoot ? ns->Root : scope;
+
+	for (uint8_t i = 0; i < parents && current->Parent != NULL; ++i) current = current->Parent;
+
+	for (size_t i = 0; i + 1 < count; ++i) {
+		AML_NamespaceNode *next = FindChild(current, &segments[i * 4]);
+
+		if (next == NULL) {
+			if (!create) return NULL;
+			next = CreateNode(ns, current, &segments[i * 4], NODE_SCOPE, NULL);
+		}
+
+		current = next;
+	}
+
+	return current;
+}
+
+static AML_NamespaceNode *Lookup(AML_Namespace *ns, AML_NamespaceNode *scope, bool isRoot, uint8_t parents, const char *segments, size_t count) {
+	if (count == 0) return isRoot ? ns->Root : NULL;
+
+	/* Single relative segments follow the upward search rules */
+	if (!isRoot && parents == 0 && count == 1) {
+		for (AML_NamespaceNode *current = scope; current != NULL; current = current->Parent) {
+			AML_NamespaceNode *node = FindChild(current, segments);
+			if (node != NULL) return node;
+		}
+
+		return NULL;
+	}
+
+	AML_NamespaceNode *parent = WalkPrefix(ns, scope, isRoot, parents, segments, count, false);
+	if (parent == NULL) return NULL;
+
+	return FindChild(parent, &segments[(count - 1) * 4]);
+}
+
+static AML_NamespaceNode *DefineNode(AML_Namespace *ns, AML_NamespaceNode *scope, NameType *name, NodeType type, Token *object) {
+	if (name->SegmentNumber == 0) return NULL;
+
+	AML_NamespaceNode *parent = WalkPrefix(ns, scope, name->IsRoot, name->ParentPrefixes, name->NameSegments, name->SegmentNumber, true);
+	const char *segment = &name->NameSegments[(name->SegmentNumber - 1) * 4];
+
+	AML_NamespaceNode *node = FindChild(parent, segment);
+	if (node == NULL) return CreateNode(ns, parent, segment, type, object);
+
+	/* A table loaded at runtime only adds, unloading it could not bring the old object back */
+	if (ns->Loading != NULL) return NULL;
+
+	/* Redefinition, or a predefined scope being filled in. A reader seeing the new type sees the new object */
+	__atomic_store_n(&node->Object, object, __ATOMIC_RELEASE);
+	__atomic_store_n(&node->Type, type, __ATOMIC_RELEASE);
+
+	return node;
+}
+
+static void LoadScope(AML_Namespace *ns, AML_NamespaceNode *scope, TokenList *list) {
+	if (list == NULL) return;
+
+	for (Token *current = list->Head; current != NULL; current = current->Next) {
+		switch (current->Type) {
+			case NAME:
+				DefineNode(ns, scope, &current->Name, NODE_NAME, current);
+				break;
+			case ALIAS:
+				DefineNode(ns, scope, &current->Alias.NameTwo, NODE_ALIAS, current);
+				break;
+			case METHOD:
+				DefineNode(ns, scope, &current->Method.Name, NODE_METHOD, current);
+				break;
+			case REGION:
+				DefineNode(ns, scope, &current->Region.Name, NODE_REGION, current);
+				break;
+			case MUTEX:
+				DefineNode(ns, scope, &current->Mutex.Name, NODE_MUTEX, current);
+				break;
+			case EVENT:
+				DefineNode(ns, scope, &current->Event.Name, NODE_EVENT, current);
+				break;
+			case SCOPE: {
+				NameType *name = &current->Scope.Name;
+				AML_NamespaceNode *target = Lookup(ns, scope, name->IsRoot, name->ParentPrefixes, name->NameSegments, name->SegmentNumber);
+				if (target == NULL) target = DefineNode(ns, scope, name, NODE_SCOPE, NULL);
+				if (target != NULL) LoadScope(ns, target, current->Children);
+				}
+				break;
+			case DEVICE:
+			case THERMALZONE: {
+				NodeType type = current->Type == DEVICE ? NODE_DEVICE : NODE_THERMAL_ZONE;
+				AML_NamespaceNode *device = DefineNode(ns, scope, &current->Device.Name, type, current);
+				if (device != NULL) LoadScope(ns, device, current->Children);
+				}
+				break;
+			case PROCESSOR: {
+				AML_NamespaceNode *processor = DefineNode(ns, scope, &current->Processor.Name, NODE_PROCESSOR, current);
+				if (processor != NULL) LoadScope(ns, processor, current->Children);
+				}
+				break;
+			case FIELD:
+				for (uint32_t i = 0; i < current->Field.UnitCount; ++i) {
+					if (ns->Loading != NULL && FindChild(scope, current->Field.Units[i].Name) != NULL) continue;
+
+					AML_NamespaceNode *unit = CreateNode(ns, scope, current->Field.Units[i].Name, NODE_FIELD_UNIT, current);
+					unit->FieldUnit = i;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void LoadNamespace(AML_Namespace *ns, AML_NamespaceNode *scope, TokenList *list, AML_NamespaceOwner *owner) {
+	AcquireSpinLock(&ns->WriteLock);
+	ns->Loading = owner;
+	LoadScope(ns, scope, list);
+	ns->Loading = NULL;
+	ReleaseSpinLock(&ns->WriteLock);
+}
+
+AML_NamespaceNode *ResolveName(AML_Namespace *ns, AML_NamespaceNode *scope, NameType *name) {
+	return Lookup(ns, scope, name->IsRoot, name->ParentPrefixes, name->NameSegments, name->SegmentNumber);
+}
+
+AML_NamespaceNode *FindNode(AML_Namespace *ns, AML_NamespaceNode *scope, const char *path) {
+	char segments[NAMESPACE_MAX_SEGMENTS * 4];
+	size_t count = 0;
+	bool isRoot = false;
+	uint8_t parents = 0;
+
+	if (scope == NULL) scope = ns->Root;
+
+	if (*path == '\\') {
+		isRoot = true;
+		path++;
+	}
+
+	while (*path == '^') {
+		parents++;
+		path++;
+	}
+
+	/* Segments shorter than four characters are padded with underscores */
+	while (*path != '\0' && count < NAMESPACE_MAX_SEGMENTS) {
+		char *segment = &segments[count * 4];
+		size_t length = 0;
+
+		while (*path != '\0' && *path != '.') {
+			if (length < 4) segment[length++] = *path;
+			path++;
+		}
+
+		while (length < 4) segment[length++] = '_';
+		count++;
+
+		if (*path == '.') path++;
+	}
+
+	return Lookup(ns, scope, isRoot, parents, segments, count);
+}
+
+bool IsNodeInSubtree(AML_NamespaceNode *node, AML_NamespaceNode *subtree) {
+	for (; node != NULL; node = node->Parent) {
+		if (node == subtree) return true;
+	}
+
+	return false;
+}
+
+size_t GetNodePath(AML_NamespaceNode *node, char *buffer, size_t size) {
+	AML_NamespaceNode *stack[NAMESPACE_MAX_SEGMENTS];
+	size_t depth = 0;
+
+	for (; node != NULL && node->Parent != NULL && depth < NAMESPACE_MAX_SEGMENTS; node = node->Parent) {
+		stack[depth++] = node;
+	}
+
+	/* "\" plus "XXXX." for every segment, the last dot becomes the terminator */
+	size_t length = 1 + depth * 5;
+	if (depth == 0) length = 2;
+	if (size < length) return 0;
+
+	size_t idx = 0;
+	buffer[idx++] = '\\';
+
+	while (depth > 0) {
+		Memcpy(&buffer[idx], stack[--depth]->Name, 4);
+		idx += 4;
+
+		if (depth > 0) buffer[idx++] = '.';
+	}
+
+	buffer[idx] = '\0';
+
+	return idx;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "aml_types.h"
+#include "sync.h"
+
+struct Token;
+struct TokenList;
+struct AML_ResourceList;
+struct AML_NamespaceNode;
+
+/* Returned by _STA when the object is missing, see ACPI spec section 6.3.7 */
+#define AML_STA_DEFAULT 0x0F
+#define AML_STA_UNKNOWN 0xFFFFFFFF
+
+#define AML_STA_PRESENT 0x01
+#define AML_STA_ENABLED 0x02
+#define AML_STA_FUNCTIONING 0x08
+
+enum NodeType {
+	NODE_SCOPE,
+	NODE_DEVICE,
+	NODE_NAME,
+	NODE_METHOD,
+	NODE_REGION,
+	NODE_FIELD_UNIT,
+	NODE_ALIAS,
+	/* \_GL_ is a mutex node without an object, it stands for the global lock */
+	NODE_MUTEX,
+	NODE_EVENT,
+	NODE_THERMAL_ZONE,
+	NODE_PROCESSOR,
+};
+
+/* The nodes one definition block added, so unloading it removes exactly those */
+struct AML_NamespaceOwner {
+	/* Entries go NULL when a node leaves along with some other table's subtree */
+	AML_NamespaceNode **Nodes;
+	size_t Count;
+	size_t Capacity;
+};
+
+struct AML_NamespaceNode {
+	char Name[4];
+	NodeType Type;
+
+	/* The token that defined this node, NULL for implicit scopes */
+	Token *Object;
+	/* Index into Object->Field.Units for field unit nodes */
+	uint32_t FieldUnit;
+
+	/* Decoded _CRS, filled on first use */
+	AML_ResourceList *Resources;
+	/* Cached _STA, AML_STA_UNKNOWN until evaluated */
+	uint32_t Status;
+
+	/* NULL for the DSDT and the predefined scopes */
+	AML_NamespaceOwner *Owner;
+	size_t OwnerIndex;
+	/* Set once unlinked, the node only lives on for readers that still hold it */
+	bool Removed;
+
+	AML_NamespaceNode *Parent;
+	AML_NamespaceNode *Children;
+	AML_NamespaceNode *Next;
+};
+
+/* Freed once no reader can still see it, see RetireObject */
+struct AML_RetiredObject {
+	void *Object;
+	void (*Free)(void *object);
+	uint64_t Epoch;
+
+	AML_RetiredObject *Next;
+};
+
+/*
+ * Lookups and walks never lock. Writers publish nodes with release stores
+ * and removed ones stay readable until every reader that could have seen
+ * them has left its read section.
+ */
+struct AML_Namespace {
+	AML_NamespaceNode *Root;
+	size_t NodeCount;
+
+	/* Serializes loads, removals and reclamation */
+	AML_SpinLock WriteLock;
+	/* Whoever the nodes created right now belong to, only set with WriteLock held */
+	AML_NamespaceOwner *Loading;
+
+	/* Readers count themselves against the parity of the epoch they entered in */
+	uint64_t Epoch;
+	uint64_t Readers[2];
+
+	AML_RetiredObject *Retired;
+	size_t RetiredCount;
+};
+
+/* Children and Next may change under a reader, these are the only way down the tree */
+static inline AML_NamespaceNode *FirstChild(AML_NamespaceNode *node) {
+	return __atomic_load_n(&node->Children, __ATOMIC_ACQUIRE);
+}
+
+static inline AML_NamespaceNode *NextSibling(AML_NamespaceNode *node) {
+	return __atomic_load_n(&node->Next, __ATOMIC_ACQUIRE);
+}
+
+/* Nodes found in here stay valid until the matching LeaveNamespace, sections nest */
+static inline uint32_t EnterNamespace(AML_Namespace *ns) {
+	for (;;) {
+		uint64_t epoch = __atomic_load_n(&ns->Epoch, __ATOMIC_SEQ_CST);
+		__atomic_fetch_add(&ns->Readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+
+		/* The epoch moved on before we were counted, the writer may have missed us */
+		if (__atomic_load_n(&ns->Epoch, __ATOMIC_SEQ_CST) == epoch) return epoch & 1;
+
+		__atomic_fetch_sub(&ns->Readers[epoch & 1], 1, __ATOMIC_RELEASE);
+	}
+}
+
+static inline void LeaveNamespace(AML_Namespace *ns, uint32_t section) {
+	__atomic_fetch_sub(&ns->Readers[section], 1, __ATOMIC_RELEASE);
+}
+
+AML_Namespace *CreateNamespace();
+/* Nodes created go to owner, NULL for the DSDT. Objects already there are never redefined by an owner */
+void LoadNamespace(AML_Namespace *ns, AML_NamespaceNode *scope, TokenList *list, AML_NamespaceOwner *owner);
+/* Removes every node owner created, along with whatever was added under them */
+void UnloadNamespace(AML_Namespace *ns, AML_NamespaceOwner *owner);
+/* Nodes of owner whose parent it does not own, the subtrees it spliced in. Counts them when roots is NULL */
+size_t GetOwnerRoots(AML_Namespace *ns, AML_NamespaceOwner *owner, AML_NamespaceNode **roots, size_t max);
+void DeleteNamespace(AML_Namespace *ns);
+
+/*
+ * Unlinks node and its subtree, readers already past it keep walking until
+ * they leave. Call DropRemovedNodes on the notify queue before leaving the
+ * read section the removal happened in.
+ */
+void RemoveNode(AML_Namespace *ns, AML_NamespaceNode *node);
+/* Calls free on object once every read section open right now is over */
+void RetireObject(AML_Namespace *ns, void *object, void (*free)(void *object));
+/* Frees what is no longer reachable by any reader, returns how many objects went */
+size_t ReclaimNamespace(AML_Namespace *ns);
+
+AML_NamespaceNode *FindChild(AML_NamespaceNode *parent, const char *segment);
+AML_NamespaceNode *ResolveName(AML_Namespace *ns, AML_NamespaceNode *scope, NameType *name);
+AML_NamespaceNode *FindNode(AML_Namespace *ns, AML_NamespaceNode *scope, const char *path);
+
+bool IsNodeInSubtree(AML_NamespaceNode *node, AML_NamespaceNode *subtree);
+size_t GetNodePath(AML_NamespaceNode *node, char *buffer, size_t size);
@@ -0,0 +1,256 @@
+#include "notify.h"
+#include "namespace.h"
+
+#include <mkmi.h>
+
+AML_NotifyQueue *CreateNotifyQueue(AML_Namespace *ns) {
+	AML_NotifyQueue *queue = new AML_NotifyQueue;
+
+	queue->Head = 0;
+	queue->Tail = 0;
+
+	for (size_t i = 0; i < NOTIFY_RING_SIZE; ++i) {
+		queue->Slots[i].Sequence = i;
+		queue->Slots[i].Node = NULL;
+		queue->Slots[i].Value = 0;
+	}
+
+	InitSpinLock(&queue->SubscriptionLock);
+	queue->Subscriptions = NULL;
+	queue->SubscriptionCount = 0;
+	queue->Snapshot = NULL;
+	queue->SnapshotCapacity = 0;
+	queue->DeliverySequence = 0;
+	queue->Namespace = ns;
+
+	queue->Stats.Queued = 0;
+	queue->Stats.Dropped = 0;
+	queue->Stats.Delivered = 0;
+	queue->Stats.Batches = 0;
+
+	return queue;
+}
+
+void DeleteNotifyQueue(AML_NotifyQueue *queue) {
+	AML_NotifySubscription *current = queue->Subscriptions;
+	while (current != NULL) {
+		AML_NotifySubscription *next = current->Next;
+		delete current;
+		current = next;
+	}
+
+	delete[] queue->Snapshot;
+	delete queue;
+}
+
+AML_NotifySubscription *SubscribeNotify(AML_NotifyQueue *queue, AML_NamespaceNode *node, bool subtree, AML_NotifyHandler handler, void *context) {
+	AML_NotifySubscription *subscription = new AML_NotifySubscription;
+	subscription->Node = node;
+	subscription->Subtree = subtree;
+	subscription->Handler = handler;
+	subscription->Context = context;
+
+	AcquireSpinLock(&queue->SubscriptionLock);
+	subscription->Next = queue->Subscriptions;
+	queue->Subscriptions = subscription;
+	queue->SubscriptionCount++;
+	ReleaseSpinLock(&queue->SubscriptionLock);
+
+	return subscription;
+}
+
+void UnsubscribeNotify(AML_NotifyQueue *queue, AML_NotifySubscription *subscription) {
+	AcquireSpinLock(&queue->SubscriptionLock);
+
+	AML_NotifySubscription **current = &queue->Subscriptions;
+	while (*current != NULL && *current != subscription) current = &(*current)->Next;
+	if (*current != NULL) {
+		*current = subscription->Next;
+		queue->SubscriptionCount--;
+	}
+
+	/* A batch running now may hold a copy of it, the caller frees the context after we return */
+	uint64_t delivery = __atomic_load_n(&queue->DeliverySequence, __ATOMIC_ACQUIRE);
+
+	ReleaseSpinLock(&queue->SubscriptionLock);
+
+	if (delivery & 1) {
+		while (__atomic_load_n(&queue->DeliverySequence, __ATOMIC_ACQUIRE) == delivery) CpuRelax();
+	}
+
+	delete subscription;
+}
+
+/*
+ * Runs in the read section that removed the nodes, so they are still there
+ * to look at. A producer that queued one of them afterwards clears its own
+ * slot, see QueueNotify.
+ */
+void DropRemovedNodes(AML_NotifyQueue *queue) {
+	for (size_t i = 0; i < NOTIFY_RING_SIZE; ++i) {
+		AML_NamespaceNode *node = __atomic_load_n(&queue->Slots[i].Node, __ATOMIC_SEQ_CST);
+		if (node == NULL || !__atomic_load_n(&node->Removed, __ATOMIC_SEQ_CST)) continue;
+
+		__atomic_compare_exchange_n(&queue->Slots[i].Node, &node, NULL, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+	}
+
+	AcquireSpinLock(&queue->SubscriptionLock);
+
+	AML_NotifySubscription **current = &queue->Subscriptions;
+	while (*current != NULL) {
+		AML_NotifySubscription *subscription = *current;
+
+		if (!subscription->Node->Removed) {
+			current = &subscription->Next;
+			continue;
+		}
+
+		*current = subscription->Next;
+		queue->SubscriptionCount--;
+		delete subscription;
+	}
+
+	ReleaseSpinLock(&queue->SubscriptionLock);
+}
+
+/*
+ * Multiple producers, single consumer. Every slot carries a sequence number
+ * telling producers whether the consumer is done with it, so a full ring is
+ * detected without ever waiting on the delivery side. Callers hold a read
+ * section on the namespace node came from.
+ */
+bool QueueNotify(AML_NotifyQueue *queue, AML_NamespaceNode *node, uint32_t value) {
+	uint64_t position = __atomic_load_n(&queue->Tail, __ATOMIC_RELAXED);
+	AML_NotifySlot *slot;
+
+	while (true) {
+		slot = &queue->Slots[position & (NOTIFY_RING_SIZE - 1)];
+		uint64_t sequence = __atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE);
+		int64_t difference = (int64_t)sequence - (int64_t)position;
+
+		if (difference == 0) {
+			if (__atomic_compare_exchange_n(&queue->Tail, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+		} else if (difference < 0) {
+			/* The ring is full, the interpreter must not wait for the consumer */
+			__atomic_fetch_add(&queue->Stats.Dropped, 1, __ATOMIC_RELAXED);
+			return false;
+		} else {
+			position = __atomic_load_n(&queue->Tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->Value = value;
+	__atomic_store_n(&slot->Node, node, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&slot->Sequence, position + 1, __ATOMIC_RELEASE);
+
+	/* Removed while we were queueing it, DropRemovedNodes may already have been past this slot */
+	if (__atomic_load_n(&node->Removed, __ATOMIC_SEQ_CST)) {
+		__atomic_compare_exchange_n(&slot->Node, &node, NULL, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+	}
+
+	__atomic_fetch_add(&queue->Stats.Queued, 1, __ATOMIC_RELAXED);
+
+	return true;
+}
+
+static size_t DequeueBatch(AML_NotifyQueue *queue, AML_NotifySlot *batch) {
+	size_t count = 0;
+
+	while (count < NOTIFY_BATCH_SIZE) {
+		AML_NotifySlot *slot = &queue->Slots[queue->Head & (NOTIFY_RING_SIZE - 1)];
+		uint64_t sequence = __atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE);
+
+		if (sequence != queue->Head + 1) break;
+
+		batch[count].Node = __atomic_exchange_n(&slot->Node, NULL, __ATOMIC_SEQ_CST);
+		batch[count].Value = slot->Value;
+		count++;
+
+		/* Hand the slot back to the producers one lap ahead */
+		__atomic_store_n(&slot->Sequence, queue->Head + NOTIFY_RING_SIZE, __ATOMIC_RELEASE);
+		queue->Head++;
+	}
+
+	return count;
+}
+
+/*
+ * Copies the subscriptions and marks a delivery as running in one go, so an
+ * unsubscriber either is not in the copy or sees the delivery and waits.
+ * Returns how many were copied.
+ */
+static size_t TakeSnapshot(AML_NotifyQueue *queue) {
+	AcquireSpinLock(&queue->SubscriptionLock);
+
+	while (queue->SubscriptionCount > queue->SnapshotCapacity) {
+		size_t capacity = queue->SubscriptionCount * 2;
+		ReleaseSpinLock(&queue->SubscriptionLock);
+
+		delete[] queue->Snapshot;
+		queue->Snapshot = new AML_NotifySubscription[capacity];
+		queue->SnapshotCapacity = capacity;
+
+		AcquireSpinLock(&queue->SubscriptionLock);
+	}
+
+	size_t count = 0;
+	for (AML_NotifySubscription *current = queue->Subscriptions; current != NULL; current = current->Next) {
+		queue->Snapshot[count++] = *current;
+	}
+
+	__atomic_store_n(&queue->DeliverySequence, queue->DeliverySequence + 1, __ATOMIC_RELEASE);
+
+	ReleaseSpinLock(&queue->SubscriptionLock);
+
+	return count;
+}
+
+/* Meant to be called by a single delivery thread, drains the ring in batches */
+size_t DeliverNotifications(AML_NotifyQueue *queue) {
+	AML_NotifySlot batch[NOTIFY_BATCH_SIZE];
+	size_t total = 0;
+	size_t count;
+
+	for (;;) {
+		/* Nodes taken out of the ring stay valid until the batch is delivered */
+		uint32_t section = EnterNamespace(queue->Namespace);
+
+		count = DequeueBatch(queue, batch);
+		if (count == 0) {
+			LeaveNamespace(queue->Namespace, section);
+			break;
+		}
+
+		/* Handlers may take locks or subscribe, so they run without the subscription lock */
+		size_t subscriptions = TakeSnapshot(queue);
+
+		for (size_t i = 0; i < count; ++i) {
+			if (batch[i].Node == NULL || batch[i].Node->Removed) continue;
+
+			for (size_t j = 0; j < subscriptions; ++j) {
+				AML_NotifySubscription *current = &queue->Snapshot[j];
+				bool match = current->Subtree ?
+					IsNodeInSubtree(batch[i].Node, current->Node) :
+					batch[i].Node == current->Node;
+
+				if (match) current->Handler(batch[i].Node, batch[i].Value, current->Context);
+			}
+		}
+
+		__atomic_store_n(&queue->DeliverySequence, queue->DeliverySequence + 1, __ATOMIC_RELEASE);
+		LeaveNamespace(queue->Namespace, section);
+
+		__atomic_fetch_add(&queue->Stats.Delivered, count, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&queue->Stats.Batches, 1, __ATOMIC_RELAXED);
+		total += count;
+	}
+
+	return total;
+}
+
+void GetNotifyStats(AML_NotifyQueue *queue, AML_NotifyStats *stats) {
+	stats->Queued = __atomic_load_n(&queue->Stats.Queued, __ATOMIC_RELAXED);
+	stats->Dropped = __atomic_load_n(&queue->Stats.Dropped, __ATOMIC_RELAXED);
+	stats->Delivered = __atomic_load_n(&queue->Stats.Delivered, __ATOMIC_RELAXED);
+	stats->Batches = __atomic_load_n(&queue->Stats.Batches, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sync.h"
+
+struct AML_Namespace;
+struct AML_NamespaceNode;
+
+/* Must be a power of two */
+#define NOTIFY_RING_SIZE 256
+#define NOTIFY_BATCH_SIZE 32
+
+/* Notification values, see ACPI spec section 5.6.6 */
+#define AML_NOTIFY_BUS_CHECK 0x00
+#define AML_NOTIFY_DEVICE_CHECK 0x01
+#define AML_NOTIFY_DEVICE_WAKE 0x02
+#define AML_NOTIFY_EJECT_REQUEST 0x03
+#define AML_NOTIFY_DEVICE_CHECK_LIGHT 0x04
+#define AML_NOTIFY_FREQUENCY_MISMATCH 0x05
+#define AML_NOTIFY_BUS_MODE_MISMATCH 0x06
+#define AML_NOTIFY_POWER_FAULT 0x07
+
+typedef void (*AML_NotifyHandler)(AML_NamespaceNode *node, uint32_t value, void *context);
+
+struct AML_NotifySubscription {
+	AML_NamespaceNode *Node;
+	bool Subtree;
+
+	AML_NotifyHandler Handler;
+	void *Context;
+
+	AML_NotifySubscription *Next;
+};
+
+struct AML_NotifySlot {
+	uint64_t Sequence;
+
+	AML_NamespaceNode *Node;
+	uint32_t Value;
+};
+
+struct AML_NotifyStats {
+	uint64_t Queued;
+	uint64_t Dropped;
+	uint64_t Delivered;
+	uint64_t Batches;
+};
+
+struct AML_NotifyQueue {
+	/* Producers and the consumer live on separate cache lines */
+	uint64_t Tail;
+	uint8_t TailPadding[56];
+	uint64_t Head;
+	uint8_t HeadPadding[56];
+
+	AML_NotifySlot Slots[NOTIFY_RING_SIZE];
+
+	AML_SpinLock SubscriptionLock;
+	AML_NotifySubscription *Subscriptions;
+	size_t SubscriptionCount;
+
+	/* Consumer owned copy of the subscriptions, handlers run from it without the lock */
+	AML_NotifySubscription *Snapshot;
+	size_t SnapshotCapacity;
+	/* Odd while handlers run */
+	uint64_t DeliverySequence;
+
+	/* Queued nodes are only touched inside its read sections */
+	AML_Namespace *Namespace;
+
+	AML_NotifyStats Stats;
+};
+
+AML_NotifyQueue *CreateNotifyQueue(AML_Namespace *ns);
+void DeleteNotifyQueue(AML_NotifyQueue *queue);
+
+AML_NotifySubscription *SubscribeNotify(AML_NotifyQueue *queue, AML_NamespaceNode *node, bool subtree, AML_NotifyHandler handler, void *context);
+/* Waits for handlers already running, so it must not be called from one */
+void UnsubscribeNotify(AML_NotifyQueue *queue, AML_NotifySubscription *subscription);
+/* Forgets pending notifications and subscriptions of removed nodes, see RemoveNode */
+void DropRemovedNodes(AML_NotifyQueue *queue);
+
+bool QueueNotify(AML_NotifyQueue *queue, AML_NamespaceNode *node, uint32_t value);
+size_t DeliverNotifications(AML_NotifyQueue *queue);
+
+void GetNotifyStats(AML_NotifyQueue *queue, AML_NotifyStats *stats);
@@ -0,0 +1,197 @@
+#include "numa.h"
+
+#include <mkmi.h>
+
+/* Later revisions may append fields, so only a minimum is checked */
+static size_t EntrySize(uint8_t type) {
+	switch (type) {
+		case SRAT_PROCESSOR_AFFINITY: return sizeof(SRATProcessorAffinity);
+		case SRAT_MEMORY_AFFINITY: return sizeof(SRATMemoryAffinity);
+		case SRAT_X2APIC_AFFINITY: return sizeof(SRATX2APICAffinity);
+		case SRAT_GICC_AFFINITY: return sizeof(SRATGICCAffinity);
+		default: return sizeof(SRATEntryHeader);
+	}
+}
+
+/* The entry at *idx, NULL at the end of the table. Entries too short for their type are stepped over */
+static SRATEntryHeader *NextEntry(uint8_t *entries, size_t length, size_t *idx) {
+	while (*idx + sizeof(SRATEntryHeader) <= length) {
+		SRATEntryHeader *entry = (SRATEntryHeader*)&entries[*idx];
+		if (entry->Length < sizeof(SRATEntryHeader) || *idx + entry->Length > length) return NULL;
+
+		*idx += entry->Length;
+		if (entry->Length >= EntrySize(entry->Type)) return entry;
+	}
+
+	return NULL;
+}
+
+static uint16_t NodeForDomain(NUMA_Topology *topology, uint32_t domain) {
+	for (size_t i = 0; i < topology->NodeCount; ++i) {
+		if (topology->Domains[i] == domain) return i;
+	}
+
+	topology->Domains[topology->NodeCount] = domain;
+	return topology->NodeCount++;
+}
+
+static void AddCPU(NUMA_Topology *topology, uint64_t hardwareId, uint32_t domain, uint32_t flags) {
+	if (!(flags & SRAT_ENABLED)) return;
+
+	/* Insertion keeps the array sorted, SRATs are short and mostly in order already */
+	size_t idx = topology->CPUCount++;
+	while (idx > 0 && topology->CPUHardwareID[idx - 1] > hardwareId) {
+		topology->CPUHardwareID[idx] = topology->CPUHardwareID[idx - 1];
+		topology->CPUNode[idx] = topology->CPUNode[idx - 1];
+		idx--;
+	}
+
+	topology->CPUHardwareID[idx] = hardwareId;
+	topology->CPUNode[idx] = NodeForDomain(topology, domain);
+}
+
+static void AddMemory(NUMA_Topology *topology, SRATMemoryAffinity *memory) {
+	if (!(memory->Flags & SRAT_ENABLED) || memory->Length == 0) return;
+
+	size_t idx = topology->MemoryRangeCount++;
+	while (idx > 0 && topology->MemoryRanges[idx - 1].Base > memory->Base) {
+		topology->MemoryRanges[idx] = topology->MemoryRanges[idx - 1];
+		idx--;
+	}
+
+	NUMA_MemoryRange *range = &topology->MemoryRanges[idx];
+	range->Base = memory->Base;
+	range->Length = memory->Length;
+	range->Node = NodeForDomain(topology, memory->Proximity);
+	range->Flags = memory->Flags;
+}
+
+static void FillDistances(NUMA_Topology *topology, SLITTable *slit) {
+	size_t count = topology->NodeCount;
+	topology->Distances = new uint8_t[count * count > 0 ? count * count : 1];
+
+	/* A matrix larger than the table is ignored, the first check keeps the square from overflowing */
+	uint64_t localities = 0;
+	if (slit != NULL && slit->Header.Length > sizeof(SLITTable)) {
+		localities = slit->LocalityCount;
+		if (localities > slit->Header.Length || localities * localities > slit->Header.Length - sizeof(SLITTable)) localities = 0;
+	}
+
+	for (size_t from = 0; from < count; ++from) {
+		for (size_t to = 0; to < count; ++to) {
+			uint32_t fromDomain = topology->Domains[from];
+			uint32_t toDomain = topology->Domains[to];
+			uint8_t distance = from == to ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+
+			if (fromDomain < localities && toDomain < localities) {
+				distance = slit->Entries[fromDomain * localities + toDomain];
+			}
+
+			topology->Distances[from * count + to] = distance;
+		}
+	}
+}
+
+NUMA_Topology *CreateNUMATopology(SRATTable *srat, SLITTable *slit) {
+	NUMA_Topology *topology = new NUMA_Topology;
+	uint8_t *entries = (uint8_t*)srat + sizeof(SRATTable);
+	size_t entriesLength = srat->Header.Length > sizeof(SRATTable) ? srat->Header.Length - sizeof(SRATTable) : 0;
+
+	/* Counted first, every CPU or memory entry brings at most one new domain */
+	size_t cpus = 0, ranges = 0;
+	size_t idx = 0;
+	SRATEntryHeader *entry;
+
+	while ((entry = NextEntry(entries, entriesLength, &idx)) != NULL) {
+		if (entry->Type == SRAT_MEMORY_AFFINITY) ranges++;
+		else if (entry->Type <= SRAT_GICC_AFFINITY) cpus++;
+	}
+
+	topology->NodeCount = 0;
+	topology->Domains = new uint32_t[cpus + ranges];
+
+	topology->CPUCount = 0;
+	topology->CPUHardwareID = new uint64_t[cpus];
+	topology->CPUNode = new uint16_t[cpus];
+
+	topology->MemoryRangeCount = 0;
+	topology->MemoryRanges = new NUMA_MemoryRange[ranges];
+
+	idx = 0;
+
+	while ((entry = NextEntry(entries, entriesLength, &idx)) != NULL) {
+		switch (entry->Type) {
+			case SRAT_PROCESSOR_AFFINITY: {
+				SRATProcessorAffinity *cpu = (SRATProcessorAffinity*)entry;
+				uint32_t domain = cpu->ProximityLow | (cpu->ProximityHigh[0] << 8) |
+						  (cpu->ProximityHigh[1] << 16) | (cpu->ProximityHigh[2] << 24);
+				AddCPU(topology, cpu->APICID, domain, cpu->Flags);
+				}
+				break;
+			case SRAT_MEMORY_AFFINITY:
+				AddMemory(topology, (SRATMemoryAffinity*)entry);
+				break;
+			case SRAT_X2APIC_AFFINITY: {
+				SRATX2APICAffinity *cpu = (SRATX2APICAffinity*)entry;
+				AddCPU(topology, cpu->X2APICID, cpu->Proximity, cpu->Flags);
+				}
+				break;
+			case SRAT_GICC_AFFINITY: {
+				SRATGICCAffinity *cpu = (SRATGICCAffinity*)entry;
+				AddCPU(topology, cpu->ProcessorUID, cpu->Proximity, cpu->Flags);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	FillDistances(topology, slit);
+
+	return topology;
+}
+
+void DeleteNUMATopology(NUMA_Topology *topology) {
+	delete[] topology->Domains;
+	delete[] topology->CPUHardwareID;
+	delete[] topology->CPUNode;
+	delete[] topology->MemoryRanges;
+	delete[] topology->Distances;
+	delete topology;
+}
+
+uint16_t FindNodeForCPU(NUMA_Topology *topology, uint64_t hardwareId) {
+	size_t low = 0;
+	size_t high = topology->CPUCount;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if (topology->CPUHardwareID[middle] < hardwareId) low = middle + 1;
+		else high = middle;
+	}
+
+	if (low < topology->CPUCount && topology->CPUHardwareID[low] == hardwareId) return topology->CPUNode[low];
+
+	return NUMA_NO_NODE;
+}
+
+uint16_t FindNodeForAddress(NUMA_Topology *topology, uint64_t address) {
+	/* Finds the last range starting at or below the address */
+	size_t low = 0;
+	size_t high = topology->MemoryRangeCount;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if (topology->MemoryRanges[middle].Base <= address) low = middle + 1;
+		else high = middle;
+	}
+
+	if (low == 0) return NUMA_NO_NODE;
+
+	NUMA_MemoryRange *range = &topology->MemoryRanges[low - 1];
+	if (address - range->Base >= range->Length) return NUMA_NO_NODE;
+
+	return range->Node;
+}
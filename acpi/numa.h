@@ -0,0 +1,115 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "acpi.h"
+
+#define SRAT_PROCESSOR_AFFINITY 0x00
+#define SRAT_MEMORY_AFFINITY 0x01
+#define SRAT_X2APIC_AFFINITY 0x02
+#define SRAT_GICC_AFFINITY 0x03
+
+#define SRAT_ENABLED 0x01
+#define SRAT_MEMORY_HOTPLUGGABLE 0x02
+#define SRAT_MEMORY_NONVOLATILE 0x04
+
+#define NUMA_NO_NODE 0xFFFF
+
+/* Distances used when there is no SLIT, see ACPI spec section 5.2.17 */
+#define NUMA_LOCAL_DISTANCE 10
+#define NUMA_REMOTE_DISTANCE 20
+
+struct SRATTable {
+	SDTHeader Header;
+
+	uint32_t Reserved1;
+	uint64_t Reserved2;
+}__attribute__((packed));
+
+struct SRATEntryHeader {
+	uint8_t Type;
+	uint8_t Length;
+}__attribute__((packed));
+
+struct SRATProcessorAffinity {
+	SRATEntryHeader Header;
+	uint8_t ProximityLow;
+	uint8_t APICID;
+	uint32_t Flags;
+	uint8_t SAPICEID;
+	uint8_t ProximityHigh[3];
+	uint32_t ClockDomain;
+}__attribute__((packed));
+
+struct SRATMemoryAffinity {
+	SRATEntryHeader Header;
+	uint32_t Proximity;
+	uint16_t Reserved1;
+	uint64_t Base;
+	uint64_t Length;
+	uint32_t Reserved2;
+	uint32_t Flags;
+	uint64_t Reserved3;
+}__attribute__((packed));
+
+struct SRATX2APICAffinity {
+	SRATEntryHeader Header;
+	uint16_t Reserved1;
+	uint32_t Proximity;
+	uint32_t X2APICID;
+	uint32_t Flags;
+	uint32_t ClockDomain;
+	uint32_t Reserved2;
+}__attribute__((packed));
+
+struct SRATGICCAffinity {
+	SRATEntryHeader Header;
+	uint32_t Proximity;
+	uint32_t ProcessorUID;
+	uint32_t Flags;
+	uint32_t ClockDomain;
+}__attribute__((packed));
+
+struct SLITTable {
+	SDTHeader Header;
+
+	uint64_t LocalityCount;
+	uint8_t Entries[];
+}__attribute__((packed));
+
+struct NUMA_MemoryRange {
+	uint64_t Base;
+	uint64_t Length;
+	uint16_t Node;
+	uint16_t Flags;
+};
+
+struct NUMA_Topology {
+	/* Nodes are dense, Domains maps them back to proximity domains */
+	size_t NodeCount;
+	uint32_t *Domains;
+
+	/* Sorted by hardware ID (APIC ID, x2APIC ID or ACPI UID for GICC) */
+	size_t CPUCount;
+	uint64_t *CPUHardwareID;
+	uint16_t *CPUNode;
+
+	/* Sorted by base, non overlapping */
+	size_t MemoryRangeCount;
+	NUMA_MemoryRange *MemoryRanges;
+
+	/* NodeCount * NodeCount, row major */
+	uint8_t *Distances;
+};
+
+NUMA_Topology *CreateNUMATopology(SRATTable *srat, SLITTable *slit);
+void DeleteNUMATopology(NUMA_Topology *topology);
+
+uint16_t FindNodeForCPU(NUMA_Topology *topology, uint64_t hardwareId);
+uint16_t FindNodeForAddress(NUMA_Topology *topology, uint64_t address);
+
+static inline uint8_t GetNodeDistance(NUMA_Topology *topology, uint16_t from, uint16_t to) {
+	if (from >= topology->NodeCount || to >= topology->NodeCount) return 0xFF;
+
+	return topology->Distances[from * topology->NodeCount + to];
+}
@@ -0,0 +1,214 @@
+#include "pci_config.h"
+#include "region.h"
+#include "pci_routing.h"
+#include "aml_executive.h"
+#include "aml_opcodes.h"
+
+#include <mkmi.h>
+
+#define PCI_LEGACY_ADDRESS 0xCF8
+#define PCI_LEGACY_DATA 0xCFC
+
+PCI_ConfigSpace *CreateConfigSpace(MCFGTable *mcfg) {
+	PCI_ConfigSpace *config = new PCI_ConfigSpace;
+
+	config->SegmentCount = 0;
+	config->BusBase = NULL;
+	InitSpinLock(&config->LegacyLock);
+
+	if (mcfg == NULL) return config;
+
+	size_t entries = (mcfg->Header.Length - sizeof(MCFGTable)) / sizeof(MCFGEntry);
+
+	for (size_t i = 0; i < entries; ++i) {
+		if (mcfg->Entries[i].Segment >= config->SegmentCount) config->SegmentCount = mcfg->Entries[i].Segment + 1;
+	}
+
+	if (config->SegmentCount == 0) return config;
+
+	config->BusBase = new uintptr_t[config->SegmentCount][PCI_MAX_BUSES];
+	for (size_t segment = 0; segment < config->SegmentCount; ++segment) {
+		for (size_t bus = 0; bus < PCI_MAX_BUSES; ++bus) config->BusBase[segment][bus] = 0;
+	}
+
+	/*
+	 * Every bus gets its own base so an access is a table load plus shifts.
+	 * The base address is where bus 0 would be, even when the entry starts
+	 * at a later bus, see the PCI Firmware Specification section 4.1.2.
+	 */
+	for (size_t i = 0; i < entries; ++i) {
+		MCFGEntry *entry = &mcfg->Entries[i];
+		uintptr_t window = entry->BaseAddress + HIGHER_HALF;
+
+		for (size_t bus = entry->StartBus; bus <= entry->EndBus; ++bus) {
+			config->BusBase[entry->Segment][bus] = window + ((uint64_t)bus << 20);
+		}
+	}
+
+	return config;
+}
+
+void DeleteConfigSpace(PCI_ConfigSpace *config) {
+	delete[] config->BusBase;
+	delete config;
+}
+
+static uint32_t LegacyRead(PCI_ConfigSpace *config, uint8_t bus, uint8_t device, uint8_t function, uint16_t offset, uint8_t width) {
+	uint32_t address = 0x80000000 | (bus << 16) | (device << 11) | (function << 8) | (offset & 0xFC);
+
+	AcquireSpinLock(&config->LegacyLock);
+	OutPort(PCI_LEGACY_ADDRESS, address, 32);
+	uint32_t value = InPort(PCI_LEGACY_DATA + (offset & 3), width);
+	ReleaseSpinLock(&config->LegacyLock);
+
+	return value;
+}
+
+static void LegacyWrite(PCI_ConfigSpace *config, uint8_t bus, uint8_t device, uint8_t function, uint16_t offset, uint32_t value, uint8_t width) {
+	uint32_t address = 0x80000000 | (bus << 16) | (device << 11) | (function << 8) | (offset & 0xFC);
+
+	AcquireSpinLock(&config->LegacyLock);
+	OutPort(PCI_LEGACY_ADDRESS, address, 32);
+	OutPort(PCI_LEGACY_DATA + (offset & 3), value, width);
+	ReleaseSpinLock(&config->LegacyLock);
+}
+
+static inline uintptr_t ECAMAddress(PCI_ConfigSpace *config, uint16_t segment, uint8_t bus, uint8_t device, uint8_t function, uint16_t offset) {
+	if (segment >= config->SegmentCount) return 0;
+
+	uintptr_t base = config->BusBase[segment][bus];
+	if (base == 0) return 0;
+
+	return base | ((device & 0x1F) << 15) | ((function & 0x07) << 12) | (offset & 0xFFF);
+}
+
+uint32_t PCIConfigRead(PCI_ConfigSpace *config, uint16_t segment, uint8_t bus, uint8_t device, uint8_t function, uint16_t offset, uint8_t width) {
+	uintptr_t address = ECAMAddress(config, segment, bus, device, function, offset);
+
+	if (address == 0) {
+		if (segment != 0 || offset >= 256) return 0xFFFFFFFF;
+		return LegacyRead(config, bus, device, function, offset, width);
+	}
+
+	switch (width) {
+		case 8:
+			return *(volatile uint8_t*)address;
+		case 16:
+			return *(volatile uint16_t*)address;
+		default:
+			return *(volatile uint32_t*)address;
+	}
+}
+
+void PCIConfigWrite(PCI_ConfigSpace *config, uint16_t segment, uint8_t bus, uint8_t device, uint8_t function, uint16_t offset, uint32_t value, uint8_t width) {
+	uintptr_t address = ECAMAddress(config, segment, bus, device, function, offset);
+
+	if (address == 0) {
+		if (segment != 0 || offset >= 256) return;
+		return LegacyWrite(config, bus, device, function, offset, value, width);
+	}
+
+	switch (width) {
+		case 8:
+			*(volatile uint8_t*)address = value;
+			break;
+		case 16:
+			*(volatile uint16_t*)address = value;
+			break;
+		default:
+			*(volatile uint32_t*)address = value;
+			break;
+	}
+}
+
+static uint64_t ConfigRegionRead(void *context, uint64_t address, uint8_t width) {
+	PCI_ConfigSpace *config = (PCI_ConfigSpace*)context;
+
+	if (width == 64) {
+		uint64_t low = ConfigRegionRead(context, address, 32);
+		return low | ((uint64_t)ConfigRegionRead(context, address + 4, 32) << 32);
+	}
+
+	return PCIConfigRead(config, address >> 48, (address >> 40) & 0xFF, (address >> 32) & 0xFF,
+			     (address >> 16) & 0xFF, address & 0xFFFF, width);
+}
+
+static void ConfigRegionWrite(void *context, uint64_t address, uint64_t value, uint8_t width) {
+	PCI_ConfigSpace *config = (PCI_ConfigSpace*)context;
+
+	if (width == 64) {
+		ConfigRegionWrite(context, address, value & 0xFFFFFFFF, 32);
+		ConfigRegionWrite(context, address + 4, value >> 32, 32);
+		return;
+	}
+
+	PCIConfigWrite(config, address >> 48, (address >> 40) & 0xFF, (address >> 32) & 0xFF,
+		       (address >> 16) & 0xFF, address & 0xFFFF, value, width);
+}
+
+void InstallConfigSpaceHandler(PCI_ConfigSpace *config) {
+	InstallRegionHandler(AML_REGION_PCI_CONFIG, ConfigRegionRead, ConfigRegionWrite, config);
+}
+
+static uint64_t EvaluateInteger(AMLExecutive *executive, AML_NamespaceNode *device, const char *name, uint64_t fallback) {
+	uint64_t value;
+	if (executive->EvaluateInteger(FindChild(device, name), &value)) return value;
+
+	return fallback;
+}
+
+/* Walks from the root bridge down to the device, following secondary bus numbers */
+static void ResolveRegion(AMLExecutive *executive, PCI_ConfigSpace *config, AML_NamespaceNode *region) {
+	AML_NamespaceNode *chain[32];
+	size_t depth = 0;
+	AML_NamespaceNode *root = NULL;
+
+	for (AML_NamespaceNode *node = region->Parent; node != NULL && depth < 32; node = node->Parent) {
+		if (node->Type != NODE_DEVICE) continue;
+
+		chain[depth++] = node;
+		if (IsPciRootBridge(executive, node)) {
+			root = node;
+			break;
+		}
+	}
+
+	if (depth == 0) return;
+
+	uint16_t segment = root != NULL ? EvaluateInteger(executive, root, "_SEG", 0) : 0;
+	uint8_t bus = root != NULL ? EvaluateInteger(executive, root, "_BBN", 0) : 0;
+
+	/* The root's own _BBN already names its bus, only bridges below it are followed */
+	for (size_t i = depth - 1; i > 0; --i) {
+		if (chain[i] == root) continue;
+
+		uint64_t address = EvaluateInteger(executive, chain[i], "_ADR", 0);
+		bus = PCIConfigRead(config, segment, bus, address >> 16, address & 0x7, 0x19, 8);
+	}
+
+	uint64_t address = EvaluateInteger(executive, chain[0], "_ADR", 0);
+	Token *token = region->Object;
+	token->Region.Base = PCI_CONFIG_ADDRESS(segment, bus, address >> 16, address & 0x7, token->Region.RegionOffset.Data);
+}
+
+static void ResolveRegions(AMLExecutive *executive, PCI_ConfigSpace *config, AML_NamespaceNode *node) {
+	if (node->Type == NODE_REGION && node->Object->Region.RegionSpace == AML_REGION_PCI_CONFIG) {
+		ResolveRegion(executive, config, node);
+	}
+
+	for (AML_NamespaceNode *child = FirstChild(node); child != NULL; child = NextSibling(child)) {
+		ResolveRegions(executive, config, child);
+	}
+}
+
+void ResolvePciRegions(AMLExecutive *executive, PCI_ConfigSpace *config) {
+	ResolvePciSubtree(executive, config, executive->GetNamespace()->Root);
+}
+
+void ResolvePciSubtree(AMLExecutive *executive, PCI_ConfigSpace *config, AML_NamespaceNode *subtree) {
+	AML_Namespace *ns = executive->GetNamespace();
+
+	uint32_t section = EnterNamespace(ns);
+	ResolveRegions(executive, config, subtree);
+	LeaveNamespace(ns, section);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "acpi.h"
+#include "sync.h"
+
+class AMLExecutive;
+struct AML_NamespaceNode;
+
+#define PCI_MAX_BUSES 256
+
+/*
+ * Address format handed to the PCI_Config region handler. It extends the
+ * GAS encoding (device in 39:32, function in 31:16, offset in 15:0) with
+ * the bus in 47:40 and the segment in 63:48, which the GAS leaves implicit.
+ */
+#define PCI_CONFIG_ADDRESS(segment, bus, device, function, offset) \
+	(((uint64_t)(segment) << 48) | ((uint64_t)(bus) << 40) | ((uint64_t)(device) << 32) | \
+	 ((uint64_t)(function) << 16) | (uint64_t)(offset))
+
+struct MCFGEntry {
+	uint64_t BaseAddress;
+	uint16_t Segment;
+	uint8_t StartBus;
+	uint8_t EndBus;
+	uint32_t Reserved;
+}__attribute__((packed));
+
+struct MCFGTable {
+	SDTHeader Header;
+
+	uint64_t Reserved;
+	MCFGEntry Entries[];
+}__attribute__((packed));
+
+struct PCI_ConfigSpace {
+	/* Per segment, per bus: virtual address of function 0 of device 0, or 0 */
+	size_t SegmentCount;
+	uintptr_t (*BusBase)[PCI_MAX_BUSES];
+
+	/* Only taken by the legacy 0xCF8/0xCFC fallback */
+	AML_SpinLock LegacyLock;
+};
+
+PCI_ConfigSpace *CreateConfigSpace(MCFGTable *mcfg);
+void DeleteConfigSpace(PCI_ConfigSpace *config);
+
+uint32_t PCIConfigRead(PCI_ConfigSpace *config, uint16_t segment, uint8_t bus, uint8_t device, uint8_t function, uint16_t offset, uint8_t width);
+void PCIConfigWrite(PCI_ConfigSpace *config, uint16_t segment, uint8_t bus, uint8_t device, uint8_t function, uint16_t offset, uint32_t value, uint8_t width);
+
+void InstallConfigSpaceHandler(PCI_ConfigSpace *config);
+void ResolvePciRegions(AMLExecutive *executive, PCI_ConfigSpace *config);
+/* Same for the regions a table loaded at runtime brought along */
+void ResolvePciSubtree(AMLExecutive *executive, PCI_ConfigSpace *config, AML_NamespaceNode *subtree);
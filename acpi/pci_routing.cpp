@@ -0,0 +1,468 @@
+#include "pci_routing.h"
+#include "pci_config.h"
+#include "aml_executive.h"
+#include "namespace.h"
+#include "resource.h"
+#include "notify.h"
+#include "token.h"
+
+#include <mkmi.h>
+
+#define PCI_ROUTING_INITIAL_CAPACITY 64
+
+/* Type 1 config header */
+#define PCI_HEADER_TYPE 0x0E
+#define PCI_SECONDARY_BUS 0x19
+#define PCI_HEADER_BRIDGE 0x01
+
+/* Compressed EISA IDs */
+#define PCI_ROOT_HID 0x030AD041 /* PNP0A03 */
+#define PCIE_ROOT_HID 0x080AD041 /* PNP0A08 */
+
+static inline uint32_t RoutingKey(uint16_t segment, uint8_t bus, uint8_t device, uint8_t pin) {
+	return ((uint32_t)segment << 16) | ((uint32_t)bus << 8) | ((device & 0x1F) << 3) | (pin & 0x03);
+}
+
+static inline size_t RoutingHash(uint32_t key, size_t capacity) {
+	return (key * 0x9E3779B1u) & (capacity - 1);
+}
+
+static bool MatchesId(Token *id, uint32_t eisaId, const char *stringId) {
+	uint64_t value;
+	if (GetTokenInteger(id, &value)) return value == eisaId;
+	if (id != NULL && id->Type == STRING) return Memcmp(id->String, stringId, 8) == 0;
+
+	return false;
+}
+
+static bool IsRootBridgeId(Token *id) {
+	return MatchesId(id, PCI_ROOT_HID, "PNP0A03") || MatchesId(id, PCIE_ROOT_HID, "PNP0A08");
+}
+
+bool IsPciRootBridge(AMLExecutive *executive, AML_NamespaceNode *device) {
+	Token *hid = executive->Evaluate(FindChild(device, "_HID"));
+	bool isRoot = IsRootBridgeId(hid);
+	executive->ReleaseResult(hid);
+	if (isRoot) return true;
+
+	Token *cid = executive->Evaluate(FindChild(device, "_CID"));
+	if (cid == NULL) return false;
+
+	if (cid->Type != PACKAGE) {
+		isRoot = IsRootBridgeId(cid);
+	} else {
+		for (Token *id = cid->Children->Head; id != NULL && !isRoot; id = id->Next) isRoot = IsRootBridgeId(id);
+	}
+
+	executive->ReleaseResult(cid);
+
+	return isRoot;
+}
+
+static uint64_t EvaluateInteger(AMLExecutive *executive, AML_NamespaceNode *device, const char *name, uint64_t fallback) {
+	uint64_t value;
+	if (executive->EvaluateInteger(FindChild(device, name), &value)) return value;
+
+	return fallback;
+}
+
+/* Routes and bridges one scan found. They are gathered before the writer lock is taken, evaluating _PRT can take long */
+struct PCI_RoutingBatch {
+	size_t Count;
+	size_t Capacity;
+	PCI_RoutingEntry *Entries;
+
+	size_t BridgeCount;
+	size_t BridgeCapacity;
+	PCI_RoutingBridge *Bridges;
+
+	size_t Scanned;
+	size_t Unresolved;
+};
+
+static void InitBatch(PCI_RoutingBatch *batch) {
+	batch->Count = 0;
+	batch->Capacity = 0;
+	batch->Entries = NULL;
+	batch->BridgeCount = 0;
+	batch->BridgeCapacity = 0;
+	batch->Bridges = NULL;
+	batch->Scanned = 0;
+	batch->Unresolved = 0;
+}
+
+static void FreeBatch(PCI_RoutingBatch *batch) {
+	delete[] batch->Entries;
+	delete[] batch->Bridges;
+}
+
+static void AddRoute(PCI_RoutingBatch *batch, uint32_t key, uint32_t gsi, uint8_t flags, AML_NamespaceNode *bridge) {
+	if (batch->Count == batch->Capacity) {
+		PCI_RoutingEntry *old = batch->Entries;
+		batch->Capacity = batch->Capacity == 0 ? 32 : batch->Capacity * 2;
+		batch->Entries = new PCI_RoutingEntry[batch->Capacity];
+		for (size_t i = 0; i < batch->Count; ++i) batch->Entries[i] = old[i];
+		delete[] old;
+	}
+
+	PCI_RoutingEntry *entry = &batch->Entries[batch->Count++];
+	entry->Key = key;
+	entry->GSI = gsi;
+	entry->Flags = flags;
+	entry->Used = true;
+	entry->Bridge = bridge;
+}
+
+static void AddBridgeRecord(PCI_RoutingBatch *batch, PCI_RoutingBridge *record) {
+	if (batch->BridgeCount == batch->BridgeCapacity) {
+		PCI_RoutingBridge *old = batch->Bridges;
+		batch->BridgeCapacity = batch->BridgeCapacity == 0 ? 8 : batch->BridgeCapacity * 2;
+		batch->Bridges = new PCI_RoutingBridge[batch->BridgeCapacity];
+		for (size_t i = 0; i < batch->BridgeCount; ++i) batch->Bridges[i] = old[i];
+		delete[] old;
+	}
+
+	batch->Bridges[batch->BridgeCount++] = *record;
+}
+
+static PCI_RoutingMap *CreateMap(size_t routes, size_t bridges) {
+	PCI_RoutingMap *map = new PCI_RoutingMap;
+
+	/* Keep the load factor under one half so probes stay short */
+	map->Capacity = PCI_ROUTING_INITIAL_CAPACITY;
+	while (map->Capacity < routes * 2) map->Capacity *= 2;
+
+	map->Count = 0;
+	map->Entries = new PCI_RoutingEntry[map->Capacity];
+	for (size_t i = 0; i < map->Capacity; ++i) map->Entries[i].Used = false;
+
+	map->BridgeCount = 0;
+	map->Bridges = bridges != 0 ? new PCI_RoutingBridge[bridges] : NULL;
+
+	return map;
+}
+
+static void DeleteMap(PCI_RoutingMap *map) {
+	delete[] map->Entries;
+	delete[] map->Bridges;
+	delete map;
+}
+
+static void FreeRetiredMap(void *object) {
+	DeleteMap((PCI_RoutingMap*)object);
+}
+
+static void Insert(PCI_RoutingMap *map, PCI_RoutingEntry *route) {
+	size_t idx = RoutingHash(route->Key, map->Capacity);
+	while (map->Entries[idx].Used && map->Entries[idx].Key != route->Key) {
+		idx = (idx + 1) & (map->Capacity - 1);
+	}
+
+	if (!map->Entries[idx].Used) map->Count++;
+	map->Entries[idx] = *route;
+}
+
+static bool IsRemoved(AML_NamespaceNode *node, AML_NamespaceNode *removed) {
+	return removed != NULL && IsNodeInSubtree(node, removed);
+}
+
+/* Publishes the current map without anything under removed, plus what the batch found */
+static void Commit(PCI_RoutingTable *table, AML_NamespaceNode *removed, PCI_RoutingBatch *batch) {
+	AcquireSpinLock(&table->WriteLock);
+
+	PCI_RoutingMap *old = table->Map;
+	PCI_RoutingMap *map = CreateMap(old->Count + batch->Count, old->BridgeCount + batch->BridgeCount);
+
+	for (size_t i = 0; i < old->Capacity; ++i) {
+		if (old->Entries[i].Used && !IsRemoved(old->Entries[i].Bridge, removed)) Insert(map, &old->Entries[i]);
+	}
+
+	for (size_t i = 0; i < batch->Count; ++i) Insert(map, &batch->Entries[i]);
+
+	for (size_t i = 0; i < old->BridgeCount; ++i) {
+		if (!IsRemoved(old->Bridges[i].Node, removed)) map->Bridges[map->BridgeCount++] = old->Bridges[i];
+	}
+
+	for (size_t i = 0; i < batch->BridgeCount; ++i) map->Bridges[map->BridgeCount++] = batch->Bridges[i];
+
+	table->Stats.Bridges += batch->Scanned;
+	table->Stats.Unresolved += batch->Unresolved;
+
+	__atomic_store_n(&table->Map, map, __ATOMIC_RELEASE);
+
+	ReleaseSpinLock(&table->WriteLock);
+
+	/* Lookups on other cores may still be probing the old one */
+	RetireObject(table->Executive->GetNamespace(), old, FreeRetiredMap);
+}
+
+static bool ResolveLink(AMLExecutive *executive, AML_NamespaceNode *link, uint32_t index, uint32_t *gsi, uint8_t *flags) {
+	AML_ResourceList *resources = executive->GetResources(link);
+	if (resources == NULL) return false;
+
+	for (size_t i = 0; i < resources->Count; ++i) {
+		AML_Resource *resource = &resources->Resources[i];
+
+		if (resource->Type == RESOURCE_IRQ && resource->Irq.Mask != 0) {
+			*gsi = __builtin_ctz(resource->Irq.Mask);
+		} else if (resource->Type == RESOURCE_EXTENDED_IRQ && resource->ExtendedIrq.Count != 0) {
+			*gsi = GetExtendedIrq(resource, index < resource->ExtendedIrq.Count ? index : 0);
+		} else {
+			continue;
+		}
+
+		*flags = 0;
+		if (resource->Flags & AML_RESOURCE_EDGE) *flags |= PCI_IRQ_EDGE;
+		if (resource->Flags & AML_RESOURCE_ACTIVE_LOW) *flags |= PCI_IRQ_ACTIVE_LOW;
+
+		return true;
+	}
+
+	return false;
+}
+
+/* Routes from the _PRT of a bridge whose secondary side is bus */
+static void AddBridge(PCI_RoutingTable *table, PCI_RoutingBatch *batch, AML_NamespaceNode *bridge, uint16_t segment, uint8_t bus) {
+	AMLExecutive *executive = table->Executive;
+
+	Token *prt = executive->Evaluate(FindChild(bridge, "_PRT"));
+	if (prt == NULL || prt->Type != PACKAGE || prt->Children == NULL) {
+		executive->ReleaseResult(prt);
+		return;
+	}
+
+	batch->Scanned++;
+
+	/* Every element is Package { Address, Pin, Source, SourceIndex } */
+	for (Token *entry = prt->Children->Head; entry != NULL; entry = entry->Next) {
+		if (entry->Type != PACKAGE || entry->Children == NULL) continue;
+
+		Token *address = entry->Children->Head;
+		Token *pin = address != NULL ? address->Next : NULL;
+		Token *source = pin != NULL ? pin->Next : NULL;
+		Token *sourceIndex = source != NULL ? source->Next : NULL;
+
+		uint64_t addressValue, pinValue, indexValue;
+		if (!GetTokenInteger(address, &addressValue) ||
+		    !GetTokenInteger(pin, &pinValue) ||
+		    !GetTokenInteger(sourceIndex, &indexValue)) {
+			batch->Unresolved++;
+			continue;
+		}
+
+		uint32_t gsi;
+		uint8_t flags;
+
+		if (source->Type == NAMEREF) {
+			AML_NamespaceNode *link = executive->Resolve(bridge, &source->Name);
+			if (link == NULL || !ResolveLink(executive, link, indexValue, &gsi, &flags)) {
+				batch->Unresolved++;
+				continue;
+			}
+		} else {
+			/* Hard-wired, SourceIndex is the GSI. Level triggered, active low */
+			gsi = indexValue;
+			flags = PCI_IRQ_ACTIVE_LOW;
+		}
+
+		uint8_t device = (addressValue >> 16) & 0x1F;
+		AddRoute(batch, RoutingKey(segment, bus, device, pinValue), gsi, flags, bridge);
+	}
+
+	executive->ReleaseResult(prt);
+}
+
+static void RoutingNotifyHandler(AML_NamespaceNode *node, uint32_t value, void *context) {
+	PCI_RoutingTable *table = (PCI_RoutingTable*)context;
+
+	if (value != AML_NOTIFY_BUS_CHECK && value != AML_NOTIFY_DEVICE_CHECK) return;
+
+	/* Buses below the root may have been renumbered, all of it is scanned again */
+	for (; node != NULL; node = node->Parent) {
+		if (node->Type == NODE_DEVICE && IsPciRootBridge(table->Executive, node)) {
+			RebuildBridgeRouting(table, node);
+			return;
+		}
+	}
+}
+
+/* Where the children of a node sit, found by following secondary bus numbers down from the root */
+struct PCI_ScanContext {
+	bool Inside;
+	uint16_t Segment;
+	uint8_t Bus;
+};
+
+/*
+ * A root bridge starts a hierarchy at its _BBN. Below it, devices whose
+ * config header says PCI-to-PCI bridge lead to their secondary bus, and
+ * their own _PRT describes it. Other devices end the walk.
+ */
+static void Scan(PCI_RoutingTable *table, PCI_RoutingBatch *batch, AML_NamespaceNode *node, PCI_ScanContext context, bool subscribe) {
+	AMLExecutive *executive = table->Executive;
+
+	if (node->Type == NODE_DEVICE && IsPciRootBridge(executive, node)) {
+		context.Inside = true;
+		context.Segment = EvaluateInteger(executive, node, "_SEG", 0);
+		context.Bus = EvaluateInteger(executive, node, "_BBN", 0);
+
+		AddBridge(table, batch, node, context.Segment, context.Bus);
+
+		/* Dropped along with the bridge when its table is unloaded */
+		if (subscribe) SubscribeNotify(executive->GetNotifyQueue(), node, true, RoutingNotifyHandler, table);
+	} else if (context.Inside) {
+		if (node->Type != NODE_DEVICE) return;
+
+		uint64_t address;
+		if (!executive->EvaluateInteger(FindChild(node, "_ADR"), &address)) return;
+
+		uint8_t device = (address >> 16) & 0x1F, function = address & 0x07;
+		uint8_t header = PCIConfigRead(table->Config, context.Segment, context.Bus, device, function, PCI_HEADER_TYPE, 8);
+		if ((header & 0x7F) != PCI_HEADER_BRIDGE) return;
+
+		PCI_RoutingBridge record;
+		record.Segment = context.Segment;
+		record.Secondary = PCIConfigRead(table->Config, context.Segment, context.Bus, device, function, PCI_SECONDARY_BUS, 8);
+		record.Bus = context.Bus;
+		record.Device = device;
+		record.Node = node;
+		AddBridgeRecord(batch, &record);
+
+		context.Bus = record.Secondary;
+		AddBridge(table, batch, node, context.Segment, context.Bus);
+	}
+
+	for (AML_NamespaceNode *child = FirstChild(node); child != NULL; child = NextSibling(child)) {
+		Scan(table, batch, child, context, subscribe);
+	}
+}
+
+/* The context a scan starting at node inherits from its ancestors */
+static PCI_ScanContext FindContext(PCI_RoutingTable *table, AML_NamespaceNode *node) {
+	AML_NamespaceNode *chain[32];
+	size_t depth = 0;
+	PCI_ScanContext context = { false, 0, 0 };
+
+	for (AML_NamespaceNode *parent = node->Parent; parent != NULL && depth < 32; parent = parent->Parent) {
+		if (parent->Type != NODE_DEVICE) continue;
+
+		chain[depth++] = parent;
+		if (IsPciRootBridge(table->Executive, parent)) break;
+	}
+
+	if (depth == 0 || !IsPciRootBridge(table->Executive, chain[depth - 1])) return context;
+
+	context.Inside = true;
+	context.Segment = EvaluateInteger(table->Executive, chain[depth - 1], "_SEG", 0);
+	context.Bus = EvaluateInteger(table->Executive, chain[depth - 1], "_BBN", 0);
+
+	for (size_t i = depth - 1; i-- > 0;) {
+		uint64_t address = EvaluateInteger(table->Executive, chain[i], "_ADR", 0);
+		context.Bus = PCIConfigRead(table->Config, context.Segment, context.Bus, (address >> 16) & 0x1F, address & 0x07, PCI_SECONDARY_BUS, 8);
+	}
+
+	return context;
+}
+
+static void ScanSubtree(PCI_RoutingTable *table, AML_NamespaceNode *subtree, AML_NamespaceNode *removed, bool subscribe) {
+	AML_Namespace *ns = table->Executive->GetNamespace();
+	PCI_RoutingBatch batch;
+	InitBatch(&batch);
+
+	uint32_t section = EnterNamespace(ns);
+	Scan(table, &batch, subtree, FindContext(table, subtree), subscribe);
+	Commit(table, removed, &batch);
+	LeaveNamespace(ns, section);
+
+	FreeBatch(&batch);
+}
+
+void RebuildBridgeRouting(PCI_RoutingTable *table, AML_NamespaceNode *bridge) {
+	ScanSubtree(table, bridge, bridge, false);
+	__atomic_fetch_add(&table->Stats.Rebuilds, 1, __ATOMIC_RELAXED);
+}
+
+void AddRoutingSubtree(PCI_RoutingTable *table, AML_NamespaceNode *subtree) {
+	ScanSubtree(table, subtree, NULL, true);
+}
+
+void RemoveRoutingSubtree(PCI_RoutingTable *table, AML_NamespaceNode *subtree) {
+	PCI_RoutingBatch batch;
+	InitBatch(&batch);
+
+	Commit(table, subtree, &batch);
+}
+
+PCI_RoutingTable *CreateRoutingTable(AMLExecutive *executive, PCI_ConfigSpace *config) {
+	PCI_RoutingTable *table = new PCI_RoutingTable;
+
+	table->Executive = executive;
+	table->Config = config;
+	InitSpinLock(&table->WriteLock);
+	table->Map = CreateMap(0, 0);
+
+	table->Stats.Bridges = 0;
+	table->Stats.Unresolved = 0;
+	table->Stats.Rebuilds = 0;
+
+	ScanSubtree(table, executive->GetNamespace()->Root, NULL, true);
+
+	return table;
+}
+
+/* Nothing may be looking up routes anymore */
+void DeleteRoutingTable(PCI_RoutingTable *table) {
+	DeleteMap(table->Map);
+	delete table;
+}
+
+static bool FindRoute(PCI_RoutingMap *map, uint32_t key, uint32_t *gsi, uint8_t *flags) {
+	size_t idx = RoutingHash(key, map->Capacity);
+
+	while (map->Entries[idx].Used) {
+		if (map->Entries[idx].Key == key) {
+			*gsi = map->Entries[idx].GSI;
+			*flags = map->Entries[idx].Flags;
+			return true;
+		}
+
+		idx = (idx + 1) & (map->Capacity - 1);
+	}
+
+	return false;
+}
+
+static PCI_RoutingBridge *FindBridge(PCI_RoutingMap *map, uint16_t segment, uint8_t bus) {
+	for (size_t i = 0; i < map->BridgeCount; ++i) {
+		if (map->Bridges[i].Segment == segment && map->Bridges[i].Secondary == bus) return &map->Bridges[i];
+	}
+
+	return NULL;
+}
+
+bool LookupPciInterrupt(PCI_RoutingTable *table, uint16_t segment, uint8_t bus, uint8_t device, uint8_t pin, uint32_t *gsi, uint8_t *flags) {
+	AML_Namespace *ns = table->Executive->GetNamespace();
+	bool found = false;
+
+	uint32_t section = EnterNamespace(ns);
+	PCI_RoutingMap *map = __atomic_load_n(&table->Map, __ATOMIC_ACQUIRE);
+
+	/* A bridge without a _PRT rotates the pin by the slot, PCI-to-PCI Bridge Architecture section 9.1 */
+	for (size_t hops = 0; hops < PCI_MAX_BUSES; ++hops) {
+		if (FindRoute(map, RoutingKey(segment, bus, device, pin), gsi, flags)) {
+			found = true;
+			break;
+		}
+
+		PCI_RoutingBridge *bridge = FindBridge(map, segment, bus);
+		if (bridge == NULL) break;
+
+		pin = (pin + device) & 0x03;
+		bus = bridge->Bus;
+		device = bridge->Device;
+	}
+
+	LeaveNamespace(ns, section);
+
+	return found;
+}
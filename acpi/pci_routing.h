@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sync.h"
+
+class AMLExecutive;
+struct AML_NamespaceNode;
+struct PCI_ConfigSpace;
+
+/* Interrupt flags, same meaning as the resource ones */
+#define PCI_IRQ_EDGE 0x01
+#define PCI_IRQ_ACTIVE_LOW 0x02
+
+struct PCI_RoutingEntry {
+	/* Segment << 16 | Bus << 8 | Device << 3 | Pin, see RoutingKey */
+	uint32_t Key;
+	uint32_t GSI;
+	uint8_t Flags;
+	bool Used;
+
+	/* The bridge whose _PRT produced this entry */
+	AML_NamespaceNode *Bridge;
+};
+
+/* A PCI-to-PCI bridge or root port the namespace describes */
+struct PCI_RoutingBridge {
+	uint16_t Segment;
+	uint8_t Secondary;
+	/* Where the bridge itself sits */
+	uint8_t Bus;
+	uint8_t Device;
+
+	AML_NamespaceNode *Node;
+};
+
+struct PCI_RoutingStats {
+	size_t Bridges;
+	size_t Unresolved;
+	size_t Rebuilds;
+};
+
+/* Never changed once published, writers build a new one and retire the old one */
+struct PCI_RoutingMap {
+	size_t Capacity;
+	size_t Count;
+	PCI_RoutingEntry *Entries;
+
+	size_t BridgeCount;
+	PCI_RoutingBridge *Bridges;
+};
+
+struct PCI_RoutingTable {
+	AMLExecutive *Executive;
+	PCI_ConfigSpace *Config;
+
+	/* Serializes writers, lookups only enter the namespace */
+	AML_SpinLock WriteLock;
+	PCI_RoutingMap *Map;
+
+	PCI_RoutingStats Stats;
+};
+
+bool IsPciRootBridge(AMLExecutive *executive, AML_NamespaceNode *device);
+
+/* Bridges below the roots are found through config space, so it must be set up first */
+PCI_RoutingTable *CreateRoutingTable(AMLExecutive *executive, PCI_ConfigSpace *config);
+void DeleteRoutingTable(PCI_RoutingTable *table);
+
+/* Scans bridge and everything below it again */
+void RebuildBridgeRouting(PCI_RoutingTable *table, AML_NamespaceNode *bridge);
+/* Routes the bridges a table loaded at runtime brought along */
+void AddRoutingSubtree(PCI_RoutingTable *table, AML_NamespaceNode *subtree);
+/* Drops the routes of bridges under subtree, call it before the subtree leaves the namespace */
+void RemoveRoutingSubtree(PCI_RoutingTable *table, AML_NamespaceNode *subtree);
+/* Safe from any core, behind a bridge without a _PRT the pin is swizzled up to the bridge's slot */
+bool LookupPciInterrupt(PCI_RoutingTable *table, uint16_t segment, uint8_t bus, uint8_t device, uint8_t pin, uint32_t *gsi, uint8_t *flags);
@@ -0,0 +1,112 @@
+#include "power.h"
+#include "aml_executive.h"
+#include "gas.h"
+#include "namespace.h"
+#include "token.h"
+
+#include <mkmi.h>
+
+/* The 8042 pulses the reset line when sent this, the fallback on PCs */
+#define KBC_COMMAND_PORT 0x64
+#define KBC_PULSE_RESET 0xFE
+
+static void ResolveSleepState(ACPI_PowerControl *control, uint8_t state) {
+	char path[6] = { '\\', '_', 'S', (char)('0' + state), '_', '\0' };
+	ACPI_SleepState *sleep = &control->States[state];
+	sleep->Valid = false;
+
+	uint32_t pin = control->Executive->PinNamespace();
+	Token *package = control->Executive->Evaluate(control->Executive->FindNode(path));
+	control->Executive->UnpinNamespace(pin);
+
+	if (package == NULL || package->Type != PACKAGE || package->Children == NULL) {
+		control->Executive->ReleaseResult(package);
+		return;
+	}
+
+	Token *first = package->Children->Head;
+	Token *second = first != NULL ? first->Next : NULL;
+
+	uint64_t typeA, typeB;
+	if (GetTokenInteger(first, &typeA)) {
+		/* Some old tables pack both values into the first element */
+		if (!GetTokenInteger(second, &typeB)) typeB = typeA >> 8;
+
+		sleep->Valid = true;
+		sleep->TypeA = typeA & 0x07;
+		sleep->TypeB = typeB & 0x07;
+	}
+
+	control->Executive->ReleaseResult(package);
+}
+
+ACPI_PowerControl *CreatePowerControl(AMLExecutive *executive, volatile FADTTable *fadt, const ACPI_FixedRegisters *registers) {
+	ACPI_PowerControl *control = new ACPI_PowerControl;
+	control->Executive = executive;
+
+	control->Control[0] = &registers->PM1aControl;
+	control->Control[1] = &registers->PM1bControl;
+
+	for (uint8_t state = 0; state < ACPI_SLEEP_STATES; ++state) {
+		ResolveSleepState(control, state);
+
+		ACPI_SleepState *sleep = &control->States[state];
+		control->SleepControl[state][0] = sleep->TypeA << PM1_CONTROL_SLP_TYP_SHIFT;
+		control->SleepControl[state][1] = sleep->TypeB << PM1_CONTROL_SLP_TYP_SHIFT;
+	}
+
+	control->PrepareToSleep = executive->FindNode("\\_PTS");
+	control->GoingToSleep = executive->FindNode("\\_GTS");
+
+	control->ResetSupported = (fadt->Flags & FADT_RESET_REG_SUP) && registers->Reset.Valid;
+	control->Reset = &registers->Reset;
+	control->ResetValue = fadt->ResetValue;
+
+	return control;
+}
+
+void DeletePowerControl(ACPI_PowerControl *control) {
+	delete control;
+}
+
+static void Prepare(AML_NamespaceNode *method, AMLExecutive *executive, uint64_t state) {
+	if (method == NULL) return;
+
+	executive->ReleaseResult(executive->Evaluate(method, &state, 1));
+}
+
+int EnterSleepState(ACPI_PowerControl *control, uint8_t state) {
+	if (state >= ACPI_SLEEP_STATES || !control->States[state].Valid) return -1;
+
+	Prepare(control->PrepareToSleep, control->Executive, state);
+	Prepare(control->GoingToSleep, control->Executive, state);
+
+	/*
+	 * SLP_TYP first, then SLP_EN on its own write, as the spec asks. Only those
+	 * two fields change, SCI_EN and the other bits keep what the register holds.
+	 * A missing PM1b ignores both.
+	 */
+	uint64_t values[2];
+	for (size_t i = 0; i < 2; ++i) {
+		values[i] = (ReadGAS(control->Control[i]) & ~(uint64_t)(PM1_CONTROL_SLP_TYP_MASK | PM1_CONTROL_SLP_EN)) | control->SleepControl[state][i];
+		WriteGAS(control->Control[i], values[i]);
+	}
+
+	for (size_t i = 0; i < 2; ++i) WriteGAS(control->Control[i], values[i] | PM1_CONTROL_SLP_EN);
+
+	return -1;
+}
+
+int PowerOff(ACPI_PowerControl *control) {
+	return EnterSleepState(control, ACPI_S5);
+}
+
+int Reboot(ACPI_PowerControl *control) {
+	if (control->ResetSupported) WriteGAS(control->Reset, control->ResetValue);
+
+#if defined(__x86_64__)
+	OutPort(KBC_COMMAND_PORT, KBC_PULSE_RESET, 8);
+#endif
+
+	return -1;
+}
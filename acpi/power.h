@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "acpi.h"
+
+class AMLExecutive;
+struct AML_NamespaceNode;
+struct GAS_Register;
+struct ACPI_FixedRegisters;
+
+#define ACPI_SLEEP_STATES 6
+#define ACPI_S5 5
+
+/* PM1 control register, see ACPI spec section 4.8.3.2.1 */
+#define PM1_CONTROL_SCI_EN (1 << 0)
+#define PM1_CONTROL_SLP_TYP_SHIFT 10
+#define PM1_CONTROL_SLP_TYP_MASK (0x07 << PM1_CONTROL_SLP_TYP_SHIFT)
+#define PM1_CONTROL_SLP_EN (1 << 13)
+
+/* FADT flags */
+#define FADT_RESET_REG_SUP (1 << 10)
+
+struct ACPI_SleepState {
+	bool Valid;
+	uint8_t TypeA;
+	uint8_t TypeB;
+};
+
+/* Everything the shutdown and reset paths need, worked out at boot */
+struct ACPI_PowerControl {
+	AMLExecutive *Executive;
+
+	ACPI_SleepState States[ACPI_SLEEP_STATES];
+
+	/* _PTS and _GTS, NULL when the firmware has none */
+	AML_NamespaceNode *PrepareToSleep;
+	AML_NamespaceNode *GoingToSleep;
+
+	/* PM1a and PM1b control, resolved once from the FADT */
+	const GAS_Register *Control[2];
+	/* SLP_TYP already shifted into place, the rest of the register is kept as read */
+	uint16_t SleepControl[ACPI_SLEEP_STATES][2];
+
+	bool ResetSupported;
+	const GAS_Register *Reset;
+	uint8_t ResetValue;
+};
+
+ACPI_PowerControl *CreatePowerControl(AMLExecutive *executive, volatile FADTTable *fadt, const ACPI_FixedRegisters *registers);
+void DeletePowerControl(ACPI_PowerControl *control);
+
+/* Only return if the hardware did not do what it was asked */
+int EnterSleepState(ACPI_PowerControl *control, uint8_t state);
+int PowerOff(ACPI_PowerControl *control);
+int Reboot(ACPI_PowerControl *control);
@@ -0,0 +1,492 @@
+#include "processor.h"
+#include "aml_executive.h"
+#include "device_index.h"
+#include "madt.h"
+#include "namespace.h"
+#include "notify.h"
+#include "token.h"
+#include "trace.h"
+
+#include <mkmi.h>
+
+/* Generic Register descriptor, see ACPI spec section 6.4.3.7 */
+#define GENERIC_REGISTER_DESCRIPTOR 0x82
+#define GENERIC_REGISTER_LENGTH 15
+
+#define PROCESSOR_MAX_DEVICES 256
+
+static Token *Element(Token *package, size_t index) {
+	if (package == NULL || package->Type != PACKAGE || package->Children == NULL) return NULL;
+
+	Token *current = package->Children->Head;
+	for (size_t i = 0; i < index && current != NULL; ++i) current = current->Next;
+
+	return current;
+}
+
+static uint64_t ElementInteger(Token *package, size_t index) {
+	uint64_t value = 0;
+	GetTokenInteger(Element(package, index), &value);
+	return value;
+}
+
+static bool DecodeRegister(Token *buffer, GenericAddressStructure *gas) {
+	gas->AddressSpace = 0;
+	gas->BitWidth = 0;
+	gas->BitOffset = 0;
+	gas->AccessSize = 0;
+	gas->Address = 0;
+
+	if (buffer == NULL) return false;
+
+	/* Integer entry methods are fixed hardware addresses */
+	uint64_t value;
+	if (GetTokenInteger(buffer, &value)) {
+		gas->AddressSpace = ACPI_SPACE_FIXED_HARDWARE;
+		gas->Address = value;
+		return true;
+	}
+
+	if (buffer->Type != BUFFER || buffer->Buffer.BufferSize.Data < GENERIC_REGISTER_LENGTH) return false;
+	if (buffer->Buffer.ByteList[0] != GENERIC_REGISTER_DESCRIPTOR) return false;
+
+	/* The descriptor carries a GenericAddressStructure after its three byte header */
+	Memcpy(gas, &buffer->Buffer.ByteList[3], sizeof(GenericAddressStructure));
+	return true;
+}
+
+static Token *EvaluateChild(AMLExecutive *executive, AML_NamespaceNode *node, const char *name) {
+	AML_NamespaceNode *child = FindChild(node, name);
+	if (child == NULL) return NULL;
+
+	Token *result = executive->Evaluate(child);
+	if (result != NULL && result->Type != PACKAGE) {
+		executive->ReleaseResult(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+static void DecodeCStates(AMLExecutive *executive, AML_NamespaceNode *node, ACPI_ProcessorPower *power) {
+	power->CStateCount = 0;
+
+	/* _CST is {Count, CState...}, each CState is {Register, Type, Latency, Power} */
+	Token *cst = EvaluateChild(executive, node, "_CST");
+	if (cst == NULL) return;
+
+	uint64_t count = ElementInteger(cst, 0);
+	Token *state = Element(cst, 1);
+
+	for (uint64_t i = 0; i < count && state != NULL && power->CStateCount < ACPI_MAX_CSTATES; ++i, state = state->Next) {
+		if (state->Type != PACKAGE) continue;
+
+		ACPI_CState *cstate = &power->CStates[power->CStateCount];
+		if (!DecodeRegister(Element(state, 0), &cstate->Entry)) continue;
+
+		cstate->Type = ElementInteger(state, 1);
+		cstate->Latency = ElementInteger(state, 2);
+		cstate->Power = ElementInteger(state, 3);
+		power->CStateCount++;
+	}
+
+	executive->ReleaseResult(cst);
+}
+
+static void DecodeLPIStates(AMLExecutive *executive, AML_NamespaceNode *node, ACPI_ProcessorPower *power) {
+	power->LPICount = 0;
+
+	/* _LPI is {Revision, LevelId, Count, State...} */
+	Token *lpi = EvaluateChild(executive, node, "_LPI");
+	if (lpi == NULL) return;
+
+	uint64_t count = ElementInteger(lpi, 2);
+	Token *state = Element(lpi, 3);
+
+	for (uint64_t i = 0; i < count && state != NULL && power->LPICount < ACPI_MAX_LPI_STATES; ++i, state = state->Next) {
+		if (state->Type != PACKAGE) continue;
+
+		ACPI_LPIState *lpiState = &power->LPIStates[power->LPICount];
+		if (!DecodeRegister(Element(state, 6), &lpiState->Entry)) continue;
+
+		lpiState->MinResidency = ElementInteger(state, 0);
+		lpiState->WakeLatency = ElementInteger(state, 1);
+		lpiState->Flags = ElementInteger(state, 2);
+		lpiState->ArchFlags = ElementInteger(state, 3);
+		lpiState->EnabledParent = ElementInteger(state, 5);
+		power->LPICount++;
+	}
+
+	executive->ReleaseResult(lpi);
+}
+
+static uint64_t EvaluateLimit(AMLExecutive *executive, AML_NamespaceNode *node) {
+	uint64_t limit = 0;
+	AML_NamespaceNode *ppc = FindChild(node, "_PPC");
+
+	/* Without _PPC every state is available */
+	if (ppc != NULL) executive->EvaluateInteger(ppc, &limit);
+
+	return limit;
+}
+
+static inline uint8_t ClampLimit(uint64_t limit, uint8_t count) {
+	return limit < count ? limit : 0;
+}
+
+static void DecodePStates(AMLExecutive *executive, AML_NamespaceNode *node, ACPI_ProcessorPower *power) {
+	power->PStateCount = 0;
+	power->PerformanceControl.Valid = false;
+	power->PerformanceStatus.Valid = false;
+	power->Dependency.Valid = false;
+
+	/* _PSS is a package of {Frequency, Power, Latency, BusMasterLatency, Control, Status} */
+	Token *pss = EvaluateChild(executive, node, "_PSS");
+	if (pss != NULL) {
+		for (Token *state = Element(pss, 0); state != NULL && power->PStateCount < ACPI_MAX_PSTATES; state = state->Next) {
+			if (state->Type != PACKAGE) continue;
+
+			ACPI_PState *pstate = &power->PStates[power->PStateCount++];
+			pstate->Frequency = ElementInteger(state, 0);
+			pstate->Power = ElementInteger(state, 1);
+			pstate->Latency = ElementInteger(state, 2);
+			pstate->BusMasterLatency = ElementInteger(state, 3);
+			pstate->Control = ElementInteger(state, 4);
+			pstate->Status = ElementInteger(state, 5);
+		}
+
+		executive->ReleaseResult(pss);
+	}
+
+	Token *pct = EvaluateChild(executive, node, "_PCT");
+	if (pct != NULL) {
+		GenericAddressStructure gas;
+
+		if (DecodeRegister(Element(pct, 0), &gas)) ResolveGAS(&power->PerformanceControl, &gas);
+		if (DecodeRegister(Element(pct, 1), &gas)) ResolveGAS(&power->PerformanceStatus, &gas);
+
+		executive->ReleaseResult(pct);
+	}
+
+	/* _PSD is {{NumEntries, Revision, Domain, CoordType, NumProcessors}} */
+	Token *psd = EvaluateChild(executive, node, "_PSD");
+	if (psd != NULL) {
+		Token *dependency = Element(psd, 0);
+
+		if (dependency != NULL && dependency->Type == PACKAGE) {
+			power->Dependency.Valid = true;
+			power->Dependency.Domain = ElementInteger(dependency, 2);
+			power->Dependency.Coordination = ElementInteger(dependency, 3);
+			power->Dependency.ProcessorCount = ElementInteger(dependency, 4);
+		}
+
+		executive->ReleaseResult(psd);
+	}
+
+	power->PStateLimit = ClampLimit(EvaluateLimit(executive, node), power->PStateCount);
+}
+
+/* Evaluation happens unlocked, only the copy into the table is serialized */
+void RefreshProcessor(ACPI_ProcessorTable *table, ACPI_Processor *processor, uint8_t refresh) {
+	AMLExecutive *executive = table->Executive;
+	AML_Namespace *ns = executive->GetNamespace();
+
+	/* The node stays valid until we leave, even if its table is unloaded meanwhile */
+	uint32_t section = EnterNamespace(ns);
+	AML_NamespaceNode *node = __atomic_load_n(&processor->Node, __ATOMIC_ACQUIRE);
+	if (node == NULL) {
+		LeaveNamespace(ns, section);
+		return;
+	}
+
+	ACPI_ProcessorPower *power = new ACPI_ProcessorPower;
+
+	if (refresh & PROCESSOR_REFRESH_IDLE) {
+		DecodeCStates(executive, node, power);
+		DecodeLPIStates(executive, node, power);
+	}
+
+	uint64_t limit = 0;
+	if (refresh & PROCESSOR_REFRESH_PERFORMANCE) DecodePStates(executive, node, power);
+	else if (refresh & PROCESSOR_REFRESH_LIMIT) limit = EvaluateLimit(executive, node);
+
+	LeaveNamespace(ns, section);
+
+	AcquireSpinLock(&table->Lock);
+
+	/* Removed while we were evaluating, its tables stay empty */
+	if (processor->Node == NULL) {
+		ReleaseSpinLock(&table->Lock);
+		delete power;
+		return;
+	}
+
+	__atomic_store_n(&processor->Sequence, processor->Sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	ACPI_ProcessorPower *current = &processor->Power;
+
+	if (refresh & PROCESSOR_REFRESH_IDLE) {
+		current->CStateCount = power->CStateCount;
+		Memcpy(current->CStates, power->CStates, sizeof(power->CStates));
+		current->LPICount = power->LPICount;
+		Memcpy(current->LPIStates, power->LPIStates, sizeof(power->LPIStates));
+	}
+
+	if (refresh & PROCESSOR_REFRESH_PERFORMANCE) {
+		current->PStateCount = power->PStateCount;
+		Memcpy(current->PStates, power->PStates, sizeof(power->PStates));
+		current->PerformanceControl = power->PerformanceControl;
+		current->PerformanceStatus = power->PerformanceStatus;
+		current->Dependency.Valid = power->Dependency.Valid;
+		current->Dependency.Domain = power->Dependency.Domain;
+		current->Dependency.Coordination = power->Dependency.Coordination;
+		current->Dependency.ProcessorCount = power->Dependency.ProcessorCount;
+		current->PStateLimit = power->PStateLimit;
+	} else if (refresh & PROCESSOR_REFRESH_LIMIT) {
+		/* _PPC is checked against the P-state count the table already has */
+		current->PStateLimit = ClampLimit(limit, current->PStateCount);
+	}
+
+	table->Refreshes++;
+
+	__atomic_store_n(&processor->Sequence, processor->Sequence + 1, __ATOMIC_RELEASE);
+	ReleaseSpinLock(&table->Lock);
+
+	delete power;
+}
+
+static void EmptyPower(ACPI_ProcessorPower *power) {
+	power->CStateCount = 0;
+	power->LPICount = 0;
+	power->PStateCount = 0;
+	power->PStateLimit = 0;
+	power->Dependency.Valid = false;
+}
+
+void RemoveProcessorSubtree(ACPI_ProcessorTable *table, AML_NamespaceNode *subtree) {
+	AcquireSpinLock(&table->Lock);
+
+	for (size_t i = 0; i < table->Count; ++i) {
+		ACPI_Processor *processor = &table->Processors[i];
+		if (processor->Node == NULL || !IsNodeInSubtree(processor->Node, subtree)) continue;
+
+		__atomic_store_n(&processor->Sequence, processor->Sequence + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		__atomic_store_n(&processor->Node, (AML_NamespaceNode*)NULL, __ATOMIC_RELEASE);
+		EmptyPower(&processor->Power);
+
+		__atomic_store_n(&processor->Sequence, processor->Sequence + 1, __ATOMIC_RELEASE);
+	}
+
+	ReleaseSpinLock(&table->Lock);
+}
+
+static void ProcessorNotifyHandler(AML_NamespaceNode *node, uint32_t value, void *context) {
+	ACPI_ProcessorTable *table = (ACPI_ProcessorTable*)context;
+
+	/* Only the CPU the notification names is evaluated again */
+	size_t count = __atomic_load_n(&table->Count, __ATOMIC_ACQUIRE);
+	for (size_t i = 0; i < count; ++i) {
+		if (__atomic_load_n(&table->Processors[i].Node, __ATOMIC_ACQUIRE) != node) continue;
+
+		if (value == AML_NOTIFY_PROCESSOR_PERFORMANCE) RefreshProcessor(table, &table->Processors[i], PROCESSOR_REFRESH_LIMIT);
+		else if (value == AML_NOTIFY_PROCESSOR_POWER) RefreshProcessor(table, &table->Processors[i], PROCESSOR_REFRESH_IDLE);
+
+		return;
+	}
+}
+
+static size_t CollectProcessors(AML_NamespaceNode *node, ACPI_Processor *processors, size_t count, size_t max) {
+	if (node->Type == NODE_PROCESSOR) {
+		if (processors != NULL && count >= max) return count;
+
+		if (processors != NULL) {
+			processors[count].Node = node;
+			processors[count].Uid = node->Object->Processor.ProcessorId;
+		}
+
+		count++;
+	}
+
+	for (AML_NamespaceNode *child = FirstChild(node); child != NULL; child = NextSibling(child)) {
+		count = CollectProcessors(child, processors, count, max);
+	}
+
+	return count;
+}
+
+static uint32_t EvaluateUid(AMLExecutive *executive, AML_NamespaceNode *device) {
+	uint64_t uid = 0;
+	executive->EvaluateInteger(FindChild(device, "_UID"), &uid);
+
+	return uid;
+}
+
+static void MatchTopology(ACPI_ProcessorTable *table, ACPI_Processor *processor) {
+	CPUTopology *topology = table->Topology;
+
+	processor->Cpu = topology != NULL ? FindCPUByUID(topology, processor->Uid) : -1;
+	processor->HardwareID = processor->Cpu >= 0 ? topology->HardwareID[processor->Cpu] : 0;
+}
+
+ACPI_ProcessorTable *CreateProcessorTable(AMLExecutive *executive, AML_DeviceIndex *devices, CPUTopology *topology) {
+	ACPI_ProcessorTable *table = new ACPI_ProcessorTable;
+	AML_NamespaceNode *root = executive->GetNamespace()->Root;
+
+	table->Executive = executive;
+	table->Devices = devices;
+	table->Topology = topology;
+	InitSpinLock(&table->Lock);
+	table->Refreshes = 0;
+
+	/* Processor objects, then the Device(ACPI0007) declarations that replace them */
+	AML_NamespaceNode *processorDevices[PROCESSOR_MAX_DEVICES];
+	size_t deviceCount = FindDevices(devices, "ACPI0007", processorDevices, PROCESSOR_MAX_DEVICES);
+	if (deviceCount > PROCESSOR_MAX_DEVICES) deviceCount = PROCESSOR_MAX_DEVICES;
+
+	uint32_t section = EnterNamespace(executive->GetNamespace());
+	size_t objectCount = CollectProcessors(root, NULL, 0, 0);
+
+	/* The MADT lists every CPU that can be added later, that many spare slots cover any table loaded for them */
+	table->Capacity = objectCount + deviceCount + (topology != NULL ? topology->CPUCount : 0);
+	table->Processors = NULL;
+	if (table->Capacity != 0) table->Processors = new ACPI_Processor[table->Capacity];
+
+	/* A table load between the two walks may have changed the count */
+	objectCount = CollectProcessors(root, table->Processors, 0, objectCount);
+	table->Count = objectCount + deviceCount;
+	LeaveNamespace(executive->GetNamespace(), section);
+
+	for (size_t i = 0; i < deviceCount; ++i) {
+		ACPI_Processor *processor = &table->Processors[objectCount + i];
+
+		processor->Node = processorDevices[i];
+		processor->Uid = EvaluateUid(executive, processorDevices[i]);
+	}
+
+	size_t idle = 0, performance = 0;
+
+	for (size_t i = 0; i < table->Count; ++i) {
+		ACPI_Processor *processor = &table->Processors[i];
+
+		MatchTopology(table, processor);
+		processor->Sequence = 0;
+
+		RefreshProcessor(table, processor, PROCESSOR_REFRESH_IDLE | PROCESSOR_REFRESH_PERFORMANCE);
+
+		if (processor->Power.CStateCount != 0 || processor->Power.LPICount != 0) idle++;
+		if (processor->Power.PStateCount != 0) performance++;
+	}
+
+	table->Subscription = SubscribeNotify(executive->GetNotifyQueue(), root, true, ProcessorNotifyHandler, table);
+
+	Trace(ACPI_TRACE_INFO, TRACE_PROCESSORS, table->Count, idle, performance);
+
+	return table;
+}
+
+/*
+ * A processor coming back after its table was unloaded gets its old slot and
+ * index again, others take a spare slot. Power is empty until the slot is
+ * published, the evaluation runs once the lock is dropped.
+ */
+void AddProcessorSubtree(ACPI_ProcessorTable *table, AML_NamespaceNode *subtree) {
+	AMLExecutive *executive = table->Executive;
+
+	AML_NamespaceNode *processorDevices[PROCESSOR_MAX_DEVICES];
+	size_t found = FindDevices(table->Devices, "ACPI0007", processorDevices, PROCESSOR_MAX_DEVICES);
+	if (found > PROCESSOR_MAX_DEVICES) found = PROCESSOR_MAX_DEVICES;
+
+	size_t deviceCount = 0;
+	for (size_t i = 0; i < found; ++i) {
+		if (IsNodeInSubtree(processorDevices[i], subtree)) processorDevices[deviceCount++] = processorDevices[i];
+	}
+
+	size_t objectCount = CollectProcessors(subtree, NULL, 0, 0);
+	size_t count = objectCount + deviceCount;
+	if (count == 0) return;
+
+	ACPI_Processor *processors = new ACPI_Processor[count];
+	objectCount = CollectProcessors(subtree, processors, 0, objectCount);
+	count = objectCount + deviceCount;
+
+	for (size_t i = 0; i < deviceCount; ++i) {
+		processors[objectCount + i].Node = processorDevices[i];
+		processors[objectCount + i].Uid = EvaluateUid(executive, processorDevices[i]);
+	}
+
+	ACPI_Processor **added = new ACPI_Processor*[count];
+	size_t addedCount = 0;
+
+	AcquireSpinLock(&table->Lock);
+
+	for (size_t i = 0; i < count; ++i) {
+		ACPI_Processor *processor = NULL;
+
+		for (size_t j = 0; j < table->Count && processor == NULL; ++j) {
+			if (table->Processors[j].Node == NULL && table->Processors[j].Uid == processors[i].Uid) processor = &table->Processors[j];
+		}
+
+		if (processor == NULL) {
+			if (table->Count == table->Capacity) continue;
+
+			processor = &table->Processors[table->Count];
+			processor->Uid = processors[i].Uid;
+			MatchTopology(table, processor);
+			processor->Sequence = 0;
+			EmptyPower(&processor->Power);
+
+			__atomic_store_n(&table->Count, table->Count + 1, __ATOMIC_RELEASE);
+		}
+
+		__atomic_store_n(&processor->Node, processors[i].Node, __ATOMIC_RELEASE);
+		added[addedCount++] = processor;
+	}
+
+	ReleaseSpinLock(&table->Lock);
+
+	for (size_t i = 0; i < addedCount; ++i) RefreshProcessor(table, added[i], PROCESSOR_REFRESH_IDLE | PROCESSOR_REFRESH_PERFORMANCE);
+
+	Trace(addedCount == count ? ACPI_TRACE_INFO : ACPI_TRACE_WARNING, TRACE_PROCESSORS_ADDED, addedCount, count - addedCount);
+
+	delete[] added;
+	delete[] processors;
+}
+
+void DeleteProcessorTable(ACPI_ProcessorTable *table) {
+	UnsubscribeNotify(table->Executive->GetNotifyQueue(), table->Subscription);
+
+	if (table->Processors != NULL) delete[] table->Processors;
+	delete table;
+}
+
+int FindProcessor(ACPI_ProcessorTable *table, uint32_t uid) {
+	size_t count = __atomic_load_n(&table->Count, __ATOMIC_ACQUIRE);
+	for (size_t i = 0; i < count; ++i) {
+		if (table->Processors[i].Uid == uid) return i;
+	}
+
+	return -1;
+}
+
+bool ReadProcessorPower(ACPI_ProcessorTable *table, size_t index, ACPI_ProcessorPower *power) {
+	if (index >= __atomic_load_n(&table->Count, __ATOMIC_ACQUIRE)) return false;
+
+	ACPI_Processor *processor = &table->Processors[index];
+	uint32_t sequence;
+
+	do {
+		sequence = __atomic_load_n(&processor->Sequence, __ATOMIC_ACQUIRE);
+		if (sequence & 1) {
+			CpuRelax();
+			continue;
+		}
+
+		Memcpy(power, &processor->Power, sizeof(ACPI_ProcessorPower));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((sequence & 1) || __atomic_load_n(&processor->Sequence, __ATOMIC_RELAXED) != sequence);
+
+	return true;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "gas.h"
+#include "sync.h"
+
+class AMLExecutive;
+struct AML_NamespaceNode;
+struct AML_NotifySubscription;
+struct AML_DeviceIndex;
+struct CPUTopology;
+
+/* Processor notification values, see ACPI spec section 5.6.6 */
+#define AML_NOTIFY_PROCESSOR_PERFORMANCE 0x80
+#define AML_NOTIFY_PROCESSOR_POWER 0x81
+
+#define ACPI_MAX_CSTATES 8
+#define ACPI_MAX_PSTATES 16
+#define ACPI_MAX_LPI_STATES 8
+
+/* Entry methods outside of memory and I/O, e.g. MWAIT hints */
+#define ACPI_SPACE_FIXED_HARDWARE 0x7F
+
+#define PROCESSOR_REFRESH_IDLE 0x01
+#define PROCESSOR_REFRESH_PERFORMANCE 0x02
+/* Only _PPC, the table itself stays */
+#define PROCESSOR_REFRESH_LIMIT 0x04
+
+/* See ACPI spec section 8.4.1.1 */
+struct ACPI_CState {
+	uint8_t Type;
+	/* Microseconds and milliwatts */
+	uint16_t Latency;
+	uint32_t Power;
+
+	GenericAddressStructure Entry;
+};
+
+/* See ACPI spec section 8.4.4.2 */
+struct ACPI_LPIState {
+	uint32_t MinResidency;
+	uint32_t WakeLatency;
+	uint32_t Flags;
+	uint32_t ArchFlags;
+	uint32_t EnabledParent;
+
+	/* An integer entry method is kept as a fixed hardware address */
+	GenericAddressStructure Entry;
+};
+
+/* See ACPI spec section 8.4.5.2 */
+struct ACPI_PState {
+	/* MHz, milliwatts and microseconds */
+	uint32_t Frequency;
+	uint32_t Power;
+	uint32_t Latency;
+	uint32_t BusMasterLatency;
+
+	uint64_t Control;
+	uint64_t Status;
+};
+
+struct ACPI_ProcessorPower {
+	uint8_t CStateCount;
+	ACPI_CState CStates[ACPI_MAX_CSTATES];
+
+	uint8_t LPICount;
+	ACPI_LPIState LPIStates[ACPI_MAX_LPI_STATES];
+
+	uint8_t PStateCount;
+	ACPI_PState PStates[ACPI_MAX_PSTATES];
+	/* Index of the fastest P-state the platform allows right now, from _PPC */
+	uint8_t PStateLimit;
+
+	/* _PCT, the PStates' Control and Status values go through these */
+	GAS_Register PerformanceControl;
+	GAS_Register PerformanceStatus;
+
+	/* _PSD, Valid is false without one */
+	struct {
+		bool Valid;
+		uint32_t Domain;
+		uint8_t Coordination;
+		uint32_t ProcessorCount;
+	} Dependency;
+};
+
+struct ACPI_Processor {
+	/* NULL once its table was unloaded */
+	AML_NamespaceNode *Node;
+
+	/* Processor ID or _UID, matches the MADT */
+	uint32_t Uid;
+	/* Index into the CPU topology, -1 when the MADT does not list it */
+	int32_t Cpu;
+	uint64_t HardwareID;
+
+	/* Odd while Power is being replaced */
+	uint32_t Sequence;
+	ACPI_ProcessorPower Power;
+};
+
+struct ACPI_ProcessorTable {
+	AMLExecutive *Executive;
+	AML_DeviceIndex *Devices;
+	CPUTopology *Topology;
+
+	/* Serializes writers, readers go through the sequence numbers */
+	AML_SpinLock Lock;
+	/* Never moves, processors are added in place up to Capacity */
+	ACPI_Processor *Processors;
+	size_t Count;
+	size_t Capacity;
+
+	uint64_t Refreshes;
+
+	AML_NotifySubscription *Subscription;
+};
+
+ACPI_ProcessorTable *CreateProcessorTable(AMLExecutive *executive, AML_DeviceIndex *devices, CPUTopology *topology);
+void DeleteProcessorTable(ACPI_ProcessorTable *table);
+
+/* Evaluates the methods picked by the PROCESSOR_REFRESH bits again */
+void RefreshProcessor(ACPI_ProcessorTable *table, ACPI_Processor *processor, uint8_t refresh);
+/* Adds the processors under subtree, call it once the subtree is in the namespace and the device index */
+void AddProcessorSubtree(ACPI_ProcessorTable *table, AML_NamespaceNode *subtree);
+/* Empties the power tables of processors under subtree, call it before the subtree leaves the namespace */
+void RemoveProcessorSubtree(ACPI_ProcessorTable *table, AML_NamespaceNode *subtree);
+
+int FindProcessor(ACPI_ProcessorTable *table, uint32_t uid);
+/* A consistent copy, safe against a Notify replacing the tables meanwhile */
+bool ReadProcessorPower(ACPI_ProcessorTable *table, size_t index, ACPI_ProcessorPower *power);
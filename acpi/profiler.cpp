@@ -0,0 +1,295 @@
+#include "profiler.h"
+#include "namespace.h"
+#include "memory.h"
+
+#include <mkmi.h>
+
+static const char *SpaceNames[AML_REGION_SPACE_COUNT] = {
+	[AML_REGION_SYSTEM_MEMORY] = "Memory",
+	[AML_REGION_SYSTEM_IO] = "IO",
+	[AML_REGION_PCI_CONFIG] = "PCI",
+	[AML_REGION_EMBEDDED_CONTROL] = "EC",
+	[AML_REGION_SMBUS] = "SMBus",
+	[AML_REGION_SYSTEM_CMOS] = "CMOS",
+	[AML_REGION_PCI_BAR_TARGET] = "BAR",
+	[AML_REGION_IPMI] = "IPMI",
+	[AML_REGION_GPIO] = "GPIO",
+	[AML_REGION_GENERIC_SERIAL_BUS] = "GSB",
+	[AML_REGION_PCC] = "PCC",
+};
+
+static inline size_t MethodBucket(AML_NamespaceNode *method) {
+	return ((uintptr_t)method >> 4) & (PROFILE_METHOD_BUCKETS - 1);
+}
+
+AML_Profiler *CreateProfiler() {
+	AML_Profiler *profiler = new AML_Profiler;
+
+	InitSpinLock(&profiler->Lock);
+
+	for (size_t i = 0; i < PROFILE_METHOD_BUCKETS; ++i) profiler->Methods[i] = NULL;
+	for (size_t i = 0; i < PROFILE_STACK_BUCKETS; ++i) profiler->Stacks[i] = NULL;
+	profiler->MethodCount = 0;
+	profiler->StackCount = 0;
+
+	return profiler;
+}
+
+/* Expects Lock held */
+static void ClearProfiler(AML_Profiler *profiler) {
+	for (size_t i = 0; i < PROFILE_STACK_BUCKETS; ++i) {
+		AML_ProfileStack *stack = profiler->Stacks[i];
+		while (stack != NULL) {
+			AML_ProfileStack *next = stack->Next;
+			FreeMemory(stack->Frames);
+			FreeMemory(stack);
+			stack = next;
+		}
+
+		profiler->Stacks[i] = NULL;
+	}
+
+	for (size_t i = 0; i < PROFILE_METHOD_BUCKETS; ++i) {
+		AML_ProfileEntry *entry = profiler->Methods[i];
+		while (entry != NULL) {
+			AML_ProfileEntry *next = entry->Next;
+			FreeMemory(entry);
+			entry = next;
+		}
+
+		profiler->Methods[i] = NULL;
+	}
+
+	profiler->MethodCount = 0;
+	profiler->StackCount = 0;
+}
+
+void DeleteProfiler(AML_Profiler *profiler) {
+	ClearProfiler(profiler);
+	delete profiler;
+}
+
+void ResetProfiler(AML_Profiler *profiler) {
+	AcquireSpinLock(&profiler->Lock);
+	ClearProfiler(profiler);
+	ReleaseSpinLock(&profiler->Lock);
+}
+
+void EnterProfileFrame(AML_ProfileFrame *frame, AML_ProfileFrame *caller, AML_NamespaceNode *method, uint64_t now) {
+	frame->Method = method;
+	frame->StartNs = now;
+	frame->ChildNs = 0;
+	frame->StallNs = 0;
+	frame->Caller = caller;
+
+	for (size_t i = 0; i < AML_REGION_SPACE_COUNT; ++i) frame->RegionAccesses[i] = 0;
+}
+
+/* Expects Lock held */
+static AML_ProfileEntry *FindEntry(AML_Profiler *profiler, AML_NamespaceNode *method) {
+	size_t bucket = MethodBucket(method);
+
+	for (AML_ProfileEntry *entry = profiler->Methods[bucket]; entry != NULL; entry = entry->Next) {
+		if (entry->Method == method) return entry;
+	}
+
+	AML_ProfileEntry *entry = (AML_ProfileEntry*)AllocateMemory(ACPI_MEMORY_PROFILE, sizeof(AML_ProfileEntry));
+	entry->Method = method;
+	if (GetNodePath(method, entry->Path, PROFILE_PATH_LENGTH) == 0) entry->Path[0] = '\0';
+
+	entry->Calls = 0;
+	entry->InclusiveNs = 0;
+	entry->ExclusiveNs = 0;
+	entry->SleepNs = 0;
+	entry->StallNs = 0;
+	for (size_t i = 0; i < AML_REGION_SPACE_COUNT; ++i) entry->RegionAccesses[i] = 0;
+
+	entry->Next = profiler->Methods[bucket];
+	profiler->Methods[bucket] = entry;
+	profiler->MethodCount++;
+
+	return entry;
+}
+
+/* Expects Lock held, every method on the stack already has its entry */
+static AML_ProfileStack *FindStack(AML_Profiler *profiler, AML_ProfileFrame *frame) {
+	AML_ProfileEntry *frames[PROFILE_MAX_DEPTH];
+	size_t depth = 0;
+
+	/* Innermost first while walking, the stack keeps them the other way around */
+	for (AML_ProfileFrame *current = frame; current != NULL && depth < PROFILE_MAX_DEPTH; current = current->Caller) {
+		frames[depth++] = FindEntry(profiler, current->Method);
+	}
+
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < depth; ++i) {
+		hash ^= (uintptr_t)frames[i];
+		hash *= 0x100000001B3ull;
+	}
+
+	size_t bucket = hash & (PROFILE_STACK_BUCKETS - 1);
+
+	for (AML_ProfileStack *stack = profiler->Stacks[bucket]; stack != NULL; stack = stack->Next) {
+		if (stack->Hash != hash || stack->Depth != depth) continue;
+
+		bool same = true;
+		for (size_t i = 0; i < depth && same; ++i) same = stack->Frames[depth - 1 - i] == frames[i];
+
+		if (same) return stack;
+	}
+
+	AML_ProfileStack *stack = (AML_ProfileStack*)AllocateMemory(ACPI_MEMORY_PROFILE, sizeof(AML_ProfileStack));
+	stack->Hash = hash;
+	stack->Depth = depth;
+	stack->Frames = (AML_ProfileEntry**)AllocateMemory(ACPI_MEMORY_PROFILE, depth * sizeof(AML_ProfileEntry*));
+	for (size_t i = 0; i < depth; ++i) stack->Frames[depth - 1 - i] = frames[i];
+
+	stack->Samples = 0;
+	stack->ExclusiveNs = 0;
+
+	stack->Next = profiler->Stacks[bucket];
+	profiler->Stacks[bucket] = stack;
+	profiler->StackCount++;
+
+	return stack;
+}
+
+void LeaveProfileFrame(AML_Profiler *profiler, AML_ProfileFrame *frame, uint64_t now, uint64_t sleepNs) {
+	uint64_t inclusive = now - frame->StartNs;
+	uint64_t exclusive = inclusive > frame->ChildNs ? inclusive - frame->ChildNs : 0;
+
+	if (frame->Caller != NULL) {
+		frame->Caller->ChildNs += inclusive;
+		frame->Caller->StallNs += frame->StallNs;
+	}
+
+	AcquireSpinLock(&profiler->Lock);
+
+	AML_ProfileEntry *entry = FindEntry(profiler, frame->Method);
+	entry->Calls++;
+	entry->InclusiveNs += inclusive;
+	entry->ExclusiveNs += exclusive;
+	entry->SleepNs += sleepNs;
+	entry->StallNs += frame->StallNs;
+	for (size_t i = 0; i < AML_REGION_SPACE_COUNT; ++i) entry->RegionAccesses[i] += frame->RegionAccesses[i];
+
+	AML_ProfileStack *stack = FindStack(profiler, frame);
+	stack->Samples++;
+	stack->ExclusiveNs += exclusive;
+
+	ReleaseSpinLock(&profiler->Lock);
+}
+
+/* A new method allocated where a removed one was must not add to its entry */
+void DropRemovedMethods(AML_Profiler *profiler) {
+	AcquireSpinLock(&profiler->Lock);
+
+	for (size_t i = 0; i < PROFILE_METHOD_BUCKETS; ++i) {
+		for (AML_ProfileEntry *entry = profiler->Methods[i]; entry != NULL; entry = entry->Next) {
+			if (entry->Method != NULL && entry->Method->Removed) entry->Method = NULL;
+		}
+	}
+
+	ReleaseSpinLock(&profiler->Lock);
+}
+
+size_t GetSlowestMethods(AML_Profiler *profiler, AML_ProfileEntry **entries, size_t max) {
+	size_t found = 0;
+
+	AcquireSpinLock(&profiler->Lock);
+
+	for (size_t i = 0; i < PROFILE_METHOD_BUCKETS; ++i) {
+		for (AML_ProfileEntry *entry = profiler->Methods[i]; entry != NULL; entry = entry->Next) {
+			size_t position = found < max ? found : max;
+			found++;
+
+			/* Insertion into the few slowest seen so far */
+			while (position > 0 && entries[position - 1]->InclusiveNs < entry->InclusiveNs) {
+				if (position < max) entries[position] = entries[position - 1];
+				position--;
+			}
+
+			if (position < max) entries[position] = entry;
+		}
+	}
+
+	ReleaseSpinLock(&profiler->Lock);
+
+	return found;
+}
+
+void PrintProfile(AML_Profiler *profiler, size_t count) {
+	AML_ProfileEntry *entries[32];
+	if (count > 32) count = 32;
+
+	size_t found = GetSlowestMethods(profiler, entries, count);
+	if (found < count) count = found;
+
+	MKMI_Printf("%d methods profiled, %d slowest:\r\n", found, count);
+
+	for (size_t i = 0; i < count; ++i) {
+		AML_ProfileEntry *entry = entries[i];
+
+		MKMI_Printf("%s: %d calls, %dus inclusive, %dus exclusive, %dus sleeping, %dus stalled",
+		            entry->Path, entry->Calls, entry->InclusiveNs / 1000, entry->ExclusiveNs / 1000,
+		            entry->SleepNs / 1000, entry->StallNs / 1000);
+
+		for (size_t space = 0; space < AML_REGION_SPACE_COUNT; ++space) {
+			if (entry->RegionAccesses[space] != 0) MKMI_Printf(", %d %s", entry->RegionAccesses[space], SpaceNames[space]);
+		}
+
+		MKMI_Printf("\r\n");
+	}
+}
+
+static size_t AppendText(char *buffer, size_t size, size_t length, const char *text) {
+	for (; *text != '\0'; ++text, ++length) {
+		if (length < size) buffer[length] = *text;
+	}
+
+	return length;
+}
+
+static size_t AppendNumber(char *buffer, size_t size, size_t length, uint64_t number) {
+	char digits[21];
+	size_t count = 0;
+
+	do {
+		digits[count++] = '0' + number % 10;
+		number /= 10;
+	} while (number != 0);
+
+	while (count > 0) {
+		if (length < size) buffer[length] = digits[count - 1];
+		length++;
+		count--;
+	}
+
+	return length;
+}
+
+size_t ExportProfileStacks(AML_Profiler *profiler, char *buffer, size_t size) {
+	size_t length = 0;
+
+	AcquireSpinLock(&profiler->Lock);
+
+	for (size_t i = 0; i < PROFILE_STACK_BUCKETS; ++i) {
+		for (AML_ProfileStack *stack = profiler->Stacks[i]; stack != NULL; stack = stack->Next) {
+			for (size_t frame = 0; frame < stack->Depth; ++frame) {
+				if (frame > 0) length = AppendText(buffer, size, length, ";");
+				length = AppendText(buffer, size, length, stack->Frames[frame]->Path);
+			}
+
+			length = AppendText(buffer, size, length, " ");
+			length = AppendNumber(buffer, size, length, stack->ExclusiveNs);
+			length = AppendText(buffer, size, length, "\n");
+		}
+	}
+
+	ReleaseSpinLock(&profiler->Lock);
+
+	/* Terminated when it fits, the length never counts the terminator */
+	if (length < size) buffer[length] = '\0';
+
+	return length;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sync.h"
+#include "aml_opcodes.h"
+
+struct AML_NamespaceNode;
+
+/* Must be powers of two */
+#define PROFILE_METHOD_BUCKETS 256
+#define PROFILE_STACK_BUCKETS 1024
+
+/* Same as AML_MAX_CALL_DEPTH */
+#define PROFILE_MAX_DEPTH 32
+/* "\" and "XXXX." for as many segments as a path can have */
+#define PROFILE_PATH_LENGTH (1 + 32 * 5)
+
+struct AML_ProfileEntry {
+	/* NULL once its table was unloaded, the path is kept for the report */
+	AML_NamespaceNode *Method;
+	char Path[PROFILE_PATH_LENGTH];
+
+	uint64_t Calls;
+	/* Callees included, and without them */
+	uint64_t InclusiveNs;
+	uint64_t ExclusiveNs;
+	/* Callees included, like the method stats */
+	uint64_t SleepNs;
+	uint64_t StallNs;
+	/* Field unit reads and writes the method made itself, by the space of their region */
+	uint64_t RegionAccesses[AML_REGION_SPACE_COUNT];
+
+	AML_ProfileEntry *Next;
+};
+
+/* A distinct call stack, with the time spent while its innermost method was running */
+struct AML_ProfileStack {
+	uint64_t Hash;
+	size_t Depth;
+	/* Outermost first */
+	AML_ProfileEntry **Frames;
+
+	uint64_t Samples;
+	uint64_t ExclusiveNs;
+
+	AML_ProfileStack *Next;
+};
+
+/* One per running method, lives on the stack of ExecuteMethod */
+struct AML_ProfileFrame {
+	AML_NamespaceNode *Method;
+	uint64_t StartNs;
+
+	/* Inclusive time of the callees */
+	uint64_t ChildNs;
+	uint64_t StallNs;
+	uint64_t RegionAccesses[AML_REGION_SPACE_COUNT];
+
+	AML_ProfileFrame *Caller;
+};
+
+struct AML_Profiler {
+	/* Only taken when a method returns */
+	AML_SpinLock Lock;
+
+	AML_ProfileEntry *Methods[PROFILE_METHOD_BUCKETS];
+	size_t MethodCount;
+	AML_ProfileStack *Stacks[PROFILE_STACK_BUCKETS];
+	size_t StackCount;
+};
+
+AML_Profiler *CreateProfiler();
+void DeleteProfiler(AML_Profiler *profiler);
+void ResetProfiler(AML_Profiler *profiler);
+
+void EnterProfileFrame(AML_ProfileFrame *frame, AML_ProfileFrame *caller, AML_NamespaceNode *method, uint64_t now);
+/* Charges the frame to its method and call stack, sleepNs is what the interpreter already measured */
+void LeaveProfileFrame(AML_Profiler *profiler, AML_ProfileFrame *frame, uint64_t now, uint64_t sleepNs);
+/* Forgets which nodes removed methods were, call it in the read section that removed them */
+void DropRemovedMethods(AML_Profiler *profiler);
+
+/* Fills up to max entries, slowest inclusive time first, and returns how many there are in total */
+size_t GetSlowestMethods(AML_Profiler *profiler, AML_ProfileEntry **entries, size_t max);
+void PrintProfile(AML_Profiler *profiler, size_t count);
+
+/*
+ * One "\A.B;\C.D 1234" line per stack, exclusive nanoseconds last, the
+ * format flame graph tools collapse stacks into. Returns the length the
+ * whole text needs, nothing past size is written.
+ */
+size_t ExportProfileStacks(AML_Profiler *profiler, char *buffer, size_t size);
@@ -0,0 +1,308 @@
+#include "query.h"
+#include "aml_executive.h"
+#include "token.h"
+#include "numa.h"
+
+#include <mkmi.h>
+
+#define QUERY_MAX_PATH 256
+
+static inline uint32_t AlignUp(uint32_t value, uint32_t alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+int InitQueryRequest(void *buffer, size_t size) {
+	if (size < sizeof(AML_QueryHeader)) return -1;
+
+	AML_QueryHeader *header = (AML_QueryHeader*)buffer;
+	header->Magic = AML_QUERY_MAGIC;
+	header->Count = 0;
+	header->Size = size;
+	header->Status = AML_QUERY_OK;
+	/* Paths are stored from the end of the buffer downwards */
+	header->Data = size;
+
+	return 0;
+}
+
+static int AddItem(void *buffer, size_t size, uint16_t operation, const void *path, size_t pathLength) {
+	AML_QueryHeader *header = (AML_QueryHeader*)buffer;
+
+	/* A header not set up for this buffer would have us write past it */
+	if (header->Data > size) return -1;
+
+	size_t itemsEnd = sizeof(AML_QueryHeader) + (header->Count + 1) * sizeof(AML_QueryItem);
+	if (pathLength >= QUERY_MAX_PATH || itemsEnd + pathLength > header->Data) return -1;
+
+	header->Data -= pathLength;
+	Memcpy((uint8_t*)buffer + header->Data, path, pathLength);
+
+	AML_QueryItem *item = (AML_QueryItem*)((uint8_t*)buffer + sizeof(AML_QueryHeader)) + header->Count;
+	item->Operation = operation;
+	item->PathLength = pathLength;
+	item->PathOffset = header->Data;
+
+	header->Count++;
+
+	return 0;
+}
+
+int AddQueryItem(void *buffer, size_t size, uint16_t operation, const char *path) {
+	return AddItem(buffer, size, operation, path, Strlen(path));
+}
+
+int AddQueryArgument(void *buffer, size_t size, uint16_t operation, uint64_t argument) {
+	return AddItem(buffer, size, operation, &argument, sizeof(argument));
+}
+
+int SubmitQuery(AML_QueryTransport *transport, const void *request, void *response, size_t responseSize) {
+	const AML_QueryHeader *header = (const AML_QueryHeader*)request;
+
+	return transport->Dispatch(transport->Context, request, header->Size, response, responseSize);
+}
+
+AML_QueryResult *GetQueryResult(void *response, uint32_t index) {
+	AML_QueryHeader *header = (AML_QueryHeader*)response;
+	if (index >= header->Count) return NULL;
+
+	return (AML_QueryResult*)((uint8_t*)response + sizeof(AML_QueryHeader)) + index;
+}
+
+AML_QueryResult *GetQueryElement(void *response, AML_QueryResult *package, uint32_t index) {
+	if (package->Type != AML_QUERY_TYPE_PACKAGE || index >= package->Length) return NULL;
+
+	return (AML_QueryResult*)((uint8_t*)response + package->Offset) + index;
+}
+
+void *GetQueryData(void *response, AML_QueryResult *result) {
+	if (result->Offset == 0) return NULL;
+
+	return (uint8_t*)response + result->Offset;
+}
+
+struct QueryWriter {
+	uint8_t *Response;
+	uint32_t Used;
+	uint32_t Size;
+};
+
+static uint32_t ReserveData(QueryWriter *writer, uint32_t size, uint32_t alignment) {
+	uint32_t offset = AlignUp(writer->Used, alignment);
+	if (offset > writer->Size || size > writer->Size - offset) return 0;
+
+	writer->Used = offset + size;
+
+	return offset;
+}
+
+static void WriteObject(QueryWriter *writer, AML_QueryResult *result, Token *object) {
+	result->Status = AML_QUERY_OK;
+	result->Type = AML_QUERY_TYPE_NONE;
+	result->Length = 0;
+	result->Offset = 0;
+	result->Reserved = 0;
+	result->Integer = 0;
+
+	if (object == NULL) {
+		result->Status = AML_QUERY_NOT_SUPPORTED;
+		return;
+	}
+
+	switch (object->Type) {
+		case ZERO:
+			result->Type = AML_QUERY_TYPE_INTEGER;
+			break;
+		case ONE:
+			result->Type = AML_QUERY_TYPE_INTEGER;
+			result->Integer = 1;
+			break;
+		case INTEGER:
+			result->Type = AML_QUERY_TYPE_INTEGER;
+			result->Integer = object->Int.Data;
+			break;
+		case STRING: {
+			uint32_t length = Strlen(object->String);
+			uint32_t offset = ReserveData(writer, length + 1, 1);
+			if (offset == 0) {
+				result->Status = AML_QUERY_NO_SPACE;
+				break;
+			}
+
+			Memcpy(writer->Response + offset, object->String, length + 1);
+			result->Type = AML_QUERY_TYPE_STRING;
+			result->Length = length;
+			result->Offset = offset;
+			}
+			break;
+		case BUFFER: {
+			uint32_t length = object->Buffer.BufferSize.Data;
+			uint32_t offset = ReserveData(writer, length, 1);
+			if (offset == 0) {
+				result->Status = AML_QUERY_NO_SPACE;
+				break;
+			}
+
+			Memcpy(writer->Response + offset, object->Buffer.ByteList, length);
+			result->Type = AML_QUERY_TYPE_BUFFER;
+			result->Length = length;
+			result->Offset = offset;
+			}
+			break;
+		case PACKAGE: {
+			uint32_t count = object->Package.NumElements;
+			uint32_t offset = ReserveData(writer, count * sizeof(AML_QueryResult), 8);
+			if (offset == 0) {
+				result->Status = AML_QUERY_NO_SPACE;
+				break;
+			}
+
+			result->Type = AML_QUERY_TYPE_PACKAGE;
+			result->Length = count;
+			result->Offset = offset;
+
+			/* Elements are laid out in place, nested packages follow them */
+			Token *element = object->Children != NULL ? object->Children->Head : NULL;
+			for (uint32_t i = 0; i < count; ++i) {
+				AML_QueryResult *slot = (AML_QueryResult*)(writer->Response + offset) + i;
+				WriteObject(writer, slot, element);
+
+				if (element != NULL) element = element->Next;
+			}
+			}
+			break;
+		default:
+			result->Status = AML_QUERY_NOT_SUPPORTED;
+			break;
+	}
+}
+
+static void ProcessNUMAQuery(NUMA_Topology *topology, QueryWriter *writer, AML_QueryResult *result, uint16_t operation, uint64_t argument) {
+	if (topology == NULL) {
+		result->Status = AML_QUERY_NOT_SUPPORTED;
+		return;
+	}
+
+	result->Status = AML_QUERY_OK;
+	result->Type = AML_QUERY_TYPE_INTEGER;
+
+	switch (operation) {
+		case AML_QUERY_NUMA_CPU:
+			result->Integer = FindNodeForCPU(topology, argument);
+			break;
+		case AML_QUERY_NUMA_MEMORY:
+			result->Integer = FindNodeForAddress(topology, argument);
+			break;
+		case AML_QUERY_NUMA_DISTANCES: {
+			uint32_t length = topology->NodeCount * topology->NodeCount;
+			uint32_t offset = ReserveData(writer, length, 1);
+			if (offset == 0) {
+				result->Status = AML_QUERY_NO_SPACE;
+				break;
+			}
+
+			Memcpy(writer->Response + offset, topology->Distances, length);
+			result->Type = AML_QUERY_TYPE_BUFFER;
+			result->Length = length;
+			result->Offset = offset;
+			result->Integer = topology->NodeCount;
+			}
+			break;
+	}
+
+	if (result->Integer == NUMA_NO_NODE && result->Type == AML_QUERY_TYPE_INTEGER) result->Status = AML_QUERY_NOT_FOUND;
+}
+
+int ProcessQuery(AMLExecutive *executive, NUMA_Topology *topology, const void *request, size_t requestSize, void *response, size_t responseSize) {
+	const AML_QueryHeader *requestHeader = (const AML_QueryHeader*)request;
+	AML_QueryHeader *responseHeader = (AML_QueryHeader*)response;
+
+	if (requestSize < sizeof(AML_QueryHeader) || requestHeader->Magic != AML_QUERY_MAGIC) return -1;
+	if (sizeof(AML_QueryHeader) + requestHeader->Count * sizeof(AML_QueryItem) > requestSize) return -1;
+
+	/* Offsets in the response are 32 bits wide */
+	if (responseSize > 0xFFFFFFFF) responseSize = 0xFFFFFFFF;
+
+	size_t resultsEnd = sizeof(AML_QueryHeader) + requestHeader->Count * sizeof(AML_QueryResult);
+	if (resultsEnd > responseSize) return -1;
+
+	responseHeader->Magic = AML_QUERY_MAGIC;
+	responseHeader->Count = requestHeader->Count;
+	responseHeader->Status = AML_QUERY_OK;
+	responseHeader->Data = resultsEnd;
+
+	QueryWriter writer = { (uint8_t*)response, (uint32_t)resultsEnd, (uint32_t)responseSize };
+
+	const AML_QueryItem *items = (const AML_QueryItem*)((const uint8_t*)request + sizeof(AML_QueryHeader));
+
+	/* Nodes found for the batch must outlive their evaluation, an unload could free them otherwise */
+	uint32_t pin = executive->PinNamespace();
+
+	for (uint32_t i = 0; i < requestHeader->Count; ++i) {
+		AML_QueryResult *result = GetQueryResult(response, i);
+		const AML_QueryItem *item = &items[i];
+
+		result->Status = AML_QUERY_INVALID;
+		result->Type = AML_QUERY_TYPE_NONE;
+		result->Length = 0;
+		result->Offset = 0;
+		result->Reserved = 0;
+		result->Integer = 0;
+
+		/* Both come from the client, added up they could wrap around */
+		if (item->PathLength >= QUERY_MAX_PATH || item->PathOffset > requestSize || item->PathLength > requestSize - item->PathOffset) continue;
+
+		if (item->Operation >= AML_QUERY_NUMA_CPU && item->Operation <= AML_QUERY_NUMA_DISTANCES) {
+			uint64_t argument = 0;
+			if (item->PathLength == sizeof(argument)) Memcpy(&argument, (const uint8_t*)request + item->PathOffset, sizeof(argument));
+
+			ProcessNUMAQuery(topology, &writer, result, item->Operation, argument);
+			if (result->Status == AML_QUERY_NO_SPACE) responseHeader->Status = AML_QUERY_NO_SPACE;
+			continue;
+		}
+
+		char path[QUERY_MAX_PATH];
+		Memcpy(path, (const uint8_t*)request + item->PathOffset, item->PathLength);
+		path[item->PathLength] = '\0';
+
+		AML_NamespaceNode *node = executive->FindNode(path);
+		if (node == NULL) {
+			result->Status = AML_QUERY_NOT_FOUND;
+			continue;
+		}
+
+		switch (item->Operation) {
+			case AML_QUERY_LOOKUP:
+				result->Status = AML_QUERY_OK;
+				result->Type = AML_QUERY_TYPE_NODE;
+				result->Integer = node->Type;
+				break;
+			case AML_QUERY_EVALUATE: {
+				Token *object = executive->Evaluate(node);
+				WriteObject(&writer, result, object);
+				executive->ReleaseResult(object);
+				}
+				break;
+			default:
+				break;
+		}
+
+		if (result->Status == AML_QUERY_NO_SPACE) responseHeader->Status = AML_QUERY_NO_SPACE;
+	}
+
+	executive->UnpinNamespace(pin);
+
+	responseHeader->Size = writer.Used;
+
+	return 0;
+}
+
+static int LoopbackDispatch(void *context, const void *request, size_t requestSize, void *response, size_t responseSize) {
+	AML_QueryServer *server = (AML_QueryServer*)context;
+
+	return ProcessQuery(server->Executive, server->NUMA, request, requestSize, response, responseSize);
+}
+
+void InitLoopbackTransport(AML_QueryTransport *transport, AML_QueryServer *server) {
+	transport->Dispatch = LoopbackDispatch;
+	transport->Context = server;
+}
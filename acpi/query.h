@@ -0,0 +1,98 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+class AMLExecutive;
+struct NUMA_Topology;
+
+/*
+ * Batched namespace queries for other modules.
+ *
+ * A request is a header followed by an array of items, each pointing at a
+ * path stored after the array. The response, written straight into the
+ * shared buffer the client provides, is a header, one fixed-size result per
+ * item and a data area holding strings, buffers and package elements.
+ * All offsets are relative to the start of the buffer they live in.
+ */
+
+#define AML_QUERY_MAGIC 0x51495041 /* "APIQ" */
+
+#define AML_QUERY_LOOKUP 0x01
+#define AML_QUERY_EVALUATE 0x02
+
+/*
+ * NUMA queries take an integer argument in place of a path.
+ * CPU: hardware ID to node, MEMORY: physical address to node,
+ * DISTANCES: the node count and the row major distance matrix as a buffer.
+ */
+#define AML_QUERY_NUMA_CPU 0x10
+#define AML_QUERY_NUMA_MEMORY 0x11
+#define AML_QUERY_NUMA_DISTANCES 0x12
+
+#define AML_QUERY_OK 0x00
+#define AML_QUERY_NOT_FOUND 0x01
+#define AML_QUERY_NOT_SUPPORTED 0x02
+#define AML_QUERY_NO_SPACE 0x03
+#define AML_QUERY_INVALID 0x04
+
+#define AML_QUERY_TYPE_NONE 0x00
+#define AML_QUERY_TYPE_INTEGER 0x01
+#define AML_QUERY_TYPE_STRING 0x02
+#define AML_QUERY_TYPE_BUFFER 0x03
+#define AML_QUERY_TYPE_PACKAGE 0x04
+#define AML_QUERY_TYPE_NODE 0x05
+
+struct AML_QueryHeader {
+	uint32_t Magic;
+	uint32_t Count;
+	/* Bytes of the buffer in use */
+	uint32_t Size;
+	uint32_t Status;
+	/* Requests: start of the path area, responses: start of the data area */
+	uint32_t Data;
+}__attribute__((packed));
+
+struct AML_QueryItem {
+	uint16_t Operation;
+	uint16_t PathLength;
+	uint32_t PathOffset;
+}__attribute__((packed));
+
+struct AML_QueryResult {
+	uint16_t Status;
+	uint16_t Type;
+	/* Strings and buffers: bytes, packages: elements */
+	uint32_t Length;
+	uint32_t Offset;
+	uint32_t Reserved;
+	/* Integers and node types */
+	uint64_t Integer;
+}__attribute__((packed));
+
+typedef int (*AML_QueryDispatch)(void *context, const void *request, size_t requestSize, void *response, size_t responseSize);
+
+struct AML_QueryTransport {
+	AML_QueryDispatch Dispatch;
+	void *Context;
+};
+
+/* Client side */
+int InitQueryRequest(void *buffer, size_t size);
+int AddQueryItem(void *buffer, size_t size, uint16_t operation, const char *path);
+int AddQueryArgument(void *buffer, size_t size, uint16_t operation, uint64_t argument);
+int SubmitQuery(AML_QueryTransport *transport, const void *request, void *response, size_t responseSize);
+
+AML_QueryResult *GetQueryResult(void *response, uint32_t index);
+AML_QueryResult *GetQueryElement(void *response, AML_QueryResult *package, uint32_t index);
+void *GetQueryData(void *response, AML_QueryResult *result);
+
+/* Server side, NUMA queries are not supported without a topology */
+struct AML_QueryServer {
+	AMLExecutive *Executive;
+	NUMA_Topology *NUMA;
+};
+
+int ProcessQuery(AMLExecutive *executive, NUMA_Topology *topology, const void *request, size_t requestSize, void *response, size_t responseSize);
+
+/* Calls straight into the server, standing in for kernel IPC */
+void InitLoopbackTransport(AML_QueryTransport *transport, AML_QueryServer *server);
@@ -0,0 +1,158 @@
+#include "region.h"
+#include "aml_opcodes.h"
+#include "region_trace.h"
+
+#include <mkmi.h>
+
+static uint64_t SystemMemoryRead(void*, uint64_t address, uint8_t width) {
+	uintptr_t addr = address + HIGHER_HALF;
+
+	switch(width) {
+		case 8:
+			return *(volatile uint8_t*)addr;
+		case 16:
+			return *(volatile uint16_t*)addr;
+		case 32:
+			return *(volatile uint32_t*)addr;
+		case 64:
+			return *(volatile uint64_t*)addr;
+		default:
+			return 0;
+	}
+}
+
+static void SystemMemoryWrite(void*, uint64_t address, uint64_t value, uint8_t width) {
+	uintptr_t addr = address + HIGHER_HALF;
+
+	switch(width) {
+		case 8:
+			*(volatile uint8_t*)addr = value;
+			break;
+		case 16:
+			*(volatile uint16_t*)addr = value;
+			break;
+		case 32:
+			*(volatile uint32_t*)addr = value;
+			break;
+		case 64:
+			*(volatile uint64_t*)addr = value;
+			break;
+	}
+}
+
+static uint64_t SystemIORead(void*, uint64_t address, uint8_t width) {
+	/* Ports are at most 32 bits wide, split anything larger */
+	if (width == 64) {
+		return InPort(address, 32) | ((uint64_t)InPort(address + 4, 32) << 32);
+	}
+
+	return InPort(address, width);
+}
+
+static void SystemIOWrite(void*, uint64_t address, uint64_t value, uint8_t width) {
+	if (width == 64) {
+		OutPort(address, value & 0xFFFFFFFF, 32);
+		OutPort(address + 4, value >> 32, 32);
+		return;
+	}
+
+	OutPort(address, value, width);
+}
+
+static AML_RegionHandler RegionHandlers[AML_REGION_SPACE_COUNT] = {
+	[AML_REGION_SYSTEM_MEMORY] = { SystemMemoryRead, SystemMemoryWrite, NULL },
+	[AML_REGION_SYSTEM_IO] = { SystemIORead, SystemIOWrite, NULL },
+};
+
+/* Recording or replaying, NULL most of the time */
+static AML_RegionTrace *RegionTrace = NULL;
+/* Accesses holding the trace, SetRegionTrace waits for them to leave */
+static uint32_t RegionTraceUsers = 0;
+
+static inline uint64_t RegionHandlerRead(uint8_t space, uint64_t address, uint8_t width) {
+	AML_RegionHandler *handler = FindRegionHandler(space);
+	if (handler == NULL || handler->Read == NULL) return 0;
+
+	return handler->Read(handler->Context, address, width);
+}
+
+static inline void RegionHandlerWrite(uint8_t space, uint64_t address, uint64_t value, uint8_t width) {
+	AML_RegionHandler *handler = FindRegionHandler(space);
+	if (handler == NULL || handler->Write == NULL) return;
+
+	handler->Write(handler->Context, address, value, width);
+}
+
+void InstallRegionHandler(uint8_t space, AML_RegionReadHandler read, AML_RegionWriteHandler write, void *context) {
+	if (space >= AML_REGION_SPACE_COUNT) return;
+
+	RegionHandlers[space].Read = read;
+	RegionHandlers[space].Write = write;
+	RegionHandlers[space].Context = context;
+}
+
+AML_RegionHandler *FindRegionHandler(uint8_t space) {
+	if (space >= AML_REGION_SPACE_COUNT) return NULL;
+
+	return &RegionHandlers[space];
+}
+
+void SetRegionTrace(AML_RegionTrace *trace) {
+	__atomic_store_n(&RegionTrace, trace, __ATOMIC_SEQ_CST);
+
+	/* Accesses starting from now see the new trace, only ones already holding the old one are waited for */
+	while (__atomic_load_n(&RegionTraceUsers, __ATOMIC_SEQ_CST) != 0) CpuRelax();
+}
+
+/* Pins the trace so SetRegionTrace cannot return while we use it, NULL if it went away meanwhile */
+static AML_RegionTrace *HoldRegionTrace() {
+	__atomic_fetch_add(&RegionTraceUsers, 1, __ATOMIC_SEQ_CST);
+
+	AML_RegionTrace *trace = __atomic_load_n(&RegionTrace, __ATOMIC_SEQ_CST);
+	if (trace == NULL) __atomic_fetch_sub(&RegionTraceUsers, 1, __ATOMIC_RELEASE);
+
+	return trace;
+}
+
+static void DropRegionTrace() {
+	__atomic_fetch_sub(&RegionTraceUsers, 1, __ATOMIC_RELEASE);
+}
+
+/* Only ever called with a trace set, accesses without one cost the load and branch in front of it */
+static void TraceAccess(AML_RegionTrace *trace, AML_RegionAccess *access) {
+	if (trace->Mode == REGION_TRACE_REPLAY) {
+		ReplayRegionAccess(trace, access);
+		return;
+	}
+
+	if (access->Write) {
+		RegionHandlerWrite(access->Space, access->Address, access->Value, access->Width);
+	} else {
+		access->Value = RegionHandlerRead(access->Space, access->Address, access->Width);
+	}
+
+	RecordRegionAccess(trace, access);
+}
+
+uint64_t RegionRead(uint8_t space, uint64_t address, uint8_t width) {
+	AML_RegionTrace *trace = __atomic_load_n(&RegionTrace, __ATOMIC_ACQUIRE);
+	if (trace == NULL || (trace = HoldRegionTrace()) == NULL) return RegionHandlerRead(space, address, width);
+
+	AML_RegionAccess access = { false, space, width, address, 0 };
+	TraceAccess(trace, &access);
+	DropRegionTrace();
+
+	return access.Value;
+}
+
+void RegionWrite(uint8_t space, uint64_t address, uint64_t value, uint8_t width) {
+	AML_RegionTrace *trace = __atomic_load_n(&RegionTrace, __ATOMIC_ACQUIRE);
+	if (trace == NULL || (trace = HoldRegionTrace()) == NULL) {
+		RegionHandlerWrite(space, address, value, width);
+		return;
+	}
+
+	AML_RegionAccess access = { true, space, width, address, value };
+	TraceAccess(trace, &access);
+	DropRegionTrace();
+}
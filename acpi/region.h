@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+struct AML_RegionTrace;
+
+/* Widths are expressed in bits, like InPort/OutPort */
+typedef uint64_t (*AML_RegionReadHandler)(void *context, uint64_t address, uint8_t width);
+typedef void (*AML_RegionWriteHandler)(void *context, uint64_t address, uint64_t value, uint8_t width);
+
+struct AML_RegionHandler {
+	AML_RegionReadHandler Read;
+	AML_RegionWriteHandler Write;
+	void *Context;
+};
+
+void InstallRegionHandler(uint8_t space, AML_RegionReadHandler read, AML_RegionWriteHandler write, void *context);
+AML_RegionHandler *FindRegionHandler(uint8_t space);
+
+/*
+ * Every access goes to the trace as well while recording. While replaying
+ * the handlers are never called, reads return what the trace recorded.
+ * NULL goes back to the handlers alone. Returns once no access uses the
+ * old trace, so it may be deleted then. Not to be called from a handler.
+ */
+void SetRegionTrace(AML_RegionTrace *trace);
+
+uint64_t RegionRead(uint8_t space, uint64_t address, uint8_t width);
+void RegionWrite(uint8_t space, uint64_t address, uint64_t value, uint8_t width);
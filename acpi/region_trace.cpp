@@ -0,0 +1,187 @@
+#include "region_trace.h"
+#include "memory.h"
+
+#include <mkmi.h>
+
+/* A record is at most the two leading bytes and two ten byte LEB128 numbers */
+#define REGION_RECORD_MAX 22
+#define REGION_TRACE_INITIAL_CAPACITY 4096
+
+static uint8_t WidthLog(uint8_t width) {
+	uint8_t log = 0;
+	while (log < 7 && (1u << log) < width) log++;
+
+	return log;
+}
+
+static void GrowTrace(AML_RegionTrace *trace, size_t needed) {
+	if (trace->Length + needed <= trace->Capacity) return;
+
+	size_t capacity = trace->Capacity * 2;
+	while (capacity < trace->Length + needed) capacity *= 2;
+
+	uint8_t *data = (uint8_t*)AllocateMemory(ACPI_MEMORY_RECORDING, capacity);
+	Memcpy(data, trace->Data, trace->Length);
+	FreeMemory(trace->Data);
+
+	trace->Data = data;
+	trace->Capacity = capacity;
+}
+
+static size_t WriteNumber(uint8_t *out, uint64_t number) {
+	size_t length = 0;
+
+	do {
+		uint8_t byte = number & 0x7F;
+		number >>= 7;
+		out[length++] = byte | (number != 0 ? 0x80 : 0);
+	} while (number != 0);
+
+	return length;
+}
+
+static bool ReadNumber(AML_RegionTrace *trace, size_t *position, uint64_t *number) {
+	*number = 0;
+
+	for (uint32_t shift = 0; shift < 64; shift += 7) {
+		if (*position >= trace->Length) return false;
+
+		uint8_t byte = trace->Data[(*position)++];
+		*number |= (uint64_t)(byte & 0x7F) << shift;
+
+		if (!(byte & 0x80)) return true;
+	}
+
+	return false;
+}
+
+static void InitTrace(AML_RegionTrace *trace, AML_RegionTraceMode mode, size_t capacity) {
+	trace->Mode = mode;
+	InitSpinLock(&trace->Lock);
+
+	trace->Data = (uint8_t*)AllocateMemory(ACPI_MEMORY_RECORDING, capacity);
+	trace->Length = 0;
+	trace->Capacity = capacity;
+	trace->Position = sizeof(AML_RegionTraceHeader);
+	trace->Address = 0;
+
+	trace->Stats.Records = 0;
+	trace->Stats.Mismatches = 0;
+	trace->Stats.Overruns = 0;
+}
+
+AML_RegionTrace *CreateRegionRecording() {
+	AML_RegionTrace *trace = new AML_RegionTrace;
+	InitTrace(trace, REGION_TRACE_RECORD, REGION_TRACE_INITIAL_CAPACITY);
+
+	AML_RegionTraceHeader *header = (AML_RegionTraceHeader*)trace->Data;
+	header->Magic = REGION_TRACE_MAGIC;
+	header->Version = REGION_TRACE_VERSION;
+	header->Reserved = 0;
+	header->Records = 0;
+	trace->Length = sizeof(AML_RegionTraceHeader);
+
+	return trace;
+}
+
+AML_RegionTrace *CreateRegionReplay(const uint8_t *data, size_t length) {
+	if (data == NULL || length < sizeof(AML_RegionTraceHeader)) return NULL;
+
+	const AML_RegionTraceHeader *header = (const AML_RegionTraceHeader*)data;
+	if (header->Magic != REGION_TRACE_MAGIC || header->Version != REGION_TRACE_VERSION) return NULL;
+
+	AML_RegionTrace *trace = new AML_RegionTrace;
+	InitTrace(trace, REGION_TRACE_REPLAY, length);
+
+	Memcpy(trace->Data, data, length);
+	trace->Length = length;
+	trace->Stats.Records = header->Records;
+
+	return trace;
+}
+
+void DeleteRegionTrace(AML_RegionTrace *trace) {
+	FreeMemory(trace->Data);
+	delete trace;
+}
+
+const uint8_t *GetRegionTraceData(AML_RegionTrace *trace, size_t *length) {
+	AcquireSpinLock(&trace->Lock);
+	const uint8_t *data = trace->Data;
+	*length = trace->Length;
+	ReleaseSpinLock(&trace->Lock);
+
+	return data;
+}
+
+void GetRegionTraceStats(AML_RegionTrace *trace, AML_RegionTraceStats *stats) {
+	AcquireSpinLock(&trace->Lock);
+	*stats = trace->Stats;
+	ReleaseSpinLock(&trace->Lock);
+}
+
+void RecordRegionAccess(AML_RegionTrace *trace, AML_RegionAccess *access) {
+	uint8_t record[REGION_RECORD_MAX];
+
+	AcquireSpinLock(&trace->Lock);
+
+	record[0] = (access->Write ? REGION_TRACE_WRITE : 0) | WidthLog(access->Width) << 1;
+	record[1] = access->Space;
+
+	/* Firmware walks registers next to each other, deltas keep addresses to a byte or two */
+	int64_t delta = (int64_t)(access->Address - trace->Address);
+	size_t length = 2;
+	length += WriteNumber(&record[length], ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+	length += WriteNumber(&record[length], access->Value);
+
+	GrowTrace(trace, length);
+	Memcpy(&trace->Data[trace->Length], record, length);
+	trace->Length += length;
+	trace->Address = access->Address;
+
+	trace->Stats.Records++;
+	((AML_RegionTraceHeader*)trace->Data)->Records = trace->Stats.Records;
+
+	ReleaseSpinLock(&trace->Lock);
+}
+
+void ReplayRegionAccess(AML_RegionTrace *trace, AML_RegionAccess *access) {
+	AcquireSpinLock(&trace->Lock);
+
+	/* Past the leading bytes, which are only looked at once the record turned out complete */
+	size_t position = trace->Position + 2;
+	uint64_t delta, value;
+
+	if (position > trace->Length || !ReadNumber(trace, &position, &delta) || !ReadNumber(trace, &position, &value)) {
+		trace->Stats.Overruns++;
+		ReleaseSpinLock(&trace->Lock);
+
+		if (!access->Write) access->Value = 0;
+		return;
+	}
+
+	uint8_t kind = trace->Data[trace->Position];
+	uint8_t space = trace->Data[trace->Position + 1];
+	uint64_t address = trace->Address + ((delta >> 1) ^ -(delta & 1));
+
+	bool same = (kind & REGION_TRACE_WRITE) == (access->Write ? REGION_TRACE_WRITE : 0) &&
+		    (kind >> 1 & 0x07) == WidthLog(access->Width) &&
+		    space == access->Space &&
+		    address == access->Address;
+
+	/* The interpreter went somewhere the recorded one did not, the trace waits for it to come back */
+	if (!same) {
+		trace->Stats.Mismatches++;
+		ReleaseSpinLock(&trace->Lock);
+
+		if (!access->Write) access->Value = 0;
+		return;
+	}
+
+	trace->Position = position;
+	trace->Address = address;
+
+	ReleaseSpinLock(&trace->Lock);
+
+	if (!access->Write) access->Value = value;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sync.h"
+
+/* "ARTR" */
+#define REGION_TRACE_MAGIC 0x52545241
+#define REGION_TRACE_VERSION 2
+
+/*
+ * A header followed by one record per access. A record starts with a byte
+ * holding the direction in bit 0 and log2 of the width in bits 1 to 3, then
+ * a byte with the space, so OEM spaces from 0x80 up keep their number. The
+ * address follows as a zigzag LEB128 delta from the previous record's, then
+ * the value as plain LEB128.
+ */
+struct AML_RegionTraceHeader {
+	uint32_t Magic;
+	uint16_t Version;
+	uint16_t Reserved;
+	uint64_t Records;
+} __attribute__((packed));
+
+#define REGION_TRACE_WRITE 0x01
+
+enum AML_RegionTraceMode {
+	REGION_TRACE_RECORD,
+	REGION_TRACE_REPLAY,
+};
+
+struct AML_RegionAccess {
+	bool Write;
+	uint8_t Space;
+	uint8_t Width;
+	uint64_t Address;
+	uint64_t Value;
+};
+
+struct AML_RegionTraceStats {
+	uint64_t Records;
+	/* Replayed accesses that were not the next one in the trace, they read 0 and the trace stays put */
+	uint64_t Mismatches;
+	/* Accesses after the trace ran out, they read 0 */
+	uint64_t Overruns;
+};
+
+struct AML_RegionTrace {
+	AML_RegionTraceMode Mode;
+	/* Cores may access regions at the same time, records go in one at a time */
+	AML_SpinLock Lock;
+
+	/* Header included */
+	uint8_t *Data;
+	size_t Length;
+	size_t Capacity;
+	/* Where replay reads the next record */
+	size_t Position;
+	uint64_t Address;
+
+	AML_RegionTraceStats Stats;
+};
+
+AML_RegionTrace *CreateRegionRecording();
+/* Replays a trace some recording produced, NULL if it is not one. The data is copied */
+AML_RegionTrace *CreateRegionReplay(const uint8_t *data, size_t length);
+void DeleteRegionTrace(AML_RegionTrace *trace);
+
+/* What a recording produced so far, ready to be written out. Recording more may move it */
+const uint8_t *GetRegionTraceData(AML_RegionTrace *trace, size_t *length);
+void GetRegionTraceStats(AML_RegionTrace *trace, AML_RegionTraceStats *stats);
+
+void RecordRegionAccess(AML_RegionTrace *trace, AML_RegionAccess *access);
+/* Fills in the value of a read, a write is only checked against the trace */
+void ReplayRegionAccess(AML_RegionTrace *trace, AML_RegionAccess *access);
@@ -0,0 +1,259 @@
+#include "resource.h"
+
+#include <mkmi.h>
+
+/* Small resource items, see ACPI spec section 6.4.2 */
+#define SMALL_IRQ 0x04
+#define SMALL_DMA 0x05
+#define SMALL_IO 0x08
+#define SMALL_FIXED_IO 0x09
+#define SMALL_END_TAG 0x0F
+
+/* Large resource items, see ACPI spec section 6.4.3 */
+#define LARGE_MEMORY32 0x05
+#define LARGE_FIXED_MEMORY32 0x06
+#define LARGE_DWORD_ADDRESS 0x07
+#define LARGE_WORD_ADDRESS 0x08
+#define LARGE_EXTENDED_IRQ 0x09
+#define LARGE_QWORD_ADDRESS 0x0A
+#define LARGE_GPIO 0x0C
+
+static inline uint16_t Read16(const uint8_t *data) {
+	return data[0] | (data[1] << 8);
+}
+
+static inline uint32_t Read32(const uint8_t *data) {
+	return (uint32_t)Read16(data) | ((uint32_t)Read16(data + 2) << 16);
+}
+
+static inline uint64_t Read64(const uint8_t *data) {
+	return (uint64_t)Read32(data) | ((uint64_t)Read32(data + 4) << 32);
+}
+
+static bool DecodeSmall(const uint8_t *data, uint8_t length, AML_Resource *resource) {
+	uint8_t item = (data[0] >> 3) & 0x0F;
+
+	switch (item) {
+		case SMALL_IRQ:
+			if (length < 2) return false;
+			resource->Type = RESOURCE_IRQ;
+			resource->Irq.Mask = Read16(&data[1]);
+			resource->Flags = AML_RESOURCE_EDGE;
+
+			if (length >= 3) {
+				uint8_t info = data[3];
+				resource->Flags = 0;
+				if (info & 0x01) resource->Flags |= AML_RESOURCE_EDGE;
+				if (info & 0x08) resource->Flags |= AML_RESOURCE_ACTIVE_LOW;
+				if (info & 0x10) resource->Flags |= AML_RESOURCE_SHARED;
+				if (info & 0x20) resource->Flags |= AML_RESOURCE_WAKE;
+			}
+			return true;
+		case SMALL_DMA:
+			if (length < 2) return false;
+			resource->Type = RESOURCE_DMA;
+			resource->Dma.Mask = data[1];
+			resource->Dma.Info = data[2];
+			return true;
+		case SMALL_IO:
+			if (length < 7) return false;
+			resource->Type = RESOURCE_IO;
+			resource->Range.Minimum = Read16(&data[2]);
+			resource->Range.Maximum = Read16(&data[4]);
+			resource->Range.Alignment = data[6];
+			resource->Range.Length = data[7];
+			return true;
+		case SMALL_FIXED_IO:
+			if (length < 3) return false;
+			resource->Type = RESOURCE_FIXED_IO;
+			resource->Range.Minimum = Read16(&data[1]) & 0x3FF;
+			resource->Range.Maximum = resource->Range.Minimum;
+			resource->Range.Alignment = 1;
+			resource->Range.Length = data[3];
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void DecodeAddressFlags(const uint8_t *data, AML_Resource *resource) {
+	resource->Address.Kind = data[3];
+	resource->Address.SpecificFlags = data[5];
+
+	if (data[4] & 0x01) resource->Flags |= AML_RESOURCE_CONSUMER;
+	if (data[3] == AML_RESOURCE_MEMORY_RANGE && (data[5] & 0x01)) resource->Flags |= AML_RESOURCE_WRITEABLE;
+}
+
+static bool DecodeLarge(const uint8_t *data, uint16_t length, AML_Resource *resource) {
+	uint8_t item = data[0] & 0x7F;
+
+	switch (item) {
+		case LARGE_MEMORY32:
+			if (length < 17) return false;
+			resource->Type = RESOURCE_MEMORY32;
+			resource->Flags = (data[3] & 0x01) ? AML_RESOURCE_WRITEABLE : 0;
+			resource->Range.Minimum = Read32(&data[4]);
+			resource->Range.Maximum = Read32(&data[8]);
+			resource->Range.Alignment = Read32(&data[12]);
+			resource->Range.Length = Read32(&data[16]);
+			return true;
+		case LARGE_FIXED_MEMORY32:
+			if (length < 9) return false;
+			resource->Type = RESOURCE_FIXED_MEMORY32;
+			resource->Flags = (data[3] & 0x01) ? AML_RESOURCE_WRITEABLE : 0;
+			resource->Range.Minimum = Read32(&data[4]);
+			resource->Range.Length = Read32(&data[8]);
+			resource->Range.Maximum = resource->Range.Minimum + resource->Range.Length - 1;
+			resource->Range.Alignment = 1;
+			return true;
+		case LARGE_WORD_ADDRESS:
+			if (length < 13) return false;
+			resource->Type = RESOURCE_ADDRESS16;
+			DecodeAddressFlags(data, resource);
+			resource->Address.Granularity = Read16(&data[6]);
+			resource->Address.Minimum = Read16(&data[8]);
+			resource->Address.Maximum = Read16(&data[10]);
+			resource->Address.Translation = Read16(&data[12]);
+			resource->Address.Length = Read16(&data[14]);
+			return true;
+		case LARGE_DWORD_ADDRESS:
+			if (length < 23) return false;
+			resource->Type = RESOURCE_ADDRESS32;
+			DecodeAddressFlags(data, resource);
+			resource->Address.Granularity = Read32(&data[6]);
+			resource->Address.Minimum = Read32(&data[10]);
+			resource->Address.Maximum = Read32(&data[14]);
+			resource->Address.Translation = Read32(&data[18]);
+			resource->Address.Length = Read32(&data[22]);
+			return true;
+		case LARGE_QWORD_ADDRESS:
+			if (length < 43) return false;
+			resource->Type = RESOURCE_ADDRESS64;
+			DecodeAddressFlags(data, resource);
+			resource->Address.Granularity = Read64(&data[6]);
+			resource->Address.Minimum = Read64(&data[14]);
+			resource->Address.Maximum = Read64(&data[22]);
+			resource->Address.Translation = Read64(&data[30]);
+			resource->Address.Length = Read64(&data[38]);
+			return true;
+		case LARGE_EXTENDED_IRQ: {
+			if (length < 6) return false;
+			uint8_t info = data[3];
+			resource->Type = RESOURCE_EXTENDED_IRQ;
+			if (info & 0x01) resource->Flags |= AML_RESOURCE_CONSUMER;
+			if (info & 0x02) resource->Flags |= AML_RESOURCE_EDGE;
+			if (info & 0x04) resource->Flags |= AML_RESOURCE_ACTIVE_LOW;
+			if (info & 0x08) resource->Flags |= AML_RESOURCE_SHARED;
+			if (info & 0x10) resource->Flags |= AML_RESOURCE_WAKE;
+			resource->ExtendedIrq.Count = data[4];
+			if (length < 2 + data[4] * 4) resource->ExtendedIrq.Count = (length - 2) / 4;
+			resource->ExtendedIrq.First = Read32(&data[5]);
+			}
+			return true;
+		case LARGE_GPIO: {
+			if (length < 20) return false;
+			uint16_t pinTable = Read16(&data[14]);
+			uint16_t sourceName = Read16(&data[17]);
+			uint16_t flags = Read16(&data[7]);
+			resource->Type = RESOURCE_GPIO;
+			resource->Gpio.ConnectionType = data[4];
+			resource->Gpio.PinConfig = data[9];
+			resource->Gpio.DebounceTimeout = Read16(&data[12]);
+
+			/* Offsets count from the start of the descriptor, the pin table has to lie within it */
+			size_t end = sourceName < length + 3 ? sourceName : length + 3;
+			resource->Gpio.PinCount = pinTable >= 23 && end > pinTable ? (end - pinTable) / 2 : 0;
+			resource->Gpio.FirstPin = resource->Gpio.PinCount ? Read16(&data[pinTable]) : 0;
+
+			/* Interrupt connections carry the same polarity bits as Extended IRQ */
+			if (data[4] == 0) {
+				if (flags & 0x01) resource->Flags |= AML_RESOURCE_EDGE;
+				if ((flags >> 1) & 0x01) resource->Flags |= AML_RESOURCE_ACTIVE_LOW;
+				if (flags & 0x08) resource->Flags |= AML_RESOURCE_SHARED;
+				if (flags & 0x10) resource->Flags |= AML_RESOURCE_WAKE;
+			}
+			if (Read16(&data[5]) & 0x01) resource->Flags |= AML_RESOURCE_CONSUMER;
+			}
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Walks a resource template once. When resources is NULL it only counts the
+ * descriptors we know about, so callers can size a single allocation.
+ */
+size_t DecodeResources(const uint8_t *buffer, size_t length, AML_Resource *resources) {
+	size_t count = 0;
+	size_t idx = 0;
+
+	while (idx < length) {
+		const uint8_t *data = &buffer[idx];
+		AML_Resource resource;
+		bool known;
+
+		resource.Flags = 0;
+		resource.Raw = data;
+
+		if (data[0] & 0x80) {
+			if (idx + 3 > length) break;
+
+			uint16_t itemLength = Read16(&data[1]);
+			if (idx + 3 + itemLength > length) break;
+
+			known = DecodeLarge(data, itemLength, &resource);
+			idx += 3 + itemLength;
+		} else {
+			uint8_t itemLength = data[0] & 0x07;
+			if (((data[0] >> 3) & 0x0F) == SMALL_END_TAG) break;
+			if (idx + 1 + itemLength > length) break;
+
+			known = DecodeSmall(data, itemLength, &resource);
+			idx += 1 + itemLength;
+		}
+
+		if (!known) continue;
+
+		if (resources != NULL) resources[count] = resource;
+		count++;
+	}
+
+	return count;
+}
+
+AML_ResourceList *CreateResourceList(const uint8_t *buffer, size_t length) {
+	AML_ResourceList *list = new AML_ResourceList;
+
+	/* The buffer may be a method result that is released right after */
+	list->Data = new uint8_t[length != 0 ? length : 1];
+	Memcpy(list->Data, buffer, length);
+
+	list->Count = DecodeResources(list->Data, length, NULL);
+	list->Resources = NULL;
+
+	if (list->Count != 0) {
+		list->Resources = new AML_Resource[list->Count];
+		DecodeResources(list->Data, length, list->Resources);
+	}
+
+	return list;
+}
+
+void DeleteResourceList(AML_ResourceList *list) {
+	delete[] list->Resources;
+	delete[] list->Data;
+	delete list;
+}
+
+uint32_t GetExtendedIrq(AML_Resource *resource, uint8_t index) {
+	if (resource->Type != RESOURCE_EXTENDED_IRQ || index >= resource->ExtendedIrq.Count) return 0;
+
+	return Read32(&resource->Raw[5 + index * 4]);
+}
+
+uint16_t GetGpioPin(AML_Resource *resource, uint16_t index) {
+	if (resource->Type != RESOURCE_GPIO || index >= resource->Gpio.PinCount) return 0;
+
+	return Read16(&resource->Raw[Read16(&resource->Raw[14]) + index * 2]);
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+enum AML_ResourceType {
+	RESOURCE_IRQ,
+	RESOURCE_DMA,
+	RESOURCE_IO,
+	RESOURCE_FIXED_IO,
+	RESOURCE_MEMORY32,
+	RESOURCE_FIXED_MEMORY32,
+	RESOURCE_ADDRESS16,
+	RESOURCE_ADDRESS32,
+	RESOURCE_ADDRESS64,
+	RESOURCE_EXTENDED_IRQ,
+	RESOURCE_GPIO,
+};
+
+/* Interrupt flags */
+#define AML_RESOURCE_EDGE 0x01
+#define AML_RESOURCE_ACTIVE_LOW 0x02
+#define AML_RESOURCE_SHARED 0x04
+#define AML_RESOURCE_WAKE 0x08
+/* Address and memory flags */
+#define AML_RESOURCE_CONSUMER 0x10
+#define AML_RESOURCE_WRITEABLE 0x20
+
+/* Address space descriptor kinds */
+#define AML_RESOURCE_MEMORY_RANGE 0x00
+#define AML_RESOURCE_IO_RANGE 0x01
+#define AML_RESOURCE_BUS_RANGE 0x02
+
+struct AML_Resource {
+	AML_ResourceType Type;
+	uint8_t Flags;
+
+	/* The descriptor inside the original buffer, for variable length data */
+	const uint8_t *Raw;
+
+	union {
+		struct {
+			uint16_t Mask;
+		} Irq;
+
+		struct {
+			uint8_t Mask;
+			uint8_t Info;
+		} Dma;
+
+		/* IO, fixed IO, Memory32 and fixed Memory32 */
+		struct {
+			uint64_t Minimum;
+			uint64_t Maximum;
+			uint64_t Alignment;
+			uint64_t Length;
+		} Range;
+
+		/* Word, DWord and QWord address space */
+		struct {
+			uint8_t Kind;
+			uint8_t SpecificFlags;
+			uint64_t Granularity;
+			uint64_t Minimum;
+			uint64_t Maximum;
+			uint64_t Translation;
+			uint64_t Length;
+		} Address;
+
+		struct {
+			uint8_t Count;
+			uint32_t First;
+		} ExtendedIrq;
+
+		struct {
+			uint8_t ConnectionType;
+			uint8_t PinConfig;
+			uint16_t DebounceTimeout;
+			uint16_t PinCount;
+			uint16_t FirstPin;
+		} Gpio;
+	};
+};
+
+struct AML_ResourceList {
+	size_t Count;
+	AML_Resource *Resources;
+	/* Private copy of the template, Raw points in here */
+	uint8_t *Data;
+};
+
+size_t DecodeResources(const uint8_t *buffer, size_t length, AML_Resource *resources);
+AML_ResourceList *CreateResourceList(const uint8_t *buffer, size_t length);
+void DeleteResourceList(AML_ResourceList *list);
+
+uint32_t GetExtendedIrq(AML_Resource *resource, uint8_t index);
+uint16_t GetGpioPin(AML_Resource *resource, uint16_t index);
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+static inline void CpuRelax() {
+#if defined(__x86_64__)
+	asm volatile("pause" ::: "memory");
+#elif defined(__aarch64__)
+	asm volatile("yield" ::: "memory");
+#endif
+}
+
+struct AML_SpinLock {
+	volatile uint8_t Locked;
+};
+
+static inline void InitSpinLock(AML_SpinLock *lock) {
+	lock->Locked = 0;
+}
+
+static inline void AcquireSpinLock(AML_SpinLock *lock) {
+	while (__atomic_test_and_set(&lock->Locked, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&lock->Locked, __ATOMIC_RELAXED)) CpuRelax();
+	}
+}
+
+static inline bool TryAcquireSpinLock(AML_SpinLock *lock) {
+	return !__atomic_test_and_set(&lock->Locked, __ATOMIC_ACQUIRE);
+}
+
+static inline void ReleaseSpinLock(AML_SpinLock *lock) {
+	__atomic_clear(&lock->Locked, __ATOMIC_RELEASE);
+}
+
+/* Recursive for its owner, which is whatever identifies the running thread of execution */
+struct AML_Mutex {
+	void *Owner;
+	uint32_t Depth;
+	uint8_t SyncLevel;
+
+	/* Only touched by the owner, for the list of mutexes it holds */
+	uint8_t PreviousSyncLevel;
+	AML_Mutex *NextHeld;
+};
+
+static inline void InitMutex(AML_Mutex *mutex, uint8_t syncLevel) {
+	mutex->Owner = NULL;
+	mutex->Depth = 0;
+	mutex->SyncLevel = syncLevel;
+	mutex->PreviousSyncLevel = 0;
+	mutex->NextHeld = NULL;
+}
+
+static inline bool TryAcquireMutex(AML_Mutex *mutex, void *owner) {
+	if (__atomic_load_n(&mutex->Owner, __ATOMIC_RELAXED) == owner) {
+		mutex->Depth++;
+		return true;
+	}
+
+	void *expected = NULL;
+	if (!__atomic_compare_exchange_n(&mutex->Owner, &expected, owner, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return false;
+
+	mutex->Depth = 1;
+	return true;
+}
+
+static inline void AcquireMutex(AML_Mutex *mutex, void *owner) {
+	while (!TryAcquireMutex(mutex, owner)) {
+		while (__atomic_load_n(&mutex->Owner, __ATOMIC_RELAXED) != NULL) CpuRelax();
+	}
+}
+
+static inline void ReleaseMutex(AML_Mutex *mutex) {
+	if (--mutex->Depth == 0) __atomic_store_n(&mutex->Owner, (void*)NULL, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,310 @@
+#include "thermal.h"
+#include "aml_executive.h"
+#include "namespace.h"
+#include "notify.h"
+#include "timer_wheel.h"
+#include "trace.h"
+
+#include <mkmi.h>
+
+/* _TSP and _TZP are in tenths of a second */
+#define THERMAL_PERIOD_NS 100000000ull
+
+static inline uint64_t Min(uint64_t a, uint64_t b) {
+	return a < b ? a : b;
+}
+
+static uint64_t Now(ACPI_ThermalMonitor *monitor) {
+	return ReadTimerWheelNanoseconds(monitor->Executive->GetTimerWheel());
+}
+
+static uint64_t EvaluateObject(AMLExecutive *executive, AML_NamespaceNode *zone, const char *name) {
+	uint64_t value;
+	AML_NamespaceNode *node = FindChild(zone, name);
+
+	if (node == NULL || !executive->EvaluateInteger(node, &value)) return THERMAL_TRIP_NONE;
+
+	return value;
+}
+
+static void RefreshTrips(ACPI_ThermalMonitor *monitor, ACPI_ThermalZone *zone) {
+	AMLExecutive *executive = monitor->Executive;
+
+	zone->Passive = EvaluateObject(executive, zone->Node, "_PSV");
+	zone->Hot = EvaluateObject(executive, zone->Node, "_HOT");
+	zone->Critical = EvaluateObject(executive, zone->Node, "_CRT");
+
+	uint64_t sampling = EvaluateObject(executive, zone->Node, "_TSP");
+	zone->SamplingNs = sampling == THERMAL_TRIP_NONE ? 0 : sampling * THERMAL_PERIOD_NS;
+
+	uint64_t polling = EvaluateObject(executive, zone->Node, "_TZP");
+	zone->NotifiesOnly = polling == 0;
+	zone->PollingNs = polling == THERMAL_TRIP_NONE ? 0 : polling * THERMAL_PERIOD_NS;
+}
+
+static ACPI_ThermalState ZoneState(ACPI_ThermalZone *zone) {
+	if (zone->Critical != THERMAL_TRIP_NONE && zone->Temperature >= zone->Critical) return THERMAL_CRITICAL;
+	if (zone->Hot != THERMAL_TRIP_NONE && zone->Temperature >= zone->Hot) return THERMAL_HOT;
+	if (zone->Passive != THERMAL_TRIP_NONE && zone->Temperature >= zone->Passive) return THERMAL_PASSIVE;
+
+	return THERMAL_NORMAL;
+}
+
+/* The closer the nearest trip point, the shorter the interval */
+static uint64_t ZoneInterval(ACPI_ThermalZone *zone) {
+	if (zone->State != THERMAL_NORMAL) return zone->SamplingNs != 0 ? zone->SamplingNs : THERMAL_MIN_INTERVAL_NS;
+	if (zone->NotifiesOnly) return THERMAL_NEVER;
+
+	uint64_t slowest = zone->PollingNs != 0 ? zone->PollingNs : THERMAL_MAX_INTERVAL_NS;
+	uint64_t trip = Min(zone->Passive, Min(zone->Hot, zone->Critical));
+
+	if (trip == THERMAL_TRIP_NONE || trip - zone->Temperature >= THERMAL_COLD_MARGIN) return slowest;
+	if (slowest <= THERMAL_MIN_INTERVAL_NS) return slowest;
+
+	return THERMAL_MIN_INTERVAL_NS + (slowest - THERMAL_MIN_INTERVAL_NS) * (trip - zone->Temperature) / THERMAL_COLD_MARGIN;
+}
+
+static void RefreshZone(ACPI_ThermalMonitor *monitor, ACPI_ThermalZone *zone, uint8_t refresh, uint64_t now) {
+	if (refresh & THERMAL_REFRESH_TRIPS) RefreshTrips(monitor, zone);
+
+	if (refresh & THERMAL_REFRESH_TEMPERATURE) {
+		uint64_t temperature = EvaluateObject(monitor->Executive, zone->Node, "_TMP");
+		monitor->Stats.Evaluations++;
+
+		/* A failed read keeps the last known temperature */
+		if (temperature != THERMAL_TRIP_NONE) zone->Temperature = temperature;
+		else monitor->Stats.Errors++;
+	}
+
+	ACPI_ThermalState previous = zone->State;
+	zone->State = ZoneState(zone);
+
+	if (zone->State != previous) {
+		monitor->Stats.StateChanges++;
+		Trace(zone->State >= THERMAL_HOT ? ACPI_TRACE_WARNING : ACPI_TRACE_INFO, TRACE_THERMAL_STATE,
+		      TraceTag(zone->Node->Name, 4), zone->State, zone->Temperature);
+
+		if (monitor->Handler != NULL) monitor->Handler(zone, previous, monitor->Context);
+	}
+
+	zone->IntervalNs = ZoneInterval(zone);
+	zone->NextPollNs = zone->IntervalNs == THERMAL_NEVER ? THERMAL_NEVER : now + zone->IntervalNs;
+}
+
+/*
+ * One pass evaluates every zone that is due within the batch slack, so zones
+ * drifting apart by a little still share a wakeup. Notify only marks zones
+ * and leaves the evaluation to whoever holds the lock.
+ */
+static void RunPasses(ACPI_ThermalMonitor *monitor) {
+	while (TryAcquireSpinLock(&monitor->Lock)) {
+		__atomic_store_n(&monitor->Pending, false, __ATOMIC_RELAXED);
+
+		uint64_t now = Now(monitor);
+		uint64_t next = THERMAL_NEVER;
+
+		for (size_t i = 0; i < monitor->Count; ++i) {
+			ACPI_ThermalZone *zone = &monitor->Zones[i];
+			uint8_t refresh = __atomic_exchange_n(&zone->Pending, 0, __ATOMIC_ACQUIRE);
+			if (zone->Node == NULL) continue;
+
+			if (zone->NextPollNs != THERMAL_NEVER && zone->NextPollNs <= now + THERMAL_BATCH_SLACK_NS) refresh |= THERMAL_REFRESH_TEMPERATURE;
+			if (refresh != 0) RefreshZone(monitor, zone, refresh, now);
+
+			next = Min(next, zone->NextPollNs);
+		}
+
+		__atomic_store_n(&monitor->NextWakeNs, next, __ATOMIC_RELAXED);
+		ReleaseSpinLock(&monitor->Lock);
+
+		/* A Notify that came in after its zone was looked at */
+		if (!__atomic_load_n(&monitor->Pending, __ATOMIC_ACQUIRE)) break;
+	}
+}
+
+static void ThermalNotifyHandler(AML_NamespaceNode *node, uint32_t value, void *context) {
+	ACPI_ThermalMonitor *monitor = (ACPI_ThermalMonitor*)context;
+
+	uint8_t refresh;
+	switch (value) {
+		case AML_NOTIFY_THERMAL_STATUS:
+			refresh = THERMAL_REFRESH_TEMPERATURE;
+			break;
+		case AML_NOTIFY_THERMAL_TRIP_POINTS:
+			refresh = THERMAL_REFRESH_TRIPS | THERMAL_REFRESH_TEMPERATURE;
+			break;
+		default:
+			return;
+	}
+
+	ACPI_ThermalZone *zone = FindThermalZone(monitor, node);
+	if (zone == NULL) return;
+
+	__atomic_fetch_add(&monitor->Stats.Notifications, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_or(&zone->Pending, refresh, __ATOMIC_RELEASE);
+	__atomic_store_n(&monitor->Pending, true, __ATOMIC_RELEASE);
+
+	RunPasses(monitor);
+}
+
+static size_t CollectZones(AML_NamespaceNode *node, ACPI_ThermalZone *zones, size_t count, size_t max) {
+	if (node->Type == NODE_THERMAL_ZONE) {
+		if (zones != NULL && count >= max) return count;
+		if (zones != NULL) zones[count].Node = node;
+		count++;
+	}
+
+	for (AML_NamespaceNode *child = FirstChild(node); child != NULL; child = NextSibling(child)) {
+		count = CollectZones(child, zones, count, max);
+	}
+
+	return count;
+}
+
+static void InitZone(ACPI_ThermalZone *zone) {
+	zone->Temperature = 0;
+	zone->State = THERMAL_NORMAL;
+	zone->Pending = 0;
+}
+
+ACPI_ThermalMonitor *CreateThermalMonitor(AMLExecutive *executive) {
+	ACPI_ThermalMonitor *monitor = new ACPI_ThermalMonitor;
+	AML_NamespaceNode *root = executive->GetNamespace()->Root;
+
+	monitor->Executive = executive;
+	InitSpinLock(&monitor->Lock);
+	monitor->Handler = NULL;
+	monitor->Context = NULL;
+	monitor->Pending = false;
+
+	monitor->Stats.Wakeups = 0;
+	monitor->Stats.Evaluations = 0;
+	monitor->Stats.Notifications = 0;
+	monitor->Stats.StateChanges = 0;
+	monitor->Stats.Errors = 0;
+
+	/* Counting first lets us allocate all the zones at once, a table load in between may change the count */
+	uint32_t section = EnterNamespace(executive->GetNamespace());
+	size_t count = CollectZones(root, NULL, 0, 0);
+	monitor->Capacity = count + THERMAL_SPARE_ZONES;
+	monitor->Zones = new ACPI_ThermalZone[monitor->Capacity];
+	monitor->Count = CollectZones(root, monitor->Zones, 0, count);
+	LeaveNamespace(executive->GetNamespace(), section);
+
+	uint64_t now = Now(monitor);
+	uint64_t next = THERMAL_NEVER;
+
+	for (size_t i = 0; i < monitor->Count; ++i) {
+		ACPI_ThermalZone *zone = &monitor->Zones[i];
+
+		InitZone(zone);
+		RefreshZone(monitor, zone, THERMAL_REFRESH_TRIPS | THERMAL_REFRESH_TEMPERATURE, now);
+		next = Min(next, zone->NextPollNs);
+	}
+
+	monitor->NextWakeNs = next;
+	monitor->Subscription = SubscribeNotify(executive->GetNotifyQueue(), root, true, ThermalNotifyHandler, monitor);
+
+	Trace(ACPI_TRACE_INFO, TRACE_THERMAL_ZONES, monitor->Count);
+
+	return monitor;
+}
+
+void DeleteThermalMonitor(ACPI_ThermalMonitor *monitor) {
+	UnsubscribeNotify(monitor->Executive->GetNotifyQueue(), monitor->Subscription);
+
+	delete[] monitor->Zones;
+	delete monitor;
+}
+
+void SetThermalHandler(ACPI_ThermalMonitor *monitor, ACPI_ThermalHandler handler, void *context) {
+	AcquireSpinLock(&monitor->Lock);
+	monitor->Handler = handler;
+	monitor->Context = context;
+	ReleaseSpinLock(&monitor->Lock);
+}
+
+uint64_t RunThermalMonitor(ACPI_ThermalMonitor *monitor) {
+	__atomic_fetch_add(&monitor->Stats.Wakeups, 1, __ATOMIC_RELAXED);
+	RunPasses(monitor);
+
+	return __atomic_load_n(&monitor->NextWakeNs, __ATOMIC_RELAXED);
+}
+
+/*
+ * Zones take the slot of a removed zone or a spare one, so the array stays
+ * where FindThermalZone looks for it. Count grows only once a slot is ready.
+ */
+void AddThermalSubtree(ACPI_ThermalMonitor *monitor, AML_NamespaceNode *subtree) {
+	size_t count = CollectZones(subtree, NULL, 0, 0);
+	if (count == 0) return;
+
+	ACPI_ThermalZone *zones = new ACPI_ThermalZone[count];
+	count = CollectZones(subtree, zones, 0, count);
+
+	AcquireSpinLock(&monitor->Lock);
+
+	uint64_t now = Now(monitor);
+	uint64_t next = THERMAL_NEVER;
+	size_t added = 0, slot = 0;
+
+	for (; added < count; ++added) {
+		while (slot < monitor->Count && monitor->Zones[slot].Node != NULL) slot++;
+		if (slot == monitor->Capacity) break;
+
+		ACPI_ThermalZone *zone = &monitor->Zones[slot];
+
+		InitZone(zone);
+		__atomic_store_n(&zone->Node, zones[added].Node, __ATOMIC_RELEASE);
+		if (slot == monitor->Count) __atomic_store_n(&monitor->Count, slot + 1, __ATOMIC_RELEASE);
+
+		RefreshZone(monitor, zone, THERMAL_REFRESH_TRIPS | THERMAL_REFRESH_TEMPERATURE, now);
+	}
+
+	for (size_t i = 0; i < monitor->Count; ++i) next = Min(next, monitor->Zones[i].NextPollNs);
+
+	__atomic_store_n(&monitor->NextWakeNs, next, __ATOMIC_RELAXED);
+	ReleaseSpinLock(&monitor->Lock);
+
+	delete[] zones;
+
+	Trace(added == count ? ACPI_TRACE_INFO : ACPI_TRACE_WARNING, TRACE_THERMAL_ZONES_ADDED, added, count - added);
+}
+
+/* Passes evaluate zones with the lock held, once we have it none of them is touched again */
+void RemoveThermalSubtree(ACPI_ThermalMonitor *monitor, AML_NamespaceNode *subtree) {
+	AcquireSpinLock(&monitor->Lock);
+
+	uint64_t next = THERMAL_NEVER;
+
+	for (size_t i = 0; i < monitor->Count; ++i) {
+		ACPI_ThermalZone *zone = &monitor->Zones[i];
+
+		if (zone->Node != NULL && IsNodeInSubtree(zone->Node, subtree)) {
+			zone->Node = NULL;
+			zone->NextPollNs = THERMAL_NEVER;
+		}
+
+		next = Min(next, zone->NextPollNs);
+	}
+
+	__atomic_store_n(&monitor->NextWakeNs, next, __ATOMIC_RELAXED);
+	ReleaseSpinLock(&monitor->Lock);
+}
+
+ACPI_ThermalZone *FindThermalZone(ACPI_ThermalMonitor *monitor, AML_NamespaceNode *node) {
+	if (node == NULL) return NULL;
+
+	size_t count = __atomic_load_n(&monitor->Count, __ATOMIC_ACQUIRE);
+	for (size_t i = 0; i < count; ++i) {
+		if (__atomic_load_n(&monitor->Zones[i].Node, __ATOMIC_ACQUIRE) == node) return &monitor->Zones[i];
+	}
+
+	return NULL;
+}
+
+void GetThermalStats(ACPI_ThermalMonitor *monitor, ACPI_ThermalStats *stats) {
+	AcquireSpinLock(&monitor->Lock);
+	*stats = monitor->Stats;
+	ReleaseSpinLock(&monitor->Lock);
+}
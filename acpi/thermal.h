@@ -0,0 +1,112 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sync.h"
+
+class AMLExecutive;
+struct AML_NamespaceNode;
+struct AML_NotifySubscription;
+
+/* Thermal zone notification values, see ACPI spec section 5.6.6 */
+#define AML_NOTIFY_THERMAL_STATUS 0x80
+#define AML_NOTIFY_THERMAL_TRIP_POINTS 0x81
+#define AML_NOTIFY_THERMAL_DEVICE_LISTS 0x82
+
+/* A trip point the zone does not define */
+#define THERMAL_TRIP_NONE (~0ull)
+#define THERMAL_NEVER (~0ull)
+
+#define THERMAL_MIN_INTERVAL_NS 500000000ull
+#define THERMAL_MAX_INTERVAL_NS 30000000000ull
+/* Tenths of a Kelvin below the nearest trip point from where a zone polls at the slowest rate */
+#define THERMAL_COLD_MARGIN 200
+/* Zones due this close to a wakeup are evaluated along with it */
+#define THERMAL_BATCH_SLACK_NS 250000000ull
+/* Slots kept free for zones of tables loaded later, on top of the removed ones */
+#define THERMAL_SPARE_ZONES 16
+
+#define THERMAL_REFRESH_TEMPERATURE 0x01
+#define THERMAL_REFRESH_TRIPS 0x02
+
+enum ACPI_ThermalState {
+	THERMAL_NORMAL,
+	THERMAL_PASSIVE,
+	THERMAL_HOT,
+	THERMAL_CRITICAL,
+};
+
+struct ACPI_ThermalZone {
+	/* NULL once its table was unloaded */
+	AML_NamespaceNode *Node;
+
+	/* All in tenths of a Kelvin, as the firmware reports them */
+	uint64_t Temperature;
+	uint64_t Passive;
+	uint64_t Hot;
+	uint64_t Critical;
+
+	/* _TSP while cooling passively, _TZP otherwise. Zero when missing */
+	uint64_t SamplingNs;
+	uint64_t PollingNs;
+	/* _TZP returned zero, the zone sends Notify on its own and is never polled */
+	bool NotifiesOnly;
+
+	ACPI_ThermalState State;
+	uint64_t IntervalNs;
+	uint64_t NextPollNs;
+
+	/* THERMAL_REFRESH bits set by Notify, picked up by the next pass */
+	uint8_t Pending;
+};
+
+/* Called on every state change, with the monitor lock held */
+typedef void (*ACPI_ThermalHandler)(ACPI_ThermalZone *zone, ACPI_ThermalState previous, void *context);
+
+struct ACPI_ThermalStats {
+	uint64_t Wakeups;
+	uint64_t Evaluations;
+	uint64_t Notifications;
+	uint64_t StateChanges;
+	uint64_t Errors;
+};
+
+struct ACPI_ThermalMonitor {
+	AMLExecutive *Executive;
+
+	AML_SpinLock Lock;
+	/* Never moves, zones are added in place up to Capacity */
+	ACPI_ThermalZone *Zones;
+	size_t Count;
+	size_t Capacity;
+
+	/* Earliest NextPollNs of any zone, the one timer the host needs to arm */
+	uint64_t NextWakeNs;
+	/* Some zone has Pending bits, another pass is needed */
+	bool Pending;
+
+	ACPI_ThermalHandler Handler;
+	void *Context;
+
+	AML_NotifySubscription *Subscription;
+	ACPI_ThermalStats Stats;
+};
+
+ACPI_ThermalMonitor *CreateThermalMonitor(AMLExecutive *executive);
+void DeleteThermalMonitor(ACPI_ThermalMonitor *monitor);
+
+void SetThermalHandler(ACPI_ThermalMonitor *monitor, ACPI_ThermalHandler handler, void *context);
+
+/*
+ * Evaluates every zone that is due, or nearly so, in one go.
+ * Returns when it wants to be called again, THERMAL_NEVER if no zone polls.
+ */
+uint64_t RunThermalMonitor(ACPI_ThermalMonitor *monitor);
+
+/* Starts polling zones under subtree, call it once the subtree is in the namespace */
+void AddThermalSubtree(ACPI_ThermalMonitor *monitor, AML_NamespaceNode *subtree);
+/* Stops polling zones under subtree, call it before the subtree leaves the namespace */
+void RemoveThermalSubtree(ACPI_ThermalMonitor *monitor, AML_NamespaceNode *subtree);
+
+ACPI_ThermalZone *FindThermalZone(ACPI_ThermalMonitor *monitor, AML_NamespaceNode *node);
+void GetThermalStats(ACPI_ThermalMonitor *monitor, ACPI_ThermalStats *stats);
@@ -0,0 +1,186 @@
+#include "timer_wheel.h"
+#include "hpet.h"
+
+#include <mkmi.h>
+
+/* Long enough to average out the cost of reading the counter */
+#define CALIBRATION_LOOPS 100000
+
+static void DefaultYield(void*) {
+	CpuRelax();
+}
+
+static void Calibrate(AML_TimerWheel *wheel) {
+	wheel->LoopsPerUs = AML_DEFAULT_LOOPS_PER_US;
+	if (wheel->Clock == NULL) return;
+
+	uint64_t start = ReadHPETNanoseconds(wheel->Clock);
+	for (size_t i = 0; i < CALIBRATION_LOOPS; ++i) CpuRelax();
+	uint64_t elapsed = ReadHPETNanoseconds(wheel->Clock) - start;
+
+	if (elapsed != 0) wheel->LoopsPerUs = (CALIBRATION_LOOPS * 1000ull) / elapsed;
+	if (wheel->LoopsPerUs == 0) wheel->LoopsPerUs = 1;
+}
+
+AML_TimerWheel *CreateTimerWheel(HPET_Clock *clock) {
+	AML_TimerWheel *wheel = new AML_TimerWheel;
+
+	InitSpinLock(&wheel->Lock);
+	for (size_t i = 0; i < AML_WHEEL_SLOTS; ++i) wheel->Slots[i] = NULL;
+
+	wheel->Yield = DefaultYield;
+	wheel->YieldContext = NULL;
+	wheel->VirtualNs = 0;
+
+	SetTimerWheelClock(wheel, clock);
+
+	return wheel;
+}
+
+void DeleteTimerWheel(AML_TimerWheel *wheel) {
+	delete wheel;
+}
+
+void SetTimerWheelClock(AML_TimerWheel *wheel, HPET_Clock *clock) {
+	wheel->Clock = clock;
+	wheel->Current = ReadTimerWheelNanoseconds(wheel) / AML_WHEEL_TICK_NS;
+
+	Calibrate(wheel);
+}
+
+void SetYieldHandler(AML_TimerWheel *wheel, AML_YieldHandler handler, void *context) {
+	wheel->YieldContext = context;
+	wheel->Yield = handler != NULL ? handler : DefaultYield;
+}
+
+uint64_t ReadTimerWheelNanoseconds(AML_TimerWheel *wheel) {
+	if (wheel->Clock != NULL) return ReadHPETNanoseconds(wheel->Clock);
+
+	return __atomic_load_n(&wheel->VirtualNs, __ATOMIC_RELAXED);
+}
+
+void AddTimer(AML_TimerWheel *wheel, AML_Timer *timer, uint64_t deadline) {
+	timer->Deadline = deadline;
+	timer->Fired = false;
+
+	AcquireSpinLock(&wheel->Lock);
+
+	/* Already behind the wheel, it would only be seen once the slot comes around again */
+	if (deadline / AML_WHEEL_TICK_NS < wheel->Current) {
+		timer->Fired = true;
+	} else {
+		AML_Timer **slot = &wheel->Slots[(deadline / AML_WHEEL_TICK_NS) % AML_WHEEL_SLOTS];
+		timer->Next = *slot;
+		*slot = timer;
+	}
+
+	ReleaseSpinLock(&wheel->Lock);
+}
+
+void CancelTimer(AML_TimerWheel *wheel, AML_Timer *timer) {
+	AcquireSpinLock(&wheel->Lock);
+
+	if (!timer->Fired) {
+		AML_Timer **link = &wheel->Slots[(timer->Deadline / AML_WHEEL_TICK_NS) % AML_WHEEL_SLOTS];
+		while (*link != NULL && *link != timer) link = &(*link)->Next;
+		if (*link != NULL) *link = timer->Next;
+	}
+
+	ReleaseSpinLock(&wheel->Lock);
+}
+
+/* One clock read wakes every parked evaluation that is due */
+void AdvanceTimerWheel(AML_TimerWheel *wheel) {
+	/* Someone else is already doing it */
+	if (!TryAcquireSpinLock(&wheel->Lock)) return;
+
+	uint64_t now = ReadTimerWheelNanoseconds(wheel);
+	uint64_t tick = now / AML_WHEEL_TICK_NS;
+
+	/* Past one full turn every slot has been visited anyway */
+	uint64_t first = wheel->Current;
+	if (tick - first >= AML_WHEEL_SLOTS) first = tick - AML_WHEEL_SLOTS + 1;
+
+	for (uint64_t current = first; current <= tick; ++current) {
+		AML_Timer **link = &wheel->Slots[current % AML_WHEEL_SLOTS];
+
+		while (*link != NULL) {
+			AML_Timer *timer = *link;
+
+			if (timer->Deadline <= now) {
+				*link = timer->Next;
+				__atomic_store_n(&timer->Fired, true, __ATOMIC_RELEASE);
+			} else {
+				link = &timer->Next;
+			}
+		}
+	}
+
+	/* The current slot may still hold timers due later in this tick */
+	wheel->Current = tick;
+
+	ReleaseSpinLock(&wheel->Lock);
+}
+
+void YieldTimerWheel(AML_TimerWheel *wheel) {
+	AdvanceTimerWheel(wheel);
+
+	/* Without a clock, stalling is what moves time forward */
+	if (wheel->Clock == NULL) StallFor(wheel, AML_MAX_STALL_US);
+	else wheel->Yield(wheel->YieldContext);
+}
+
+/*
+ * With a comparator of its own, a parked evaluation leaves the wheel lock
+ * and the main counter alone until its deadline and only watches the
+ * comparator's status bit. The kernel has no call to block a module on an
+ * interrupt yet, routing the comparator is all this needs once it does.
+ */
+static bool ParkOnComparator(AML_TimerWheel *wheel, AML_Timer *timer) {
+	HPET_Clock *clock = wheel->Clock;
+	if (clock == NULL) return false;
+
+	int comparator = AllocateHPETComparator(clock, false);
+	if (comparator < 0) return false;
+
+	uint64_t now = ReadHPETNanoseconds(clock);
+	if (timer->Deadline > now) {
+		ArmHPETStatus(clock, comparator, timer->Deadline - now);
+
+		/* A match before arming cleared the status bit is lost, the counter tells whether one went by */
+		if (!HPETComparatorPassed(clock, comparator)) {
+			/* Another core advancing the wheel may fire it first */
+			while (!TestHPETStatus(clock, comparator) && !__atomic_load_n(&timer->Fired, __ATOMIC_ACQUIRE)) {
+				wheel->Yield(wheel->YieldContext);
+			}
+		}
+	}
+
+	ReleaseHPETComparator(clock, comparator);
+	AdvanceTimerWheel(wheel);
+
+	return true;
+}
+
+/* Out of comparators, or without a clock, the wheel is polled instead */
+void ParkUntil(AML_TimerWheel *wheel, AML_Timer *timer) {
+	while (!__atomic_load_n(&timer->Fired, __ATOMIC_ACQUIRE)) {
+		if (!ParkOnComparator(wheel, timer)) YieldTimerWheel(wheel);
+	}
+}
+
+void SleepFor(AML_TimerWheel *wheel, uint64_t ns) {
+	AML_Timer timer;
+	AddTimer(wheel, &timer, ReadTimerWheelNanoseconds(wheel) + ns);
+	ParkUntil(wheel, &timer);
+}
+
+void StallFor(AML_TimerWheel *wheel, uint32_t us) {
+	if (us > AML_MAX_STALL_US) us = AML_MAX_STALL_US;
+
+	/* Calibrated loops, reading the counter costs about as much as a short stall */
+	uint64_t loops = us * wheel->LoopsPerUs;
+	for (uint64_t i = 0; i < loops; ++i) CpuRelax();
+
+	if (wheel->Clock == NULL) __atomic_fetch_add(&wheel->VirtualNs, us * 1000ull, __ATOMIC_RELAXED);
+}
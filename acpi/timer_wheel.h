@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sync.h"
+
+struct HPET_Clock;
+
+#define AML_WHEEL_SLOTS 256
+#define AML_WHEEL_TICK_NS 1000000
+
+/* Stall is only meant for short waits, see ACPI spec section 19.6.129 */
+#define AML_MAX_STALL_US 100
+/* Relax iterations per microsecond until calibrated against a clock */
+#define AML_DEFAULT_LOOPS_PER_US 16
+
+/* Lives on the stack of whoever waits on it */
+struct AML_Timer {
+	uint64_t Deadline;
+	volatile bool Fired;
+
+	AML_Timer *Next;
+};
+
+/* Called while an evaluation is parked, lets the host run something else on this core */
+typedef void (*AML_YieldHandler)(void *context);
+
+struct AML_TimerWheel {
+	HPET_Clock *Clock;
+
+	AML_SpinLock Lock;
+	AML_Timer *Slots[AML_WHEEL_SLOTS];
+	/* Last tick the wheel was advanced to */
+	uint64_t Current;
+
+	AML_YieldHandler Yield;
+	void *YieldContext;
+
+	uint64_t LoopsPerUs;
+	/* Time spent stalling and sleeping, the only notion of time without a clock */
+	uint64_t VirtualNs;
+};
+
+AML_TimerWheel *CreateTimerWheel(HPET_Clock *clock);
+void DeleteTimerWheel(AML_TimerWheel *wheel);
+
+void SetTimerWheelClock(AML_TimerWheel *wheel, HPET_Clock *clock);
+void SetYieldHandler(AML_TimerWheel *wheel, AML_YieldHandler handler, void *context);
+
+uint64_t ReadTimerWheelNanoseconds(AML_TimerWheel *wheel);
+
+void AddTimer(AML_TimerWheel *wheel, AML_Timer *timer, uint64_t deadline);
+void CancelTimer(AML_TimerWheel *wheel, AML_Timer *timer);
+void AdvanceTimerWheel(AML_TimerWheel *wheel);
+
+/* One round of waiting: wakes whatever is due, then gives the core away */
+void YieldTimerWheel(AML_TimerWheel *wheel);
+
+/* Parks the caller until its timer fires, yielding in between */
+void ParkUntil(AML_TimerWheel *wheel, AML_Timer *timer);
+void SleepFor(AML_TimerWheel *wheel, uint64_t ns);
+void StallFor(AML_TimerWheel *wheel, uint32_t us);
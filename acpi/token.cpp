@@ -1,12 +1,15 @@
 #include "token.h"
+#include "aml_opcodes.h"
+#include "memory.h"
 
 #include <stdarg.h>
 #include <mkmi.h>
 
 TokenList *CreateTokenList() {
-	TokenList *list = new TokenList;
+	TokenList *list = (TokenList*)AllocateMemory(ACPI_MEMORY_TOKENS, sizeof(TokenList));
 
 	list->TotalNames = 0;
+	for (size_t i = 0; i < 128; ++i) list->Names[i].Token = NULL;
 	list->Head = NULL;
 	list->Tail = NULL;
 
@@ -19,8 +22,9 @@ void AddToken(TokenList *tokenList, TokenType type, ...) {
 	va_list ap;
 	va_start(ap, type);
 
-	Token *newToken = new Token;
+	Token *newToken = (Token*)AllocateMemory(ACPI_MEMORY_TOKENS, sizeof(Token));
 	newToken->Type = type;
+	newToken->Flags = 0;
 	newToken->Children = NULL;
 
 	newToken->Next = NULL;
@@ -38,9 +42,11 @@ void AddToken(TokenList *tokenList, TokenType type, ...) {
 			NameType *nameOne = va_arg(ap, NameType*);
 			NameType *nameTwo = va_arg(ap, NameType*);
 			newToken->Alias.NameOne.IsRoot = nameOne->IsRoot;
+			newToken->Alias.NameOne.ParentPrefixes = nameOne->ParentPrefixes;
 			newToken->Alias.NameOne.SegmentNumber = nameOne->SegmentNumber;
 			newToken->Alias.NameOne.NameSegments = nameOne->NameSegments;
 			newToken->Alias.NameTwo.IsRoot = nameTwo->IsRoot;
+			newToken->Alias.NameTwo.ParentPrefixes = nameTwo->ParentPrefixes;
 			newToken->Alias.NameTwo.SegmentNumber = nameTwo->SegmentNumber;
 			newToken->Alias.NameTwo.NameSegments = nameTwo->NameSegments;
 			}
@@ -54,6 +60,7 @@ void AddToken(TokenList *tokenList, TokenType type, ...) {
 			tokenList->TotalNames++;
 
 			newToken->Name.IsRoot = name->IsRoot;
+			newToken->Name.ParentPrefixes = name->ParentPrefixes;
 			newToken->Name.SegmentNumber = name->SegmentNumber;
 			newToken->Name.NameSegments = name->NameSegments;
 			}
@@ -67,14 +74,16 @@ void AddToken(TokenList *tokenList, TokenType type, ...) {
 		case STRING: {
 			const char *str = va_arg(ap, char*);
 			size_t len = va_arg(ap, size_t);
-			newToken->String = new char[len];
+			newToken->String = (char*)AllocateMemory(ACPI_MEMORY_STRINGS, len);
 			Memcpy(newToken->String, str, len);
 			}
 			break;
 		case SCOPE: {
 			NameType *name = va_arg(ap, NameType*);
 			newToken->Scope.PkgLength = va_arg(ap, uint32_t);
+			newToken->Children = va_arg(ap, TokenList*);
 			newToken->Scope.Name.IsRoot = name->IsRoot;
+			newToken->Scope.Name.ParentPrefixes = name->ParentPrefixes;
 			newToken->Scope.Name.SegmentNumber = name->SegmentNumber;
 			newToken->Scope.Name.NameSegments = name->NameSegments;
 			}
@@ -102,10 +111,20 @@ void AddToken(TokenList *tokenList, TokenType type, ...) {
 			NameType *name = va_arg(ap, NameType*);
 			uint32_t methodFlags = va_arg(ap, uint32_t);
 			newToken->Method.PkgLength = pkgLength;
+			newToken->Method.Body = va_arg(ap, uint8_t*);
+			newToken->Method.BodyLength = va_arg(ap, uint32_t);
 			newToken->Method.Name.SegmentNumber = name->SegmentNumber;
 			newToken->Method.Name.NameSegments = name->NameSegments;
 			newToken->Method.Name.IsRoot = name->IsRoot;
+			newToken->Method.Name.ParentPrefixes = name->ParentPrefixes;
 			newToken->Method.MethodFlags = methodFlags & 0xFF;
+			newToken->Method.Code = NULL;
+			newToken->Method.CodeState = METHOD_CODE_UNPARSED;
+			newToken->Method.FoldGeneration = 0;
+			InitMutex(&newToken->Method.Mutex, newToken->Method.MethodFlags >> AML_METHOD_SYNC_SHIFT);
+			newToken->Method.Stats.Calls = 0;
+			newToken->Method.Stats.ElapsedNs = 0;
+			newToken->Method.Stats.SleepNs = 0;
 			}
 			break;
 		case REGION: {
@@ -116,36 +135,118 @@ void AddToken(TokenList *tokenList, TokenType type, ...) {
 			newToken->Region.Name.SegmentNumber = name->SegmentNumber;
 			newToken->Region.Name.NameSegments = name->NameSegments;
 			newToken->Region.Name.IsRoot = name->IsRoot;
+			newToken->Region.Name.ParentPrefixes = name->ParentPrefixes;
 			newToken->Region.RegionSpace = space & 0xFF;
 			newToken->Region.RegionOffset.Data = offset->Data;
 			newToken->Region.RegionOffset.Size = offset->Size;
 			newToken->Region.RegionLen.Data = len->Data;
 			newToken->Region.RegionLen.Size = len->Size;
+			newToken->Region.Base = offset->Data;
 			}
 			break;
 		case FIELD: {
 			uint32_t pkgLength = va_arg(ap, uint32_t);
 			NameType *name = va_arg(ap, NameType*);
 			uint32_t fieldFlags = va_arg(ap, uint32_t);
-			TokenList *children = va_arg(ap, TokenList*);
-			newToken->Children = children;
+			AML_FieldUnit *units = va_arg(ap, AML_FieldUnit*);
+			size_t unitCount = va_arg(ap, size_t);
 
 			newToken->Field.PkgLength = pkgLength;
+			newToken->Field.Region = NULL;
+			newToken->Field.Units = units;
+			newToken->Field.UnitCount = unitCount;
 			newToken->Field.Name.SegmentNumber = name->SegmentNumber;
 			newToken->Field.Name.NameSegments = name->NameSegments;
 			newToken->Field.Name.IsRoot = name->IsRoot;
+			newToken->Field.Name.ParentPrefixes = name->ParentPrefixes;
 			newToken->Field.FieldFlags = fieldFlags & 0xFF;
 			}
 			break;
-		case DEVICE: {
+		case DEVICE:
+		case THERMALZONE: {
 			uint32_t pkgLength = va_arg(ap, uint32_t);
 			NameType *name = va_arg(ap, NameType*);
+			newToken->Children = va_arg(ap, TokenList*);
 			newToken->Device.PkgLength = pkgLength;
 			newToken->Device.Name.SegmentNumber = name->SegmentNumber;
 			newToken->Device.Name.NameSegments = name->NameSegments;
 			newToken->Device.Name.IsRoot = name->IsRoot;
+			newToken->Device.Name.ParentPrefixes = name->ParentPrefixes;
+			}
+			break;
+		case PROCESSOR: {
+			uint32_t pkgLength = va_arg(ap, uint32_t);
+			NameType *name = va_arg(ap, NameType*);
+			newToken->Processor.PkgLength = pkgLength;
+			newToken->Processor.Name.SegmentNumber = name->SegmentNumber;
+			newToken->Processor.Name.NameSegments = name->NameSegments;
+			newToken->Processor.Name.IsRoot = name->IsRoot;
+			newToken->Processor.Name.ParentPrefixes = name->ParentPrefixes;
+			newToken->Processor.ProcessorId = va_arg(ap, uint32_t) & 0xFF;
+			newToken->Processor.BlockAddress = va_arg(ap, uint32_t);
+			newToken->Processor.BlockLength = va_arg(ap, uint32_t) & 0xFF;
+			newToken->Children = va_arg(ap, TokenList*);
 			}
 			break;
+		case NOTIFY: {
+			NameType *object = va_arg(ap, NameType*);
+			newToken->Children = va_arg(ap, TokenList*);
+			newToken->Notify.Object.SegmentNumber = object->SegmentNumber;
+			newToken->Notify.Object.NameSegments = object->NameSegments;
+			newToken->Notify.Object.IsRoot = object->IsRoot;
+			newToken->Notify.Object.ParentPrefixes = object->ParentPrefixes;
+			}
+			break;
+		case NAMEREF: {
+			NameType *name = va_arg(ap, NameType*);
+			newToken->Name.IsRoot = name->IsRoot;
+			newToken->Name.ParentPrefixes = name->ParentPrefixes;
+			newToken->Name.SegmentNumber = name->SegmentNumber;
+			newToken->Name.NameSegments = name->NameSegments;
+			}
+			break;
+		case LOCAL:
+		case ARG:
+			newToken->Slot.Index = va_arg(ap, uint32_t) & 0xFF;
+			break;
+		case OPERATION:
+			newToken->Operation.Opcode = va_arg(ap, uint32_t) & 0xFFFF;
+			newToken->Children = va_arg(ap, TokenList*);
+			break;
+		case CALL: {
+			NameType *name = va_arg(ap, NameType*);
+			newToken->Call.Method = va_arg(ap, AML_NamespaceNode*);
+			newToken->Children = va_arg(ap, TokenList*);
+			newToken->Call.Name.IsRoot = name->IsRoot;
+			newToken->Call.Name.ParentPrefixes = name->ParentPrefixes;
+			newToken->Call.Name.SegmentNumber = name->SegmentNumber;
+			newToken->Call.Name.NameSegments = name->NameSegments;
+			}
+			break;
+		case MUTEX: {
+			NameType *name = va_arg(ap, NameType*);
+			uint32_t syncFlags = va_arg(ap, uint32_t);
+			newToken->Mutex.Name.SegmentNumber = name->SegmentNumber;
+			newToken->Mutex.Name.NameSegments = name->NameSegments;
+			newToken->Mutex.Name.IsRoot = name->IsRoot;
+			newToken->Mutex.Name.ParentPrefixes = name->ParentPrefixes;
+			InitMutex(&newToken->Mutex.Lock, syncFlags & AML_MUTEX_SYNC_MASK);
+			}
+			break;
+		case EVENT: {
+			NameType *name = va_arg(ap, NameType*);
+			newToken->Event.Name.SegmentNumber = name->SegmentNumber;
+			newToken->Event.Name.NameSegments = name->NameSegments;
+			newToken->Event.Name.IsRoot = name->IsRoot;
+			newToken->Event.Name.ParentPrefixes = name->ParentPrefixes;
+			newToken->Event.Count = 0;
+			}
+			break;
+		case CONTROL:
+			newToken->Control.Opcode = va_arg(ap, uint32_t) & 0xFF;
+			newToken->Children = va_arg(ap, TokenList*);
+			newToken->Control.Body = va_arg(ap, TokenList*);
+			break;
 		case UNKNOWN:
 			newToken->UnknownOpcode = va_arg(ap, uint32_t) & 0xFF;
 			break;
@@ -156,16 +257,65 @@ void AddToken(TokenList *tokenList, TokenType type, ...) {
 	va_end(ap);
 }
 
+static void DeleteTokenList(TokenList *tokenList) {
+	if (tokenList == NULL) return;
+
+	FreeTokenList(tokenList);
+	FreeMemory(tokenList);
+}
+
+void FreeToken(Token *token) {
+	switch (token->Type) {
+		case STRING:
+			FreeMemory(token->String);
+			break;
+		case BUFFER:
+			FreeMemory(token->Buffer.ByteList);
+			break;
+		case FIELD:
+			FreeMemory(token->Field.Units);
+			break;
+		case METHOD:
+			if (token->Method.CodeState == METHOD_CODE_PARSED) DeleteTokenList(token->Method.Code);
+			break;
+		case CONTROL:
+			DeleteTokenList(token->Control.Body);
+			break;
+		default:
+			break;
+	}
+
+	DeleteTokenList(token->Children);
+	FreeMemory(token);
+}
+
 // Function to free the memory occupied by the token list
 void FreeTokenList(TokenList *tokenList) {
 	Token *current = tokenList->Head;
 	while (current) {
-		if (current->Type == STRING) delete current->String;
 		Token *next = current->Next;
-		delete current;
+		FreeToken(current);
 		current = next;
 	}
 
 	tokenList->Head = NULL;
 	tokenList->Tail = NULL;
 }
+
+bool GetTokenInteger(Token *token, uint64_t *value) {
+	if (token == NULL) return false;
+
+	switch (token->Type) {
+		case ZERO:
+			*value = 0;
+			return true;
+		case ONE:
+			*value = 1;
+			return true;
+		case INTEGER:
+			*value = token->Int.Data;
+			return true;
+		default:
+			return false;
+	}
+}
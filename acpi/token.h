@@ -3,6 +3,20 @@
 #include <stddef.h>
 
 #include "aml_types.h"
+#include "field_access.h"
+#include "sync.h"
+
+struct AML_NamespaceNode;
+
+/* Created by the interpreter, freed with ReleaseResult */
+#define TOKEN_TEMPORARY 0x01
+/* Some method body was folded against the value of this Name */
+#define TOKEN_FOLDED 0x02
+
+/* Method.CodeState */
+#define METHOD_CODE_UNPARSED 0
+#define METHOD_CODE_PARSING 1
+#define METHOD_CODE_PARSED 2
 
 enum TokenType {
 	UNKNOWN,
@@ -21,12 +35,35 @@ enum TokenType {
 	REGION,
 	FIELD,
 	DEVICE,
+	/* Shares the Device members */
+	THERMALZONE,
+	PROCESSOR,
+
+	NOTIFY,
+	NAMEREF,
+	MUTEX,
+	EVENT,
+
+	/* Only found in method bodies */
+	LOCAL,
+	ARG,
+	OPERATION,
+	CALL,
+	CONTROL,
 };
 
 struct TokenList;
 
+/* Includes the callees, time spent computing is Elapsed minus Sleep */
+struct AML_MethodStats {
+	uint64_t Calls;
+	uint64_t ElapsedNs;
+	uint64_t SleepNs;
+};
+
 struct Token {
 	TokenType Type;
+	uint8_t Flags;
 
 	union {
 		uint8_t UnknownOpcode;
@@ -64,6 +101,20 @@ struct Token {
 			uint32_t PkgLength;
 			NameType Name;
 			uint8_t MethodFlags;
+
+			uint8_t *Body;
+			uint32_t BodyLength;
+
+			/* Parsed on first invocation, see METHOD_CODE_* */
+			TokenList *Code;
+			uint8_t CodeState;
+			/* Fold generation the code depends on, zero when no Name was folded into it */
+			uint64_t FoldGeneration;
+
+			/* Taken by every invocation of a Serialized method */
+			AML_Mutex Mutex;
+
+			AML_MethodStats Stats;
 		} Method;
 
 
@@ -72,18 +123,71 @@ struct Token {
 			uint8_t RegionSpace;
 			IntegerType RegionOffset;
 			IntegerType RegionLen;
+
+			/* Address of offset 0 in the region's space, see PCI_CONFIG_ADDRESS */
+			uint64_t Base;
 		} Region;
 
 		struct {
 			uint32_t PkgLength;
 			NameType Name;
 			uint8_t FieldFlags;
+
+			Token *Region;
+			uint32_t UnitCount;
+			AML_FieldUnit *Units;
 		} Field;
 
 		struct {
 			uint32_t PkgLength;
 			NameType Name;
 		} Device;
+
+		/* Deprecated in ACPI 6.4 in favour of Device(ACPI0007) */
+		struct {
+			uint32_t PkgLength;
+			NameType Name;
+			uint8_t ProcessorId;
+			uint32_t BlockAddress;
+			uint8_t BlockLength;
+		} Processor;
+
+		struct {
+			NameType Object;
+		} Notify;
+
+		struct {
+			NameType Name;
+			AML_Mutex Lock;
+		} Mutex;
+
+		struct {
+			NameType Name;
+			/* Signals not consumed by a Wait yet */
+			uint32_t Count;
+		} Event;
+
+		/* Local and Arg */
+		struct {
+			uint8_t Index;
+		} Slot;
+
+		/* Operands are the children, extended opcodes are AML_EXTENDED() */
+		struct {
+			uint16_t Opcode;
+		} Operation;
+
+		/* Arguments are the children */
+		struct {
+			NameType Name;
+			AML_NamespaceNode *Method;
+		} Call;
+
+		/* If, Else and While, the predicate is the only child */
+		struct {
+			uint8_t Opcode;
+			TokenList *Body;
+		} Control;
 	};
 
 	TokenList *Children;
@@ -92,7 +196,7 @@ struct Token {
 };
 
 struct NameData {
-	Token *Token = NULL;
+	::Token *Token = NULL;
 };
 
 struct TokenList {
@@ -106,3 +210,7 @@ struct TokenList {
 TokenList *CreateTokenList();
 void AddToken(TokenList *tokenList, TokenType type, ...);
 void FreeTokenList(TokenList *tokenList);
+/* The token and everything it owns, not its siblings */
+void FreeToken(Token *token);
+
+bool GetTokenInteger(Token *token, uint64_t *value);
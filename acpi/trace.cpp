@@ -0,0 +1,191 @@
+#include "trace.h"
+#include "hpet.h"
+#include "sync.h"
+
+#include <mkmi.h>
+
+#define TRACE_RING_MASK (ACPI_TRACE_RING_SIZE - 1)
+#define TRACE_TAG(arg) (1 << (arg))
+
+struct ACPI_TraceRing {
+	/* Next slot to claim, writers on the same CPU may race for it */
+	uint64_t Head;
+	/* Next slot to read, only touched with DrainLock held */
+	uint64_t Tail;
+	uint64_t Dropped;
+
+	ACPI_TraceRecord Records[ACPI_TRACE_RING_SIZE];
+} __attribute__((aligned(64)));
+
+static const struct {
+	const char *Format;
+	/* Arguments holding TraceTag text instead of a number */
+	uint8_t Tags;
+} TraceFormats[TRACE_EVENT_COUNT] = {
+	[TRACE_TABLE_FOUND] = {"ACPI table found: %s (%s), %d bytes", TRACE_TAG(0) | TRACE_TAG(1)},
+	[TRACE_TABLE_INVALID] = {"Invalid table: %s", TRACE_TAG(0)},
+	[TRACE_MADT] = {"MADT: %d CPUs, %d I/O APICs, %d GSIs.", 0},
+	[TRACE_HPET] = {"HPET: %d Hz, %d comparators.", 0},
+	[TRACE_NUMA] = {"NUMA: %d nodes, %d CPUs, %d memory ranges.", 0},
+	[TRACE_ACPI_ALREADY_ENABLED] = {"ACPI already enabled.", 0},
+	[TRACE_ACPI_ENABLING] = {"ACPI not yet enabled, waiting for it to switch modes.", 0},
+	[TRACE_ACPI_ENABLED] = {"ACPI is enabled.", 0},
+	[TRACE_PARSE_DONE] = {"Done parsing %d bytes of AML code.", 0},
+	[TRACE_PARSE_OVERRUN] = {"Malformed AML, some objects were cut short.", 0},
+	[TRACE_NAMESPACE_LOADED] = {"Namespace holds %d objects.", 0},
+	[TRACE_DEVICE_INDEX] = {"Device index: %d IDs.", 0},
+	[TRACE_PCI_ROUTING] = {"PCI routing: %d bridges, %d entries, %d unresolved.", 0},
+	[TRACE_POWER] = {"Power: S5 %s, reset register %s.", TRACE_TAG(0) | TRACE_TAG(1)},
+	[TRACE_INITIALIZED] = {"ACPI initialized.", 0},
+	[TRACE_THERMAL_ZONES] = {"Thermal: %d zones.", 0},
+	[TRACE_THERMAL_ZONES_ADDED] = {"Thermal: %d zones added, %d did not fit.", 0},
+	[TRACE_THERMAL_STATE] = {"Thermal: %s entered state %d at %d dK.", TRACE_TAG(0)},
+	[TRACE_PROCESSORS] = {"Processors: %d CPUs, %d with idle states, %d with performance states.", 0},
+	[TRACE_PROCESSORS_ADDED] = {"Processors: %d added, %d did not fit.", 0},
+	[TRACE_MEMORY] = {"Memory: %d bytes live, %d at peak, %d per KB of AML.", 0},
+	[TRACE_TABLE_LOADED] = {"Table %s loaded as handle %d, %d objects.", TRACE_TAG(0)},
+	[TRACE_TABLE_UNLOADED] = {"Table handle %d unloaded, %d objects.", 0},
+	[TRACE_DEVICES_INITIALIZED] = {"Devices: %d _INI methods run.", 0},
+	[TRACE_AML_DEBUG_INTEGER] = {"AML Debug: 0x%x", 0},
+	[TRACE_AML_DEBUG_STRING] = {"AML Debug: %s%s%s%s", TRACE_TAG(0) | TRACE_TAG(1) | TRACE_TAG(2) | TRACE_TAG(3)},
+	[TRACE_AML_DEBUG_OBJECT] = {"AML Debug: object of type %d", 0},
+	[TRACE_AML_DEBUG_REFERENCE] = {"AML Debug: reference", 0},
+};
+
+uint8_t TraceLevel = ACPI_TRACE_INFO;
+
+static ACPI_TraceRing Rings[ACPI_TRACE_MAX_CPUS];
+static HPET_Clock *TraceClock = NULL;
+static ACPI_TraceCpuHandler TraceCpu = NULL;
+static AML_SpinLock DrainLock;
+
+void SetTraceLevel(uint8_t level) {
+	__atomic_store_n(&TraceLevel, level, __ATOMIC_RELAXED);
+}
+
+void SetTraceClock(HPET_Clock *clock) {
+	TraceClock = clock;
+}
+
+void SetTraceCpuHandler(ACPI_TraceCpuHandler handler) {
+	TraceCpu = handler;
+}
+
+void RecordTrace(uint8_t level, uint16_t event, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3) {
+	uint32_t cpu = TraceCpu != NULL ? TraceCpu() % ACPI_TRACE_MAX_CPUS : 0;
+	ACPI_TraceRing *ring = &Rings[cpu];
+
+	uint64_t slot = __atomic_fetch_add(&ring->Head, 1, __ATOMIC_RELAXED);
+	ACPI_TraceRecord *record = &ring->Records[slot & TRACE_RING_MASK];
+
+	__atomic_store_n(&record->Sequence, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	record->Timestamp = TraceClock != NULL ? ReadHPETNanoseconds(TraceClock) : 0;
+	record->Event = event;
+	record->Level = level;
+	record->Cpu = cpu;
+	record->Args[0] = a0;
+	record->Args[1] = a1;
+	record->Args[2] = a2;
+	record->Args[3] = a3;
+
+	__atomic_store_n(&record->Sequence, slot + 1, __ATOMIC_RELEASE);
+}
+
+static size_t ReadRing(ACPI_TraceRing *ring, ACPI_TraceRecord *records, size_t max) {
+	uint64_t head = __atomic_load_n(&ring->Head, __ATOMIC_ACQUIRE);
+	size_t count = 0;
+
+	/* Whatever the writers lapped is gone */
+	if (head - ring->Tail > ACPI_TRACE_RING_SIZE) {
+		ring->Dropped += head - ring->Tail - ACPI_TRACE_RING_SIZE;
+		ring->Tail = head - ACPI_TRACE_RING_SIZE;
+	}
+
+	while (ring->Tail < head && count < max) {
+		ACPI_TraceRecord *record = &ring->Records[ring->Tail & TRACE_RING_MASK];
+
+		uint64_t sequence = __atomic_load_n(&record->Sequence, __ATOMIC_ACQUIRE);
+		if (sequence == 0) break;
+
+		records[count] = *record;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		/* Overwritten under us, or before we got to it */
+		if (sequence != ring->Tail + 1 || __atomic_load_n(&record->Sequence, __ATOMIC_RELAXED) != sequence) {
+			ring->Dropped++;
+			ring->Tail++;
+			continue;
+		}
+
+		ring->Tail++;
+		count++;
+	}
+
+	return count;
+}
+
+size_t ReadTrace(uint32_t cpu, ACPI_TraceRecord *records, size_t max) {
+	if (cpu >= ACPI_TRACE_MAX_CPUS) return 0;
+
+	AcquireSpinLock(&DrainLock);
+	size_t count = ReadRing(&Rings[cpu], records, max);
+	ReleaseSpinLock(&DrainLock);
+
+	return count;
+}
+
+static void PrintRecord(ACPI_TraceRecord *record) {
+	if (record->Event >= TRACE_EVENT_COUNT) return;
+
+	char tags[ACPI_TRACE_ARGS][9];
+	uint64_t args[ACPI_TRACE_ARGS];
+
+	/* Strings go through the same argument slots as the numbers they replace */
+	for (size_t i = 0; i < ACPI_TRACE_ARGS; ++i) {
+		args[i] = record->Args[i];
+		if ((TraceFormats[record->Event].Tags & TRACE_TAG(i)) == 0) continue;
+
+		Memcpy(tags[i], &record->Args[i], 8);
+		tags[i][8] = '\0';
+		args[i] = (uintptr_t)tags[i];
+	}
+
+	MKMI_Printf("[%d:%d] ", record->Cpu, record->Timestamp / 1000);
+	MKMI_Printf(TraceFormats[record->Event].Format, args[0], args[1], args[2], args[3]);
+	MKMI_Printf("\r\n");
+}
+
+size_t DrainTrace() {
+	ACPI_TraceRecord records[16];
+	size_t total = 0;
+
+	AcquireSpinLock(&DrainLock);
+
+	for (uint32_t cpu = 0; cpu < ACPI_TRACE_MAX_CPUS; ++cpu) {
+		size_t count;
+		while ((count = ReadRing(&Rings[cpu], records, 16)) != 0) {
+			for (size_t i = 0; i < count; ++i) PrintRecord(&records[i]);
+			total += count;
+		}
+	}
+
+	ReleaseSpinLock(&DrainLock);
+
+	return total;
+}
+
+void GetTraceStats(ACPI_TraceStats *stats) {
+	stats->Recorded = 0;
+	stats->Dropped = 0;
+
+	AcquireSpinLock(&DrainLock);
+
+	for (uint32_t cpu = 0; cpu < ACPI_TRACE_MAX_CPUS; ++cpu) {
+		stats->Recorded += __atomic_load_n(&Rings[cpu].Head, __ATOMIC_RELAXED);
+		stats->Dropped += Rings[cpu].Dropped;
+	}
+
+	ReleaseSpinLock(&DrainLock);
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+struct HPET_Clock;
+
+#define ACPI_TRACE_ERROR 0
+#define ACPI_TRACE_WARNING 1
+#define ACPI_TRACE_INFO 2
+#define ACPI_TRACE_DEBUG 3
+
+#define ACPI_TRACE_MAX_CPUS 16
+/* Records per CPU, a power of two */
+#define ACPI_TRACE_RING_SIZE 128
+#define ACPI_TRACE_ARGS 4
+
+/* The format of each one lives in trace.cpp */
+enum ACPI_TraceEvent {
+	TRACE_TABLE_FOUND,
+	TRACE_TABLE_INVALID,
+	TRACE_MADT,
+	TRACE_HPET,
+	TRACE_NUMA,
+	TRACE_ACPI_ALREADY_ENABLED,
+	TRACE_ACPI_ENABLING,
+	TRACE_ACPI_ENABLED,
+	TRACE_PARSE_DONE,
+	TRACE_PARSE_OVERRUN,
+	TRACE_NAMESPACE_LOADED,
+	TRACE_DEVICE_INDEX,
+	TRACE_PCI_ROUTING,
+	TRACE_POWER,
+	TRACE_INITIALIZED,
+	TRACE_THERMAL_ZONES,
+	TRACE_THERMAL_ZONES_ADDED,
+	TRACE_THERMAL_STATE,
+	TRACE_PROCESSORS,
+	TRACE_PROCESSORS_ADDED,
+	TRACE_MEMORY,
+	TRACE_TABLE_LOADED,
+	TRACE_TABLE_UNLOADED,
+	TRACE_DEVICES_INITIALIZED,
+	TRACE_AML_DEBUG_INTEGER,
+	TRACE_AML_DEBUG_STRING,
+	TRACE_AML_DEBUG_OBJECT,
+	TRACE_AML_DEBUG_REFERENCE,
+	TRACE_EVENT_COUNT,
+};
+
+struct ACPI_TraceRecord {
+	/* Slot number plus one once the record is complete, zero while it is written */
+	uint64_t Sequence;
+	uint64_t Timestamp;
+
+	uint16_t Event;
+	uint8_t Level;
+	uint8_t Cpu;
+
+	uint64_t Args[ACPI_TRACE_ARGS];
+};
+
+/* Returns the index of the running CPU, the host knows it and we do not */
+typedef uint32_t (*ACPI_TraceCpuHandler)();
+
+struct ACPI_TraceStats {
+	uint64_t Recorded;
+	/* Overwritten before anyone drained them */
+	uint64_t Dropped;
+};
+
+extern uint8_t TraceLevel;
+
+void RecordTrace(uint8_t level, uint16_t event, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3);
+
+/* Nothing but a compare when the level is filtered out, formatting waits for DrainTrace */
+static inline void Trace(uint8_t level, uint16_t event, uint64_t a0 = 0, uint64_t a1 = 0, uint64_t a2 = 0, uint64_t a3 = 0) {
+	if (level > __atomic_load_n(&TraceLevel, __ATOMIC_RELAXED)) return;
+
+	RecordTrace(level, event, a0, a1, a2, a3);
+}
+
+/* Up to eight characters in one argument, printed back as a string */
+static inline uint64_t TraceTag(const void *text, size_t length) {
+	uint64_t tag = 0;
+	if (length > 8) length = 8;
+	__builtin_memcpy(&tag, text, length);
+	return tag;
+}
+
+void SetTraceLevel(uint8_t level);
+void SetTraceClock(HPET_Clock *clock);
+void SetTraceCpuHandler(ACPI_TraceCpuHandler handler);
+
+/* Moves up to max completed records of one CPU out of its ring */
+size_t ReadTrace(uint32_t cpu, ACPI_TraceRecord *records, size_t max);
+/* Formats and prints everything recorded so far, returns the number of records */
+size_t DrainTrace();
+
+void GetTraceStats(ACPI_TraceStats *stats);
@@ -0,0 +1,411 @@
+#include "test.h"
+
+#include "aml_types.h"
+#include "aml_opcodes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void TestLoads() {
+	uint8_t data[] = { 0xAA, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF };
+	AmlCursor cursor;
+	InitCursor(&cursor, data, sizeof(data));
+
+	/* Everything after the first byte is unaligned */
+	CHECK(ReadByte(&cursor) == 0xAA);
+	CHECK(ReadWord(&cursor) == 0x2211);
+	CHECK(ReadDWord(&cursor) == 0x66554433);
+	CHECK(ReadQWord(&cursor) == 0xFFEEDDCCBB998877ull);
+	CHECK(!cursor.Overrun);
+	CHECK(CursorRemaining(&cursor) == 0);
+
+	/* The last byte was consumed, so nothing more fits */
+	CHECK(PeekByte(&cursor) == 0);
+	CHECK(ReadByte(&cursor) == 0);
+	CHECK(cursor.Overrun);
+	CHECK(cursor.Position == cursor.End);
+}
+
+static void TestOverrun() {
+	uint8_t data[] = { 0x01, 0x02, 0x03 };
+	AmlCursor cursor;
+	InitCursor(&cursor, data, sizeof(data));
+
+	CursorSkip(&cursor, 1);
+	CHECK(ReadDWord(&cursor) == 0);
+	CHECK(cursor.Overrun);
+	CHECK(cursor.Position == cursor.End);
+
+	/* Further reads stay put instead of wrapping */
+	CHECK(ReadQWord(&cursor) == 0);
+	CHECK(ReadWord(&cursor) == 0);
+	CHECK(CursorOffset(&cursor) == sizeof(data));
+
+	InitCursor(&cursor, data, sizeof(data));
+	CursorSkip(&cursor, 4);
+	CHECK(cursor.Overrun);
+	CHECK(cursor.Position == cursor.End);
+}
+
+static uint32_t DecodePkgLength(const uint8_t *bytes, size_t size, int *follow, bool *overrun) {
+	uint8_t data[8];
+	memcpy(data, bytes, size);
+
+	AmlCursor cursor;
+	InitCursor(&cursor, data, size);
+
+	uint32_t length;
+	*follow = HandlePkgLengthType(&length, &cursor);
+	*overrun = cursor.Overrun;
+
+	return length;
+}
+
+static void TestPkgLength() {
+	int follow;
+	bool overrun;
+
+	const uint8_t one[] = { 0x3F, 0xFF, 0xFF, 0xFF };
+	CHECK(DecodePkgLength(one, sizeof(one), &follow, &overrun) == 0x3F);
+	CHECK(follow == 0 && !overrun);
+
+	const uint8_t two[] = { 0x4F, 0xFF, 0xAA, 0xAA };
+	CHECK(DecodePkgLength(two, sizeof(two), &follow, &overrun) == 0xFFF);
+	CHECK(follow == 1 && !overrun);
+
+	const uint8_t four[] = { 0xC5, 0x12, 0x34, 0x56, 0x00 };
+	CHECK(DecodePkgLength(four, sizeof(four), &follow, &overrun) == 0x5634125);
+	CHECK(follow == 3 && !overrun);
+
+	/* Right at the end of the table the follow bytes are read one at a time */
+	const uint8_t tail[] = { 0x41, 0x02 };
+	CHECK(DecodePkgLength(tail, sizeof(tail), &follow, &overrun) == 0x21);
+	CHECK(follow == 1 && !overrun);
+
+	const uint8_t truncated[] = { 0xC1, 0x02, 0x03 };
+	CHECK(DecodePkgLength(truncated, sizeof(truncated), &follow, &overrun) == 0);
+	CHECK(follow == 0 && overrun);
+
+	CHECK(DecodePkgLength(one, 0, &follow, &overrun) == 0);
+	CHECK(overrun);
+}
+
+static void TestPackageEnd() {
+	uint8_t data[16] = { 0 };
+	AmlCursor cursor;
+	InitCursor(&cursor, data, sizeof(data));
+
+	CHECK(PackageEnd(&cursor, data + 2, 10) == data + 12);
+	CHECK(!cursor.Overrun);
+
+	/* A package claiming more than is left is cut at the enclosing end */
+	CHECK(PackageEnd(&cursor, data + 2, 100) == cursor.End);
+	CHECK(cursor.Overrun);
+}
+
+static void TestNames() {
+	NameType name;
+	AmlCursor cursor;
+
+	uint8_t root[] = { AML_ROOT_CHAR, '_', 'S', 'B', '_', 0xAA };
+	InitCursor(&cursor, root, sizeof(root));
+	HandleNameType(&name, &cursor);
+	CHECK(name.IsRoot && name.ParentPrefixes == 0);
+	CHECK(name.SegmentNumber == 1 && memcmp(name.NameSegments, "_SB_", 4) == 0);
+	CHECK(CursorOffset(&cursor) == 5);
+
+	uint8_t parents[] = { AML_PARENT_CHAR, AML_PARENT_CHAR, AML_DUAL_PREFIX, 'P', 'C', 'I', '0', 'L', 'P', 'C', 'B' };
+	InitCursor(&cursor, parents, sizeof(parents));
+	HandleNameType(&name, &cursor);
+	CHECK(!name.IsRoot && name.ParentPrefixes == 2);
+	CHECK(name.SegmentNumber == 2 && memcmp(name.NameSegments, "PCI0LPCB", 8) == 0);
+	CHECK(!cursor.Overrun && CursorRemaining(&cursor) == 0);
+
+	uint8_t multi[] = { AML_MULTI_PREFIX, 3, '_', 'S', 'B', '_', 'P', 'C', 'I', '0', 'S', 'A', 'T', '0' };
+	InitCursor(&cursor, multi, sizeof(multi));
+	HandleNameType(&name, &cursor);
+	CHECK(name.SegmentNumber == 3 && name.NameSegments == (char*)&multi[2]);
+	CHECK(!cursor.Overrun);
+
+	uint8_t null[] = { 0x00, 0x12 };
+	InitCursor(&cursor, null, sizeof(null));
+	HandleNameType(&name, &cursor);
+	CHECK(name.SegmentNumber == 0 && name.NameSegments == NULL);
+	CHECK(CursorOffset(&cursor) == 1);
+
+	/* Three segments announced, two present */
+	uint8_t truncated[] = { AML_MULTI_PREFIX, 3, '_', 'S', 'B', '_', 'P', 'C', 'I', '0' };
+	InitCursor(&cursor, truncated, sizeof(truncated));
+	HandleNameType(&name, &cursor);
+	CHECK(name.SegmentNumber == 0 && name.NameSegments == NULL);
+	CHECK(cursor.Overrun && cursor.Position == cursor.End);
+
+	/* A lone segment cut short */
+	uint8_t segment[] = { 'A', 'B' };
+	InitCursor(&cursor, segment, sizeof(segment));
+	HandleNameType(&name, &cursor);
+	CHECK(name.SegmentNumber == 0);
+	CHECK(cursor.Overrun);
+
+	/* Prefixes only, the overrun reads as a NULL name */
+	uint8_t prefixes[] = { AML_PARENT_CHAR, AML_PARENT_CHAR };
+	InitCursor(&cursor, prefixes, sizeof(prefixes));
+	HandleNameType(&name, &cursor);
+	CHECK(name.SegmentNumber == 0);
+	CHECK(cursor.Overrun);
+}
+
+static void TestIntegers() {
+	IntegerType integer;
+	AmlCursor cursor;
+
+	uint8_t qword[] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 };
+	InitCursor(&cursor, qword, sizeof(qword));
+	HandleIntegerType(&integer, AML_QWORDPREFIX, &cursor);
+	CHECK(integer.Data == 0x8877665544332211ull && integer.Size == 8);
+
+	uint8_t word[] = { 0x34, 0x12 };
+	InitCursor(&cursor, word, sizeof(word));
+	HandleIntegerType(&integer, AML_WORDPREFIX, &cursor);
+	CHECK(integer.Data == 0x1234 && integer.Size == 2);
+
+	InitCursor(&cursor, word, 0);
+	HandleIntegerType(&integer, AML_ONES_OP, &cursor);
+	CHECK(integer.Data == ~0ull && !cursor.Overrun);
+
+	HandleIntegerType(&integer, AML_ONE_OP, &cursor);
+	CHECK(integer.Data == 1 && !cursor.Overrun);
+
+	uint8_t dword[] = { 0x01, 0x02, 0x03 };
+	InitCursor(&cursor, dword, sizeof(dword));
+	HandleIntegerType(&integer, AML_DWORDPREFIX, &cursor);
+	CHECK(integer.Data == 0 && cursor.Overrun);
+}
+
+/*
+ * The decoders as they were before the cursor, kept to benchmark against.
+ * Only the QWORD shifts are widened, they used to truncate to int.
+ */
+static void LegacyNameSegments(NameType *name, uint8_t *data, size_t *idx) {
+	if (data[*idx] == AML_DUAL_PREFIX) {
+		*idx += 1;
+
+		name->SegmentNumber = 2;
+		name->NameSegments = (char*)malloc(name->SegmentNumber * 4);
+		memcpy(name->NameSegments + 0, &data[*idx], 4);
+		memcpy(name->NameSegments + 4, &data[*idx + 4], 4);
+
+		*idx += 8;
+	} else if (data[*idx] == AML_MULTI_PREFIX) {
+		*idx += 1;
+
+		name->SegmentNumber = data[*idx];
+
+		*idx += 1;
+
+		name->NameSegments = (char*)malloc(name->SegmentNumber * 4);
+
+		for (size_t i = 0; i < name->SegmentNumber ; ++i) {
+			memcpy(&name->NameSegments[i * 4], &data[*idx], 4);
+			*idx += 4;
+		}
+	} else if (data[*idx] == 0x00) {
+		*idx += 1;
+
+		name->SegmentNumber = 0;
+		name->NameSegments = NULL;
+	} else {
+		name->SegmentNumber = 1;
+		name->NameSegments = (char*)malloc(name->SegmentNumber * 4);
+		memcpy(name->NameSegments + 0, &data[*idx], 4);
+
+		*idx += 4;
+	}
+}
+
+static void LegacyName(NameType *name, uint8_t *data, size_t *idx) {
+	if(data[*idx] == AML_ROOT_CHAR) {
+		name->IsRoot = true;
+		*idx += 1;
+	} else if (data[*idx] == AML_PARENT_CHAR) {
+		name->IsRoot = false;
+		*idx += 1;
+	} else {
+		name->IsRoot = false;
+	}
+
+	LegacyNameSegments(name, data, idx);
+}
+
+static void LegacyInteger(IntegerType *integer, uint8_t *data, size_t *idx) {
+	size_t moveAmount = 0;
+
+	integer->Data = 0;
+
+	switch(data[*idx - 1]) {
+		case AML_QWORDPREFIX:
+			moveAmount += 4;
+			integer->Data |= ((uint64_t)data[*idx + 7] << 56);
+			integer->Data |= ((uint64_t)data[*idx + 6] << 48);
+			integer->Data |= ((uint64_t)data[*idx + 5] << 40);
+			integer->Data |= ((uint64_t)data[*idx + 4] << 32);
+			/* fall through */
+		case AML_DWORDPREFIX:
+			moveAmount += 2;
+			integer->Data |= ((uint64_t)data[*idx + 3] << 24);
+			integer->Data |= (data[*idx + 2] << 16);
+			/* fall through */
+		case AML_WORDPREFIX:
+			moveAmount += 1;
+			integer->Data |= (data[*idx + 1] << 8);
+			/* fall through */
+		case AML_BYTEPREFIX:
+			moveAmount += 1;
+			integer->Data |= data[*idx];
+
+			*idx += moveAmount;
+			break;
+		default:
+			moveAmount = 1;
+			integer->Data |= data[*idx - 1];
+			break;
+	}
+
+	integer->Size = moveAmount;
+}
+
+static int LegacyPkgLength(uint8_t *pkgLength, uint8_t *data, size_t *idx) {
+	uint8_t leadByte = data[*idx];
+	*pkgLength = 0;
+	uint8_t byteCount = leadByte & 0b11000000;
+
+	byteCount >>= 6;
+
+	switch(byteCount) {
+		case 0:
+			*pkgLength |= leadByte & 0b00111111;
+			*idx += 1;
+			break;
+		case 1:
+			*pkgLength |= leadByte & 0b00001111;
+			*pkgLength |= (data[*idx + 1] << 4);
+			*idx += 2;
+			break;
+		case 2:
+			*pkgLength |= leadByte & 0b00001111;
+			*pkgLength |= (data[*idx + 1] << 4);
+			*pkgLength |= (data[*idx + 2] << 12);
+			*idx += 3;
+			break;
+		case 3:
+			*pkgLength |= leadByte & 0b00001111;
+			*pkgLength |= (data[*idx + 1] << 4);
+			*pkgLength |= (data[*idx + 2] << 12);
+			*pkgLength |= (data[*idx + 3] << 20);
+			*idx += 4;
+			break;
+	}
+
+	return byteCount;
+}
+
+#define BENCHMARK_RECORDS 4096
+#define BENCHMARK_ROUNDS 200
+
+/* Records of a PkgLength, a prefixed integer and a NameString, each in every encoding */
+static size_t BuildStream(uint8_t *stream) {
+	static const uint8_t pkgLengths[4][4] = { { 0x3F }, { 0x4A, 0x12 }, { 0x85, 0x34, 0x12 }, { 0xC1, 0x78, 0x56, 0x34 } };
+	static const uint8_t prefixes[4] = { AML_BYTEPREFIX, AML_WORDPREFIX, AML_DWORDPREFIX, AML_QWORDPREFIX };
+	static const uint8_t names[4][14] = {
+		{ 'P', 'C', 'I', '0' },
+		{ AML_ROOT_CHAR, AML_DUAL_PREFIX, '_', 'S', 'B', '_', 'P', 'C', 'I', '0' },
+		{ AML_PARENT_CHAR, 'L', 'P', 'C', 'B' },
+		{ AML_MULTI_PREFIX, 3, '_', 'S', 'B', '_', 'P', 'C', 'I', '0', 'S', 'A', 'T', '0' },
+	};
+	static const size_t nameLengths[4] = { 4, 10, 5, 14 };
+
+	size_t length = 0;
+	for (size_t i = 0; i < BENCHMARK_RECORDS; ++i) {
+		size_t pkg = i % 4, integer = (i / 4) % 4, name = (i / 16) % 4;
+
+		memcpy(&stream[length], pkgLengths[pkg], pkg + 1);
+		length += pkg + 1;
+
+		stream[length++] = prefixes[integer];
+		for (size_t j = 0; j < (1u << integer); ++j) stream[length++] = i + j;
+
+		memcpy(&stream[length], names[name], nameLengths[name]);
+		length += nameLengths[name];
+	}
+
+	return length;
+}
+
+/* Both decode the same stream to the same values, then each is timed alone */
+static void BenchmarkDecoders() {
+	static uint8_t stream[BENCHMARK_RECORDS * 32];
+	size_t length = BuildStream(stream);
+
+	uint64_t checksum = 0, legacyChecksum = 0;
+	uint64_t start = TestNanoseconds();
+
+	for (size_t round = 0; round < BENCHMARK_ROUNDS; ++round) {
+		AmlCursor cursor;
+		InitCursor(&cursor, stream, length);
+
+		for (size_t i = 0; i < BENCHMARK_RECORDS; ++i) {
+			uint32_t pkgLength;
+			IntegerType integer;
+			NameType name;
+
+			HandlePkgLengthType(&pkgLength, &cursor);
+			HandleIntegerType(&integer, ReadByte(&cursor), &cursor);
+			HandleNameType(&name, &cursor);
+
+			checksum += (uint8_t)pkgLength + integer.Data + name.SegmentNumber + name.NameSegments[0];
+		}
+
+		CHECK(!cursor.Overrun && CursorRemaining(&cursor) == 0);
+	}
+
+	uint64_t cursorTime = TestNanoseconds() - start;
+	start = TestNanoseconds();
+
+	for (size_t round = 0; round < BENCHMARK_ROUNDS; ++round) {
+		size_t idx = 0;
+
+		for (size_t i = 0; i < BENCHMARK_RECORDS; ++i) {
+			uint8_t pkgLength;
+			IntegerType integer;
+			NameType name;
+
+			LegacyPkgLength(&pkgLength, stream, &idx);
+			idx++;
+			LegacyInteger(&integer, stream, &idx);
+			LegacyName(&name, stream, &idx);
+
+			legacyChecksum += pkgLength + integer.Data + name.SegmentNumber + name.NameSegments[0];
+			free(name.NameSegments);
+		}
+
+		CHECK(idx == length);
+	}
+
+	uint64_t legacyTime = TestNanoseconds() - start;
+	CHECK(checksum == legacyChecksum);
+
+	double records = BENCHMARK_RECORDS * BENCHMARK_ROUNDS;
+	printf("cursor: %.1f ns per record, legacy decoders %.1f ns per record\n", cursorTime / records, legacyTime / records);
+}
+
+int main() {
+	TestLoads();
+	TestOverrun();
+	TestPkgLength();
+	TestPackageEnd();
+	TestNames();
+	TestIntegers();
+	BenchmarkDecoders();
+
+	return TEST_RESULT();
+}
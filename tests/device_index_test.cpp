@@ -0,0 +1,161 @@
+#include "test.h"
+
+#include "device_index.h"
+#include "aml_executive.h"
+#include "aml_opcodes.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BULK_DEVICES 1000
+
+struct AmlBuilder {
+	uint8_t Data[32768];
+	size_t Length;
+};
+
+static void Emit(AmlBuilder *aml, const void *bytes, size_t length) {
+	memcpy(&aml->Data[aml->Length], bytes, length);
+	aml->Length += length;
+}
+
+static void EmitByte(AmlBuilder *aml, uint8_t byte) {
+	Emit(aml, &byte, 1);
+}
+
+/* Name (id, 0x...) or Name (id, "...") */
+static void EmitNameInteger(AmlBuilder *aml, const char *name, uint32_t value) {
+	EmitByte(aml, AML_NAME_OP);
+	Emit(aml, name, 4);
+	EmitByte(aml, AML_DWORDPREFIX);
+	Emit(aml, &value, 4);
+}
+
+static void EmitNameString(AmlBuilder *aml, const char *name, const char *value) {
+	EmitByte(aml, AML_NAME_OP);
+	Emit(aml, name, 4);
+	EmitByte(aml, AML_STRINGPREFIX);
+	Emit(aml, value, strlen(value) + 1);
+}
+
+/* Device (name) { body }, the body is built in place and must stay under 63 bytes */
+static size_t BeginDevice(AmlBuilder *aml, const char *name) {
+	EmitByte(aml, AML_EXTOP_PREFIX);
+	EmitByte(aml, AML_DEVICE);
+	size_t length = aml->Length;
+	EmitByte(aml, 0);
+	Emit(aml, name, 4);
+
+	return length;
+}
+
+static void EndDevice(AmlBuilder *aml, size_t length) {
+	aml->Data[length] = aml->Length - length;
+}
+
+static AMLExecutive *BuildNamespace(AmlBuilder *aml) {
+	aml->Length = 0;
+
+	size_t device = BeginDevice(aml, "DEV0");
+	EmitNameInteger(aml, "_HID", DeviceIdKey("PNP0A08"));
+	EndDevice(aml, device);
+
+	device = BeginDevice(aml, "DEV1");
+	EmitNameString(aml, "_HID", "ACPI0007");
+	EndDevice(aml, device);
+
+	/* A string _HID and a compressed _CID naming the same ID */
+	device = BeginDevice(aml, "DEV2");
+	EmitNameString(aml, "_HID", "PNP0C0F");
+	EmitNameInteger(aml, "_CID", DeviceIdKey("PNP0A08"));
+	EndDevice(aml, device);
+
+	for (size_t i = 0; i < BULK_DEVICES; ++i) {
+		char name[5], id[8];
+		snprintf(name, sizeof(name), "B%03X", (unsigned)i);
+		snprintf(id, sizeof(id), "ABC%04X", (unsigned)i);
+
+		device = BeginDevice(aml, name);
+		EmitNameInteger(aml, "_HID", DeviceIdKey(id));
+		EndDevice(aml, device);
+	}
+
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(aml->Data, aml->Length);
+
+	return executive;
+}
+
+static void TestKeys() {
+	/* EisaId ("PNP0A08") as iasl compresses it */
+	CHECK(DeviceIdKey("PNP0A08") == 0x080AD041);
+	CHECK(DeviceIdKey("PNP0C0F") == 0x0F0CD041);
+	CHECK(!(DeviceIdKey("PNP0A08") & DEVICE_KEY_STRING));
+
+	/* Anything not in EISA form is hashed, and never equals a compressed ID */
+	CHECK(DeviceIdKey("ACPI0007") & DEVICE_KEY_STRING);
+	CHECK(DeviceIdKey("pnp0a08") & DEVICE_KEY_STRING);
+	CHECK(DeviceIdKey("PNP0A0G") & DEVICE_KEY_STRING);
+	CHECK(DeviceIdKey("PNP0A0") & DEVICE_KEY_STRING);
+	CHECK(DeviceIdKey("ACPI0007") != DeviceIdKey("ACPI0008"));
+	CHECK(DeviceIdKey("") == DeviceIdKey(""));
+}
+
+static void TestLookups() {
+	static AmlBuilder aml;
+	AMLExecutive *executive = BuildNamespace(&aml);
+	AML_DeviceIndex *index = CreateDeviceIndex(executive);
+
+	AML_NamespaceNode *dev0 = executive->FindNode("\\DEV0");
+	AML_NamespaceNode *dev1 = executive->FindNode("\\DEV1");
+	AML_NamespaceNode *dev2 = executive->FindNode("\\DEV2");
+	CHECK(dev0 != NULL && dev1 != NULL && dev2 != NULL);
+
+	CHECK(index->Count == BULK_DEVICES + 4);
+
+	AML_NamespaceNode *devices[4];
+	CHECK(FindDevices(index, "PNP0A08", devices, 4) == 2);
+	CHECK(devices[0] == dev0 && devices[1] == dev2);
+	CHECK(FindDevices(index, "PNP0C0F", devices, 4) == 1 && devices[0] == dev2);
+	CHECK(FindDevices(index, "ACPI0007", devices, 4) == 1 && devices[0] == dev1);
+	CHECK(FindDevices(index, "PNP0000", devices, 4) == 0);
+
+	/* Counted past max */
+	CHECK(FindDevices(index, "PNP0A08", devices, 1) == 2 && devices[0] == dev0);
+
+	/* Far more devices than buckets, every chain must still find its own */
+	size_t found = 0;
+	for (size_t i = 0; i < BULK_DEVICES; ++i) {
+		char name[6], id[8];
+		snprintf(name, sizeof(name), "\\B%03X", (unsigned)i);
+		snprintf(id, sizeof(id), "ABC%04X", (unsigned)i);
+
+		if (FindDevices(index, id, devices, 4) == 1 && devices[0] == executive->FindNode(name)) found++;
+	}
+	CHECK(found == BULK_DEVICES);
+
+	/* Removal then a rescan through the notify path */
+	RemoveDeviceSubtree(index, dev2);
+	CHECK(FindDevices(index, "PNP0A08", devices, 4) == 1 && devices[0] == dev0);
+	CHECK(FindDevices(index, "PNP0C0F", devices, 4) == 0);
+
+	CHECK(executive->Notify(dev2, AML_NOTIFY_DEVICE_CHECK));
+	CHECK(DeliverNotifications(executive->GetNotifyQueue()) == 1);
+	CHECK(FindDevices(index, "PNP0A08", devices, 4) == 2 && devices[1] == dev2);
+	CHECK(index->Count == BULK_DEVICES + 4);
+
+	/* Rescanning everything leaves the index as it was */
+	UpdateDeviceIndex(index, executive->GetNamespace()->Root);
+	CHECK(index->Count == BULK_DEVICES + 4);
+	CHECK(FindDevices(index, "PNP0A08", devices, 4) == 2 && devices[0] == dev0 && devices[1] == dev2);
+
+	DeleteDeviceIndex(index);
+	delete executive;
+}
+
+int main() {
+	TestKeys();
+	TestLookups();
+
+	return TEST_RESULT();
+}
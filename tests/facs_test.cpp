@@ -0,0 +1,219 @@
+#include "test.h"
+
+#include "aml_executive.h"
+#include "facs.h"
+#include "gas.h"
+
+#include <string.h>
+#include <thread>
+
+#define OS_THREADS 4
+#define ACQUISITIONS_PER_THREAD 20000
+#define FIRMWARE_ACQUISITIONS 5000
+
+/*
+ * Host memory stands in for the FACS and the PM1a control register, the
+ * stub maps physical memory one to one. Tests play the firmware's part of
+ * the protocol on the lock word themselves.
+ */
+static FACSTable Facs __attribute__((aligned(64)));
+static uint16_t PM1aControl;
+
+static uint32_t LockWord() {
+	return __atomic_load_n(&Facs.GlobalLock, __ATOMIC_ACQUIRE);
+}
+
+/* The firmware side of ACPI spec section 5.2.10.1, waiting until the OS lets go */
+static void FirmwareAcquire() {
+	uint32_t old = LockWord();
+
+	while (true) {
+		uint32_t next = (old & ~FACS_GLOBAL_LOCK_PENDING) | FACS_GLOBAL_LOCK_OWNED;
+		if (old & FACS_GLOBAL_LOCK_OWNED) next |= FACS_GLOBAL_LOCK_PENDING;
+
+		if (!__atomic_compare_exchange_n(&Facs.GlobalLock, &old, next, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) continue;
+		if (!(next & FACS_GLOBAL_LOCK_PENDING)) return;
+
+		while ((old = LockWord()) & FACS_GLOBAL_LOCK_OWNED) std::this_thread::yield();
+	}
+}
+
+static void FirmwareRelease() {
+	__atomic_and_fetch(&Facs.GlobalLock, ~(FACS_GLOBAL_LOCK_PENDING | FACS_GLOBAL_LOCK_OWNED), __ATOMIC_RELEASE);
+}
+
+static ACPI_FixedRegisters *CreateRegisters() {
+	FADTTable fadt;
+	memset(&fadt, 0, sizeof(fadt));
+	fadt.Header.Length = sizeof(fadt);
+	fadt.PM1ControlLength = 2;
+	fadt.X_PM1aControlBlock.AddressSpace = AML_REGION_SYSTEM_MEMORY;
+	fadt.X_PM1aControlBlock.BitWidth = 16;
+	fadt.X_PM1aControlBlock.Address = (uintptr_t)&PM1aControl;
+
+	return CreateFixedRegisters(&fadt);
+}
+
+/* Nobody else around, one compare-and-swap each way and no GBL_RLS */
+static void TestUncontended(AML_GlobalLock *lock) {
+	int owner;
+	CHECK(TryAcquireGlobalLock(lock, &owner));
+	CHECK(LockWord() == FACS_GLOBAL_LOCK_OWNED);
+
+	CHECK(TryAcquireGlobalLock(lock, &owner));
+	ReleaseGlobalLock(lock);
+	CHECK(LockWord() == FACS_GLOBAL_LOCK_OWNED);
+
+	ReleaseGlobalLock(lock);
+	CHECK(LockWord() == 0);
+	CHECK(PM1aControl == 0 && lock->Stats.ReleasesSignalled == 0);
+}
+
+/* The firmware's hold leaves our pending bit, and its request makes our release raise GBL_RLS */
+static void TestFirmwareHandoff(AML_GlobalLock *lock) {
+	int owner;
+	uint64_t contended = lock->Stats.FirmwareContended;
+
+	FirmwareAcquire();
+	CHECK(!TryAcquireGlobalLock(lock, &owner));
+	CHECK(LockWord() == (FACS_GLOBAL_LOCK_OWNED | FACS_GLOBAL_LOCK_PENDING));
+	CHECK(lock->Stats.FirmwareContended == contended + 1);
+
+	FirmwareRelease();
+	CHECK(TryAcquireGlobalLock(lock, &owner));
+
+	/* The firmware asks for it while we hold it */
+	__atomic_or_fetch(&Facs.GlobalLock, FACS_GLOBAL_LOCK_PENDING, __ATOMIC_RELEASE);
+	ReleaseGlobalLock(lock);
+
+	CHECK(LockWord() == 0);
+	CHECK(PM1aControl & PM1_CONTROL_GBL_RLS);
+	CHECK(lock->Stats.ReleasesSignalled == 1);
+	PM1aControl = 0;
+}
+
+/*
+ * Method (GLK0) { Return (Acquire (\_GL_, 0)) }
+ * Method (GLKW) { Return (Acquire (\_GL_, 0xFFFF)) }
+ */
+static uint8_t Dsdt[] = {
+	0x14, 0x10, 'G', 'L', 'K', '0', 0x00, 0xA4, 0x5B, 0x23, 0x5C, '_', 'G', 'L', '_', 0x00, 0x00,
+	0x14, 0x10, 'G', 'L', 'K', 'W', 0x00, 0xA4, 0x5B, 0x23, 0x5C, '_', 'G', 'L', '_', 0xFF, 0xFF,
+};
+
+static uint64_t Acquire(AMLExecutive *executive, const char *path) {
+	uint64_t timedOut = ~0ull;
+	executive->EvaluateInteger(executive->FindNode(path), &timedOut);
+
+	return timedOut;
+}
+
+/* Acquire (\_GL) goes through the FACS, a method that ends holding it gives it back */
+static void TestAml(AML_GlobalLock *lock) {
+	AMLExecutive *executive = new AMLExecutive;
+	executive->SetGlobalLock(lock);
+	executive->Parse(Dsdt, sizeof(Dsdt));
+
+	CHECK(Acquire(executive, "\\GLK0") == 0);
+	CHECK(LockWord() == 0);
+
+	FirmwareAcquire();
+	CHECK(Acquire(executive, "\\GLK0") != 0);
+
+	/* Waiting for good, the firmware lets go a little later */
+	std::thread firmware([]() {
+		for (int i = 0; i < 1000; ++i) std::this_thread::yield();
+		FirmwareRelease();
+	});
+
+	CHECK(Acquire(executive, "\\GLKW") == 0);
+	firmware.join();
+	CHECK(LockWord() == 0);
+
+	delete executive;
+}
+
+/*
+ * Cores of the OS and the firmware take turns, never two of them inside at
+ * once. Holders yield while inside, so each side finds the other holding it.
+ */
+static void TestContention(AML_GlobalLock *lock) {
+	static uint64_t counter = 0;
+	static uint32_t inside = 0;
+	static uint32_t overlaps = 0;
+
+	auto critical = []() {
+		if (__atomic_add_fetch(&inside, 1, __ATOMIC_ACQ_REL) != 1) __atomic_fetch_add(&overlaps, 1, __ATOMIC_RELAXED);
+		counter++;
+		std::this_thread::yield();
+		__atomic_sub_fetch(&inside, 1, __ATOMIC_ACQ_REL);
+	};
+
+	AML_GlobalLockStats before = lock->Stats;
+	uint64_t start = TestNanoseconds();
+
+	std::thread firmware([&]() {
+		for (int i = 0; i < FIRMWARE_ACQUISITIONS; ++i) {
+			FirmwareAcquire();
+			critical();
+			FirmwareRelease();
+			std::this_thread::yield();
+		}
+	});
+
+	std::thread cores[OS_THREADS];
+	for (size_t t = 0; t < OS_THREADS; ++t) {
+		cores[t] = std::thread([&, t]() {
+			for (int i = 0; i < ACQUISITIONS_PER_THREAD; ++i) {
+				while (!TryAcquireGlobalLock(lock, &cores[t])) std::this_thread::yield();
+				critical();
+				ReleaseGlobalLock(lock);
+			}
+		});
+	}
+
+	for (size_t t = 0; t < OS_THREADS; ++t) cores[t].join();
+	firmware.join();
+
+	uint64_t elapsed = TestNanoseconds() - start;
+
+	CHECK(overlaps == 0);
+	CHECK(counter == OS_THREADS * ACQUISITIONS_PER_THREAD + FIRMWARE_ACQUISITIONS);
+	CHECK(lock->Stats.Acquisitions - before.Acquisitions == OS_THREADS * ACQUISITIONS_PER_THREAD);
+	CHECK(LockWord() == 0);
+	CHECK(lock->Stats.FirmwareContended > before.FirmwareContended);
+	CHECK(lock->Stats.ReleasesSignalled > before.ReleasesSignalled);
+
+	printf("facs: %d cores and the firmware, %.2f M acquisitions/s, %llu found the firmware holding it, %llu releases signalled\n",
+	       OS_THREADS, elapsed != 0 ? counter * 1000.0 / elapsed : 0.0,
+	       (unsigned long long)(lock->Stats.FirmwareContended - before.FirmwareContended),
+	       (unsigned long long)(lock->Stats.ReleasesSignalled - before.ReleasesSignalled));
+}
+
+int main() {
+	memset(&Facs, 0, sizeof(Facs));
+	memcpy(Facs.Signature, "FACS", 4);
+	Facs.Length = sizeof(Facs);
+
+	ACPI_FixedRegisters *registers = CreateRegisters();
+	AML_GlobalLock *lock = CreateGlobalLock(&Facs, registers);
+	CHECK(lock->Lock == &Facs.GlobalLock);
+
+	TestUncontended(lock);
+	TestFirmwareHandoff(lock);
+	TestAml(lock);
+	TestContention(lock);
+
+	/* Without a FACS only the cores of the OS are kept apart */
+	AML_GlobalLock *local = CreateGlobalLock(NULL, registers);
+	int owner;
+	CHECK(local->Lock == NULL && TryAcquireGlobalLock(local, &owner));
+	CHECK(!TryAcquireGlobalLock(local, &lock));
+	ReleaseGlobalLock(local);
+	DeleteGlobalLock(local);
+
+	DeleteGlobalLock(lock);
+	DeleteFixedRegisters(registers);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,85 @@
+#include "test.h"
+
+#include "aml_executive.h"
+#include "field_access.h"
+
+#include <string.h>
+
+/* The region is host memory, the stub maps physical memory one to one */
+static uint8_t Register[4] __attribute__((aligned(8)));
+
+/*
+ * OperationRegion (REG0, SystemMemory, Register, 4)
+ * Field (REG0, ByteAcc, NoLock, Preserve) { FLD0, 4, FLD1, 4 }
+ * Method (WR__) { Store (One, FLD0) Store (2, FLD1) }
+ */
+static uint8_t Dsdt[] = {
+	0x5B, 0x80, 'R', 'E', 'G', '0', 0x00, 0x0E, 0, 0, 0, 0, 0, 0, 0, 0, 0x0A, 0x04,
+	0x5B, 0x81, 0x10, 'R', 'E', 'G', '0', 0x01, 'F', 'L', 'D', '0', 0x04, 'F', 'L', 'D', '1', 0x04,
+	0x14, 0x13, 'W', 'R', '_', '_', 0x00, 0x70, 0x01, 'F', 'L', 'D', '0', 0x70, 0x0A, 0x02, 'F', 'L', 'D', '1',
+};
+
+#define REGION_ADDRESS_OFFSET 8
+
+/* Two Stores to two units of one register are two read-modify-writes, never one */
+static void TestStores(AMLExecutive *executive) {
+	AML_FieldAccessStats before, after;
+	GetFieldAccessStats(&before);
+
+	Register[0] = 0xFF;
+	executive->ReleaseResult(executive->Evaluate(executive->FindNode("\\WR__")));
+
+	GetFieldAccessStats(&after);
+	CHECK(Register[0] == 0x21);
+	CHECK(after.UnitWrites - before.UnitWrites == 2);
+	CHECK(after.HardwareReads - before.HardwareReads == 2);
+	CHECK(after.HardwareWrites - before.HardwareWrites == 2);
+	CHECK(after.AccessesSaved == before.AccessesSaved);
+}
+
+/* Units of one call share the container, unless the same bits are written again */
+static void TestWriteFieldUnits(AMLExecutive *executive) {
+	AML_NamespaceNode *node = executive->FindNode("\\FLD0");
+	CHECK(node != NULL);
+	if (node == NULL) return;
+
+	Token *field = node->Object;
+	AML_FieldAccessStats before, after;
+
+	uint32_t units[2] = { 0, 1 };
+	uint64_t values[2] = { 0x3, 0xA };
+	GetFieldAccessStats(&before);
+
+	Register[0] = 0xFF;
+	CHECK(WriteFieldUnits(field, units, values, 2) == 0);
+
+	/* Both halves together cover the byte, nothing needs reading back */
+	GetFieldAccessStats(&after);
+	CHECK(Register[0] == 0xA3);
+	CHECK(after.HardwareReads == before.HardwareReads);
+	CHECK(after.HardwareWrites - before.HardwareWrites == 1);
+	CHECK(after.AccessesSaved - before.AccessesSaved == 3);
+
+	units[1] = 0;
+	GetFieldAccessStats(&before);
+	CHECK(WriteFieldUnits(field, units, values, 2) == 0);
+
+	GetFieldAccessStats(&after);
+	CHECK(Register[0] == 0xAA);
+	CHECK(after.HardwareWrites - before.HardwareWrites == 2);
+}
+
+int main() {
+	uint64_t address = (uintptr_t)Register;
+	memcpy(&Dsdt[REGION_ADDRESS_OFFSET], &address, sizeof(address));
+
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(Dsdt, sizeof(Dsdt));
+
+	TestStores(executive);
+	TestWriteFieldUnits(executive);
+
+	delete executive;
+
+	return TEST_RESULT();
+}
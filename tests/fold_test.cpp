@@ -0,0 +1,212 @@
+#include "test.h"
+
+#include "aml_executive.h"
+#include "aml_opcodes.h"
+#include "interpreter.h"
+
+#include <string.h>
+
+/*
+ * Every operation the folder knows is run twice: once in a method whose
+ * operands are literals, which is folded before it runs, and once in a
+ * method taking them as arguments, which cannot be. Both must agree.
+ */
+
+#define AML_MAX_SIZE 8192
+
+struct Aml {
+	uint8_t Data[AML_MAX_SIZE];
+	size_t Size;
+};
+
+static const uint64_t Values[] = {
+	0, 1, 2, 7, 31, 63, 64, 0xFF00, 0x8000000000000000ull, 0x123456789ABCDEF0ull, ~0ull,
+};
+
+#define VALUE_COUNT (sizeof(Values) / sizeof(Values[0]))
+
+struct FoldedOperation {
+	uint8_t Opcode;
+	/* Operands, then how many Zero targets follow them */
+	uint8_t Operands;
+	uint8_t Targets;
+};
+
+static const FoldedOperation Operations[] = {
+	{ AML_ADD_OP, 2, 1 }, { AML_SUBTRACT_OP, 2, 1 }, { AML_MULTIPLY_OP, 2, 1 }, { AML_DIVIDE_OP, 2, 2 },
+	{ AML_MOD_OP, 2, 1 }, { AML_SHL_OP, 2, 1 }, { AML_SHR_OP, 2, 1 }, { AML_AND_OP, 2, 1 },
+	{ AML_NAND_OP, 2, 1 }, { AML_OR_OP, 2, 1 }, { AML_NOR_OP, 2, 1 }, { AML_XOR_OP, 2, 1 },
+	{ AML_LAND_OP, 2, 0 }, { AML_LOR_OP, 2, 0 }, { AML_LEQUAL_OP, 2, 0 }, { AML_LGREATER_OP, 2, 0 },
+	{ AML_LLESS_OP, 2, 0 }, { AML_NOT_OP, 1, 1 }, { AML_FINDSETLEFTBIT_OP, 1, 1 }, { AML_FINDSETRIGHTBIT_OP, 1, 1 },
+	{ AML_LNOT_OP, 1, 0 },
+};
+
+static void Put(Aml *aml, const void *data, size_t size) {
+	memcpy(&aml->Data[aml->Size], data, size);
+	aml->Size += size;
+}
+
+static void PutByte(Aml *aml, uint8_t byte) {
+	Put(aml, &byte, 1);
+}
+
+static void PutQWord(Aml *aml, uint64_t value) {
+	PutByte(aml, 0x0E);
+	Put(aml, &value, sizeof(value));
+}
+
+/* The opcode, the PkgLength counting itself, then the body */
+static void PutPackage(Aml *aml, uint8_t opcode, const Aml *body) {
+	PutByte(aml, opcode);
+
+	if (body->Size + 1 <= 0x3F) {
+		PutByte(aml, body->Size + 1);
+	} else {
+		size_t length = body->Size + 2;
+		PutByte(aml, 0x40 | (length & 0x0F));
+		PutByte(aml, length >> 4);
+	}
+
+	Put(aml, body->Data, body->Size);
+}
+
+static void PutMethod(Aml *aml, const char *name, uint8_t args, const Aml *code) {
+	static Aml body;
+	body.Size = 0;
+
+	Put(&body, name, 4);
+	PutByte(&body, args);
+	Put(&body, code->Data, code->Size);
+
+	PutPackage(aml, 0x14, &body);
+}
+
+/* Return (Op (operands, Zero targets)), literal operands when args is NULL */
+static void PutReturn(Aml *code, const FoldedOperation *operation, const uint64_t *args) {
+	PutByte(code, 0xA4);
+	PutByte(code, operation->Opcode);
+
+	for (uint8_t i = 0; i < operation->Operands; ++i) {
+		if (args != NULL) PutQWord(code, args[i]);
+		else PutByte(code, 0x68 + i);
+	}
+
+	for (uint8_t i = 0; i < operation->Targets; ++i) PutByte(code, 0x00);
+}
+
+static char HexDigit(size_t value) {
+	return "0123456789ABCDEF"[value & 0x0F];
+}
+
+static bool Run(AMLExecutive *executive, const char *path, const uint64_t *args, size_t argCount, uint64_t *value) {
+	Token *result = executive->Evaluate(executive->FindNode(path), args, argCount);
+	bool found = result != NULL && GetTokenInteger(result, value);
+
+	executive->ReleaseResult(result);
+
+	return found;
+}
+
+/* Method RUN takes the operands, Fxy_ has operands x and y built in */
+static void TestOperation(const FoldedOperation *operation) {
+	static Aml dsdt, code;
+	dsdt.Size = 0;
+
+	code.Size = 0;
+	PutReturn(&code, operation, NULL);
+	PutMethod(&dsdt, "RUN_", operation->Operands, &code);
+
+	size_t combinations = operation->Operands == 2 ? VALUE_COUNT * VALUE_COUNT : VALUE_COUNT;
+	for (size_t i = 0; i < combinations; ++i) {
+		uint64_t args[2] = { Values[i % VALUE_COUNT], Values[i / VALUE_COUNT] };
+		char name[4] = { 'F', HexDigit(i >> 4), HexDigit(i), '_' };
+
+		code.Size = 0;
+		PutReturn(&code, operation, args);
+		PutMethod(&dsdt, name, 0, &code);
+	}
+
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(dsdt.Data, dsdt.Size);
+
+	AML_FoldStats before, after;
+	GetFoldStats(&before);
+
+	size_t results = 0;
+	for (size_t i = 0; i < combinations; ++i) {
+		uint64_t args[2] = { Values[i % VALUE_COUNT], Values[i / VALUE_COUNT] };
+		char path[6] = { '\\', 'F', HexDigit(i >> 4), HexDigit(i), '_', '\0' };
+
+		uint64_t folded = 0, unoptimized = 0;
+		bool foldedFound = Run(executive, path, NULL, 0, &folded);
+		bool unoptimizedFound = Run(executive, "\\RUN_", args, operation->Operands, &unoptimized);
+
+		CHECK(foldedFound == unoptimizedFound);
+		CHECK(folded == unoptimized);
+		if (foldedFound) results++;
+	}
+
+	/* Only the literal methods fold, one operation each, and only those that give a result */
+	GetFoldStats(&after);
+	CHECK(after.Folded - before.Folded == results);
+	CHECK(after.Methods - before.Methods == combinations + 1);
+
+	delete executive;
+}
+
+/*
+ * Name (CNST, 5)
+ * Method (SETC, 1) { Store (Arg0, CNST) }
+ * Method (NAMF) { If (LEqual (CNST, 5)) { Return (Add (CNST, 1)) } Else { Return (Zero) } }
+ * Method (NAMR, 1) { If (LEqual (Arg0, 5)) { Return (Add (Arg0, 1)) } Else { Return (Zero) } }
+ */
+static uint8_t BranchDsdt[] = {
+	0x08, 'C', 'N', 'S', 'T', 0x0A, 0x05,
+	0x14, 0x0C, 'S', 'E', 'T', 'C', 0x01, 0x70, 0x68, 'C', 'N', 'S', 'T',
+	0x14, 0x1B, 'N', 'A', 'M', 'F', 0x00,
+		0xA0, 0x10, 0x93, 'C', 'N', 'S', 'T', 0x0A, 0x05,
+			0xA4, 0x72, 'C', 'N', 'S', 'T', 0x01, 0x00,
+		0xA1, 0x03, 0xA4, 0x00,
+	0x14, 0x15, 'N', 'A', 'M', 'R', 0x01,
+		0xA0, 0x0A, 0x93, 0x68, 0x0A, 0x05,
+			0xA4, 0x72, 0x68, 0x01, 0x00,
+		0xA1, 0x03, 0xA4, 0x00,
+};
+
+/* A branch on a Name is pruned, and the method parsed again once the Name is written */
+static void TestBranches() {
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(BranchDsdt, sizeof(BranchDsdt));
+
+	AML_FoldStats before, after;
+	GetFoldStats(&before);
+
+	uint64_t folded = 0, unoptimized = 0;
+	uint64_t args[1] = { 5 };
+	CHECK(Run(executive, "\\NAMF", NULL, 0, &folded));
+	CHECK(Run(executive, "\\NAMR", args, 1, &unoptimized));
+	CHECK(folded == 6 && folded == unoptimized);
+
+	GetFoldStats(&after);
+	CHECK(after.Pruned - before.Pruned == 1);
+	CHECK(after.Removed > before.Removed);
+
+	args[0] = 7;
+	executive->ReleaseResult(executive->Evaluate(executive->FindNode("\\SETC"), args, 1));
+	CHECK(Run(executive, "\\NAMF", NULL, 0, &folded));
+	CHECK(Run(executive, "\\NAMR", args, 1, &unoptimized));
+	CHECK(folded == 0 && folded == unoptimized);
+
+	GetFoldStats(&after);
+	CHECK(after.Invalidations - before.Invalidations == 1);
+
+	delete executive;
+}
+
+int main() {
+	for (size_t i = 0; i < sizeof(Operations) / sizeof(Operations[0]); ++i) TestOperation(&Operations[i]);
+
+	TestBranches();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,147 @@
+#include "test.h"
+
+#include "gas.h"
+#include "region.h"
+
+#include <string.h>
+
+/* Host memory stands in for the register space, the stub maps physical memory one to one */
+static uint8_t Space[256] __attribute__((aligned(8)));
+
+#define PM1_OFFSET 0x00
+#define GPE0_OFFSET 0x40
+#define GPE0_LENGTH 40
+
+static void SetMemoryGAS(GenericAddressStructure *gas, uint32_t offset, uint8_t bitWidth, uint8_t bitOffset, uint8_t accessSize) {
+	gas->AddressSpace = AML_REGION_SYSTEM_MEMORY;
+	gas->BitWidth = bitWidth;
+	gas->BitOffset = bitOffset;
+	gas->AccessSize = accessSize;
+	gas->Address = (uintptr_t)&Space[offset];
+}
+
+static uint16_t Read16(uint32_t offset) {
+	uint16_t value;
+	memcpy(&value, &Space[offset], sizeof(value));
+	return value;
+}
+
+static void Write16(uint32_t offset, uint16_t value) {
+	memcpy(&Space[offset], &value, sizeof(value));
+}
+
+/* GPE0 wider than a register can be, 20 status bytes then 20 enable bytes */
+static void TestFixedRegisters() {
+	FADTTable fadt;
+	memset(&fadt, 0, sizeof(fadt));
+	fadt.Header.Length = sizeof(fadt);
+	fadt.PM1EventLength = 4;
+	fadt.GPE0Length = GPE0_LENGTH;
+	SetMemoryGAS(&fadt.X_PM1aEventBlock, PM1_OFFSET, 32, 0, 0);
+	/* 320 bits do not fit the bit width, firmware leaves it at zero */
+	SetMemoryGAS(&fadt.X_GPE0Block, GPE0_OFFSET, 0, 0, 1);
+
+	memset(Space, 0, sizeof(Space));
+	ACPI_FixedRegisters *registers = CreateFixedRegisters(&fadt);
+
+	CHECK(registers->GPE0.Count == GPE0_LENGTH / 2);
+	CHECK(registers->GPE1.Count == 0 && registers->GPE1.Status == NULL);
+
+	/* The last enable byte is past the first 64 bits, and it alone changes */
+	Space[GPE0_OFFSET + GPE0_LENGTH - 2] = 0x5A;
+	WriteGAS(&registers->GPE0.Enable[19], 0x80);
+	CHECK(Space[GPE0_OFFSET + GPE0_LENGTH - 1] == 0x80);
+	CHECK(Space[GPE0_OFFSET + GPE0_LENGTH - 2] == 0x5A);
+	CHECK(ReadGAS(&registers->GPE0.Enable[18]) == 0x5A);
+
+	/* Status bytes come before the enable bytes */
+	Space[GPE0_OFFSET + 15] = 0x24;
+	CHECK(ReadGAS(&registers->GPE0.Status[15]) == 0x24);
+	CHECK(registers->GPE0.Status[3].WriteClear && !registers->GPE0.Enable[3].WriteClear);
+
+	/* PM1 status below the enable half, both 16 bits */
+	Write16(PM1_OFFSET, 0x8001);
+	Write16(PM1_OFFSET + 2, 0x0120);
+	CHECK(ReadGAS(&registers->PM1aStatus) == 0x8001);
+	CHECK(ReadGAS(&registers->PM1aEnable) == 0x0120);
+	CHECK(registers->PM1aStatus.WriteClear && !registers->PM1aEnable.WriteClear);
+	CHECK(!registers->PM1bStatus.Valid && ReadGAS(&registers->PM1bStatus) == 0);
+
+	WriteGAS(&registers->PM1aEnable, 0x0100);
+	CHECK(Read16(PM1_OFFSET + 2) == 0x0100 && Read16(PM1_OFFSET) == 0x8001);
+
+	DeleteFixedRegisters(registers);
+}
+
+/* An ACPI 1.0 FADT only has the port numbers, the stub ports read as all ones */
+static void TestLegacyBlocks() {
+	FADTTable fadt;
+	memset(&fadt, 0, sizeof(fadt));
+	fadt.Header.Length = __builtin_offsetof(FADTTable, ResetReg);
+	fadt.GPE0Block = 0x20;
+	fadt.GPE0Length = 16;
+	SetMemoryGAS(&fadt.X_GPE0Block, GPE0_OFFSET, 64, 0, 0);
+
+	ACPI_FixedRegisters *registers = CreateFixedRegisters(&fadt);
+
+	CHECK(registers->GPE0.Count == 8);
+	CHECK(registers->GPE0.Enable[0].Space == AML_REGION_SYSTEM_IO && registers->GPE0.Enable[0].Address == 0x28);
+	CHECK(ReadGAS(&registers->GPE0.Status[7]) == 0xFF);
+	CHECK(!registers->Reset.Valid);
+
+	DeleteFixedRegisters(registers);
+}
+
+/*
+ * A read-modify-write of a status register would write back every bit that
+ * was set and clear events nobody handled. Write-clear registers put zeroes
+ * around the target bits instead, whichever accessor ends up being used.
+ */
+static void TestWriteClear() {
+	GenericAddressStructure gas;
+	GAS_Register reg;
+
+	/* Bits 8 to 15 of a 16-bit unit, the shifted accessors */
+	SetMemoryGAS(&gas, 0, 8, 8, 2);
+	ResolveGAS(&reg, &gas);
+
+	Write16(0, 0xFFFF);
+	WriteGAS(&reg, 0x12);
+	CHECK(Read16(0) == 0x12FF);
+
+	MarkWriteClear(&reg);
+	Write16(0, 0xFFFF);
+	WriteGAS(&reg, 0x12);
+	CHECK(Read16(0) == 0x1200);
+	CHECK(ReadGAS(&reg) == 0x12);
+
+	/* Bits 4 to 11 through byte accesses, the generic path */
+	SetMemoryGAS(&gas, 0, 8, 4, 1);
+	ResolveGAS(&reg, &gas);
+
+	Write16(0, 0xFFFF);
+	WriteGAS(&reg, 0x00);
+	CHECK(Space[0] == 0x0F && Space[1] == 0xF0);
+
+	MarkWriteClear(&reg);
+	Write16(0, 0xFFFF);
+	WriteGAS(&reg, 0x81);
+	CHECK(Space[0] == 0x10 && Space[1] == 0x08);
+
+	/* A whole register is written as given either way */
+	SetMemoryGAS(&gas, 0, 16, 0, 2);
+	ResolveGAS(&reg, &gas);
+	MarkWriteClear(&reg);
+
+	Write16(0, 0xFFFF);
+	WriteGAS(&reg, 0x0004);
+	CHECK(Read16(0) == 0x0004);
+}
+
+int main() {
+	TestFixedRegisters();
+	TestLegacyBlocks();
+	TestWriteClear();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,203 @@
+#include "test.h"
+
+#include "hpet.h"
+#include "aml_opcodes.h"
+
+#include <string.h>
+
+/* 14.31818 MHz, the usual chipset HPET, its period rounded down */
+#define PERIOD_FS 69841279ull
+#define COMPARATORS 8
+#define MINIMUM_TICK 128
+
+/* Comparators 0 and 1 can be periodic, comparator 3 only counts in 32 bits */
+#define PERIODIC_COMPARATORS 0x3
+#define NARROW_COMPARATOR 3
+
+/* Host memory stands in for the registers, the stub maps physical memory one to one */
+static uint64_t Registers[0x200 / 8];
+
+static uint64_t *Register(uint32_t offset) {
+	return &Registers[offset / 8];
+}
+
+static void ResetRegisters(bool counter64) {
+	memset(Registers, 0, sizeof(Registers));
+	*Register(HPET_CAPABILITIES) = (PERIOD_FS << 32) | ((COMPARATORS - 1) << 8) | (counter64 ? HPET_CAP_COUNTER_64 : 0);
+
+	for (uint8_t i = 0; i < COMPARATORS; ++i) {
+		uint64_t config = (1ull << (32 + 20)) | (1ull << (32 + 22));
+		if (PERIODIC_COMPARATORS & (1u << i)) config |= HPET_TIMER_PERIODIC_CAPABLE;
+		if (i != NARROW_COMPARATOR) config |= HPET_TIMER_64_CAPABLE;
+
+		/* Whatever the firmware left armed */
+		config |= HPET_TIMER_ENABLE;
+		*Register(HPET_TIMER_CONFIGURATION(i)) = config;
+	}
+}
+
+static void BuildTable(HPETTable *table) {
+	memset(table, 0, sizeof(*table));
+	table->Address.AddressSpace = AML_REGION_SYSTEM_MEMORY;
+	table->Address.Address = (uintptr_t)Registers;
+	table->MinimumTick = MINIMUM_TICK;
+}
+
+/* The table and the capabilities register come out as given, firmware leftovers disarmed */
+static void TestDecode() {
+	HPETTable table;
+	BuildTable(&table);
+	ResetRegisters(true);
+
+	HPET_Clock *clock = CreateHPETClock(&table);
+	CHECK(clock != NULL);
+	if (clock == NULL) return;
+
+	CHECK(clock->Period == PERIOD_FS && clock->Frequency == 14318179);
+	CHECK(clock->Is64Bit && clock->ComparatorCount == COMPARATORS && clock->MinimumTick == MINIMUM_TICK);
+	CHECK(clock->PeriodicMask == PERIODIC_COMPARATORS);
+	CHECK(*Register(HPET_CONFIGURATION) & HPET_CONFIG_ENABLE);
+
+	for (uint8_t i = 0; i < COMPARATORS; ++i) CHECK(!(*Register(HPET_TIMER_CONFIGURATION(i)) & HPET_TIMER_ENABLE));
+
+	DeleteHPETClock(clock);
+
+	/* Only memory mapped blocks with a period are taken */
+	table.Address.AddressSpace = AML_REGION_SYSTEM_IO;
+	CHECK(CreateHPETClock(&table) == NULL);
+
+	BuildTable(&table);
+	*Register(HPET_CAPABILITIES) &= 0xFFFFFFFF;
+	CHECK(CreateHPETClock(&table) == NULL);
+}
+
+/* The fixed point multipliers stay within a unit per 2^32 units converted of the exact result */
+static void TestConversion(HPET_Clock *clock) {
+	static const uint64_t ticks[] = { 0, 1, 14318180, 1ull << 32, 1ull << 40, 0x0123456789ABull };
+
+	for (size_t i = 0; i < sizeof(ticks) / sizeof(ticks[0]); ++i) {
+		*Register(HPET_MAIN_COUNTER) = ticks[i];
+
+		uint64_t exact = (unsigned __int128)ticks[i] * PERIOD_FS / 1000000;
+		uint64_t ns = ReadHPETNanoseconds(clock);
+		CHECK(ns <= exact && exact - ns <= (ticks[i] >> 32) + 1);
+
+		uint64_t back = HPETNsToTicks(clock, ns);
+		CHECK(back <= ticks[i] && ticks[i] - back <= (ns >> 32) + 1);
+	}
+
+	/* One second is one second */
+	uint64_t second = HPETNsToTicks(clock, 1000000000ull);
+	CHECK(second >= 14318179 && second <= 14318180);
+}
+
+/* A 32 bit counter keeps counting past its wrap, a late reader never goes backwards */
+static void TestNarrowCounter() {
+	HPETTable table;
+	BuildTable(&table);
+	ResetRegisters(false);
+
+	/* Created while the counter was in its upper half */
+	*Register(HPET_MAIN_COUNTER) = 0xFFFFFF00;
+	HPET_Clock *clock = CreateHPETClock(&table);
+	CHECK(clock != NULL && !clock->Is64Bit);
+	if (clock == NULL) return;
+
+	CHECK(ReadHPETCounter(clock) == 0xFFFFFF00);
+
+	*Register(HPET_MAIN_COUNTER) = 0x100;
+	CHECK(ReadHPETCounter(clock) == 0x100000100ull);
+
+	CHECK(ExtendHPETCounter(clock, 0xFFFFFFF0) == 0x100000100ull);
+
+	*Register(HPET_MAIN_COUNTER) = 0x80000000;
+	CHECK(ReadHPETCounter(clock) == 0x180000000ull);
+
+	DeleteHPETClock(clock);
+}
+
+/* Periodic requests get the periodic capable comparators, the rest go elsewhere first */
+static void TestAllocation(HPET_Clock *clock) {
+	CHECK(AllocateHPETComparator(clock, false) == 2);
+	CHECK(AllocateHPETComparator(clock, true) == 0);
+	CHECK(AllocateHPETComparator(clock, true) == 1);
+	CHECK(AllocateHPETComparator(clock, true) == -1);
+
+	for (int i = 3; i < COMPARATORS; ++i) CHECK(AllocateHPETComparator(clock, false) == i);
+	CHECK(AllocateHPETComparator(clock, false) == -1);
+
+	ReleaseHPETComparator(clock, 1);
+	CHECK(AllocateHPETComparator(clock, false) == 1);
+
+	for (uint8_t i = 0; i < COMPARATORS; ++i) ReleaseHPETComparator(clock, i);
+	CHECK(clock->Allocated == 0);
+}
+
+static void TestArming(HPET_Clock *clock) {
+	*Register(HPET_MAIN_COUNTER) = 1000;
+
+	/* Shorter than the minimum tick, it is raised to it */
+	ArmHPETOneShot(clock, 2, 1000);
+	CHECK(*Register(HPET_TIMER_COMPARATOR(2)) == 1000 + MINIMUM_TICK);
+	uint64_t config = *Register(HPET_TIMER_CONFIGURATION(2));
+	CHECK((config & HPET_TIMER_ENABLE) && !(config & HPET_TIMER_PERIODIC));
+
+	ArmHPETOneShot(clock, 2, 1000000);
+	CHECK(*Register(HPET_TIMER_COMPARATOR(2)) == 1000 + HPETNsToTicks(clock, 1000000));
+
+	DisarmHPETComparator(clock, 2);
+	CHECK(!(*Register(HPET_TIMER_CONFIGURATION(2)) & HPET_TIMER_ENABLE));
+
+	/* The stand-in keeps the last write, with VALUE_SET that is the period */
+	CHECK(!ArmHPETPeriodic(clock, 2, 1000000));
+	CHECK(ArmHPETPeriodic(clock, 0, 1000000));
+	config = *Register(HPET_TIMER_CONFIGURATION(0));
+	CHECK((config & (HPET_TIMER_ENABLE | HPET_TIMER_PERIODIC | HPET_TIMER_VALUE_SET)) == (HPET_TIMER_ENABLE | HPET_TIMER_PERIODIC | HPET_TIMER_VALUE_SET));
+	CHECK(*Register(HPET_TIMER_COMPARATOR(0)) == HPETNsToTicks(clock, 1000000));
+	DisarmHPETComparator(clock, 0);
+
+	/* Only the IRQs the comparator lists */
+	CHECK(GetHPETComparatorRoutes(clock, 4) == ((1u << 20) | (1u << 22)));
+	CHECK(!RouteHPETComparator(clock, 4, 21, false));
+	CHECK(RouteHPETComparator(clock, 4, 22, true));
+	config = *Register(HPET_TIMER_CONFIGURATION(4));
+	CHECK(((config & HPET_TIMER_ROUTE_MASK) >> HPET_TIMER_ROUTE_SHIFT) == 22 && (config & HPET_TIMER_LEVEL));
+}
+
+/* A 32 bit comparator is compared in 32 bits, across the counter's wrap */
+static void TestPassed(HPET_Clock *clock) {
+	*Register(HPET_TIMER_COMPARATOR(NARROW_COMPARATOR)) = 0xFFFFFFF0;
+	*Register(HPET_MAIN_COUNTER) = 0x100000010ull;
+	CHECK(HPETComparatorPassed(clock, NARROW_COMPARATOR));
+
+	*Register(HPET_MAIN_COUNTER) = 0xFFFFFF00;
+	CHECK(!HPETComparatorPassed(clock, NARROW_COMPARATOR));
+
+	*Register(HPET_TIMER_COMPARATOR(5)) = 0x100000000ull;
+	*Register(HPET_MAIN_COUNTER) = 0xFFFFFFFF;
+	CHECK(!HPETComparatorPassed(clock, 5));
+
+	*Register(HPET_MAIN_COUNTER) = 0x100000000ull;
+	CHECK(HPETComparatorPassed(clock, 5));
+}
+
+int main() {
+	TestDecode();
+	TestNarrowCounter();
+
+	HPETTable table;
+	BuildTable(&table);
+	ResetRegisters(true);
+	HPET_Clock *clock = CreateHPETClock(&table);
+	CHECK(clock != NULL);
+	if (clock == NULL) return TEST_RESULT();
+
+	TestConversion(clock);
+	TestAllocation(clock);
+	TestArming(clock);
+	TestPassed(clock);
+
+	DeleteHPETClock(clock);
+
+	return TEST_RESULT();
+}
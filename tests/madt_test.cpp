@@ -0,0 +1,183 @@
+#include "test.h"
+
+#include "madt.h"
+
+#include <string.h>
+
+struct TableBuilder {
+	uint8_t Data[1024];
+	size_t Length;
+};
+
+static void Append(TableBuilder *table, const void *entry, size_t length) {
+	memcpy(&table->Data[table->Length], entry, length);
+	table->Length += length;
+}
+
+static MADTTable *StartMADT(TableBuilder *table) {
+	memset(table, 0, sizeof(*table));
+	table->Length = sizeof(MADTTable);
+
+	MADTTable *madt = (MADTTable*)table->Data;
+	memcpy(madt->Header.Signature, "APIC", 4);
+	madt->LocalAPICAddress = 0xFEE00000;
+
+	return madt;
+}
+
+static MADTTable *FinishMADT(TableBuilder *table) {
+	MADTTable *madt = (MADTTable*)table->Data;
+	madt->Header.Length = table->Length;
+
+	return madt;
+}
+
+static void AddLocalAPIC(TableBuilder *table, uint8_t uid, uint8_t apicId, uint32_t flags) {
+	MADTLocalAPIC lapic = { { MADT_LOCAL_APIC, sizeof(MADTLocalAPIC) }, uid, apicId, flags };
+	Append(table, &lapic, sizeof(lapic));
+}
+
+static void AddIOAPIC(TableBuilder *table, uint8_t id, uint32_t address, uint32_t gsiBase) {
+	MADTIOAPIC ioapic = { { MADT_IO_APIC, sizeof(MADTIOAPIC) }, id, 0, address, gsiBase };
+	Append(table, &ioapic, sizeof(ioapic));
+}
+
+static void AddOverride(TableBuilder *table, uint8_t source, uint32_t gsi, uint16_t flags) {
+	MADTInterruptOverride override = { { MADT_INTERRUPT_OVERRIDE, sizeof(MADTInterruptOverride) }, 0, source, gsi, flags };
+	Append(table, &override, sizeof(override));
+}
+
+static void AddLocalAPICNMI(TableBuilder *table, uint8_t uid, uint8_t lint, uint16_t flags) {
+	MADTLocalAPICNMI nmi = { { MADT_LOCAL_APIC_NMI, sizeof(MADTLocalAPICNMI) }, uid, flags, lint };
+	Append(table, &nmi, sizeof(nmi));
+}
+
+static void TestDecode() {
+	TableBuilder table;
+	StartMADT(&table);
+
+	/* NMI entries ahead of the processors they name */
+	AddLocalAPICNMI(&table, 1, 0, 0x0C);
+	AddLocalAPIC(&table, 0, 0, MADT_CPU_ENABLED);
+	AddLocalAPIC(&table, 1, 2, MADT_CPU_ENABLED);
+	AddLocalAPIC(&table, 2, 4, 0);
+	AddLocalAPIC(&table, 3, 6, MADT_CPU_ONLINE_CAPABLE);
+	AddIOAPIC(&table, 1, 0xFEC00000, 0);
+	AddIOAPIC(&table, 2, 0xFEC01000, 24);
+	AddOverride(&table, 0, 2, 0);
+	AddOverride(&table, 9, 9, 0x0D);
+	AddLocalAPICNMI(&table, 0xFF, 1, 0x05);
+
+	CPUTopology *topology = CreateCPUTopology(FinishMADT(&table));
+
+	CHECK(topology->LocalAPICAddress == 0xFEE00000);
+	CHECK(topology->CPUCount == 3);
+	CHECK(FindCPUByUID(topology, 1) == 1 && FindCPUByUID(topology, 2) == -1 && FindCPUByUID(topology, 3) == 2);
+	CHECK(topology->HardwareID[1] == 2 && topology->HardwareID[2] == 6);
+
+	/* The broadcast entry comes last and wins */
+	CHECK(topology->NMILINT[0] == 1 && topology->NMILINT[1] == 1 && topology->NMIFlags[1] == 0x05);
+
+	uint16_t flags;
+	CHECK(ISAIrqToGSI(topology, 0, &flags) == 2 && flags == 0);
+	CHECK(ISAIrqToGSI(topology, 9, &flags) == 9 && flags == 0x0D);
+	CHECK(ISAIrqToGSI(topology, 4, &flags) == 4);
+	CHECK(ISAIrqToGSI(topology, 20, &flags) == 20 && flags == 0);
+
+	/* Ranges are whatever the caller read from the I/O APICs, here 24 inputs each */
+	CHECK(topology->IOAPICCount == 2 && topology->IOAPICs[1].Address == 0xFEC01000);
+	topology->IOAPICs[0].GSICount = 24;
+	topology->IOAPICs[1].GSICount = 24;
+	MapIOAPICRanges(topology);
+
+	CHECK(topology->GSICount == 48);
+	CHECK(FindIOAPICForGSI(topology, 0) == 0 && FindIOAPICForGSI(topology, 23) == 0);
+	CHECK(FindIOAPICForGSI(topology, 24) == 1 && FindIOAPICForGSI(topology, 47) == 1);
+	CHECK(FindIOAPICForGSI(topology, 48) == -1);
+
+	DeleteCPUTopology(topology);
+}
+
+static void TestGaps() {
+	TableBuilder table;
+	StartMADT(&table);
+
+	AddIOAPIC(&table, 1, 0xFEC00000, 0);
+	AddIOAPIC(&table, 2, 0xFEC01000, 64);
+
+	CPUTopology *topology = CreateCPUTopology(FinishMADT(&table));
+	topology->IOAPICs[0].GSICount = 16;
+	topology->IOAPICs[1].GSICount = 8;
+	MapIOAPICRanges(topology);
+
+	CHECK(topology->GSICount == 72);
+	CHECK(FindIOAPICForGSI(topology, 15) == 0);
+	CHECK(FindIOAPICForGSI(topology, 16) == -1 && FindIOAPICForGSI(topology, 63) == -1);
+	CHECK(FindIOAPICForGSI(topology, 64) == 1);
+
+	DeleteCPUTopology(topology);
+}
+
+static void TestMalformed() {
+	TableBuilder table;
+	StartMADT(&table);
+
+	/* Many 6 byte NMI entries, shorter than anything the arrays used to be sized by */
+	for (size_t i = 0; i < 100; ++i) AddLocalAPICNMI(&table, 0xFF, 1, 0);
+
+	/* An I/O APIC too short for its fields */
+	MADTEntryHeader shortIOAPIC = { MADT_IO_APIC, 4 };
+	Append(&table, &shortIOAPIC, sizeof(shortIOAPIC));
+	Append(&table, "\0\0", 2);
+
+	/* An unknown entry */
+	uint8_t unknown[3] = { 0x7F, 3, 0 };
+	Append(&table, unknown, sizeof(unknown));
+
+	AddLocalAPIC(&table, 0, 0, MADT_CPU_ENABLED);
+
+	CPUTopology *topology = CreateCPUTopology(FinishMADT(&table));
+	CHECK(topology->CPUCount == 1 && topology->IOAPICCount == 0);
+	CHECK(topology->NMILINT[0] == 1);
+	DeleteCPUTopology(topology);
+
+	/* An entry running past the table ends it */
+	StartMADT(&table);
+	AddLocalAPIC(&table, 0, 0, MADT_CPU_ENABLED);
+	AddLocalAPIC(&table, 1, 1, MADT_CPU_ENABLED);
+	MADTTable *madt = FinishMADT(&table);
+	madt->Header.Length -= 2;
+
+	topology = CreateCPUTopology(madt);
+	CHECK(topology->CPUCount == 1);
+	DeleteCPUTopology(topology);
+
+	/* A zero length entry cannot be stepped over */
+	StartMADT(&table);
+	MADTEntryHeader empty = { MADT_LOCAL_APIC, 0 };
+	Append(&table, &empty, sizeof(empty));
+	AddLocalAPIC(&table, 0, 0, MADT_CPU_ENABLED);
+
+	topology = CreateCPUTopology(FinishMADT(&table));
+	CHECK(topology->CPUCount == 0);
+	DeleteCPUTopology(topology);
+
+	/* A header shorter than the fixed part */
+	StartMADT(&table);
+	madt = FinishMADT(&table);
+	madt->Header.Length = 8;
+
+	topology = CreateCPUTopology(madt);
+	CHECK(topology->CPUCount == 0 && topology->IOAPICCount == 0 && topology->NMISourceCount == 0);
+	MapIOAPICRanges(topology);
+	CHECK(FindIOAPICForGSI(topology, 0) == -1);
+	DeleteCPUTopology(topology);
+}
+
+int main() {
+	TestDecode();
+	TestGaps();
+	TestMalformed();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,265 @@
+#include "test.h"
+
+#include "aml_executive.h"
+#include "interpreter.h"
+#include "memory.h"
+
+#include <string.h>
+
+/*
+ * The reference corpus is generated here, shaped like what firmware ships:
+ * a PCI root full of devices with _ADR, _STA, _PRW and a _CRS buffer, and
+ * a table of methods, loops and strings. Each one must keep no more than
+ * a bound of tagged memory per KB of AML, and tearing the executive down
+ * must give every byte back.
+ */
+
+#define PCI_DEVICES 48
+#define METHODS 64
+
+/*
+ * Measured at 113 KB and 209 KB, nearly all of it the 128 name slots of
+ * every TokenList. Method bodies are parsed on their first call and kept,
+ * so the second bound is once everything has run. Both trip only when the
+ * footprint grows for real.
+ */
+#define MAX_PARSED_PER_KB (128 * 1024)
+#define MAX_RESIDENT_PER_KB (256 * 1024)
+
+#define AML_MAX_SIZE 16384
+
+struct Aml {
+	uint8_t Data[AML_MAX_SIZE];
+	size_t Size;
+};
+
+static void Put(Aml *aml, const void *data, size_t size) {
+	memcpy(&aml->Data[aml->Size], data, size);
+	aml->Size += size;
+}
+
+static void PutByte(Aml *aml, uint8_t byte) {
+	Put(aml, &byte, 1);
+}
+
+static void PutDWord(Aml *aml, uint32_t value) {
+	PutByte(aml, 0x0C);
+	Put(aml, &value, sizeof(value));
+}
+
+static void PutString(Aml *aml, const char *string) {
+	PutByte(aml, 0x0D);
+	Put(aml, string, strlen(string) + 1);
+}
+
+/* The opcode, the PkgLength counting itself, then the body. Two bytes cover up to 4 KB */
+static void PutPackage(Aml *aml, uint8_t opcode, const Aml *body) {
+	PutByte(aml, opcode);
+
+	if (body->Size + 1 <= 0x3F) {
+		PutByte(aml, body->Size + 1);
+	} else {
+		size_t length = body->Size + 2;
+		PutByte(aml, 0x40 | (length & 0x0F));
+		PutByte(aml, length >> 4);
+	}
+
+	Put(aml, body->Data, body->Size);
+}
+
+static void PutName(Aml *aml, const char *name) {
+	PutByte(aml, 0x08);
+	Put(aml, name, 4);
+}
+
+static void IndexedName(char *name, char prefix, size_t index) {
+	name[0] = prefix;
+	name[1] = "0123456789ABCDEF"[(index >> 8) & 0x0F];
+	name[2] = "0123456789ABCDEF"[(index >> 4) & 0x0F];
+	name[3] = "0123456789ABCDEF"[index & 0x0F];
+}
+
+/*
+ * Device (PCI0) {
+ *     Name (_HID, "PNP0A08")
+ *     Device (Dxxx) {
+ *         Name (_ADR, xxxx0000)
+ *         Method (_STA) { Return (0x0F) }
+ *         Name (_PRW, Package () { 0x0D, 0x03 })
+ *         Name (_CRS, ResourceTemplate () { IRQNoFlags () { 5 } Memory32Fixed (ReadWrite, ..., 0x1000) })
+ *     }
+ * }
+ */
+static void BuildPciTable(Aml *table) {
+	static Aml root, device, body;
+	table->Size = 0;
+
+	root.Size = 0;
+	Put(&root, "PCI0", 4);
+	PutName(&root, "_HID");
+	PutString(&root, "PNP0A08");
+
+	for (size_t i = 0; i < PCI_DEVICES; ++i) {
+		device.Size = 0;
+		char name[4];
+		IndexedName(name, 'D', i);
+		Put(&device, name, 4);
+
+		PutName(&device, "_ADR");
+		PutDWord(&device, (uint32_t)i << 16);
+
+		body.Size = 0;
+		Put(&body, "_STA", 4);
+		PutByte(&body, 0x00);
+		PutByte(&body, 0xA4);
+		PutByte(&body, 0x0A);
+		PutByte(&body, 0x0F);
+		PutPackage(&device, 0x14, &body);
+
+		static const uint8_t prw[] = { 0x02, 0x0A, 0x0D, 0x0A, 0x03 };
+		PutName(&device, "_PRW");
+		body.Size = 0;
+		Put(&body, prw, sizeof(prw));
+		PutPackage(&device, 0x12, &body);
+
+		uint32_t base = 0xFE000000 + i * 0x1000;
+		uint8_t crs[] = {
+			0x0A, 0x11,
+			0x22, 0x20, 0x00,
+			0x86, 0x09, 0x00, 0x01,
+			(uint8_t)base, (uint8_t)(base >> 8), (uint8_t)(base >> 16), (uint8_t)(base >> 24),
+			0x00, 0x10, 0x00, 0x00,
+			0x79, 0x00,
+		};
+		PutName(&device, "_CRS");
+		body.Size = 0;
+		Put(&body, crs, sizeof(crs));
+		PutPackage(&device, 0x11, &body);
+
+		PutByte(&root, 0x5B);
+		PutPackage(&root, 0x82, &device);
+	}
+
+	/* The device list outgrows a two byte PkgLength, so it goes in as three */
+	size_t length = root.Size + 3;
+	PutByte(table, 0x5B);
+	PutByte(table, 0x82);
+	PutByte(table, 0x80 | (length & 0x0F));
+	PutByte(table, length >> 4);
+	PutByte(table, length >> 12);
+	Put(table, root.Data, root.Size);
+}
+
+/*
+ * Name (Sxxx, "Firmware string number xxx")
+ * Method (Mxxx, 1) { Store (Zero, Local0) While (LLess (Local0, Arg0)) { Increment (Local0) } Return (Local0) }
+ */
+static void BuildMethodTable(Aml *table) {
+	static Aml body;
+	table->Size = 0;
+
+	for (size_t i = 0; i < METHODS; ++i) {
+		char name[4];
+		char string[32] = "Firmware string number ";
+		IndexedName(name, 'S', i);
+		memcpy(&string[23], &name[1], 3);
+
+		PutName(table, name);
+		PutString(table, string);
+
+		static const uint8_t code[] = {
+			0x70, 0x00, 0x60,
+			0xA2, 0x06, 0x95, 0x60, 0x68, 0x75, 0x60,
+			0xA4, 0x60,
+		};
+
+		body.Size = 0;
+		IndexedName(name, 'M', i);
+		Put(&body, name, 4);
+		PutByte(&body, 0x01);
+		Put(&body, code, sizeof(code));
+		PutPackage(table, 0x14, &body);
+	}
+}
+
+static void PrintTags(const char *table) {
+	static const char *names[ACPI_MEMORY_TAG_COUNT] = {
+		"tables", "tokens", "names", "buffers", "strings", "frames", "profile", "recording",
+	};
+
+	for (int tag = 0; tag < ACPI_MEMORY_TAG_COUNT; ++tag) {
+		ACPI_MemoryStats stats;
+		GetMemoryStats((ACPI_MemoryTag)tag, &stats);
+		if (stats.Live != 0) printf("memory: %s, %s %llu bytes live\n", table, names[tag], (unsigned long long)stats.Live);
+	}
+}
+
+static uint64_t PerKB(const ACPI_MemoryStats *before, const ACPI_MemoryStats *now, Aml *table) {
+	return (now->Live - before->Live) * 1024 / table->Size;
+}
+
+/* Every _STA of the PCI table, or every method of the other one */
+static void EvaluateAll(AMLExecutive *executive, Aml *table) {
+	bool pci = table->Data[0] == 0x5B;
+	size_t count = pci ? PCI_DEVICES : METHODS;
+
+	for (size_t i = 0; i < count; ++i) {
+		char path[16] = "\\PCI0.";
+		if (pci) {
+			IndexedName(&path[6], 'D', i);
+			memcpy(&path[10], "._STA", 6);
+		} else {
+			IndexedName(&path[1], 'M', i);
+			path[5] = 0;
+		}
+
+		uint64_t args[1] = { 4 };
+		uint64_t value = 0;
+		Token *result = executive->Evaluate(executive->FindNode(path), args, pci ? 0 : 1);
+		CHECK(result != NULL && GetTokenInteger(result, &value) && value == (pci ? 0x0F : 4));
+		executive->ReleaseResult(result);
+	}
+}
+
+static void TestTable(const char *name, Aml *table) {
+	ACPI_MemoryStats before, parsed, resident, again, after;
+	GetMemoryTotals(&before);
+
+	AMLExecutive *executive = new AMLExecutive;
+	CHECK(executive->Parse(table->Data, table->Size) == 0);
+
+	GetMemoryTotals(&parsed);
+	CHECK(parsed.Live > before.Live);
+	CHECK(PerKB(&before, &parsed, table) <= MAX_PARSED_PER_KB);
+
+	EvaluateAll(executive, table);
+	GetMemoryTotals(&resident);
+	CHECK(PerKB(&before, &resident, table) <= MAX_RESIDENT_PER_KB);
+
+	/* Bodies already parsed, whatever a call allocates it frees */
+	EvaluateAll(executive, table);
+	GetMemoryTotals(&again);
+	CHECK(again.Live == resident.Live);
+
+	printf("memory: %s, %zu bytes of AML, %llu per KB parsed, %llu per KB with every method run\n", name, table->Size,
+	       (unsigned long long)PerKB(&before, &parsed, table), (unsigned long long)PerKB(&before, &resident, table));
+	PrintTags(name);
+
+	delete executive;
+
+	GetMemoryTotals(&after);
+	CHECK(after.Live == before.Live);
+	CHECK(after.Allocations - before.Allocations == after.Frees - before.Frees);
+}
+
+int main() {
+	static Aml table;
+
+	BuildPciTable(&table);
+	TestTable("PCI", &table);
+
+	BuildMethodTable(&table);
+	TestTable("methods", &table);
+
+	return TEST_RESULT();
+}
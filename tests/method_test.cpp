@@ -0,0 +1,136 @@
+#include "test.h"
+
+#include "aml_executive.h"
+#include "interpreter.h"
+
+#include <thread>
+
+#define MAX_THREADS 8
+#define EVALUATIONS_PER_THREAD 20000
+#define SERIALIZED_PER_THREAD 5000
+#define LOOP_COUNT 8
+
+/*
+ * Name (CNT0, Zero)
+ * Method (_STA) { Return (0x0F) }
+ * Method (CALC, 1) { Store (Zero, Local0) While (LLess (Local0, Arg0)) { Increment (Local0) } Return (Local0) }
+ * Method (SERM, 0, Serialized) { Store (Add (CNT0, One), CNT0) Return (CNT0) }
+ * Mutex (MTX5, 5)
+ * Method (LOWM, 0, Serialized, 2) { Return (One) }
+ * Method (HIGH) { Acquire (MTX5, 0xFFFF) Store (LOWM (), Local0) Release (MTX5) Return (Local0) }
+ * Method (MIDM) { Return (Acquire (MTX5, 0)) }
+ */
+static uint8_t Dsdt[] = {
+	0x08, 'C', 'N', 'T', '0', 0x00,
+	0x14, 0x09, '_', 'S', 'T', 'A', 0x00, 0xA4, 0x0A, 0x0F,
+	0x14, 0x12, 'C', 'A', 'L', 'C', 0x01,
+		0x70, 0x00, 0x60,
+		0xA2, 0x06, 0x95, 0x60, 0x68, 0x75, 0x60,
+		0xA4, 0x60,
+	0x14, 0x17, 'S', 'E', 'R', 'M', 0x08,
+		0x70, 0x72, 'C', 'N', 'T', '0', 0x01, 0x00, 'C', 'N', 'T', '0',
+		0xA4, 'C', 'N', 'T', '0',
+	0x5B, 0x01, 'M', 'T', 'X', '5', 0x05,
+	0x14, 0x08, 'L', 'O', 'W', 'M', 0x28, 0xA4, 0x01,
+	0x14, 0x1C, 'H', 'I', 'G', 'H', 0x00,
+		0x5B, 0x23, 'M', 'T', 'X', '5', 0xFF, 0xFF,
+		0x70, 'L', 'O', 'W', 'M', 0x60,
+		0x5B, 0x27, 'M', 'T', 'X', '5',
+		0xA4, 0x60,
+	0x14, 0x0F, 'M', 'I', 'D', 'M', 0x00, 0xA4, 0x5B, 0x23, 'M', 'T', 'X', '5', 0x00, 0x00,
+};
+
+static bool Run(AMLExecutive *executive, AML_NamespaceNode *method, const uint64_t *args, size_t argCount, uint64_t *value) {
+	Token *result = executive->Evaluate(method, args, argCount);
+	bool found = result != NULL && GetTokenInteger(result, value);
+
+	executive->ReleaseResult(result);
+
+	return found;
+}
+
+/* Plain methods run side by side, each thread in frames of its own */
+static void Evaluate(AMLExecutive *executive, AML_NamespaceNode *status, AML_NamespaceNode *calc, uint64_t *wrong) {
+	uint64_t args[1] = { LOOP_COUNT };
+	uint64_t value;
+
+	for (uint32_t i = 0; i < EVALUATIONS_PER_THREAD; ++i) {
+		if (!Run(executive, status, NULL, 0, &value) || value != 0x0F) (*wrong)++;
+		if (!Run(executive, calc, args, 1, &value) || value != LOOP_COUNT) (*wrong)++;
+	}
+}
+
+static void TestScaling(AMLExecutive *executive) {
+	AML_NamespaceNode *status = executive->FindNode("\\_STA");
+	AML_NamespaceNode *calc = executive->FindNode("\\CALC");
+	CHECK(status != NULL && calc != NULL);
+	if (status == NULL || calc == NULL) return;
+
+	for (size_t threads = 1; threads <= MAX_THREADS; threads *= 2) {
+		uint64_t wrong[MAX_THREADS] = {};
+		std::thread workers[MAX_THREADS];
+
+		uint64_t start = TestNanoseconds();
+		for (size_t t = 0; t < threads; ++t) workers[t] = std::thread(Evaluate, executive, status, calc, &wrong[t]);
+		for (size_t t = 0; t < threads; ++t) workers[t].join();
+		uint64_t elapsed = TestNanoseconds() - start;
+
+		for (size_t t = 0; t < threads; ++t) CHECK(wrong[t] == 0);
+
+		uint64_t evaluations = threads * EVALUATIONS_PER_THREAD * 2;
+		printf("method: %zu threads, %.2f M evaluations/s\n", threads, elapsed != 0 ? evaluations * 1000.0 / elapsed : 0.0);
+	}
+}
+
+/* The read-modify-write of CNT0 loses no increment, the method's mutex keeps it whole */
+static void TestSerialized(AMLExecutive *executive) {
+	AML_NamespaceNode *method = executive->FindNode("\\SERM");
+	CHECK(method != NULL);
+	if (method == NULL) return;
+
+	AML_MutexStats before, after;
+	GetMutexStats(&before);
+
+	std::thread workers[MAX_THREADS];
+	for (size_t t = 0; t < MAX_THREADS; ++t) {
+		workers[t] = std::thread([executive, method]() {
+			uint64_t value;
+			for (uint32_t i = 0; i < SERIALIZED_PER_THREAD; ++i) Run(executive, method, NULL, 0, &value);
+		});
+	}
+
+	for (size_t t = 0; t < MAX_THREADS; ++t) workers[t].join();
+
+	uint64_t count = 0;
+	CHECK(executive->EvaluateInteger(executive->FindNode("\\CNT0"), &count));
+	CHECK(count == MAX_THREADS * SERIALIZED_PER_THREAD);
+
+	GetMutexStats(&after);
+	printf("method: %d threads on a Serialized method, %llu of %llu calls contended\n", MAX_THREADS,
+	       (unsigned long long)(after.Contended - before.Contended), (unsigned long long)(MAX_THREADS * SERIALIZED_PER_THREAD));
+}
+
+/* Calling a level 2 method while holding a level 5 mutex fails, and the mutex is still given back */
+static void TestSyncLevel(AMLExecutive *executive) {
+	uint64_t value = 0;
+
+	CHECK(Run(executive, executive->FindNode("\\LOWM"), NULL, 0, &value) && value == 1);
+	CHECK(!Run(executive, executive->FindNode("\\HIGH"), NULL, 0, &value) || value != 1);
+
+	/* Acquire returns True only when it timed out */
+	CHECK(Run(executive, executive->FindNode("\\MIDM"), NULL, 0, &value) && value == 0);
+	CHECK(Run(executive, executive->FindNode("\\LOWM"), NULL, 0, &value) && value == 1);
+}
+
+int main() {
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(Dsdt, sizeof(Dsdt));
+
+	TestScaling(executive);
+	TestSerialized(executive);
+	TestSyncLevel(executive);
+
+	delete executive;
+
+	return TEST_RESULT();
+}
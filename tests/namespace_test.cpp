@@ -0,0 +1,148 @@
+#include "test.h"
+
+#include "aml_executive.h"
+#include "acpi.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#define READERS 3
+#define LOAD_CYCLES 500
+#define SAMPLES_PER_READER 200000
+
+/* Device (DEV0) { Name (VAL0, 0x11223344) } */
+static uint8_t Dsdt[] = {
+	0x5B, 0x82, 0x0F, 'D', 'E', 'V', '0',
+	0x08, 'V', 'A', 'L', '0', 0x0C, 0x44, 0x33, 0x22, 0x11,
+};
+
+struct SSDT {
+	SDTHeader Header;
+	uint8_t Body[17];
+}__attribute__((packed));
+
+/* The same under HOT0, loaded and unloaded over and over */
+static void BuildSSDT(SSDT *ssdt) {
+	const uint8_t body[] = {
+		0x5B, 0x82, 0x0F, 'H', 'O', 'T', '0',
+		0x08, 'V', 'A', 'L', '0', 0x0C, 0x88, 0x77, 0x66, 0x55,
+	};
+
+	memset(ssdt, 0, sizeof(*ssdt));
+	memcpy(ssdt->Header.Signature, "SSDT", 4);
+	ssdt->Header.Length = sizeof(*ssdt);
+	memcpy(ssdt->Body, body, sizeof(body));
+
+	uint8_t checksum = 0;
+	for (size_t i = 0; i < sizeof(*ssdt); ++i) checksum += ((uint8_t*)ssdt)[i];
+	ssdt->Header.Checksum = -checksum;
+}
+
+struct ReaderStats {
+	uint64_t Lookups;
+	uint64_t Found;
+	uint64_t Wrong;
+	uint64_t *Samples;
+	size_t SampleCount;
+};
+
+static int CompareSamples(const void *first, const void *second) {
+	uint64_t a = *(const uint64_t*)first, b = *(const uint64_t*)second;
+	return a < b ? -1 : a > b;
+}
+
+/* One pin covers the lookup and the evaluation, the node cannot be freed in between */
+static void LookUp(AMLExecutive *executive, ReaderStats *stats, const char *path, uint64_t expected) {
+	uint64_t start = TestNanoseconds();
+
+	uint32_t pin = executive->PinNamespace();
+	AML_NamespaceNode *node = executive->FindNode(path);
+
+	uint64_t value = 0;
+	bool found = node != NULL && executive->EvaluateInteger(node, &value);
+	executive->UnpinNamespace(pin);
+
+	uint64_t elapsed = TestNanoseconds() - start;
+
+	stats->Lookups++;
+	if (found) stats->Found++;
+	if (found && value != expected) stats->Wrong++;
+	if (stats->SampleCount < SAMPLES_PER_READER) stats->Samples[stats->SampleCount++] = elapsed;
+}
+
+static void TestLookupsDuringLoads() {
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(Dsdt, sizeof(Dsdt));
+
+	SSDT ssdt;
+	BuildSSDT(&ssdt);
+
+	bool done = false;
+	ReaderStats stats[READERS] = {};
+	std::thread readers[READERS];
+
+	uint64_t start = TestNanoseconds();
+
+	for (size_t r = 0; r < READERS; ++r) {
+		stats[r].Samples = (uint64_t*)malloc(SAMPLES_PER_READER * sizeof(uint64_t));
+
+		readers[r] = std::thread([&, r]() {
+			while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+				LookUp(executive, &stats[r], "\\DEV0.VAL0", 0x11223344);
+				LookUp(executive, &stats[r], "\\HOT0.VAL0", 0x55667788);
+			}
+		});
+	}
+
+	size_t loaded = 0;
+	for (size_t i = 0; i < LOAD_CYCLES; ++i) {
+		uint64_t handle = executive->LoadTable(&ssdt, sizeof(ssdt), NULL);
+		if (handle != 0) loaded++;
+
+		std::this_thread::yield();
+		CHECK(executive->UnloadTable(handle));
+	}
+
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	for (size_t r = 0; r < READERS; ++r) readers[r].join();
+
+	uint64_t elapsed = TestNanoseconds() - start;
+	CHECK(loaded == LOAD_CYCLES);
+
+	uint64_t lookups = 0, found = 0, wrong = 0;
+	size_t sampleCount = 0;
+	uint64_t *samples = (uint64_t*)malloc(READERS * SAMPLES_PER_READER * sizeof(uint64_t));
+
+	for (size_t r = 0; r < READERS; ++r) {
+		lookups += stats[r].Lookups;
+		found += stats[r].Found;
+		wrong += stats[r].Wrong;
+
+		memcpy(&samples[sampleCount], stats[r].Samples, stats[r].SampleCount * sizeof(uint64_t));
+		sampleCount += stats[r].SampleCount;
+		free(stats[r].Samples);
+	}
+
+	/* The stable device is always there, the hot one only sometimes, never with another value */
+	CHECK(found >= lookups / 2);
+	CHECK(wrong == 0);
+	CHECK(executive->FindNode("\\HOT0") == NULL);
+
+	qsort(samples, sampleCount, sizeof(uint64_t), CompareSamples);
+	if (sampleCount != 0) {
+		printf("namespace: %d readers over %d loads and unloads, %.2f M lookups/s, p50 %llu ns, p99 %llu ns, max %llu ns\n",
+		       READERS, LOAD_CYCLES, lookups * 1000.0 / elapsed,
+		       (unsigned long long)samples[sampleCount / 2], (unsigned long long)samples[sampleCount * 99 / 100],
+		       (unsigned long long)samples[sampleCount - 1]);
+	}
+
+	free(samples);
+	delete executive;
+}
+
+int main() {
+	TestLookupsDuringLoads();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,237 @@
+#include "test.h"
+
+#include "notify.h"
+#include "aml_executive.h"
+
+#include <thread>
+
+#define PRODUCERS 4
+#define NOTIFICATIONS_PER_PRODUCER 20000
+
+struct DeliveryLog {
+	AML_NamespaceNode *Nodes[PRODUCERS];
+	uint32_t Next[PRODUCERS];
+	uint64_t Delivered;
+	uint64_t OutOfOrder;
+};
+
+static void LogHandler(AML_NamespaceNode *node, uint32_t value, void *context) {
+	DeliveryLog *log = (DeliveryLog*)context;
+
+	for (size_t i = 0; i < PRODUCERS; ++i) {
+		if (log->Nodes[i] != node) continue;
+
+		/* Producers queue increasing values, whatever they lost to a full ring */
+		if (value < log->Next[i]) log->OutOfOrder++;
+		log->Next[i] = value + 1;
+	}
+
+	log->Delivered++;
+}
+
+/* Device (PRD0) {} up to PRD3 */
+static uint8_t Devices[PRODUCERS * 7];
+
+static AMLExecutive *BuildNamespace(AML_NamespaceNode **nodes) {
+	for (size_t i = 0; i < PRODUCERS; ++i) {
+		uint8_t device[7] = { 0x5B, 0x82, 0x05, 'P', 'R', 'D', (uint8_t)('0' + i) };
+		for (size_t j = 0; j < sizeof(device); ++j) Devices[i * 7 + j] = device[j];
+	}
+
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(Devices, sizeof(Devices));
+
+	for (size_t i = 0; i < PRODUCERS; ++i) {
+		char path[6] = { '\\', 'P', 'R', 'D', (char)('0' + i), '\0' };
+		nodes[i] = executive->FindNode(path);
+	}
+
+	return executive;
+}
+
+static void TestFullRing() {
+	AML_NamespaceNode *nodes[PRODUCERS];
+	AMLExecutive *executive = BuildNamespace(nodes);
+	AML_Namespace *ns = executive->GetNamespace();
+	AML_NotifyQueue *queue = CreateNotifyQueue(ns);
+
+	DeliveryLog log = {};
+	for (size_t i = 0; i < PRODUCERS; ++i) log.Nodes[i] = nodes[i];
+	SubscribeNotify(queue, nodes[0], false, LogHandler, &log);
+
+	/* Nobody drains, the producer must not wait */
+	size_t queued = 0;
+	for (uint32_t i = 0; i < NOTIFY_RING_SIZE + 10; ++i) queued += QueueNotify(queue, nodes[0], i);
+	CHECK(queued == NOTIFY_RING_SIZE);
+
+	AML_NotifyStats stats;
+	GetNotifyStats(queue, &stats);
+	CHECK(stats.Queued == NOTIFY_RING_SIZE && stats.Dropped == 10);
+
+	CHECK(DeliverNotifications(queue) == NOTIFY_RING_SIZE);
+	CHECK(log.Delivered == NOTIFY_RING_SIZE && log.OutOfOrder == 0);
+	CHECK(log.Next[0] == NOTIFY_RING_SIZE);
+
+	/* The ring is reusable once drained */
+	CHECK(QueueNotify(queue, nodes[0], 1000));
+	CHECK(DeliverNotifications(queue) == 1 && log.Next[0] == 1001);
+
+	DeleteNotifyQueue(queue);
+	delete executive;
+}
+
+static void TestConcurrentProducers() {
+	AML_NamespaceNode *nodes[PRODUCERS];
+	AMLExecutive *executive = BuildNamespace(nodes);
+	AML_Namespace *ns = executive->GetNamespace();
+	AML_NotifyQueue *queue = CreateNotifyQueue(ns);
+
+	DeliveryLog log = {};
+	for (size_t i = 0; i < PRODUCERS; ++i) log.Nodes[i] = nodes[i];
+	SubscribeNotify(queue, ns->Root, true, LogHandler, &log);
+
+	bool done = false;
+	uint64_t delivered = 0;
+
+	uint64_t start = TestNanoseconds();
+
+	std::thread consumer([&]() {
+		while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) delivered += DeliverNotifications(queue);
+		delivered += DeliverNotifications(queue);
+	});
+
+	std::thread producers[PRODUCERS];
+	for (size_t p = 0; p < PRODUCERS; ++p) {
+		producers[p] = std::thread([&, p]() {
+			for (uint32_t i = 0; i < NOTIFICATIONS_PER_PRODUCER; ++i) {
+				uint32_t section = EnterNamespace(ns);
+				QueueNotify(queue, nodes[p], i);
+				LeaveNamespace(ns, section);
+			}
+		});
+	}
+
+	for (size_t p = 0; p < PRODUCERS; ++p) producers[p].join();
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	consumer.join();
+
+	uint64_t elapsed = TestNanoseconds() - start;
+
+	AML_NotifyStats stats;
+	GetNotifyStats(queue, &stats);
+
+	printf("notify: %d producers raised %.2f M notifications/s, %llu delivered, %llu dropped\n", PRODUCERS,
+	       elapsed != 0 ? (stats.Queued + stats.Dropped) * 1000.0 / elapsed : 0.0,
+	       (unsigned long long)stats.Delivered, (unsigned long long)stats.Dropped);
+
+	CHECK(stats.Queued + stats.Dropped == PRODUCERS * NOTIFICATIONS_PER_PRODUCER);
+	CHECK(stats.Delivered == stats.Queued && delivered == stats.Queued);
+	CHECK(log.Delivered == stats.Queued);
+	CHECK(log.OutOfOrder == 0);
+
+	DeleteNotifyQueue(queue);
+	delete executive;
+}
+
+/* Producers retry on a full ring, so every notification is delivered and the rate is end to end */
+static void TestThroughput() {
+	AML_NamespaceNode *nodes[PRODUCERS];
+	AMLExecutive *executive = BuildNamespace(nodes);
+	AML_Namespace *ns = executive->GetNamespace();
+	AML_NotifyQueue *queue = CreateNotifyQueue(ns);
+
+	DeliveryLog log = {};
+	for (size_t i = 0; i < PRODUCERS; ++i) log.Nodes[i] = nodes[i];
+	SubscribeNotify(queue, ns->Root, true, LogHandler, &log);
+
+	bool done = false;
+	uint64_t start = TestNanoseconds();
+
+	std::thread consumer([&]() {
+		while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+			if (DeliverNotifications(queue) == 0) std::this_thread::yield();
+		}
+		DeliverNotifications(queue);
+	});
+
+	std::thread producers[PRODUCERS];
+	for (size_t p = 0; p < PRODUCERS; ++p) {
+		producers[p] = std::thread([&, p]() {
+			for (uint32_t i = 0; i < NOTIFICATIONS_PER_PRODUCER; ++i) {
+				uint32_t section = EnterNamespace(ns);
+				while (!QueueNotify(queue, nodes[p], i)) std::this_thread::yield();
+				LeaveNamespace(ns, section);
+			}
+		});
+	}
+
+	for (size_t p = 0; p < PRODUCERS; ++p) producers[p].join();
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	consumer.join();
+
+	uint64_t elapsed = TestNanoseconds() - start;
+
+	CHECK(log.Delivered == PRODUCERS * NOTIFICATIONS_PER_PRODUCER);
+	CHECK(log.OutOfOrder == 0);
+
+	printf("notify: %d producers, %.2f M notifications/s delivered\n", PRODUCERS,
+	       elapsed != 0 ? log.Delivered * 1000.0 / elapsed : 0.0);
+
+	DeleteNotifyQueue(queue);
+	delete executive;
+}
+
+struct ChainContext {
+	AML_NotifyQueue *Queue;
+	AML_NotifySubscription *Added;
+	uint64_t Calls;
+};
+
+static void CountHandler(AML_NamespaceNode*, uint32_t, void *context) {
+	((ChainContext*)context)->Calls++;
+}
+
+/* Subscribes from inside delivery, which used to spin on the subscription lock forever */
+static void SubscribingHandler(AML_NamespaceNode *node, uint32_t, void *context) {
+	ChainContext *chain = (ChainContext*)context;
+	if (chain->Added == NULL) chain->Added = SubscribeNotify(chain->Queue, node, false, CountHandler, chain);
+}
+
+static void TestSubscribeFromHandler() {
+	AML_NamespaceNode *nodes[PRODUCERS];
+	AMLExecutive *executive = BuildNamespace(nodes);
+	AML_Namespace *ns = executive->GetNamespace();
+	AML_NotifyQueue *queue = CreateNotifyQueue(ns);
+
+	ChainContext chain = { queue, NULL, 0 };
+	AML_NotifySubscription *first = SubscribeNotify(queue, nodes[1], false, SubscribingHandler, &chain);
+
+	CHECK(QueueNotify(queue, nodes[1], 0));
+	CHECK(DeliverNotifications(queue) == 1);
+	CHECK(chain.Added != NULL && chain.Calls == 0);
+
+	/* The new subscription only sees later batches */
+	CHECK(QueueNotify(queue, nodes[1], 0));
+	CHECK(QueueNotify(queue, nodes[2], 0));
+	CHECK(DeliverNotifications(queue) == 2);
+	CHECK(chain.Calls == 1);
+
+	UnsubscribeNotify(queue, chain.Added);
+	UnsubscribeNotify(queue, first);
+
+	CHECK(QueueNotify(queue, nodes[1], 0));
+	CHECK(DeliverNotifications(queue) == 1);
+	CHECK(chain.Calls == 1);
+
+	DeleteNotifyQueue(queue);
+	delete executive;
+}
+
+int main() {
+	TestFullRing();
+	TestConcurrentProducers();
+	TestThroughput();
+	TestSubscribeFromHandler();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,178 @@
+#include "test.h"
+
+#include "numa.h"
+
+#include <string.h>
+
+struct TableBuilder {
+	uint8_t Data[1024];
+	size_t Length;
+};
+
+static void Append(TableBuilder *table, const void *entry, size_t length) {
+	memcpy(&table->Data[table->Length], entry, length);
+	table->Length += length;
+}
+
+static void StartSRAT(TableBuilder *table) {
+	memset(table, 0, sizeof(*table));
+	table->Length = sizeof(SRATTable);
+	memcpy(((SRATTable*)table->Data)->Header.Signature, "SRAT", 4);
+}
+
+static SRATTable *FinishSRAT(TableBuilder *table) {
+	SRATTable *srat = (SRATTable*)table->Data;
+	srat->Header.Length = table->Length;
+
+	return srat;
+}
+
+static void AddProcessor(TableBuilder *table, uint8_t apicId, uint32_t domain, uint32_t flags) {
+	SRATProcessorAffinity cpu;
+	memset(&cpu, 0, sizeof(cpu));
+	cpu.Header.Type = SRAT_PROCESSOR_AFFINITY;
+	cpu.Header.Length = sizeof(cpu);
+	cpu.ProximityLow = domain & 0xFF;
+	cpu.ProximityHigh[0] = (domain >> 8) & 0xFF;
+	cpu.ProximityHigh[1] = (domain >> 16) & 0xFF;
+	cpu.ProximityHigh[2] = (domain >> 24) & 0xFF;
+	cpu.APICID = apicId;
+	cpu.Flags = flags;
+	Append(table, &cpu, sizeof(cpu));
+}
+
+static void AddX2APIC(TableBuilder *table, uint32_t x2apicId, uint32_t domain) {
+	SRATX2APICAffinity cpu;
+	memset(&cpu, 0, sizeof(cpu));
+	cpu.Header.Type = SRAT_X2APIC_AFFINITY;
+	cpu.Header.Length = sizeof(cpu);
+	cpu.Proximity = domain;
+	cpu.X2APICID = x2apicId;
+	cpu.Flags = SRAT_ENABLED;
+	Append(table, &cpu, sizeof(cpu));
+}
+
+static void AddMemory(TableBuilder *table, uint64_t base, uint64_t length, uint32_t domain) {
+	SRATMemoryAffinity memory;
+	memset(&memory, 0, sizeof(memory));
+	memory.Header.Type = SRAT_MEMORY_AFFINITY;
+	memory.Header.Length = sizeof(memory);
+	memory.Proximity = domain;
+	memory.Base = base;
+	memory.Length = length;
+	memory.Flags = SRAT_ENABLED;
+	Append(table, &memory, sizeof(memory));
+}
+
+static SLITTable *BuildSLIT(TableBuilder *table, uint64_t localities, const uint8_t *distances, size_t count) {
+	memset(table, 0, sizeof(*table));
+	table->Length = sizeof(SLITTable);
+
+	SLITTable *slit = (SLITTable*)table->Data;
+	memcpy(slit->Header.Signature, "SLIT", 4);
+	slit->LocalityCount = localities;
+	Append(table, distances, count);
+	slit->Header.Length = table->Length;
+
+	return slit;
+}
+
+static void TestDecode() {
+	TableBuilder srat, slit;
+	StartSRAT(&srat);
+
+	/* Out of order on purpose, lookups rely on the sorted copies */
+	AddProcessor(&srat, 6, 1, SRAT_ENABLED);
+	AddProcessor(&srat, 0, 0, SRAT_ENABLED);
+	AddProcessor(&srat, 2, 0, SRAT_ENABLED);
+	AddProcessor(&srat, 8, 1, 0);
+	AddX2APIC(&srat, 0x100, 0x10203);
+	AddMemory(&srat, 0x100000000ull, 0x100000000ull, 1);
+	AddMemory(&srat, 0, 0x80000000ull, 0);
+	AddMemory(&srat, 0x200000000ull, 0, 1);
+
+	const uint8_t distances[] = { 10, 21, 21, 10 };
+	NUMA_Topology *topology = CreateNUMATopology(FinishSRAT(&srat), BuildSLIT(&slit, 2, distances, sizeof(distances)));
+
+	CHECK(topology->NodeCount == 3);
+	CHECK(topology->CPUCount == 4);
+	CHECK(topology->MemoryRangeCount == 2);
+
+	uint16_t node0 = FindNodeForCPU(topology, 0);
+	uint16_t node1 = FindNodeForCPU(topology, 6);
+	uint16_t far = FindNodeForCPU(topology, 0x100);
+
+	CHECK(node0 != node1 && node0 != far && node1 != far);
+	CHECK(FindNodeForCPU(topology, 2) == node0);
+	CHECK(FindNodeForCPU(topology, 8) == NUMA_NO_NODE);
+	CHECK(topology->Domains[far] == 0x10203);
+
+	CHECK(FindNodeForAddress(topology, 0x1000) == node0);
+	CHECK(FindNodeForAddress(topology, 0x80000000ull) == NUMA_NO_NODE);
+	CHECK(FindNodeForAddress(topology, 0x180000000ull) == node1);
+	CHECK(FindNodeForAddress(topology, 0x200000000ull) == NUMA_NO_NODE);
+
+	/* Domain 0x10203 is outside the SLIT, it gets the defaults */
+	CHECK(GetNodeDistance(topology, node0, node1) == 21);
+	CHECK(GetNodeDistance(topology, node1, node1) == 10);
+	CHECK(GetNodeDistance(topology, node0, far) == NUMA_REMOTE_DISTANCE);
+	CHECK(GetNodeDistance(topology, far, far) == NUMA_LOCAL_DISTANCE);
+	CHECK(GetNodeDistance(topology, 0, 3) == 0xFF);
+
+	DeleteNUMATopology(topology);
+}
+
+static void TestMalformed() {
+	TableBuilder srat, slit;
+	StartSRAT(&srat);
+
+	/* Processor entries cut down to their header, far more than the table could hold at full length */
+	for (size_t i = 0; i < 200; ++i) {
+		SRATEntryHeader header = { SRAT_PROCESSOR_AFFINITY, sizeof(SRATEntryHeader) };
+		Append(&srat, &header, sizeof(header));
+	}
+
+	AddProcessor(&srat, 1, 0, SRAT_ENABLED);
+
+	/* A memory entry too short for its base and length */
+	SRATEntryHeader shortMemory = { SRAT_MEMORY_AFFINITY, 8 };
+	Append(&srat, &shortMemory, sizeof(shortMemory));
+	Append(&srat, "\0\0\0\0\0\0", 6);
+
+	/* A SLIT whose locality count squares to zero */
+	const uint8_t distances[] = { 10 };
+	NUMA_Topology *topology = CreateNUMATopology(FinishSRAT(&srat), BuildSLIT(&slit, 1ull << 32, distances, sizeof(distances)));
+
+	CHECK(topology->CPUCount == 1 && topology->MemoryRangeCount == 0);
+	CHECK(FindNodeForCPU(topology, 1) == 0);
+	CHECK(GetNodeDistance(topology, 0, 0) == NUMA_LOCAL_DISTANCE);
+	DeleteNUMATopology(topology);
+
+	/* An entry running past the table ends it */
+	StartSRAT(&srat);
+	AddProcessor(&srat, 1, 0, SRAT_ENABLED);
+	AddProcessor(&srat, 2, 0, SRAT_ENABLED);
+	SRATTable *table = FinishSRAT(&srat);
+	table->Header.Length -= 1;
+
+	topology = CreateNUMATopology(table, NULL);
+	CHECK(topology->CPUCount == 1 && topology->NodeCount == 1);
+	DeleteNUMATopology(topology);
+
+	/* A header shorter than the fixed part */
+	StartSRAT(&srat);
+	table = FinishSRAT(&srat);
+	table->Header.Length = 4;
+
+	topology = CreateNUMATopology(table, BuildSLIT(&slit, 2, distances, sizeof(distances)));
+	CHECK(topology->NodeCount == 0 && topology->CPUCount == 0);
+	CHECK(FindNodeForAddress(topology, 0) == NUMA_NO_NODE);
+	DeleteNUMATopology(topology);
+}
+
+int main() {
+	TestDecode();
+	TestMalformed();
+
+	return TEST_RESULT();
+}
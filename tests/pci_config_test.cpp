@@ -0,0 +1,161 @@
+#include "test.h"
+
+#include "aml_executive.h"
+#include "pci_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BUS_WINDOW (1ull << 20)
+
+/*
+ * Host memory stands in for the ECAM windows, the stub maps physical memory
+ * one to one. Segment 0 covers buses 0 and 1, segment 1 only bus 2.
+ */
+struct ECAM {
+	uint8_t *Segment0;
+	uint8_t *Segment1Bus2;
+};
+
+#define MCFG_SIZE (sizeof(MCFGTable) + 2 * sizeof(MCFGEntry))
+
+static size_t Offset(uint8_t device, uint8_t function, uint16_t offset) {
+	return ((size_t)device << 15) | ((size_t)function << 12) | offset;
+}
+
+static uint32_t Read32(uint8_t *window, size_t offset) {
+	uint32_t value;
+	memcpy(&value, &window[offset], sizeof(value));
+	return value;
+}
+
+static void Write32(uint8_t *window, size_t offset, uint32_t value) {
+	memcpy(&window[offset], &value, sizeof(value));
+}
+
+static void BuildMCFG(MCFGTable *mcfg, ECAM *ecam) {
+	memset(mcfg, 0, MCFG_SIZE);
+	memcpy(mcfg->Header.Signature, "MCFG", 4);
+	mcfg->Header.Length = MCFG_SIZE;
+
+	mcfg->Entries[0].BaseAddress = (uintptr_t)ecam->Segment0;
+	mcfg->Entries[0].Segment = 0;
+	mcfg->Entries[0].StartBus = 0;
+	mcfg->Entries[0].EndBus = 1;
+
+	/* The base is where bus 0 would be, the entry starts at bus 2 */
+	mcfg->Entries[1].BaseAddress = (uintptr_t)ecam->Segment1Bus2 - 2 * BUS_WINDOW;
+	mcfg->Entries[1].Segment = 1;
+	mcfg->Entries[1].StartBus = 2;
+	mcfg->Entries[1].EndBus = 2;
+}
+
+/* Every width lands on the bytes the ECAM layout puts it at, extended space included */
+static void TestAccessor(PCI_ConfigSpace *config, ECAM *ecam) {
+	uint8_t *bus1 = ecam->Segment0 + BUS_WINDOW;
+
+	PCIConfigWrite(config, 0, 1, 2, 0, 0x10, 0xDEADBEEF, 32);
+	CHECK(Read32(bus1, Offset(2, 0, 0x10)) == 0xDEADBEEF);
+	CHECK(PCIConfigRead(config, 0, 1, 2, 0, 0x12, 16) == 0xDEAD);
+
+	PCIConfigWrite(config, 0, 1, 2, 0, 0x13, 0x5A, 8);
+	CHECK(Read32(bus1, Offset(2, 0, 0x10)) == 0x5AADBEEF);
+
+	Write32(ecam->Segment0, Offset(31, 7, 0xFFC), 0x12345678);
+	CHECK(PCIConfigRead(config, 0, 0, 31, 7, 0xFFC, 32) == 0x12345678);
+
+	Write32(ecam->Segment1Bus2, Offset(1, 0, 0), 0x80861234);
+	CHECK(PCIConfigRead(config, 1, 2, 1, 0, 0, 32) == 0x80861234);
+}
+
+/* Buses outside every window read as all ones, only segment 0 has the legacy ports */
+static void TestMissingBuses(PCI_ConfigSpace *config) {
+	CHECK(PCIConfigRead(config, 1, 1, 0, 0, 0, 32) == 0xFFFFFFFF);
+	CHECK(PCIConfigRead(config, 1, 3, 0, 0, 0, 16) == 0xFFFFFFFF);
+	CHECK(PCIConfigRead(config, 2, 0, 0, 0, 0, 32) == 0xFFFFFFFF);
+
+	/* The stub ports read as all ones too, and extended space is not reachable through them */
+	CHECK(PCIConfigRead(config, 0, 5, 0, 0, 0, 8) == 0xFF);
+	CHECK(PCIConfigRead(config, 0, 5, 0, 0, 0x100, 32) == 0xFFFFFFFF);
+
+	PCI_ConfigSpace *legacy = CreateConfigSpace(NULL);
+	CHECK(legacy->SegmentCount == 0);
+	CHECK(PCIConfigRead(legacy, 0, 0, 0, 0, 0, 32) == 0xFFFFFFFF);
+	DeleteConfigSpace(legacy);
+}
+
+/*
+ * Device (PCI0) {
+ *     Name (_HID, "PNP0A08")
+ *     Name (_BBN, One)
+ *     Device (DEV1) {
+ *         Name (_ADR, 0x00030001)
+ *         OperationRegion (CFG0, PCI_Config, 0x40, 4)
+ *         Field (CFG0, DWordAcc, NoLock, Preserve) { VAL0, 32 }
+ *     }
+ * }
+ * Method (RD__) { Return (\PCI0.DEV1.VAL0) }
+ * Method (WR__, 1) { Store (Arg0, \PCI0.DEV1.VAL0) }
+ */
+static uint8_t Dsdt[] = {
+	0x5B, 0x82, 0x43, 0x04, 'P', 'C', 'I', '0',
+		0x08, '_', 'H', 'I', 'D', 0x0D, 'P', 'N', 'P', '0', 'A', '0', '8', 0x00,
+		0x08, '_', 'B', 'B', 'N', 0x01,
+		0x5B, 0x82, 0x27, 'D', 'E', 'V', '1',
+			0x08, '_', 'A', 'D', 'R', 0x0C, 0x01, 0x00, 0x03, 0x00,
+			0x5B, 0x80, 'C', 'F', 'G', '0', 0x02, 0x0A, 0x40, 0x0A, 0x04,
+			0x5B, 0x81, 0x0B, 'C', 'F', 'G', '0', 0x03, 'V', 'A', 'L', '0', 0x20,
+	0x14, 0x16, 'R', 'D', '_', '_', 0x00, 0xA4,
+		0x5C, 0x2F, 0x03, 'P', 'C', 'I', '0', 'D', 'E', 'V', '1', 'V', 'A', 'L', '0',
+	0x14, 0x17, 'W', 'R', '_', '_', 0x01, 0x70, 0x68,
+		0x5C, 0x2F, 0x03, 'P', 'C', 'I', '0', 'D', 'E', 'V', '1', 'V', 'A', 'L', '0',
+};
+
+/* The region resolves to bus 1 from _BBN, device 3 function 1 from _ADR, and goes through ECAM */
+static void TestRegion(PCI_ConfigSpace *config, ECAM *ecam) {
+	uint8_t *bus1 = ecam->Segment0 + BUS_WINDOW;
+
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(Dsdt, sizeof(Dsdt));
+	InstallConfigSpaceHandler(config);
+	ResolvePciRegions(executive, config);
+
+	Write32(bus1, Offset(3, 1, 0x40), 0xCAFEF00D);
+
+	uint64_t value = 0;
+	Token *result = executive->Evaluate(executive->FindNode("\\RD__"));
+	CHECK(result != NULL && GetTokenInteger(result, &value) && value == 0xCAFEF00D);
+	executive->ReleaseResult(result);
+
+	uint64_t args[1] = { 0x01020304 };
+	executive->ReleaseResult(executive->Evaluate(executive->FindNode("\\WR__"), args, 1));
+	CHECK(Read32(bus1, Offset(3, 1, 0x40)) == 0x01020304);
+	CHECK(Read32(bus1, Offset(3, 1, 0x44)) == 0);
+
+	delete executive;
+}
+
+int main() {
+	ECAM ecam;
+	ecam.Segment0 = (uint8_t*)aligned_alloc(BUS_WINDOW, 2 * BUS_WINDOW);
+	ecam.Segment1Bus2 = (uint8_t*)aligned_alloc(BUS_WINDOW, BUS_WINDOW);
+	memset(ecam.Segment0, 0, 2 * BUS_WINDOW);
+	memset(ecam.Segment1Bus2, 0, BUS_WINDOW);
+
+	static uint8_t table[MCFG_SIZE] __attribute__((aligned(8)));
+	MCFGTable *mcfg = (MCFGTable*)table;
+	BuildMCFG(mcfg, &ecam);
+
+	PCI_ConfigSpace *config = CreateConfigSpace(mcfg);
+	CHECK(config->SegmentCount == 2);
+
+	TestAccessor(config, &ecam);
+	TestMissingBuses(config);
+	TestRegion(config, &ecam);
+
+	DeleteConfigSpace(config);
+	free(ecam.Segment0);
+	free(ecam.Segment1Bus2);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,170 @@
+#include "test.h"
+
+#include "query.h"
+#include "aml_executive.h"
+#include "numa.h"
+
+#include <string.h>
+
+static uint8_t Dsdt[] = {
+	/* Device (DEV0) {} */
+	0x5B, 0x82, 0x05, 'D', 'E', 'V', '0',
+	/* Name (INT0, 0x1234) */
+	0x08, 'I', 'N', 'T', '0', 0x0B, 0x34, 0x12,
+	/* Name (STR0, "ABC") */
+	0x08, 'S', 'T', 'R', '0', 0x0D, 'A', 'B', 'C', 0x00,
+	/* Name (BUF0, Buffer () { 1, 2, 3 }) */
+	0x08, 'B', 'U', 'F', '0', 0x11, 0x06, 0x0A, 0x03, 0x01, 0x02, 0x03,
+	/* Name (PKG0, Package () { 5, "A" }) */
+	0x08, 'P', 'K', 'G', '0', 0x12, 0x07, 0x02, 0x0A, 0x05, 0x0D, 'A', 0x00,
+	/* Method (MTH0) { Return (0x42) } */
+	0x14, 0x09, 'M', 'T', 'H', '0', 0x00, 0xA4, 0x0A, 0x42,
+};
+
+struct SRAT {
+	SRATTable Table;
+	SRATProcessorAffinity Processors[2];
+}__attribute__((packed));
+
+/* APIC IDs 0 and 1 in domains 0 and 1 */
+static NUMA_Topology *BuildTopology(SRAT *srat) {
+	memset(srat, 0, sizeof(*srat));
+	memcpy(srat->Table.Header.Signature, "SRAT", 4);
+	srat->Table.Header.Length = sizeof(*srat);
+
+	for (uint8_t i = 0; i < 2; ++i) {
+		srat->Processors[i].Header.Type = SRAT_PROCESSOR_AFFINITY;
+		srat->Processors[i].Header.Length = sizeof(SRATProcessorAffinity);
+		srat->Processors[i].ProximityLow = i;
+		srat->Processors[i].APICID = i;
+		srat->Processors[i].Flags = SRAT_ENABLED;
+	}
+
+	return CreateNUMATopology(&srat->Table, NULL);
+}
+
+static void TestBatch(AML_QueryTransport *transport, NUMA_Topology *topology) {
+	static uint8_t request[1024], response[1024];
+
+	CHECK(InitQueryRequest(request, sizeof(request)) == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_LOOKUP, "\\DEV0") == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\INT0") == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\STR0") == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\BUF0") == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\PKG0") == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\MTH0") == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\NONE") == 0);
+	CHECK(AddQueryArgument(request, sizeof(request), AML_QUERY_NUMA_CPU, 1) == 0);
+	CHECK(AddQueryArgument(request, sizeof(request), AML_QUERY_NUMA_CPU, 7) == 0);
+	CHECK(AddQueryArgument(request, sizeof(request), AML_QUERY_NUMA_DISTANCES, 0) == 0);
+
+	CHECK(SubmitQuery(transport, request, response, sizeof(response)) == 0);
+	CHECK(((AML_QueryHeader*)response)->Status == AML_QUERY_OK);
+	CHECK(((AML_QueryHeader*)response)->Count == 10);
+
+	AML_QueryResult *result = GetQueryResult(response, 0);
+	CHECK(result->Status == AML_QUERY_OK && result->Type == AML_QUERY_TYPE_NODE);
+
+	result = GetQueryResult(response, 1);
+	CHECK(result->Status == AML_QUERY_OK && result->Type == AML_QUERY_TYPE_INTEGER && result->Integer == 0x1234);
+
+	result = GetQueryResult(response, 2);
+	CHECK(result->Type == AML_QUERY_TYPE_STRING && result->Length == 3);
+	CHECK(memcmp(GetQueryData(response, result), "ABC", 4) == 0);
+
+	result = GetQueryResult(response, 3);
+	CHECK(result->Type == AML_QUERY_TYPE_BUFFER && result->Length == 3);
+	CHECK(((uint8_t*)GetQueryData(response, result))[2] == 3);
+
+	result = GetQueryResult(response, 4);
+	CHECK(result->Type == AML_QUERY_TYPE_PACKAGE && result->Length == 2);
+	AML_QueryResult *element = GetQueryElement(response, result, 0);
+	CHECK(element != NULL && element->Type == AML_QUERY_TYPE_INTEGER && element->Integer == 5);
+	element = GetQueryElement(response, result, 1);
+	CHECK(element != NULL && element->Type == AML_QUERY_TYPE_STRING && element->Length == 1);
+	CHECK(GetQueryElement(response, result, 2) == NULL);
+
+	result = GetQueryResult(response, 5);
+	CHECK(result->Status == AML_QUERY_OK && result->Integer == 0x42);
+
+	CHECK(GetQueryResult(response, 6)->Status == AML_QUERY_NOT_FOUND);
+
+	result = GetQueryResult(response, 7);
+	CHECK(result->Status == AML_QUERY_OK && result->Integer == FindNodeForCPU(topology, 1));
+	CHECK(GetQueryResult(response, 8)->Status == AML_QUERY_NOT_FOUND);
+
+	result = GetQueryResult(response, 9);
+	CHECK(result->Type == AML_QUERY_TYPE_BUFFER && result->Integer == 2 && result->Length == 4);
+
+	CHECK(GetQueryResult(response, 10) == NULL);
+}
+
+/* Items and headers come from another module, none of them may take the server outside the buffers */
+static void TestBounds(AML_QueryTransport *transport) {
+	static uint8_t request[256], response[512];
+
+	CHECK(InitQueryRequest(request, sizeof(request)) == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\INT0") == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\INT0") == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\INT0") == 0);
+
+	AML_QueryItem *items = (AML_QueryItem*)(request + sizeof(AML_QueryHeader));
+	items[0].PathOffset = sizeof(request) - 2;
+	items[1].PathOffset = 0xFFFFFFF0;
+	items[1].PathLength = 0x20;
+	items[2].PathLength = 0xFFFF;
+
+	CHECK(SubmitQuery(transport, request, response, sizeof(response)) == 0);
+	for (uint32_t i = 0; i < 3; ++i) CHECK(GetQueryResult(response, i)->Status == AML_QUERY_INVALID);
+
+	/* The item array running past the request */
+	((AML_QueryHeader*)request)->Count = 1000;
+	CHECK(SubmitQuery(transport, request, response, sizeof(response)) == -1);
+
+	/* No room for the results, then no room for the data */
+	CHECK(InitQueryRequest(request, sizeof(request)) == 0);
+	CHECK(AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\STR0") == 0);
+	CHECK(SubmitQuery(transport, request, response, sizeof(AML_QueryHeader)) == -1);
+	CHECK(SubmitQuery(transport, request, response, sizeof(AML_QueryHeader) + sizeof(AML_QueryResult) + 2) == 0);
+	CHECK(((AML_QueryHeader*)response)->Status == AML_QUERY_NO_SPACE);
+	CHECK(GetQueryResult(response, 0)->Status == AML_QUERY_NO_SPACE);
+
+	/* A wrong magic and a request smaller than its header */
+	((AML_QueryHeader*)request)->Magic = 0;
+	CHECK(SubmitQuery(transport, request, response, sizeof(response)) == -1);
+	CHECK(ProcessQuery(NULL, NULL, request, 4, response, sizeof(response)) == -1);
+
+	/* A client header claiming more room than its buffer has */
+	CHECK(InitQueryRequest(request, 64) == 0);
+	((AML_QueryHeader*)request)->Data = 1024;
+	CHECK(AddQueryItem(request, 64, AML_QUERY_LOOKUP, "\\DEV0") == -1);
+}
+
+int main() {
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(Dsdt, sizeof(Dsdt));
+
+	SRAT srat;
+	NUMA_Topology *topology = BuildTopology(&srat);
+	AML_QueryServer server = { executive, topology };
+	AML_QueryTransport transport;
+	InitLoopbackTransport(&transport, &server);
+
+	TestBatch(&transport, server.NUMA);
+	TestBounds(&transport);
+
+	/* Without a topology NUMA queries are refused, the rest still answered */
+	server.NUMA = NULL;
+	static uint8_t request[256], response[512];
+	InitQueryRequest(request, sizeof(request));
+	AddQueryArgument(request, sizeof(request), AML_QUERY_NUMA_CPU, 0);
+	AddQueryItem(request, sizeof(request), AML_QUERY_EVALUATE, "\\INT0");
+	CHECK(SubmitQuery(&transport, request, response, sizeof(response)) == 0);
+	CHECK(GetQueryResult(response, 0)->Status == AML_QUERY_NOT_SUPPORTED);
+	CHECK(GetQueryResult(response, 1)->Integer == 0x1234);
+
+	DeleteNUMATopology(topology);
+	delete executive;
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,214 @@
+#include "test.h"
+
+#include "aml_executive.h"
+#include "aml_opcodes.h"
+#include "interpreter.h"
+#include "region.h"
+#include "region_trace.h"
+
+#include <string.h>
+
+#define EC_DATA 0x62
+#define EC_STATUS 0x66
+#define EC_STATUS_READY 0x01
+
+#define CALLS 32
+#define REPLAY_ROUNDS 200
+
+/*
+ * A stand-in embedded controller behind SystemIO. A write to the data port
+ * keeps the status busy for a few reads, then the data port reads back
+ * three times what was written. Only recording talks to it.
+ */
+struct EmbeddedController {
+	uint64_t Data;
+	uint32_t Busy;
+	uint64_t Accesses;
+};
+
+static EmbeddedController Ec;
+
+static uint64_t EcRead(void *context, uint64_t address, uint8_t width) {
+	EmbeddedController *ec = (EmbeddedController*)context;
+	ec->Accesses++;
+
+	if (width != 8) return ~0ull;
+	if (address == EC_DATA) return (ec->Data * 3) & 0xFF;
+	if (address != EC_STATUS) return 0xFF;
+
+	if (ec->Busy == 0) return EC_STATUS_READY;
+	ec->Busy--;
+
+	return 0;
+}
+
+static void EcWrite(void *context, uint64_t address, uint64_t value, uint8_t width) {
+	EmbeddedController *ec = (EmbeddedController*)context;
+	ec->Accesses++;
+
+	if (width != 8 || address != EC_DATA) return;
+	ec->Data = value;
+	ec->Busy = value % 5 + 2;
+}
+
+/*
+ * OperationRegion (ECIO, SystemIO, 0x62, 5)
+ * Field (ECIO, ByteAcc, NoLock, Preserve) { DATA, 8, , 24, STAT, 8 }
+ * Method (POLL, 1) {
+ *     Store (Arg0, DATA)
+ *     Store (Zero, Local0)
+ *     While (LEqual (And (STAT, One), Zero)) { Increment (Local0) }
+ *     Return (Add (DATA, Local0))
+ * }
+ * Method (RDDT) { Return (DATA) }
+ */
+static uint8_t Dsdt[] = {
+	0x5B, 0x80, 'E', 'C', 'I', 'O', 0x01, 0x0A, 0x62, 0x0A, 0x05,
+	0x5B, 0x81, 0x12, 'E', 'C', 'I', 'O', 0x01, 'D', 'A', 'T', 'A', 0x08, 0x00, 0x18, 'S', 'T', 'A', 'T', 0x08,
+	0x14, 0x24, 'P', 'O', 'L', 'L', 0x01,
+		0x70, 0x68, 'D', 'A', 'T', 'A',
+		0x70, 0x00, 0x60,
+		0xA2, 0x0C, 0x93, 0x7B, 'S', 'T', 'A', 'T', 0x01, 0x00, 0x00, 0x75, 0x60,
+		0xA4, 0x72, 'D', 'A', 'T', 'A', 0x60, 0x00,
+	0x14, 0x0B, 'R', 'D', 'D', 'T', 0x00, 0xA4, 'D', 'A', 'T', 'A',
+};
+
+static bool Run(AMLExecutive *executive, const char *path, const uint64_t *args, size_t argCount, uint64_t *value) {
+	Token *result = executive->Evaluate(executive->FindNode(path), args, argCount);
+	bool found = result != NULL && GetTokenInteger(result, value);
+
+	executive->ReleaseResult(result);
+
+	return found;
+}
+
+static void RunCalls(AMLExecutive *executive, uint64_t *results) {
+	for (uint64_t i = 0; i < CALLS; ++i) {
+		uint64_t args[1] = { i };
+		results[i] = ~0ull;
+		Run(executive, "\\POLL", args, 1, &results[i]);
+	}
+}
+
+/* Every access reaches the controller and the trace, a few bytes each */
+static AML_RegionTrace *Record(AMLExecutive *executive, uint64_t *results) {
+	AML_RegionTrace *trace = CreateRegionRecording();
+	SetRegionTrace(trace);
+	RunCalls(executive, results);
+	SetRegionTrace(NULL);
+
+	for (uint64_t i = 0; i < CALLS; ++i) CHECK(results[i] == ((i * 3) & 0xFF) + i % 5 + 2);
+
+	AML_RegionTraceStats stats;
+	GetRegionTraceStats(trace, &stats);
+	CHECK(stats.Records == Ec.Accesses && stats.Records != 0);
+
+	size_t length;
+	const uint8_t *data = GetRegionTraceData(trace, &length);
+	CHECK(((const AML_RegionTraceHeader*)data)->Records == stats.Records);
+	/* Two leading bytes, a byte of address delta and one of value, only the first address takes more */
+	CHECK(length - sizeof(AML_RegionTraceHeader) <= stats.Records * 4 + 8);
+
+	return trace;
+}
+
+/* The same calls give the same results off the controller, record for record */
+static void TestReplay(AMLExecutive *executive, const uint8_t *data, size_t length, const uint64_t *recorded) {
+	uint64_t results[CALLS];
+	uint64_t accesses = Ec.Accesses;
+
+	AML_RegionTrace *replay = CreateRegionReplay(data, length);
+	CHECK(replay != NULL);
+	if (replay == NULL) return;
+
+	SetRegionTrace(replay);
+	RunCalls(executive, results);
+
+	for (uint64_t i = 0; i < CALLS; ++i) CHECK(results[i] == recorded[i]);
+	CHECK(Ec.Accesses == accesses);
+
+	AML_RegionTraceStats stats;
+	GetRegionTraceStats(replay, &stats);
+	CHECK(stats.Mismatches == 0 && stats.Overruns == 0);
+	CHECK(replay->Position == replay->Length);
+
+	/* Past the end reads are 0 */
+	uint64_t value = ~0ull;
+	CHECK(Run(executive, "\\RDDT", NULL, 0, &value) && value == 0);
+	GetRegionTraceStats(replay, &stats);
+	CHECK(stats.Overruns == 1);
+
+	SetRegionTrace(NULL);
+	DeleteRegionTrace(replay);
+}
+
+/* An access the recording never made reads 0, the trace waits for the interpreter to come back to it */
+static void TestDivergence(AMLExecutive *executive, const uint8_t *data, size_t length, const uint64_t *recorded) {
+	AML_RegionTrace *replay = CreateRegionReplay(data, length);
+	if (replay == NULL) return;
+
+	SetRegionTrace(replay);
+
+	uint64_t value = ~0ull;
+	CHECK(Run(executive, "\\RDDT", NULL, 0, &value) && value == 0);
+
+	AML_RegionTraceStats stats;
+	GetRegionTraceStats(replay, &stats);
+	CHECK(stats.Mismatches == 1 && replay->Position == sizeof(AML_RegionTraceHeader));
+
+	uint64_t args[1] = { 0 };
+	CHECK(Run(executive, "\\POLL", args, 1, &value) && value == recorded[0]);
+
+	SetRegionTrace(NULL);
+	DeleteRegionTrace(replay);
+
+	/* Only traces some recording produced are taken */
+	uint8_t broken[sizeof(AML_RegionTraceHeader)];
+	memcpy(broken, data, sizeof(broken));
+	broken[0] ^= 0xFF;
+	CHECK(CreateRegionReplay(broken, sizeof(broken)) == NULL);
+	CHECK(CreateRegionReplay(data, sizeof(AML_RegionTraceHeader) - 1) == NULL);
+}
+
+/* What offline benchmarking of the interpreter against a captured trace looks like */
+static void BenchmarkReplay(AMLExecutive *executive, const uint8_t *data, size_t length, uint64_t records) {
+	uint64_t results[CALLS];
+	uint64_t elapsed = 0;
+
+	for (int round = 0; round < REPLAY_ROUNDS; ++round) {
+		AML_RegionTrace *replay = CreateRegionReplay(data, length);
+		SetRegionTrace(replay);
+
+		uint64_t start = TestNanoseconds();
+		RunCalls(executive, results);
+		elapsed += TestNanoseconds() - start;
+
+		SetRegionTrace(NULL);
+		DeleteRegionTrace(replay);
+	}
+
+	printf("region_trace: %llu records in %zu bytes, %.2f M evaluations/s replayed\n", (unsigned long long)records, length,
+	       elapsed != 0 ? (double)REPLAY_ROUNDS * CALLS * 1000.0 / elapsed : 0.0);
+}
+
+int main() {
+	InstallRegionHandler(AML_REGION_SYSTEM_IO, EcRead, EcWrite, &Ec);
+
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(Dsdt, sizeof(Dsdt));
+
+	uint64_t recorded[CALLS];
+	AML_RegionTrace *recording = Record(executive, recorded);
+
+	size_t length;
+	const uint8_t *data = GetRegionTraceData(recording, &length);
+
+	TestReplay(executive, data, length, recorded);
+	TestDivergence(executive, data, length, recorded);
+	BenchmarkReplay(executive, data, length, recording->Stats.Records);
+
+	DeleteRegionTrace(recording);
+	delete executive;
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,267 @@
+#include "test.h"
+
+#include "resource.h"
+
+static const uint8_t Template[] = {
+	/* IRQNoFlags () {4} */
+	0x22, 0x10, 0x00,
+	/* IRQ (Level, ActiveLow, Shared) {9} */
+	0x23, 0x00, 0x02, 0x18,
+	/* IO (Decode16, 0x60, 0x60, 0x01, 0x01) */
+	0x47, 0x01, 0x60, 0x00, 0x60, 0x00, 0x01, 0x01,
+	/* DWordMemory (ResourceConsumer, ..., ReadWrite, 0, 0xFED00000, 0xFED003FF, 0, 0x400) */
+	0x87, 0x17, 0x00, 0x00, 0x01, 0x01,
+	0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0xD0, 0xFE,
+	0xFF, 0x03, 0xD0, 0xFE,
+	0x00, 0x00, 0x00, 0x00,
+	0x00, 0x04, 0x00, 0x00,
+	/* WordBusNumber (ResourceProducer, ..., 0, 0, 0xFF, 0, 0x100) */
+	0x88, 0x0D, 0x00, 0x02, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x01,
+	/* Interrupt (ResourceConsumer, Edge, ActiveHigh, Exclusive) {20, 21} */
+	0x89, 0x0A, 0x00, 0x03, 0x02, 0x14, 0x00, 0x00, 0x00, 0x15, 0x00, 0x00, 0x00,
+	/* EndTag */
+	0x79, 0x00,
+};
+
+static const uint8_t Gpio[] = {
+	/* GpioInt (Edge, ActiveLow, Exclusive, PullUp, 0, "A") {16, 17} */
+	0x8C, 0x1A, 0x00,
+	0x01, 0x00,
+	0x01, 0x00,
+	0x03, 0x00,
+	0x01,
+	0x00, 0x00,
+	0x00, 0x00,
+	0x17, 0x00,
+	0x00,
+	0x1B, 0x00,
+	0x1D, 0x00,
+	0x00, 0x00,
+	0x10, 0x00, 0x11, 0x00,
+	'A', 0x00,
+	0x79, 0x00,
+};
+
+/* _CRS buffers as dumped from a QEMU q35 DSDT */
+static const uint8_t HostBridge[] = {
+	/* WordBusNumber (ResourceProducer, MinFixed, MaxFixed, PosDecode, 0, 0, 0xFF, 0, 0x100) */
+	0x88, 0x0D, 0x00, 0x02, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x01,
+	/* IO (Decode16, 0xCF8, 0xCF8, 0x01, 0x08) */
+	0x47, 0x01, 0xF8, 0x0C, 0xF8, 0x0C, 0x01, 0x08,
+	/* WordIO (ResourceProducer, MinFixed, MaxFixed, PosDecode, EntireRange, 0, 0, 0xCF7, 0, 0xCF8) */
+	0x88, 0x0D, 0x00, 0x01, 0x0C, 0x03, 0x00, 0x00, 0x00, 0x00, 0xF7, 0x0C, 0x00, 0x00, 0xF8, 0x0C,
+	/* WordIO (ResourceProducer, MinFixed, MaxFixed, PosDecode, EntireRange, 0, 0xD00, 0xFFFF, 0, 0xF300) */
+	0x88, 0x0D, 0x00, 0x01, 0x0C, 0x03, 0x00, 0x00, 0x00, 0x0D, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0xF3,
+	/* DWordMemory (ResourceProducer, PosDecode, MinFixed, MaxFixed, Cacheable, ReadWrite, 0, 0xA0000, 0xBFFFF, 0, 0x20000) */
+	0x87, 0x17, 0x00, 0x00, 0x0C, 0x03,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0A, 0x00, 0xFF, 0xFF, 0x0B, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00,
+	/* DWordMemory (ResourceProducer, PosDecode, MinFixed, MaxFixed, NonCacheable, ReadWrite, 0, 0x80000000, 0xAFFFFFFF, 0, 0x30000000) */
+	0x87, 0x17, 0x00, 0x00, 0x0C, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0xFF, 0xFF, 0xFF, 0xAF,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30,
+	/* QWordMemory (ResourceProducer, PosDecode, MinFixed, MaxFixed, Cacheable, ReadWrite, 0, 0x800000000, 0xFFFFFFFFF, 0, 0x800000000) */
+	0x8A, 0x2B, 0x00, 0x00, 0x0C, 0x03,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00,
+	0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00,
+	0x79, 0x00,
+};
+
+static const uint8_t Hpet[] = {
+	/* Memory32Fixed (ReadOnly, 0xFED00000, 0x400) */
+	0x86, 0x09, 0x00, 0x00, 0x00, 0x00, 0xD0, 0xFE, 0x00, 0x04, 0x00, 0x00,
+	0x79, 0x00,
+};
+
+static const uint8_t Rtc[] = {
+	/* IO (Decode16, 0x70, 0x70, 0x01, 0x08), IRQNoFlags () {8} */
+	0x47, 0x01, 0x70, 0x00, 0x70, 0x00, 0x01, 0x08,
+	0x22, 0x00, 0x01,
+	0x79, 0x00,
+};
+
+static const uint8_t Keyboard[] = {
+	/* IO (Decode16, 0x60, 0x60, 0x01, 0x01), IO (Decode16, 0x64, 0x64, 0x01, 0x01), IRQNoFlags () {1} */
+	0x47, 0x01, 0x60, 0x00, 0x60, 0x00, 0x01, 0x01,
+	0x47, 0x01, 0x64, 0x00, 0x64, 0x00, 0x01, 0x01,
+	0x22, 0x02, 0x00,
+	0x79, 0x00,
+};
+
+static const uint8_t Floppy[] = {
+	/* IO (Decode16, 0x3F2, 0x3F2, 0x00, 0x04), IO (Decode16, 0x3F7, 0x3F7, 0x00, 0x01) */
+	0x47, 0x01, 0xF2, 0x03, 0xF2, 0x03, 0x00, 0x04,
+	0x47, 0x01, 0xF7, 0x03, 0xF7, 0x03, 0x00, 0x01,
+	/* IRQNoFlags () {6}, DMA (Compatibility, NotBusMaster, Transfer8) {2} */
+	0x22, 0x40, 0x00,
+	0x2A, 0x04, 0x00,
+	0x79, 0x00,
+};
+
+static const uint8_t Link[] = {
+	/* Interrupt (ResourceConsumer, Level, ActiveHigh, Shared) {16} */
+	0x89, 0x06, 0x00, 0x09, 0x01, 0x10, 0x00, 0x00, 0x00,
+	0x79, 0x00,
+};
+
+struct Dump {
+	const uint8_t *Data;
+	size_t Length;
+	size_t Count;
+};
+
+static const Dump Dumps[] = {
+	{ HostBridge, sizeof(HostBridge), 7 },
+	{ Hpet, sizeof(Hpet), 1 },
+	{ Rtc, sizeof(Rtc), 2 },
+	{ Keyboard, sizeof(Keyboard), 3 },
+	{ Floppy, sizeof(Floppy), 4 },
+	{ Link, sizeof(Link), 1 },
+};
+
+#define DUMP_COUNT (sizeof(Dumps) / sizeof(Dumps[0]))
+#define BENCHMARK_ROUNDS 200000
+
+static void TestTemplate() {
+	AML_ResourceList *list = CreateResourceList(Template, sizeof(Template));
+	CHECK(list->Count == 6);
+	if (list->Count != 6) {
+		DeleteResourceList(list);
+		return;
+	}
+
+	AML_Resource *irq = &list->Resources[0];
+	CHECK(irq->Type == RESOURCE_IRQ && irq->Irq.Mask == 0x10 && irq->Flags == AML_RESOURCE_EDGE);
+
+	irq = &list->Resources[1];
+	CHECK(irq->Type == RESOURCE_IRQ && irq->Irq.Mask == 0x200);
+	CHECK(irq->Flags == (AML_RESOURCE_ACTIVE_LOW | AML_RESOURCE_SHARED));
+
+	AML_Resource *io = &list->Resources[2];
+	CHECK(io->Type == RESOURCE_IO && io->Range.Minimum == 0x60 && io->Range.Maximum == 0x60 && io->Range.Length == 1);
+
+	AML_Resource *memory = &list->Resources[3];
+	CHECK(memory->Type == RESOURCE_ADDRESS32 && memory->Address.Kind == AML_RESOURCE_MEMORY_RANGE);
+	CHECK(memory->Address.Minimum == 0xFED00000 && memory->Address.Maximum == 0xFED003FF && memory->Address.Length == 0x400);
+	CHECK(memory->Flags == (AML_RESOURCE_CONSUMER | AML_RESOURCE_WRITEABLE));
+
+	AML_Resource *bus = &list->Resources[4];
+	CHECK(bus->Type == RESOURCE_ADDRESS16 && bus->Address.Kind == AML_RESOURCE_BUS_RANGE);
+	CHECK(bus->Address.Maximum == 0xFF && bus->Address.Length == 0x100);
+	CHECK(!(bus->Flags & AML_RESOURCE_CONSUMER));
+
+	AML_Resource *extended = &list->Resources[5];
+	CHECK(extended->Type == RESOURCE_EXTENDED_IRQ && extended->ExtendedIrq.Count == 2);
+	CHECK(extended->Flags == (AML_RESOURCE_CONSUMER | AML_RESOURCE_EDGE));
+	CHECK(GetExtendedIrq(extended, 0) == 20 && GetExtendedIrq(extended, 1) == 21 && GetExtendedIrq(extended, 2) == 0);
+
+	DeleteResourceList(list);
+}
+
+static void TestGpio() {
+	AML_ResourceList *list = CreateResourceList(Gpio, sizeof(Gpio));
+	CHECK(list->Count == 1);
+
+	AML_Resource *gpio = &list->Resources[0];
+	CHECK(gpio->Type == RESOURCE_GPIO && gpio->Gpio.ConnectionType == 0);
+	CHECK(gpio->Flags == (AML_RESOURCE_CONSUMER | AML_RESOURCE_EDGE | AML_RESOURCE_ACTIVE_LOW));
+	CHECK(gpio->Gpio.PinCount == 2 && gpio->Gpio.FirstPin == 16);
+	CHECK(GetGpioPin(gpio, 1) == 17 && GetGpioPin(gpio, 2) == 0);
+
+	DeleteResourceList(list);
+
+	/* A pin table outside the descriptor has no pins */
+	uint8_t outside[sizeof(Gpio)];
+	for (size_t i = 0; i < sizeof(Gpio); ++i) outside[i] = Gpio[i];
+	outside[14] = 0xF0;
+
+	list = CreateResourceList(outside, sizeof(outside));
+	CHECK(list->Count == 1 && list->Resources[0].Gpio.PinCount == 0);
+	DeleteResourceList(list);
+
+	/* A resource source name in the middle of the pin table cuts it short */
+	outside[14] = 0x17;
+	outside[17] = 0x19;
+
+	list = CreateResourceList(outside, sizeof(outside));
+	CHECK(list->Count == 1 && list->Resources[0].Gpio.PinCount == 1);
+	DeleteResourceList(list);
+}
+
+static void TestMalformed() {
+	/* IO claiming three bytes, followed by a valid fixed IO */
+	const uint8_t shortIo[] = { 0x43, 0x01, 0x60, 0x00, 0x4B, 0x20, 0x00, 0x02, 0x79, 0x00 };
+	AML_Resource resources[4];
+	CHECK(DecodeResources(shortIo, sizeof(shortIo), resources) == 1);
+	CHECK(resources[0].Type == RESOURCE_FIXED_IO && resources[0].Range.Minimum == 0x20 && resources[0].Range.Length == 2);
+
+	/* A large descriptor running past the buffer ends the walk */
+	const uint8_t truncated[] = { 0x22, 0x10, 0x00, 0x87, 0x17, 0x00, 0x00, 0x01 };
+	CHECK(DecodeResources(truncated, sizeof(truncated), resources) == 1);
+
+	/* Half a large header */
+	const uint8_t header[] = { 0x89, 0x06 };
+	CHECK(DecodeResources(header, sizeof(header), NULL) == 0);
+
+	/* Extended IRQ announcing more interrupts than it holds */
+	const uint8_t extended[] = { 0x89, 0x06, 0x00, 0x01, 0x05, 0x07, 0x00, 0x00, 0x00 };
+	CHECK(DecodeResources(extended, sizeof(extended), resources) == 1);
+	CHECK(resources[0].ExtendedIrq.Count == 1 && GetExtendedIrq(&resources[0], 1) == 0);
+
+	/* A DWord address too short for its fields is skipped */
+	const uint8_t address[] = { 0x87, 0x05, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00 };
+	CHECK(DecodeResources(address, sizeof(address), resources) == 0);
+
+	CHECK(DecodeResources(Template, 0, NULL) == 0);
+}
+
+static void TestDumps() {
+	AML_Resource resources[8];
+
+	for (size_t i = 0; i < DUMP_COUNT; ++i) CHECK(DecodeResources(Dumps[i].Data, Dumps[i].Length, resources) == Dumps[i].Count);
+
+	DecodeResources(HostBridge, sizeof(HostBridge), resources);
+	CHECK(resources[0].Type == RESOURCE_ADDRESS16 && resources[0].Address.Kind == AML_RESOURCE_BUS_RANGE);
+	CHECK(resources[3].Type == RESOURCE_ADDRESS16 && resources[3].Address.Minimum == 0xD00 && resources[3].Address.Length == 0xF300);
+	CHECK(resources[5].Type == RESOURCE_ADDRESS32 && resources[5].Address.Maximum == 0xAFFFFFFF);
+	CHECK(resources[6].Type == RESOURCE_ADDRESS64 && resources[6].Address.Minimum == 0x800000000ull);
+	CHECK(resources[6].Address.Length == 0x800000000ull);
+
+	DecodeResources(Floppy, sizeof(Floppy), resources);
+	CHECK(resources[2].Type == RESOURCE_IRQ && resources[2].Irq.Mask == 0x40);
+	CHECK(resources[3].Type == RESOURCE_DMA && resources[3].Dma.Mask == 0x04);
+
+	DecodeResources(Link, sizeof(Link), resources);
+	CHECK(resources[0].Type == RESOURCE_EXTENDED_IRQ && GetExtendedIrq(&resources[0], 0) == 16);
+	CHECK(resources[0].Flags == (AML_RESOURCE_CONSUMER | AML_RESOURCE_SHARED));
+}
+
+/* Decodes every dump over and over, as a boot enumerating devices would */
+static void BenchmarkDumps() {
+	AML_Resource resources[8];
+	size_t descriptors = 0;
+
+	uint64_t start = TestNanoseconds();
+	for (size_t round = 0; round < BENCHMARK_ROUNDS; ++round) {
+		for (size_t i = 0; i < DUMP_COUNT; ++i) descriptors += DecodeResources(Dumps[i].Data, Dumps[i].Length, resources);
+	}
+	uint64_t elapsed = TestNanoseconds() - start;
+
+	printf("resource: %zu descriptors from %zu _CRS dumps, %.2f M descriptors/s\n", descriptors, BENCHMARK_ROUNDS * DUMP_COUNT,
+	       elapsed != 0 ? descriptors * 1000.0 / elapsed : 0.0);
+}
+
+int main() {
+	TestTemplate();
+	TestGpio();
+	TestMalformed();
+	TestDumps();
+	BenchmarkDumps();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,46 @@
+#include <mkmi.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void *Malloc(size_t size) {
+	return malloc(size);
+}
+
+void Free(void *pointer) {
+	free(pointer);
+}
+
+void *Memcpy(void *destination, const void *source, size_t size) {
+	return memcpy(destination, source, size);
+}
+
+void *Memset(void *destination, int value, size_t size) {
+	return memset(destination, value, size);
+}
+
+int Memcmp(const void *first, const void *second, size_t size) {
+	return memcmp(first, second, size);
+}
+
+size_t Strlen(const char *string) {
+	return strlen(string);
+}
+
+int MKMI_Printf(const char *format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	int written = vprintf(format, ap);
+	va_end(ap);
+
+	return written;
+}
+
+uint64_t InPort(uint16_t, uint8_t width) {
+	return width >= 64 ? ~0ull : (1ull << width) - 1;
+}
+
+void OutPort(uint16_t, uint64_t, uint8_t) {
+}
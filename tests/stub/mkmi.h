@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/* The parts of mkmi the decoders use, backed by the host C library */
+
+/* Physical addresses are used as they are */
+#define HIGHER_HALF 0
+
+void *Malloc(size_t size);
+void Free(void *pointer);
+
+void *Memcpy(void *destination, const void *source, size_t size);
+void *Memset(void *destination, int value, size_t size);
+int Memcmp(const void *first, const void *second, size_t size);
+size_t Strlen(const char *string);
+
+int MKMI_Printf(const char *format, ...);
+
+/* Reads return all ones, writes are dropped */
+uint64_t InPort(uint16_t port, uint8_t width);
+void OutPort(uint16_t port, uint64_t value, uint8_t width);
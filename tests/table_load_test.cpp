@@ -0,0 +1,152 @@
+#include "test.h"
+
+#include "aml_executive.h"
+#include "acpi.h"
+#include "device_index.h"
+#include "madt.h"
+#include "processor.h"
+#include "thermal.h"
+
+#include <string.h>
+
+/*
+ * ThermalZone (TZ0_) { Name (_TMP, 3000) }
+ * Processor (CPU0, 0, 0, 0) {}
+ */
+static uint8_t Dsdt[] = {
+	0x5B, 0x85, 0x0D, 'T', 'Z', '0', '_', 0x08, '_', 'T', 'M', 'P', 0x0B, 0xB8, 0x0B,
+	0x5B, 0x83, 0x0B, 'C', 'P', 'U', '0', 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/*
+ * ThermalZone (TZ1_) { Name (_TMP, 3100) }
+ * Processor (CPU1, 1, 0, 0) {}
+ * Device (CPU2) { Name (_HID, "ACPI0007") Name (_UID, 2) }
+ */
+static const uint8_t SsdtBody[] = {
+	0x5B, 0x85, 0x0D, 'T', 'Z', '1', '_', 0x08, '_', 'T', 'M', 'P', 0x0B, 0x1C, 0x0C,
+	0x5B, 0x83, 0x0B, 'C', 'P', 'U', '1', 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x5B, 0x82, 0x1B, 'C', 'P', 'U', '2',
+		0x08, '_', 'H', 'I', 'D', 0x0D, 'A', 'C', 'P', 'I', '0', '0', '0', '7', 0x00,
+		0x08, '_', 'U', 'I', 'D', 0x0A, 0x02,
+};
+
+struct SSDT {
+	SDTHeader Header;
+	uint8_t Body[sizeof(SsdtBody)];
+}__attribute__((packed));
+
+static void BuildSSDT(SSDT *ssdt) {
+	memset(ssdt, 0, sizeof(*ssdt));
+	memcpy(ssdt->Header.Signature, "SSDT", 4);
+	ssdt->Header.Length = sizeof(*ssdt);
+	memcpy(ssdt->Body, SsdtBody, sizeof(SsdtBody));
+
+	uint8_t checksum = 0;
+	for (size_t i = 0; i < sizeof(*ssdt); ++i) checksum += ((uint8_t*)ssdt)[i];
+	ssdt->Header.Checksum = -checksum;
+}
+
+/* What ACPIManager::TableChanged does for the tables under test */
+struct LoadedTables {
+	AML_DeviceIndex *Devices;
+	ACPI_ThermalMonitor *Thermal;
+	ACPI_ProcessorTable *Processors;
+	/* No topology, so no spare slots either */
+	ACPI_ProcessorTable *Unmatched;
+};
+
+static void TableChanged(AML_NamespaceNode *subtree, bool loaded, void *context) {
+	LoadedTables *tables = (LoadedTables*)context;
+
+	if (loaded) {
+		UpdateDeviceIndex(tables->Devices, subtree);
+		AddThermalSubtree(tables->Thermal, subtree);
+		AddProcessorSubtree(tables->Processors, subtree);
+		AddProcessorSubtree(tables->Unmatched, subtree);
+		return;
+	}
+
+	RemoveProcessorSubtree(tables->Unmatched, subtree);
+	RemoveProcessorSubtree(tables->Processors, subtree);
+	RemoveThermalSubtree(tables->Thermal, subtree);
+	RemoveDeviceSubtree(tables->Devices, subtree);
+}
+
+static ACPI_ThermalZone *FindZone(AMLExecutive *executive, LoadedTables *tables, const char *path) {
+	return FindThermalZone(tables->Thermal, executive->FindNode(path));
+}
+
+/* Zones and processors of a loaded table show up, and come back in the same slots after a reload */
+static void TestLoad(AMLExecutive *executive, LoadedTables *tables) {
+	static SSDT ssdt;
+	BuildSSDT(&ssdt);
+
+	uint64_t handle = executive->LoadTable(&ssdt, sizeof(ssdt), NULL);
+	CHECK(handle != 0);
+
+	ACPI_ThermalZone *zone = FindZone(executive, tables, "\\TZ1_");
+	CHECK(zone != NULL && zone->Temperature == 3100);
+	CHECK(tables->Thermal->Count == 2);
+
+	int cpu1 = FindProcessor(tables->Processors, 1);
+	int cpu2 = FindProcessor(tables->Processors, 2);
+	CHECK(cpu1 >= 0 && cpu2 >= 0 && tables->Processors->Count == 3);
+	CHECK(tables->Processors->Processors[cpu1].Cpu == 1 && tables->Processors->Processors[cpu1].HardwareID == 11);
+	CHECK(tables->Processors->Processors[cpu2].Cpu == 2 && tables->Processors->Processors[cpu2].HardwareID == 12);
+
+	ACPI_ProcessorPower power;
+	CHECK(ReadProcessorPower(tables->Processors, cpu2, &power) && power.CStateCount == 0);
+
+	/* Without spare slots the new processors are left out, the old ones stay */
+	CHECK(tables->Unmatched->Count == 1 && FindProcessor(tables->Unmatched, 1) == -1);
+
+	CHECK(executive->UnloadTable(handle));
+	CHECK(tables->Processors->Processors[cpu1].Node == NULL && tables->Processors->Processors[cpu2].Node == NULL);
+	CHECK(tables->Thermal->Zones[1].Node == NULL);
+
+	handle = executive->LoadTable(&ssdt, sizeof(ssdt), NULL);
+	CHECK(handle != 0);
+
+	CHECK(FindZone(executive, tables, "\\TZ1_") == &tables->Thermal->Zones[1]);
+	CHECK(tables->Thermal->Count == 2);
+	CHECK(FindProcessor(tables->Processors, 1) == cpu1 && FindProcessor(tables->Processors, 2) == cpu2);
+	CHECK(tables->Processors->Count == 3 && tables->Processors->Processors[cpu2].Node != NULL);
+
+	CHECK(executive->UnloadTable(handle));
+}
+
+int main() {
+	uint32_t uids[3] = { 0, 1, 2 };
+	uint64_t hardwareIds[3] = { 10, 11, 12 };
+
+	CPUTopology topology;
+	memset(&topology, 0, sizeof(topology));
+	topology.CPUCount = 3;
+	topology.ProcessorUID = uids;
+	topology.HardwareID = hardwareIds;
+
+	AMLExecutive *executive = new AMLExecutive;
+	executive->Parse(Dsdt, sizeof(Dsdt));
+
+	LoadedTables tables;
+	tables.Devices = CreateDeviceIndex(executive);
+	tables.Thermal = CreateThermalMonitor(executive);
+	tables.Processors = CreateProcessorTable(executive, tables.Devices, &topology);
+	tables.Unmatched = CreateProcessorTable(executive, tables.Devices, NULL);
+
+	CHECK(tables.Thermal->Count == 1 && tables.Thermal->Zones[0].Temperature == 3000);
+	CHECK(tables.Processors->Count == 1 && tables.Processors->Capacity == 4);
+	CHECK(tables.Unmatched->Count == 1 && tables.Unmatched->Capacity == 1);
+
+	executive->SetTableHandler(TableChanged, &tables);
+	TestLoad(executive, &tables);
+
+	DeleteProcessorTable(tables.Unmatched);
+	DeleteProcessorTable(tables.Processors);
+	DeleteThermalMonitor(tables.Thermal);
+	DeleteDeviceIndex(tables.Devices);
+	delete executive;
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static int TestFailures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		TestFailures++; \
+	} \
+} while (0)
+
+#define TEST_RESULT() (TestFailures != 0 ? 1 : 0)
+
+/* Monotonic host time for the throughput reports */
+static inline uint64_t TestNanoseconds() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
@@ -0,0 +1,286 @@
+#include "test.h"
+
+#include "aml_executive.h"
+#include "aml_opcodes.h"
+#include "hpet.h"
+#include "namespace.h"
+#include "notify.h"
+#include "thermal.h"
+
+#include <string.h>
+
+#define ZONES 24
+/* The last zone has _TZP zero and is only ever evaluated on Notify */
+#define NOTIFY_ZONE (ZONES - 1)
+
+#define PASSIVE 3500
+#define HOT 3600
+#define CRITICAL 3700
+/* _TSP and _TZP, in tenths of a second */
+#define SAMPLING 10
+#define POLLING 50
+
+#define SECOND 1000000000ull
+
+/*
+ * Host memory stands in for the sensors and the HPET, the stub maps
+ * physical memory one to one. Every _TMP reads a DWord of Sensors, the
+ * test moves the HPET counter itself, one tick per nanosecond.
+ */
+static uint32_t Sensors[ZONES];
+static uint64_t HPETRegisters[0x200 / 8];
+
+#define AML_MAX_SIZE 8192
+
+struct Aml {
+	uint8_t Data[AML_MAX_SIZE];
+	size_t Size;
+};
+
+static void Put(Aml *aml, const void *data, size_t size) {
+	memcpy(&aml->Data[aml->Size], data, size);
+	aml->Size += size;
+}
+
+static void PutByte(Aml *aml, uint8_t byte) {
+	Put(aml, &byte, 1);
+}
+
+static void PutWord(Aml *aml, uint16_t value) {
+	PutByte(aml, 0x0B);
+	Put(aml, &value, sizeof(value));
+}
+
+/* The opcode, the PkgLength counting itself, then the body */
+static void PutPackage(Aml *aml, uint8_t opcode, const Aml *body) {
+	PutByte(aml, opcode);
+
+	if (body->Size + 1 <= 0x3F) {
+		PutByte(aml, body->Size + 1);
+	} else {
+		size_t length = body->Size + 2;
+		PutByte(aml, 0x40 | (length & 0x0F));
+		PutByte(aml, length >> 4);
+	}
+
+	Put(aml, body->Data, body->Size);
+}
+
+static void PutName(Aml *aml, const char *name, uint16_t value) {
+	PutByte(aml, 0x08);
+	Put(aml, name, 4);
+	PutWord(aml, value);
+}
+
+static void ZoneName(char *name, const char *prefix, size_t zone) {
+	name[0] = prefix[0];
+	name[1] = prefix[1];
+	name[2] = "0123456789ABCDEF"[zone >> 4];
+	name[3] = "0123456789ABCDEF"[zone & 0x0F];
+}
+
+/*
+ * OperationRegion (SENS, SystemMemory, Sensors, ZONES * 4)
+ * Field (SENS, DWordAcc, NoLock, Preserve) { Sxx, 32, ... }
+ * ThermalZone (TZxx) { Method (_TMP) { Return (Sxx) } Name (_PSV, ...) ... }
+ */
+static void BuildDsdt(Aml *dsdt) {
+	static Aml field, zone, method;
+	dsdt->Size = 0;
+
+	PutByte(dsdt, 0x5B);
+	PutByte(dsdt, 0x80);
+	Put(dsdt, "SENS", 4);
+	PutByte(dsdt, AML_REGION_SYSTEM_MEMORY);
+	PutByte(dsdt, 0x0E);
+	uint64_t address = (uintptr_t)Sensors;
+	Put(dsdt, &address, sizeof(address));
+	PutWord(dsdt, sizeof(Sensors));
+
+	field.Size = 0;
+	Put(&field, "SENS", 4);
+	PutByte(&field, 0x03);
+	for (size_t i = 0; i < ZONES; ++i) {
+		char name[4];
+		ZoneName(name, "SN", i);
+		Put(&field, name, 4);
+		PutByte(&field, 32);
+	}
+
+	PutByte(dsdt, 0x5B);
+	PutPackage(dsdt, 0x81, &field);
+
+	for (size_t i = 0; i < ZONES; ++i) {
+		char name[4];
+
+		method.Size = 0;
+		Put(&method, "_TMP", 4);
+		PutByte(&method, 0x00);
+		PutByte(&method, 0xA4);
+		ZoneName(name, "SN", i);
+		Put(&method, name, 4);
+
+		zone.Size = 0;
+		ZoneName(name, "TZ", i);
+		Put(&zone, name, 4);
+		PutPackage(&zone, 0x14, &method);
+		PutName(&zone, "_PSV", PASSIVE);
+		PutName(&zone, "_HOT", HOT);
+		PutName(&zone, "_CRT", CRITICAL);
+		PutName(&zone, "_TSP", SAMPLING);
+		PutName(&zone, "_TZP", i == NOTIFY_ZONE ? 0 : POLLING);
+
+		PutByte(dsdt, 0x5B);
+		PutPackage(dsdt, 0x85, &zone);
+	}
+}
+
+static void SetTime(uint64_t ns) {
+	HPETRegisters[HPET_MAIN_COUNTER / 8] = ns;
+}
+
+static HPET_Clock *CreateClock() {
+	HPETRegisters[HPET_CAPABILITIES / 8] = (1000000ull << 32) | HPET_CAP_COUNTER_64;
+
+	HPETTable table;
+	memset(&table, 0, sizeof(table));
+	table.Address.AddressSpace = AML_REGION_SYSTEM_MEMORY;
+	table.Address.Address = (uintptr_t)HPETRegisters;
+
+	return CreateHPETClock(&table);
+}
+
+struct StateLog {
+	size_t Changes;
+	ACPI_ThermalZone *Zone;
+	ACPI_ThermalState Previous;
+};
+
+static void LogState(ACPI_ThermalZone *zone, ACPI_ThermalState previous, void *context) {
+	StateLog *log = (StateLog*)context;
+
+	log->Changes++;
+	log->Zone = zone;
+	log->Previous = previous;
+}
+
+static ACPI_ThermalZone *Zone(AMLExecutive *executive, ACPI_ThermalMonitor *monitor, size_t index) {
+	char path[6] = { '\\' };
+	ZoneName(&path[1], "TZ", index);
+
+	return FindThermalZone(monitor, executive->FindNode(path));
+}
+
+/* Cold zones poll at _TZP, nearer the trip point faster, past it at _TSP */
+static void TestIntervals(AMLExecutive *executive, ACPI_ThermalMonitor *monitor) {
+	ACPI_ThermalZone *cold = Zone(executive, monitor, 0);
+	ACPI_ThermalZone *near = Zone(executive, monitor, 1);
+	ACPI_ThermalZone *passive = Zone(executive, monitor, 2);
+	ACPI_ThermalZone *quiet = Zone(executive, monitor, NOTIFY_ZONE);
+	CHECK(cold != NULL && near != NULL && passive != NULL && quiet != NULL);
+	if (cold == NULL || near == NULL || passive == NULL || quiet == NULL) return;
+
+	CHECK(cold->Temperature == 2900 && cold->Passive == PASSIVE && cold->Hot == HOT && cold->Critical == CRITICAL);
+	CHECK(cold->State == THERMAL_NORMAL && cold->IntervalNs == POLLING * SECOND / 10);
+
+	/* A hundred below a margin of two hundred, halfway between the fastest and slowest rate */
+	CHECK(near->State == THERMAL_NORMAL);
+	CHECK(near->IntervalNs == THERMAL_MIN_INTERVAL_NS + (POLLING * SECOND / 10 - THERMAL_MIN_INTERVAL_NS) / 2);
+
+	CHECK(passive->State == THERMAL_PASSIVE && passive->IntervalNs == SAMPLING * SECOND / 10);
+
+	CHECK(quiet->NotifiesOnly && quiet->NextPollNs == THERMAL_NEVER);
+}
+
+/* Zones falling due together cost one wakeup, however many there are */
+static void TestBatching(ACPI_ThermalMonitor *monitor, uint64_t start) {
+	ACPI_ThermalStats before, after;
+	GetThermalStats(monitor, &before);
+
+	uint64_t next = RunThermalMonitor(monitor);
+	CHECK(next == start + SAMPLING * SECOND / 10);
+
+	GetThermalStats(monitor, &after);
+	CHECK(after.Evaluations == before.Evaluations);
+
+	/* Past every polling zone's deadline */
+	SetTime(start + POLLING * SECOND / 10);
+	GetThermalStats(monitor, &before);
+	uint64_t begin = TestNanoseconds();
+
+	next = RunThermalMonitor(monitor);
+
+	uint64_t elapsed = TestNanoseconds() - begin;
+	GetThermalStats(monitor, &after);
+
+	CHECK(after.Wakeups - before.Wakeups == 1);
+	CHECK(after.Evaluations - before.Evaluations == ZONES - 1);
+	CHECK(next == start + POLLING * SECOND / 10 + SAMPLING * SECOND / 10);
+
+	printf("thermal: %llu zones evaluated in one wakeup, %llu us\n",
+	       (unsigned long long)(after.Evaluations - before.Evaluations), (unsigned long long)(elapsed / 1000));
+}
+
+/* Notify evaluates the zone it names right away, polling or not */
+static void TestNotify(AMLExecutive *executive, ACPI_ThermalMonitor *monitor, StateLog *log) {
+	ACPI_ThermalZone *zone = Zone(executive, monitor, NOTIFY_ZONE);
+	if (zone == NULL) return;
+
+	ACPI_ThermalStats before, after;
+	GetThermalStats(monitor, &before);
+	size_t changes = log->Changes;
+
+	Sensors[NOTIFY_ZONE] = 3750;
+
+	AML_Namespace *ns = executive->GetNamespace();
+	uint32_t section = EnterNamespace(ns);
+	CHECK(executive->Notify(zone->Node, AML_NOTIFY_THERMAL_STATUS));
+	LeaveNamespace(ns, section);
+	DeliverNotifications(executive->GetNotifyQueue());
+
+	GetThermalStats(monitor, &after);
+	CHECK(after.Notifications - before.Notifications == 1);
+	CHECK(after.Evaluations - before.Evaluations == 1);
+	CHECK(after.Wakeups == before.Wakeups);
+
+	CHECK(zone->Temperature == 3750 && zone->State == THERMAL_CRITICAL);
+	CHECK(log->Changes == changes + 1 && log->Zone == zone && log->Previous == THERMAL_NORMAL);
+
+	/* Past a trip point the zone is sampled at _TSP, _TZP zero or not */
+	CHECK(zone->IntervalNs == SAMPLING * SECOND / 10 && zone->NextPollNs != THERMAL_NEVER);
+}
+
+int main() {
+	for (size_t i = 0; i < ZONES; ++i) Sensors[i] = 2900;
+	Sensors[1] = PASSIVE - THERMAL_COLD_MARGIN / 2;
+	Sensors[2] = PASSIVE + 50;
+
+	uint64_t start = 100 * SECOND;
+	SetTime(start);
+	HPET_Clock *clock = CreateClock();
+	CHECK(clock != NULL);
+	if (clock == NULL) return TEST_RESULT();
+
+	static Aml dsdt;
+	BuildDsdt(&dsdt);
+
+	AMLExecutive *executive = new AMLExecutive;
+	executive->SetClock(clock);
+	executive->Parse(dsdt.Data, dsdt.Size);
+
+	ACPI_ThermalMonitor *monitor = CreateThermalMonitor(executive);
+	CHECK(monitor->Count == ZONES);
+
+	StateLog log = {};
+	SetThermalHandler(monitor, LogState, &log);
+
+	TestIntervals(executive, monitor);
+	TestBatching(monitor, start);
+	TestNotify(executive, monitor, &log);
+
+	DeleteThermalMonitor(monitor);
+	delete executive;
+	DeleteHPETClock(clock);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,155 @@
+#include "test.h"
+
+#include "timer_wheel.h"
+#include "hpet.h"
+#include "aml_opcodes.h"
+
+#include <string.h>
+#include <thread>
+
+/* 100 MHz, three comparators, the model moves the counter 10 us at a time */
+#define PERIOD_FS 10000000ull
+#define COMPARATORS 3
+#define STEP_TICKS 1000
+
+#define MS 1000000ull
+
+/*
+ * Host memory stands in for the HPET registers. A thread plays the part of
+ * the hardware: it moves the main counter on and sets the status bit of a
+ * level triggered comparator when the counter goes past it.
+ *
+ * The status register is write one to clear. The model keeps the real bits
+ * to itself and publishes them with a generation in the reserved upper
+ * half, anything else found there was written by the module.
+ */
+struct HPETModel {
+	uint64_t Registers[0x200 / 8];
+	bool Stop;
+	uint64_t Matches;
+
+	uint32_t Status;
+	uint64_t Published;
+	uint32_t Generation;
+};
+
+static uint64_t *Register(HPETModel *model, uint32_t offset) {
+	return &model->Registers[offset / 8];
+}
+
+static void RunModel(HPETModel *model) {
+	uint64_t *status = Register(model, HPET_INTERRUPT_STATUS);
+
+	while (!__atomic_load_n(&model->Stop, __ATOMIC_ACQUIRE)) {
+		uint64_t counter = __atomic_add_fetch(Register(model, HPET_MAIN_COUNTER), STEP_TICKS, __ATOMIC_SEQ_CST);
+		uint64_t previous = counter - STEP_TICKS;
+
+		uint64_t seen = __atomic_load_n(status, __ATOMIC_SEQ_CST);
+		if (seen != model->Published) model->Status &= ~(uint32_t)seen;
+
+		for (uint8_t i = 0; i < COMPARATORS; ++i) {
+			uint64_t config = __atomic_load_n(Register(model, HPET_TIMER_CONFIGURATION(i)), __ATOMIC_SEQ_CST);
+			uint64_t value = __atomic_load_n(Register(model, HPET_TIMER_COMPARATOR(i)), __ATOMIC_SEQ_CST);
+
+			/* A match is the counter going past the value, not being beyond it */
+			if (!(config & HPET_TIMER_LEVEL) || previous >= value || counter < value) continue;
+
+			model->Status |= 1u << i;
+			__atomic_fetch_add(&model->Matches, 1, __ATOMIC_RELAXED);
+		}
+
+		/* A write in between is picked up next time round */
+		uint64_t next = model->Status | (uint64_t)++model->Generation << 32;
+		if (__atomic_compare_exchange_n(status, &seen, next, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			__atomic_store_n(&model->Published, next, __ATOMIC_RELEASE);
+		}
+
+		std::this_thread::yield();
+	}
+}
+
+/* The status bits once the model has seen every write to them */
+static uint32_t SettledStatus(HPETModel *model) {
+	while (__atomic_load_n(Register(model, HPET_INTERRUPT_STATUS), __ATOMIC_SEQ_CST) != __atomic_load_n(&model->Published, __ATOMIC_ACQUIRE)) {
+		std::this_thread::yield();
+	}
+
+	return __atomic_load_n(Register(model, HPET_INTERRUPT_STATUS), __ATOMIC_SEQ_CST);
+}
+
+static HPET_Clock *CreateModelClock(HPETModel *model) {
+	memset(model, 0, sizeof(*model));
+	*Register(model, HPET_CAPABILITIES) = (PERIOD_FS << 32) | HPET_CAP_COUNTER_64 | ((COMPARATORS - 1) << 8);
+	for (uint8_t i = 0; i < COMPARATORS; ++i) *Register(model, HPET_TIMER_CONFIGURATION(i)) = HPET_TIMER_64_CAPABLE;
+
+	HPETTable table;
+	memset(&table, 0, sizeof(table));
+	table.Address.AddressSpace = AML_REGION_SYSTEM_MEMORY;
+	table.Address.Address = (uintptr_t)model->Registers;
+
+	return CreateHPETClock(&table);
+}
+
+/* Sleeps wait on a comparator of their own and hand it back quiet */
+static void TestComparatorSleep(HPETModel *model, HPET_Clock *clock, AML_TimerWheel *wheel) {
+	uint64_t start = ReadHPETNanoseconds(clock);
+	uint64_t matches = __atomic_load_n(&model->Matches, __ATOMIC_RELAXED);
+
+	SleepFor(wheel, 2 * MS);
+
+	CHECK(ReadHPETNanoseconds(clock) >= start + 2 * MS);
+	CHECK(__atomic_load_n(&model->Matches, __ATOMIC_RELAXED) > matches);
+	CHECK(__atomic_load_n(&clock->Allocated, __ATOMIC_RELAXED) == 0);
+
+	uint64_t config = ReadHPETRegister(clock, HPET_TIMER_CONFIGURATION(0));
+	CHECK(!(config & (HPET_TIMER_LEVEL | HPET_TIMER_ENABLE)));
+	CHECK(SettledStatus(model) == 0);
+}
+
+/* With every comparator taken the wheel is polled, the sleep still ends on time */
+static void TestNoComparator(HPETModel *model, HPET_Clock *clock, AML_TimerWheel *wheel) {
+	for (uint8_t i = 0; i < COMPARATORS; ++i) CHECK(AllocateHPETComparator(clock, false) >= 0);
+	CHECK(AllocateHPETComparator(clock, false) == -1);
+
+	uint64_t start = ReadHPETNanoseconds(clock);
+	uint64_t matches = __atomic_load_n(&model->Matches, __ATOMIC_RELAXED);
+
+	SleepFor(wheel, 2 * MS);
+
+	CHECK(ReadHPETNanoseconds(clock) >= start + 2 * MS);
+	CHECK(__atomic_load_n(&model->Matches, __ATOMIC_RELAXED) == matches);
+
+	for (uint8_t i = 0; i < COMPARATORS; ++i) ReleaseHPETComparator(clock, i);
+}
+
+/* A deadline that went by before the comparator was armed does not wait for a match */
+static void TestPassedDeadline(HPET_Clock *clock, AML_TimerWheel *wheel) {
+	AML_Timer timer;
+	AddTimer(wheel, &timer, ReadHPETNanoseconds(clock) + 100);
+
+	while (ReadHPETNanoseconds(clock) < timer.Deadline) std::this_thread::yield();
+
+	ParkUntil(wheel, &timer);
+	CHECK(timer.Fired);
+}
+
+int main() {
+	static HPETModel model;
+	HPET_Clock *clock = CreateModelClock(&model);
+	CHECK(clock != NULL && clock->ComparatorCount == COMPARATORS);
+
+	std::thread hardware(RunModel, &model);
+	AML_TimerWheel *wheel = CreateTimerWheel(clock);
+
+	TestComparatorSleep(&model, clock, wheel);
+	TestNoComparator(&model, clock, wheel);
+	TestPassedDeadline(clock, wheel);
+
+	__atomic_store_n(&model.Stop, true, __ATOMIC_RELEASE);
+	hardware.join();
+
+	DeleteTimerWheel(wheel);
+	DeleteHPETClock(clock);
+
+	return TEST_RESULT();
+}